@@ -0,0 +1,77 @@
+// Copyright lowRISC contributors.
+// Licensed under the Apache License, Version 2.0, see LICENSE for details.
+// SPDX-License-Identifier: Apache-2.0
+
+#include "dpi_checkpoint.h"
+
+#include <algorithm>
+#include <cassert>
+#include <mutex>
+#include <svdpi.h>
+
+namespace {
+struct RegisteredContext {
+  DpiCheckpointEntry entry;
+  svScope scope;
+  void *ctx;
+  dpi_checkpoint_reattach_fn reattach;
+};
+
+// Registered contexts, in creation order
+std::vector<RegisteredContext> &GetContexts() {
+  static std::vector<RegisteredContext> contexts;
+  return contexts;
+}
+
+// DPI modules may register and unregister from any of the model's threads.
+// Saving and restoring happens between evaluations, when they are idle.
+std::mutex &GetContextsMutex() {
+  static std::mutex mutex;
+  return mutex;
+}
+}  // namespace
+
+void dpi_checkpoint_register(void *ctx, dpi_checkpoint_reattach_fn reattach,
+                             void *state, size_t state_size) {
+  assert(ctx && reattach);
+  assert(state || !state_size);
+
+  svScope scope = svGetScope();
+  assert(scope && "dpi_checkpoint_register needs a context import.");
+
+  std::lock_guard<std::mutex> lock(GetContextsMutex());
+  GetContexts().push_back(
+      {{svGetNameFromScope(scope), state, state_size}, scope, ctx, reattach});
+}
+
+void dpi_checkpoint_unregister(void *ctx) {
+  std::lock_guard<std::mutex> lock(GetContextsMutex());
+  std::vector<RegisteredContext> &contexts = GetContexts();
+  contexts.erase(std::remove_if(contexts.begin(), contexts.end(),
+                                [ctx](const RegisteredContext &context) {
+                                  return context.ctx == ctx;
+                                }),
+                 contexts.end());
+}
+
+std::vector<DpiCheckpointEntry> DpiCheckpointGetEntries() {
+  std::lock_guard<std::mutex> lock(GetContextsMutex());
+  std::vector<DpiCheckpointEntry> entries;
+  for (const RegisteredContext &context : GetContexts()) {
+    entries.push_back(context.entry);
+  }
+  return entries;
+}
+
+void DpiCheckpointReattachAll() {
+  std::lock_guard<std::mutex> lock(GetContextsMutex());
+
+  // The chandles in a restored model point at contexts from the process that
+  // saved the checkpoint. Point them back at ours.
+  svScope prev_scope = svGetScope();
+  for (const RegisteredContext &context : GetContexts()) {
+    svSetScope(context.scope);
+    context.reattach(context.ctx);
+  }
+  svSetScope(prev_scope);
+}
@@ -0,0 +1,87 @@
+// Copyright lowRISC contributors.
+// Licensed under the Apache License, Version 2.0, see LICENSE for details.
+// SPDX-License-Identifier: Apache-2.0
+
+#ifndef OPENTITAN_HW_DV_DPI_COMMON_DPI_CHECKPOINT_DPI_CHECKPOINT_H_
+#define OPENTITAN_HW_DV_DPI_COMMON_DPI_CHECKPOINT_DPI_CHECKPOINT_H_
+
+//
+// Support for DPI modules in simulation checkpoints
+//
+// A DPI module typically creates a host-side context object in an initial
+// block and stores a pointer to it in a chandle. When a checkpoint is
+// restored, that chandle gets the value it had in the process that saved the
+// checkpoint, which is meaningless in the restoring process. Host resources
+// such as sockets and pseudo-terminals can't be saved either.
+//
+// To deal with this, a DPI module registers its context when creating it.
+// The creating function must be imported with the "context" property so that
+// the module instance can be identified by its scope. When a checkpoint is
+// restored, the context created by this process is kept (re-creating the host
+// resources). Any plain-data simulation state in the context is overwritten
+// with the saved copy, and the module's chandle is then re-attached by calling
+// reattach with the module's scope set. reattach should be an exported SV
+// function that assigns its argument to the chandle.
+//
+// This only keeps track of the registered contexts, using standard DPI calls.
+// Writing them to a checkpoint file is up to the simulator support code (see
+// VerilatorSimCtrl::SaveCheckpoint).
+//
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef void (*dpi_checkpoint_reattach_fn)(void *ctx);
+
+/**
+ * Register a DPI context for checkpointing
+ *
+ * Call from a DPI function imported with the "context" property (usually the
+ * one that creates ctx).
+ *
+ * @param ctx        The context object
+ * @param reattach   Function to point the module's chandle at ctx
+ * @param state      Simulation state to be saved in checkpoints (may be NULL).
+ *                   This must be plain data: it is saved and restored as raw
+ *                   bytes.
+ * @param state_size Size of state in bytes
+ */
+void dpi_checkpoint_register(void *ctx, dpi_checkpoint_reattach_fn reattach,
+                             void *state, size_t state_size);
+
+/**
+ * Unregister a DPI context (call before freeing it)
+ */
+void dpi_checkpoint_unregister(void *ctx);
+
+#ifdef __cplusplus
+}  // extern "C"
+
+#include <string>
+#include <vector>
+
+struct DpiCheckpointEntry {
+  // Hierarchical name of the module instance that registered the context
+  std::string name;
+  void *state;
+  size_t state_size;
+};
+
+/**
+ * Get the registered DPI contexts, in registration order
+ */
+std::vector<DpiCheckpointEntry> DpiCheckpointGetEntries();
+
+/**
+ * Point the chandle of each registered module back at its context
+ *
+ * Call after restoring the model and copying the saved state of each context
+ * into its state buffer.
+ */
+void DpiCheckpointReattachAll();
+#endif  // __cplusplus
+
+#endif  // OPENTITAN_HW_DV_DPI_COMMON_DPI_CHECKPOINT_DPI_CHECKPOINT_H_
@@ -13,20 +13,32 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
 #include <sys/socket.h>
-#include <sys/time.h>
 #include <sys/types.h>
 #include <unistd.h>
 
 /**
- * Simple buffer for passing data between TCP sockets and DPI modules
+ * Ring buffer for passing data between TCP sockets and DPI modules
+ *
+ * Each buffer has a single producer and a single consumer, one of which is the
+ * server thread. The other is whichever thread the DPI module is called on,
+ * which may be one of Verilator's worker threads in a multi-threaded model.
+ *
+ * rptr and wptr count the bytes that have been read and written, wrapping
+ * around at 2^32 (so the buffer size must be a power of two). The producer owns
+ * wptr and the consumer owns rptr. Each side publishes its pointer with a
+ * sequentially consistent store: as well as making the buffer contents visible
+ * to the other side, this orders the store with the checks on the *_waiting
+ * flags in struct tcp_server_ctx (see wake_server()).
  */
-const int BUFSIZE_BYTE = 256;
+const unsigned int BUFSIZE_BYTE = 1 << 16;
 
 struct tcp_buf {
-  unsigned int rptr;
-  unsigned int wptr;
-  char buf[BUFSIZE_BYTE];
+  alignas(64) unsigned int rptr;
+  alignas(64) unsigned int wptr;
+  alignas(64) char buf[BUFSIZE_BYTE];
 };
 
 /**
@@ -36,50 +48,149 @@ struct tcp_server_ctx {
   // Writeable by the host thread
   char *display_name;
   uint16_t listen_port;
-  volatile bool socket_run;
+  bool socket_run;        // accessed atomically
+  bool client_close_req;  // accessed atomically
+  // Set by the server thread before it sleeps in epoll_wait(), and cleared by
+  // whichever thread wakes it (accessed atomically)
+  bool server_waiting;
+  // Set by the server thread when buf_in is full, so that it has stopped
+  // reading from the client (accessed atomically)
+  bool in_stalled;
+  // Set by a writer that is waiting for space in buf_out (accessed atomically)
+  bool writer_waiting;
   // Writeable by the server thread
   tcp_buf *buf_in;
   tcp_buf *buf_out;
   int sfd;  // socket fd
   int cfd;  // client fd
+  int epfd;           // epoll fd for sfd, cfd and wake_efd
+  int wake_efd;       // eventfd that wakes the server thread
+  int space_efd;      // eventfd that wakes a writer waiting for buf_out
+  bool out_blocked;   // the client's socket is full (only for server thread)
+  uint32_t cfd_events;  // events we wait for on cfd (only for server thread)
   pthread_t sock_thread;
 };
 
-static bool tcp_buffer_is_full(struct tcp_buf *buf) {
-  if (buf->wptr >= buf->rptr) {
-    return (buf->wptr - buf->rptr) == (BUFSIZE_BYTE - 1);
-  } else {
-    return (buf->rptr - buf->wptr) == 1;
-  }
+/**
+ * Find the contiguous free space in a buffer
+ *
+ * Only call this from the buffer's producer.
+ *
+ * @param buf buffer
+ * @param dst set to the start of the free space
+ * @return number of bytes that can be written at dst
+ */
+static size_t tcp_buffer_space(struct tcp_buf *buf, char **dst) {
+  unsigned int wptr = __atomic_load_n(&buf->wptr, __ATOMIC_RELAXED);
+  unsigned int rptr = __atomic_load_n(&buf->rptr, __ATOMIC_SEQ_CST);
+  unsigned int offset = wptr & (BUFSIZE_BYTE - 1);
+  unsigned int space = BUFSIZE_BYTE - (wptr - rptr);
+  unsigned int to_end = BUFSIZE_BYTE - offset;
+
+  *dst = &buf->buf[offset];
+  return space < to_end ? space : to_end;
 }
 
-static bool tcp_buffer_is_empty(struct tcp_buf *buf) {
-  return (buf->wptr == buf->rptr);
+/**
+ * Publish bytes written to the space found by tcp_buffer_space()
+ */
+static void tcp_buffer_commit_write(struct tcp_buf *buf, size_t len) {
+  unsigned int wptr = __atomic_load_n(&buf->wptr, __ATOMIC_RELAXED);
+  __atomic_store_n(&buf->wptr, wptr + (unsigned int)len, __ATOMIC_SEQ_CST);
+}
+
+/**
+ * Find the contiguous data waiting in a buffer
+ *
+ * Only call this from the buffer's consumer.
+ *
+ * @param buf buffer
+ * @param src set to the start of the data
+ * @return number of bytes that can be read from src
+ */
+static size_t tcp_buffer_data(struct tcp_buf *buf, const char **src) {
+  unsigned int rptr = __atomic_load_n(&buf->rptr, __ATOMIC_RELAXED);
+  unsigned int wptr = __atomic_load_n(&buf->wptr, __ATOMIC_SEQ_CST);
+  unsigned int offset = rptr & (BUFSIZE_BYTE - 1);
+  unsigned int avail = wptr - rptr;
+  unsigned int to_end = BUFSIZE_BYTE - offset;
+
+  *src = &buf->buf[offset];
+  return avail < to_end ? avail : to_end;
 }
 
-static void tcp_buffer_put_byte(struct tcp_buf *buf, char dat) {
-  bool done = false;
-  while (!done) {
-    if (!tcp_buffer_is_full(buf)) {
-      buf->buf[buf->wptr++] = dat;
-      buf->wptr %= BUFSIZE_BYTE;
-      done = true;
+/**
+ * Release bytes read from the data found by tcp_buffer_data()
+ */
+static void tcp_buffer_commit_read(struct tcp_buf *buf, size_t len) {
+  unsigned int rptr = __atomic_load_n(&buf->rptr, __ATOMIC_RELAXED);
+  __atomic_store_n(&buf->rptr, rptr + (unsigned int)len, __ATOMIC_SEQ_CST);
+}
+
+/**
+ * Copy up to len bytes into a buffer
+ *
+ * @return number of bytes copied, which is less than len if the buffer is full
+ */
+static size_t tcp_buffer_write(struct tcp_buf *buf, const char *dat,
+                               size_t len) {
+  size_t done = 0;
+  while (done < len) {
+    char *dst;
+    size_t n = tcp_buffer_space(buf, &dst);
+    if (n == 0) {
+      break;
     }
+    if (n > len - done) {
+      n = len - done;
+    }
+    memcpy(dst, dat + done, n);
+    tcp_buffer_commit_write(buf, n);
+    done += n;
   }
+  return done;
 }
 
-static bool tcp_buffer_get_byte(struct tcp_buf *buf, char *dat) {
-  if (tcp_buffer_is_empty(buf)) {
-    return false;
+/**
+ * Copy up to len bytes out of a buffer
+ *
+ * @return number of bytes copied
+ */
+static size_t tcp_buffer_read(struct tcp_buf *buf, char *dat, size_t len) {
+  size_t done = 0;
+  while (done < len) {
+    const char *src;
+    size_t n = tcp_buffer_data(buf, &src);
+    if (n == 0) {
+      break;
+    }
+    if (n > len - done) {
+      n = len - done;
+    }
+    memcpy(dat + done, src, n);
+    tcp_buffer_commit_read(buf, n);
+    done += n;
   }
-  *dat = buf->buf[buf->rptr++];
-  buf->rptr %= BUFSIZE_BYTE;
-  return true;
+  return done;
+}
+
+static bool tcp_buffer_is_empty(struct tcp_buf *buf) {
+  const char *src;
+  return tcp_buffer_data(buf, &src) == 0;
+}
+
+static bool tcp_buffer_is_full(struct tcp_buf *buf) {
+  char *dst;
+  return tcp_buffer_space(buf, &dst) == 0;
 }
 
 static struct tcp_buf *tcp_buffer_new(void) {
   struct tcp_buf *buf_new;
-  buf_new = (struct tcp_buf *)malloc(sizeof(struct tcp_buf));
+  buf_new = (struct tcp_buf *)aligned_alloc(alignof(struct tcp_buf),
+                                            sizeof(struct tcp_buf));
+  if (!buf_new) {
+    return NULL;
+  }
   buf_new->rptr = 0;
   buf_new->wptr = 0;
   return buf_new;
@@ -90,6 +201,102 @@ static void tcp_buffer_free(struct tcp_buf **buf) {
   *buf = NULL;
 }
 
+/**
+ * Add one to an eventfd's counter
+ */
+static void eventfd_signal(int efd) {
+  uint64_t one = 1;
+  ssize_t rv = write(efd, &one, sizeof(one));
+  assert(rv == sizeof(one) || (rv == -1 && errno == EAGAIN));
+  (void)rv;
+}
+
+/**
+ * Read (and so reset) an eventfd's counter, blocking if the fd is blocking and
+ * the counter is zero
+ */
+static void eventfd_drain(int efd) {
+  uint64_t count;
+  ssize_t rv;
+  do {
+    rv = read(efd, &count, sizeof(count));
+  } while (rv == -1 && errno == EINTR);
+}
+
+/**
+ * Wake the server thread if it is sleeping
+ *
+ * The server sets server_waiting and then checks for work before it sleeps.
+ * Callers change something that the server checks (with a sequentially
+ * consistent store) before calling this, so either the server sees the change
+ * or this sees server_waiting and signals it. This keeps the eventfd write off
+ * the fast path when the server is already awake.
+ *
+ * @param ctx context object
+ */
+static void wake_server(struct tcp_server_ctx *ctx) {
+  if (__atomic_load_n(&ctx->server_waiting, __ATOMIC_SEQ_CST) &&
+      __atomic_exchange_n(&ctx->server_waiting, false, __ATOMIC_SEQ_CST)) {
+    eventfd_signal(ctx->wake_efd);
+  }
+}
+
+/**
+ * Set the events that the server thread waits for on an fd
+ *
+ * @param ctx context object
+ * @param fd fd to wait on, which must already be in ctx->epfd
+ * @param events epoll events (0 to ignore the fd for now)
+ */
+static void set_epoll_events(struct tcp_server_ctx *ctx, int fd,
+                             uint32_t events) {
+  struct epoll_event ev;
+  memset(&ev, 0, sizeof(ev));
+  ev.events = events;
+  ev.data.fd = fd;
+  int rv = epoll_ctl(ctx->epfd, EPOLL_CTL_MOD, fd, &ev);
+  assert(rv == 0);
+  (void)rv;
+}
+
+static int add_epoll_fd(struct tcp_server_ctx *ctx, int fd, uint32_t events) {
+  struct epoll_event ev;
+  memset(&ev, 0, sizeof(ev));
+  ev.events = events;
+  ev.data.fd = fd;
+  return epoll_ctl(ctx->epfd, EPOLL_CTL_ADD, fd, &ev);
+}
+
+/**
+ * Set the events that the server thread waits for on the client fd
+ *
+ * epoll always reports EPOLLHUP and EPOLLERR, even for an fd that is waiting
+ * for no events. If the client hung up while we weren't reading from it, the
+ * server thread would wake up for that over and over again. So when there is
+ * nothing to wait for, take the client fd out of the epoll set instead.
+ *
+ * @param ctx context object
+ * @param events epoll events (0 to ignore the client for now)
+ */
+static void set_client_events(struct tcp_server_ctx *ctx, uint32_t events) {
+  if (events == ctx->cfd_events) {
+    return;
+  }
+
+  if (!events) {
+    int rv = epoll_ctl(ctx->epfd, EPOLL_CTL_DEL, ctx->cfd, NULL);
+    assert(rv == 0);
+    (void)rv;
+  } else if (!ctx->cfd_events) {
+    int rv = add_epoll_fd(ctx, ctx->cfd, events);
+    assert(rv == 0);
+    (void)rv;
+  } else {
+    set_epoll_events(ctx, ctx->cfd, events);
+  }
+  ctx->cfd_events = events;
+}
+
 /**
  * Start a TCP server
  *
@@ -160,6 +367,13 @@ static int start(struct tcp_server_ctx *ctx) {
     return -1;
   }
 
+  rv = add_epoll_fd(ctx, sfd, EPOLLIN);
+  if (rv != 0) {
+    fprintf(stderr, "%s: Unable to wait on socket: %s (%d)\n",
+            ctx->display_name, strerror(errno), errno);
+    return -1;
+  }
+
   ctx->sfd = sfd;
   assert(ctx->sfd > 0);
 
@@ -169,7 +383,8 @@ static int start(struct tcp_server_ctx *ctx) {
 /**
  * Accept an incoming connection from a client (nonblocking)
  *
- * The resulting client fd is made non-blocking.
+ * The resulting client fd is made non-blocking. While the client is connected,
+ * the server stops waiting for new connections.
  *
  * @param ctx context object
  * @return 0 on success, any other value indicates an error
@@ -196,10 +411,23 @@ static int client_tryaccept(struct tcp_server_ctx *ctx) {
   if (rv != 0) {
     fprintf(stderr, "%s: Unable to make client socket non-blocking: %s (%d)\n",
             ctx->display_name, strerror(errno), errno);
+    close(cfd);
     return -1;
   }
 
+  rv = add_epoll_fd(ctx, cfd, EPOLLIN);
+  if (rv != 0) {
+    fprintf(stderr, "%s: Unable to wait on client socket: %s (%d)\n",
+            ctx->display_name, strerror(errno), errno);
+    close(cfd);
+    return -1;
+  }
+
+  set_epoll_events(ctx, ctx->sfd, 0);
+
   ctx->cfd = cfd;
+  ctx->cfd_events = EPOLLIN;
+  ctx->out_blocked = false;
   assert(ctx->cfd > 0);
 
   printf("%s: Accepted client connection\n", ctx->display_name);
@@ -222,64 +450,169 @@ static void stop(struct tcp_server_ctx *ctx) {
 }
 
 /**
- * Receive a byte from a connected client
+ * Disconnect the client (if any)
+ *
+ * Only call this from the server thread; other threads should use
+ * tcp_server_client_close().
  *
  * @param ctx context object
- * @param cmd byte received
- * @return true if a byte was read
  */
-static bool get_byte(struct tcp_server_ctx *ctx, char *cmd) {
+static void client_close(struct tcp_server_ctx *ctx) {
   assert(ctx);
 
-  ssize_t num_read = read(ctx->cfd, cmd, 1);
+  if (!ctx->cfd) {
+    return;
+  }
+
+  // Closing the fd also removes it from the epoll set
+  close(ctx->cfd);
+  ctx->cfd = 0;
 
-  if (num_read == 0) {
-    return false;
+  if (ctx->sfd) {
+    set_epoll_events(ctx, ctx->sfd, EPOLLIN);
   }
-  if (num_read == -1) {
-    if (errno == EAGAIN || errno == EWOULDBLOCK) {
-      return false;
-    } else if (errno == EBADF) {
-      // Possibly client went away? Accept a new connection.
-      fprintf(stderr, "%s: Client disappeared.\n", ctx->display_name);
-      tcp_server_client_close(ctx);
-      return false;
-    } else {
-      fprintf(stderr, "%s: Error while reading from client: %s (%d)\n",
-              ctx->display_name, strerror(errno), errno);
-      assert(0 && "Error reading from client");
+}
+
+/**
+ * Wake a writer that is waiting for space in buf_out (if any)
+ *
+ * @param ctx context object
+ */
+static void wake_writer(struct tcp_server_ctx *ctx) {
+  if (__atomic_exchange_n(&ctx->writer_waiting, false, __ATOMIC_SEQ_CST)) {
+    eventfd_signal(ctx->space_efd);
+  }
+}
+
+/**
+ * Read as much as possible from the client into buf_in
+ *
+ * If buf_in fills up, this sets in_stalled and stops waiting for data from the
+ * client until a reader makes some space.
+ *
+ * @param ctx context object
+ */
+static void read_client(struct tcp_server_ctx *ctx) {
+  assert(ctx);
+
+  while (ctx->cfd) {
+    char *dst;
+    size_t space = tcp_buffer_space(ctx->buf_in, &dst);
+    if (space == 0) {
+      __atomic_store_n(&ctx->in_stalled, true, __ATOMIC_SEQ_CST);
+      return;
     }
+
+    ssize_t num_read = read(ctx->cfd, dst, space);
+
+    if (num_read == 0) {
+      printf("%s: Remote disconnected.\n", ctx->display_name);
+      client_close(ctx);
+      return;
+    }
+    if (num_read == -1) {
+      if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        return;
+      } else if (errno == EINTR) {
+        continue;
+      } else if (errno == EBADF || errno == ECONNRESET) {
+        // Possibly client went away? Accept a new connection.
+        fprintf(stderr, "%s: Client disappeared.\n", ctx->display_name);
+        client_close(ctx);
+        return;
+      } else {
+        fprintf(stderr, "%s: Error while reading from client: %s (%d)\n",
+                ctx->display_name, strerror(errno), errno);
+        assert(0 && "Error reading from client");
+      }
+    }
+
+    tcp_buffer_commit_write(ctx->buf_in, num_read);
   }
-  assert(num_read == 1);
-  return true;
 }
 
 /**
- * Send a byte to a connected client
+ * Send as much as possible from buf_out to the client
+ *
+ * If the client's socket is full, this sets out_blocked and the server waits
+ * for it to become writable.
  *
  * @param ctx context object
- * @param cmd byte to send
  */
-static void put_byte(struct tcp_server_ctx *ctx, char cmd) {
-  while (1) {
-    ssize_t num_written = send(ctx->cfd, &cmd, sizeof(cmd), MSG_NOSIGNAL);
+static void write_client(struct tcp_server_ctx *ctx) {
+  assert(ctx);
+
+  ctx->out_blocked = false;
+
+  while (ctx->cfd) {
+    const char *src;
+    size_t avail = tcp_buffer_data(ctx->buf_out, &src);
+    if (avail == 0) {
+      return;
+    }
+
+    ssize_t num_written = send(ctx->cfd, src, avail, MSG_NOSIGNAL);
     if (num_written == -1) {
       if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        ctx->out_blocked = true;
+        return;
+      } else if (errno == EINTR) {
         continue;
-      } else if (errno == EPIPE) {
+      } else if (errno == EPIPE || errno == ECONNRESET) {
         printf("%s: Remote disconnected.\n", ctx->display_name);
-        tcp_server_client_close(ctx);
-        break;
+        client_close(ctx);
+        return;
       } else {
         fprintf(stderr, "%s: Error while writing to client: %s (%d)\n",
                 ctx->display_name, strerror(errno), errno);
         assert(0 && "Error writing to client.");
       }
     }
-    if (num_written >= 1) {
-      break;
-    }
+
+    tcp_buffer_commit_read(ctx->buf_out, num_written);
+    wake_writer(ctx);
+  }
+}
+
+/**
+ * Throw away anything in buf_out
+ *
+ * This is used when there is no client, so that writers don't wait forever
+ * for the server thread to send their data (and so that a new client doesn't
+ * see responses to an old one).
+ *
+ * @param ctx context object
+ */
+static void drop_output(struct tcp_server_ctx *ctx) {
+  const char *src;
+  size_t avail;
+  while ((avail = tcp_buffer_data(ctx->buf_out, &src)) != 0) {
+    tcp_buffer_commit_read(ctx->buf_out, avail);
+    wake_writer(ctx);
+  }
+}
+
+/**
+ * Check whether the server thread has work to do without waiting
+ *
+ * @param ctx context object
+ */
+static bool server_has_work(struct tcp_server_ctx *ctx) {
+  if (!__atomic_load_n(&ctx->socket_run, __ATOMIC_SEQ_CST) ||
+      __atomic_load_n(&ctx->client_close_req, __ATOMIC_SEQ_CST)) {
+    return true;
+  }
+
+  if (!ctx->cfd) {
+    return !tcp_buffer_is_empty(ctx->buf_out);
+  }
+
+  if (__atomic_load_n(&ctx->in_stalled, __ATOMIC_SEQ_CST) &&
+      !tcp_buffer_is_full(ctx->buf_in)) {
+    return true;
   }
+
+  return !ctx->out_blocked && !tcp_buffer_is_empty(ctx->buf_out);
 }
 
 /**
@@ -288,6 +621,16 @@ static void put_byte(struct tcp_server_ctx *ctx, char cmd) {
  * @param ctx context object
  */
 static void ctx_free(struct tcp_server_ctx *ctx) {
+  // Close the epoll fd and eventfds
+  if (ctx->epfd > 0) {
+    close(ctx->epfd);
+  }
+  if (ctx->wake_efd > 0) {
+    close(ctx->wake_efd);
+  }
+  if (ctx->space_efd > 0) {
+    close(ctx->space_efd);
+  }
   // Free the buffers
   tcp_buffer_free(&ctx->buf_in);
   tcp_buffer_free(&ctx->buf_out);
@@ -301,13 +644,19 @@ static void ctx_free(struct tcp_server_ctx *ctx) {
 /**
  * Thread function to create a new server instance
  *
+ * The thread sleeps in epoll_wait() until there is a new connection, data from
+ * the client or space in the client's socket, or until another thread wakes
+ * it through wake_efd (to send data, to say that it has made space in buf_in,
+ * to close the client or to shut down).
+ *
  * @param ctx_void context object
  * @return Always returns NULL
  */
 static void *server_create(void *ctx_void) {
   // Cast to a server struct
   struct tcp_server_ctx *ctx = (struct tcp_server_ctx *)ctx_void;
-  struct timeval timeout;
+  const int max_events = 4;
+  struct epoll_event events[max_events];
 
   // Start the server
   int rv = start(ctx);
@@ -317,61 +666,67 @@ static void *server_create(void *ctx_void) {
     goto err_cleanup_return;
   }
 
-  // Initialise timeout
-  timeout.tv_sec = 0;
-
-  // Initialise fd_set
-
   // Start waiting for connection / data
-  char xfer_data;
-  while (ctx->socket_run) {
-    // Initialise structure of fds
-    fd_set read_fds;
-    FD_ZERO(&read_fds);
-    if (ctx->sfd) {
-      FD_SET(ctx->sfd, &read_fds);
+  while (__atomic_load_n(&ctx->socket_run, __ATOMIC_ACQUIRE)) {
+    if (__atomic_exchange_n(&ctx->client_close_req, false, __ATOMIC_ACQ_REL)) {
+      client_close(ctx);
     }
+
     if (ctx->cfd) {
-      FD_SET(ctx->cfd, &read_fds);
+      // A reader may have made space since we stopped reading
+      __atomic_store_n(&ctx->in_stalled, false, __ATOMIC_SEQ_CST);
+      read_client(ctx);
+    }
+    if (ctx->cfd) {
+      write_client(ctx);
+    } else {
+      drop_output(ctx);
     }
-    // max fd num
-    int mfd = (ctx->cfd > ctx->sfd) ? ctx->cfd : ctx->sfd;
-
-    // Set timeout - 50us gives good performance
-    timeout.tv_usec = 50;
-
-    // Wait for socket activity or timeout
-    rv = select(mfd + 1, &read_fds, NULL, NULL, &timeout);
 
-    if (rv < 0) {
-      printf("%s: Socket read failed, port: %d\n", ctx->display_name,
-             ctx->listen_port);
-      tcp_server_client_close(ctx);
+    // Only wait for data from the client when there is somewhere to put it,
+    // and for space in its socket when there is something to send.
+    if (ctx->cfd) {
+      bool in_stalled = __atomic_load_n(&ctx->in_stalled, __ATOMIC_SEQ_CST);
+      set_client_events(ctx, (in_stalled ? 0 : (uint32_t)EPOLLIN) |
+                                 (ctx->out_blocked ? (uint32_t)EPOLLOUT : 0));
     }
 
-    // New connection
-    if (FD_ISSET(ctx->sfd, &read_fds)) {
-      client_tryaccept(ctx);
+    // Tell other threads that we're about to sleep, then check that there's
+    // nothing that they asked for before they saw the flag.
+    __atomic_store_n(&ctx->server_waiting, true, __ATOMIC_SEQ_CST);
+    if (server_has_work(ctx)) {
+      __atomic_store_n(&ctx->server_waiting, false, __ATOMIC_SEQ_CST);
+      continue;
     }
 
-    // New client data
-    if (FD_ISSET(ctx->cfd, &read_fds)) {
-      while (get_byte(ctx, &xfer_data)) {
-        tcp_buffer_put_byte(ctx->buf_in, xfer_data);
+    int num_events = epoll_wait(ctx->epfd, events, max_events, -1);
+    __atomic_store_n(&ctx->server_waiting, false, __ATOMIC_SEQ_CST);
+
+    if (num_events < 0) {
+      if (errno == EINTR) {
+        continue;
       }
+      printf("%s: Socket wait failed, port: %d\n", ctx->display_name,
+             ctx->listen_port);
+      client_close(ctx);
+      continue;
     }
 
-    if (ctx->cfd != 0) {
-      while (tcp_buffer_get_byte(ctx->buf_out, &xfer_data)) {
-        put_byte(ctx, xfer_data);
+    for (int i = 0; i < num_events; ++i) {
+      if (events[i].data.fd == ctx->wake_efd) {
+        eventfd_drain(ctx->wake_efd);
+      } else if (events[i].data.fd == ctx->sfd && !ctx->cfd) {
+        // New connection
+        client_tryaccept(ctx);
       }
+      // Client data, space and hangups are handled at the top of the loop
     }
   }
 
 err_cleanup_return:
 
   // Simulation done - clean up
-  tcp_server_client_close(ctx);
+  client_close(ctx);
   stop(ctx);
 
   return NULL;
@@ -383,44 +738,94 @@ tcp_server_ctx *tcp_server_create(const char *display_name, int listen_port) {
       (struct tcp_server_ctx *)calloc(1, sizeof(struct tcp_server_ctx));
   assert(ctx);
 
-  // Create the buffers
-  struct tcp_buf *buf_in = tcp_buffer_new();
-  struct tcp_buf *buf_out = tcp_buffer_new();
-  assert(buf_in);
-  assert(buf_out);
-
-  // Populate the struct with buffer pointers
-  ctx->buf_in = buf_in;
-  ctx->buf_out = buf_out;
-
   // Set up socket details
-  ctx->socket_run = true;
+  __atomic_store_n(&ctx->socket_run, true, __ATOMIC_RELEASE);
   ctx->listen_port = listen_port;
   ctx->display_name = strdup(display_name);
   assert(ctx->display_name);
 
+  // Create the buffers
+  ctx->buf_in = tcp_buffer_new();
+  ctx->buf_out = tcp_buffer_new();
+  if (!ctx->buf_in || !ctx->buf_out) {
+    fprintf(stderr, "%s: Unable to allocate buffers\n", ctx->display_name);
+    ctx_free(ctx);
+    return NULL;
+  }
+
+  // Set up the fds for waking the server thread and writers. These are
+  // created here, rather than in the server thread, because other threads
+  // might use them as soon as we return.
+  ctx->epfd = epoll_create1(EPOLL_CLOEXEC);
+  ctx->wake_efd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  ctx->space_efd = eventfd(0, EFD_CLOEXEC);
+  if (ctx->epfd < 0 || ctx->wake_efd < 0 || ctx->space_efd < 0 ||
+      add_epoll_fd(ctx, ctx->wake_efd, EPOLLIN) != 0) {
+    fprintf(stderr, "%s: Unable to create wakeup fds: %s (%d)\n",
+            ctx->display_name, strerror(errno), errno);
+    ctx_free(ctx);
+    return NULL;
+  }
+
   if (pthread_create(&ctx->sock_thread, NULL, server_create, (void *)ctx) !=
       0) {
     fprintf(stderr, "%s: Unable to create TCP socket thread\n",
             ctx->display_name);
     ctx_free(ctx);
-    free(ctx);
     return NULL;
   }
   return ctx;
 }
 
+size_t tcp_server_read_bulk(struct tcp_server_ctx *ctx, char *dat,
+                            size_t len) {
+  size_t num_read = tcp_buffer_read(ctx->buf_in, dat, len);
+
+  // If the server stopped reading because buf_in was full, tell it that
+  // there's space now.
+  if (num_read && __atomic_load_n(&ctx->in_stalled, __ATOMIC_SEQ_CST)) {
+    wake_server(ctx);
+  }
+
+  return num_read;
+}
+
+void tcp_server_write_bulk(struct tcp_server_ctx *ctx, const char *dat,
+                           size_t len) {
+  while (true) {
+    size_t num_written = tcp_buffer_write(ctx->buf_out, dat, len);
+    if (num_written) {
+      wake_server(ctx);
+    }
+
+    dat += num_written;
+    len -= num_written;
+    if (!len) {
+      return;
+    }
+
+    // buf_out is full. Wait for the server thread to send some of it, using
+    // the same protocol as wake_server() but the other way around.
+    __atomic_store_n(&ctx->writer_waiting, true, __ATOMIC_SEQ_CST);
+    if (tcp_buffer_is_full(ctx->buf_out)) {
+      eventfd_drain(ctx->space_efd);
+    }
+    __atomic_store_n(&ctx->writer_waiting, false, __ATOMIC_SEQ_CST);
+  }
+}
+
 bool tcp_server_read(struct tcp_server_ctx *ctx, char *dat) {
-  return tcp_buffer_get_byte(ctx->buf_in, dat);
+  return tcp_server_read_bulk(ctx, dat, 1) == 1;
 }
 
 void tcp_server_write(struct tcp_server_ctx *ctx, char dat) {
-  tcp_buffer_put_byte(ctx->buf_out, dat);
+  tcp_server_write_bulk(ctx, &dat, 1);
 }
 
 void tcp_server_close(struct tcp_server_ctx *ctx) {
   // Shut down the socket thread
-  ctx->socket_run = false;
+  __atomic_store_n(&ctx->socket_run, false, __ATOMIC_SEQ_CST);
+  eventfd_signal(ctx->wake_efd);
   pthread_join(ctx->sock_thread, NULL);
   ctx_free(ctx);
 }
@@ -428,10 +833,8 @@ void tcp_server_close(struct tcp_server_ctx *ctx) {
 void tcp_server_client_close(struct tcp_server_ctx *ctx) {
   assert(ctx);
 
-  if (!ctx->cfd) {
-    return;
-  }
-
-  close(ctx->cfd);
-  ctx->cfd = 0;
+  // The client fd belongs to the server thread, which might be using it right
+  // now. Ask it to do the close.
+  __atomic_store_n(&ctx->client_close_req, true, __ATOMIC_SEQ_CST);
+  wake_server(ctx);
 }
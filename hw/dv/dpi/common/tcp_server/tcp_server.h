@@ -10,12 +10,20 @@
  *
  * This is intended to be used by simulation add-on DPI modules to provide
  * basic TCP socket communication between a host and simulated peripherals.
+ *
+ * Each server runs in its own thread, which sleeps until there is something
+ * to do. Data passes between it and the caller through ring buffers, so reads
+ * and writes don't make system calls unless they need to wake the server
+ * thread. The read, write and client close functions may be called from any
+ * one thread at a time (such as the thread a DPI function runs on, which can
+ * change in a multi-threaded Verilator model).
  */
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+#include <stddef.h>
 #include <stdint.h>
 
 struct tcp_server_ctx;
@@ -29,6 +37,16 @@ struct tcp_server_ctx;
  */
 bool tcp_server_read(struct tcp_server_ctx *ctx, char *dat);
 
+/**
+ * Non-blocking read of up to len bytes from a connected client
+ *
+ * @param ctx tcp server context object
+ * @param dat buffer for the bytes received
+ * @param len size of dat
+ * @return number of bytes read (0 if there is no data waiting)
+ */
+size_t tcp_server_read_bulk(struct tcp_server_ctx *ctx, char *dat, size_t len);
+
 /**
  * Write a byte to a connected client
  *
@@ -40,6 +58,19 @@ bool tcp_server_read(struct tcp_server_ctx *ctx, char *dat);
  */
 void tcp_server_write(struct tcp_server_ctx *ctx, char dat);
 
+/**
+ * Write len bytes to a connected client
+ *
+ * Like tcp_server_write(), this only blocks if the internal buffer is full.
+ * Data written while no client is connected is dropped.
+ *
+ * @param ctx tcp server context object
+ * @param dat bytes to send
+ * @param len number of bytes in dat
+ */
+void tcp_server_write_bulk(struct tcp_server_ctx *ctx, const char *dat,
+                           size_t len);
+
 /**
  * Create a new TCP server instance
  *
@@ -59,6 +90,9 @@ void tcp_server_close(struct tcp_server_ctx *ctx);
 /**
  * Instruct the server to disconnect a client
  *
+ * The server thread disconnects the client asynchronously, shortly after this
+ * call returns.
+ *
  * @param ctx tcp server context object
  */
 void tcp_server_client_close(struct tcp_server_ctx *ctx);
@@ -3,11 +3,13 @@
 // SPDX-License-Identifier: Apache-2.0
 
 #include "dmidpi.h"
+#include "dpi_checkpoint.h"
 #include "tcp_server.h"
 
 #include <assert.h>
 #include <pthread.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -30,6 +32,18 @@ const int IDCODEVAL = 0x04F5484D;
 // [3:0]    0x1  - Protocol version (0.13)
 const int DTMCSRVAL = 0x00000071;
 
+// Size of the buffer for commands received from the client
+#define DMIDPI_CMD_BUF_SIZE 4096
+// Size of the buffer for responses to the client
+#define DMIDPI_RESP_BUF_SIZE 256
+
+// Direct DMI transaction command (an extension to the remote_bitbang
+// protocol, see README.md): 'D', op, address, then data (4 bytes,
+// little-endian). The response is resp, then data (4 bytes, little-endian).
+#define DMIDPI_DMI_CMD 'D'
+#define DMIDPI_DMI_CMD_LEN 7
+#define DMIDPI_DMI_RESP_LEN 5
+
 enum jtag_state_t : uint8_t {
   TestLogicReset,
   RunTestIdle,
@@ -83,6 +97,19 @@ struct dmi_sig_values {
 
 struct dmidpi_ctx {
   struct tcp_server_ctx *sock;
+  // Commands received from the client. Those in [cmd_pos, cmd_len) haven't
+  // been processed yet.
+  char cmd_buf[DMIDPI_CMD_BUF_SIZE];
+  size_t cmd_pos;
+  size_t cmd_len;
+  // Responses that haven't been sent to the client yet
+  char resp_buf[DMIDPI_RESP_BUF_SIZE];
+  size_t resp_len;
+  // The outstanding DMI transaction came from a direct DMI transaction
+  // command, so its response goes straight back to the client. Like the
+  // buffers, this belongs to the client connection and isn't checkpointed.
+  uint8_t dmi_direct;
+  // Saved in simulation checkpoints, along with everything after
   struct jtag_ctx jtag;
   struct dmi_sig_values sig;
 };
@@ -113,17 +140,69 @@ static void set_dr_data(struct dmidpi_ctx *ctx) {
   }
 }
 
+/**
+ * Send any buffered responses to the client
+ *
+ * @param ctx dmidpi context object
+ */
+static void flush_resp(struct dmidpi_ctx *ctx) {
+  if (ctx->resp_len) {
+    tcp_server_write_bulk(ctx->sock, ctx->resp_buf, ctx->resp_len);
+    ctx->resp_len = 0;
+  }
+}
+
+/**
+ * Queue a response to the client, to be sent at the end of the tick
+ *
+ * @param ctx dmidpi context object
+ * @param dat bytes to send
+ * @param len number of bytes in dat (at most DMIDPI_RESP_BUF_SIZE)
+ */
+static void queue_resp(struct dmidpi_ctx *ctx, const char *dat, size_t len) {
+  if (ctx->resp_len + len > sizeof(ctx->resp_buf)) {
+    flush_resp(ctx);
+  }
+  memcpy(ctx->resp_buf + ctx->resp_len, dat, len);
+  ctx->resp_len += len;
+}
+
+/**
+ * Make sure that at least len unprocessed command bytes are buffered
+ *
+ * @param ctx dmidpi context object
+ * @param len number of bytes needed
+ * @return true if they are, false if more are needed from the client
+ */
+static bool fill_cmd_buf(struct dmidpi_ctx *ctx, size_t len) {
+  size_t avail = ctx->cmd_len - ctx->cmd_pos;
+  if (avail >= len) {
+    return true;
+  }
+
+  memmove(ctx->cmd_buf, ctx->cmd_buf + ctx->cmd_pos, avail);
+  ctx->cmd_pos = 0;
+  ctx->cmd_len = avail;
+  ctx->cmd_len += tcp_server_read_bulk(ctx->sock, ctx->cmd_buf + avail,
+                                       sizeof(ctx->cmd_buf) - avail);
+  return ctx->cmd_len >= len;
+}
+
 /**
  * Drive a new DMI transaction to the DPI interface
  *
  * @param ctx dmidpi context object
+ * @param addr DMI address
+ * @param op DMI operation
+ * @param data DMI write data
  */
-static void issue_dmi_req(struct dmidpi_ctx *ctx) {
+static void issue_dmi_req(struct dmidpi_ctx *ctx, uint32_t addr, uint32_t op,
+                          uint32_t data) {
   ctx->jtag.dmi_outstanding = 1;
   ctx->sig.dmi_req_valid = 1;
-  ctx->sig.dmi_req_addr = (ctx->jtag.dr_captured >> 34) & 0x7F;
-  ctx->sig.dmi_req_op = ctx->jtag.dr_captured & 0x3;
-  ctx->sig.dmi_req_data = (ctx->jtag.dr_captured >> 2) & 0xFFFFFFFF;
+  ctx->sig.dmi_req_addr = addr & 0x7F;
+  ctx->sig.dmi_req_op = op & 0x3;
+  ctx->sig.dmi_req_data = data;
 }
 
 /**
@@ -213,7 +292,10 @@ static bool process_jtag_cmd(struct dmidpi_ctx *ctx, bool tdi, bool tms,
       // If a DMI read or write completes, write it out
       if ((ctx->jtag.ir_captured == DMIAccess) &&
           ((ctx->jtag.dr_captured & 0x3) != 0)) {
-        issue_dmi_req(ctx);
+        ctx->dmi_direct = 0;
+        issue_dmi_req(ctx, (ctx->jtag.dr_captured >> 34) & 0x7F,
+                      ctx->jtag.dr_captured & 0x3,
+                      (ctx->jtag.dr_captured >> 2) & 0xFFFFFFFF);
         return true;
       }
       return false;
@@ -305,7 +387,7 @@ static bool process_cmd_byte(struct dmidpi_ctx *ctx, char cmd) {
   } else if (cmd == 'R') {
     // JTAG read, send tdo as response
     char tdo_ascii = ctx->jtag.jtag_tdo + '0';
-    tcp_server_write(ctx->sock, tdo_ascii);
+    queue_resp(ctx, &tdo_ascii, 1);
   } else if (cmd == 'B') {
     // printf("DMI DPI: BLINK ON!\n");
   } else if (cmd == 'b') {
@@ -313,7 +395,10 @@ static bool process_cmd_byte(struct dmidpi_ctx *ctx, char cmd) {
   } else if (cmd == 'Q') {
     // quit (client disconnect)
     printf("DMI DPI: Remote disconnected.\n");
+    ctx->cmd_pos = ctx->cmd_len = 0;
+    ctx->resp_len = 0;
     tcp_server_client_close(ctx->sock);
+    return true;
   } else {
     fprintf(stderr,
             "DMI DPI: Protocol violation detected: unsupported command %c\n",
@@ -324,6 +409,35 @@ static bool process_cmd_byte(struct dmidpi_ctx *ctx, char cmd) {
   return false;
 }
 
+/**
+ * Process a direct DMI transaction command
+ *
+ * This skips the JTAG state machine and drives the transaction straight to
+ * the design. The response is sent to the client once the transaction
+ * completes (see process_dmi_inputs()).
+ *
+ * @param ctx a dmi context object
+ * @param cmd the command, which is DMIDPI_DMI_CMD_LEN bytes long
+ */
+static void process_dmi_cmd(struct dmidpi_ctx *ctx, const uint8_t *cmd) {
+  uint32_t op = cmd[1];
+  uint32_t addr = cmd[2];
+  uint32_t data = cmd[3] | ((uint32_t)cmd[4] << 8) |
+                  ((uint32_t)cmd[5] << 16) | ((uint32_t)cmd[6] << 24);
+
+  // Only reads (1) and writes (2) do anything
+  if ((op != 1 && op != 2) || addr > 0x7F) {
+    fprintf(stderr,
+            "DMI DPI: Protocol violation detected: bad DMI transaction "
+            "(op %u, addr 0x%x)\n",
+            op, addr);
+    exit(1);
+  }
+
+  ctx->dmi_direct = 1;
+  issue_dmi_req(ctx, addr, op, data);
+}
+
 /**
  * Process DPI inputs from the design
  *
@@ -337,8 +451,17 @@ static void process_dmi_inputs(struct dmidpi_ctx *ctx) {
   // Always ready for a resp
   ctx->sig.dmi_rsp_ready = 1;
   if (ctx->sig.dmi_rsp_valid) {
-    ctx->jtag.dr_captured = (uint64_t)ctx->sig.dmi_rsp_data << 2;
-    ctx->jtag.dr_captured |= (uint64_t)ctx->sig.dmi_rsp_resp & 0x3;
+    if (ctx->dmi_direct) {
+      uint32_t data = ctx->sig.dmi_rsp_data;
+      char resp[DMIDPI_DMI_RESP_LEN] = {
+          (char)(ctx->sig.dmi_rsp_resp & 0x3), (char)data,
+          (char)(data >> 8), (char)(data >> 16), (char)(data >> 24)};
+      queue_resp(ctx, resp, sizeof(resp));
+      ctx->dmi_direct = 0;
+    } else {
+      ctx->jtag.dr_captured = (uint64_t)ctx->sig.dmi_rsp_data << 2;
+      ctx->jtag.dr_captured |= (uint64_t)ctx->sig.dmi_rsp_resp & 0x3;
+    }
     // Clear req outstanding flag
     ctx->jtag.dmi_outstanding = 0;
   }
@@ -357,20 +480,26 @@ static void update_dmi_state(struct dmidpi_ctx *ctx) {
 
   // If we are waiting for a previous transaction to complete, do not attempt
   // a new one
-  if (ctx->jtag.dmi_outstanding) {
-    return;
-  }
+  bool done = ctx->jtag.dmi_outstanding;
+  while (!done && fill_cmd_buf(ctx, 1)) {
+    char cmd = ctx->cmd_buf[ctx->cmd_pos];
 
-  char done = 0;
-  while (!done) {
-    // read a command byte
-    char cmd;
-    if (!tcp_server_read(ctx->sock, &cmd)) {
-      return;
+    if (cmd == DMIDPI_DMI_CMD) {
+      if (!fill_cmd_buf(ctx, DMIDPI_DMI_CMD_LEN)) {
+        break;
+      }
+      process_dmi_cmd(ctx, (const uint8_t *)ctx->cmd_buf + ctx->cmd_pos);
+      ctx->cmd_pos += DMIDPI_DMI_CMD_LEN;
+      break;
     }
+
     // Process command bytes until a command completes
+    ctx->cmd_pos++;
     done = process_cmd_byte(ctx, cmd);
   }
+
+  // Send the responses from this tick in one go
+  flush_resp(ctx);
 }
 
 void *dmidpi_create(const char *display_name, int listen_port) {
@@ -391,6 +520,10 @@ void *dmidpi_create(const char *display_name, int listen_port) {
       "  remote_bitbang_port %d\n",
       display_name, listen_port, listen_port);
 
+  dpi_checkpoint_register(
+      ctx, dmidpi_reattach, &ctx->jtag,
+      sizeof(struct dmidpi_ctx) - offsetof(struct dmidpi_ctx, jtag));
+
   return (void *)ctx;
 }
 
@@ -400,6 +533,8 @@ void dmidpi_close(void *ctx_void) {
     return;
   }
 
+  dpi_checkpoint_unregister(ctx);
+
   // Shut down the server
   tcp_server_close(ctx->sock);
 
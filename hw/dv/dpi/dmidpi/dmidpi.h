@@ -46,6 +46,15 @@ void dmidpi_tick(void *ctx_void, svBit *dmi_req_valid,
                  const svBitVecVal *dmi_resp_data,
                  const svBitVecVal *dmi_resp_resp, svBit *dmi_reset_n);
 
+/**
+ * Point the module's context handle at ctx_void (exported from dmidpi.sv)
+ *
+ * Used when restoring a simulation checkpoint.
+ *
+ * @param ctx_void  a struct dmidpi_ctx context object
+ */
+void dmidpi_reattach(void *ctx_void);
+
 #ifdef __cplusplus
 }  // extern "C"
 #endif
@@ -21,7 +21,7 @@ module dmidpi #(
   output bit        dmi_rst_n
 );
 
-  import "DPI-C"
+  import "DPI-C" context
   function chandle dmidpi_create(input string name, input int listen_port);
 
   import "DPI-C"
@@ -37,6 +37,13 @@ module dmidpi #(
 
   chandle ctx;
 
+  // Point ctx at a new context after restoring a simulation checkpoint (see
+  // dpi_checkpoint.h)
+  export "DPI-C" function dmidpi_reattach;
+  function automatic void dmidpi_reattach(input chandle new_ctx);
+    ctx = new_ctx;
+  endfunction
+
   initial begin
     ctx = dmidpi_create(Name, ListenPort);
   end
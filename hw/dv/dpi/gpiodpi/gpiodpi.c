@@ -4,6 +4,8 @@
 
 #include "gpiodpi.h"
 
+#include "dpi_checkpoint.h"
+
 #ifdef __linux__
 #include <pty.h>
 #elif __APPLE__
@@ -14,6 +16,7 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <limits.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -35,7 +38,8 @@ struct gpiodpi_ctx {
   uint32_t driven_pin_values;
 
   // File descriptors and paths for the device-to-host and host-to-device
-  // FIFOs.
+  // FIFOs. These (and everything after them) aren't saved in simulation
+  // checkpoints.
   int dev_to_host_fifo;
   char dev_to_host_path[PATH_MAX];
   int host_to_dev_fifo;
@@ -130,6 +134,9 @@ void *gpiodpi_create(const char *name, int n_bits) {
 
   print_usage(ctx->dev_to_host_path, ctx->host_to_dev_path, ctx->n_bits);
 
+  dpi_checkpoint_register(ctx, gpiodpi_reattach, ctx,
+                          offsetof(struct gpiodpi_ctx, dev_to_host_fifo));
+
   return (void *)ctx;
 }
 
@@ -241,6 +248,8 @@ void gpiodpi_close(void *ctx_void) {
     return;
   }
 
+  dpi_checkpoint_unregister(ctx);
+
   if (close(ctx->dev_to_host_fifo) != 0) {
     printf("GPIO: Failed to close FIFO file at %s: %s\n", ctx->dev_to_host_path,
            strerror(errno));
@@ -45,5 +45,12 @@ uint32_t gpiodpi_host_to_device_tick(void *ctx_void, svBitVecVal *gpio_oe);
  */
 void gpiodpi_close(void *ctx_void);
 
+/**
+ * Point the module's context handle at ctx_void.
+ *
+ * Exported from SystemVerilog and used when restoring a simulation checkpoint.
+ */
+void gpiodpi_reattach(void *ctx_void);
+
 }  // extern "C"
 #endif  // OPENTITAN_HW_DV_DPI_GPIODPI_GPIODPI_H_
@@ -14,7 +14,7 @@ module gpiodpi
   input  logic [N_GPIO-1:0] gpio_d2p,
   input  logic [N_GPIO-1:0] gpio_en_d2p
 );
-   import "DPI-C" function
+   import "DPI-C" context function
      chandle gpiodpi_create(input string name, input int n_bits);
 
    import "DPI-C" function
@@ -30,6 +30,13 @@ module gpiodpi
 
    chandle ctx;
 
+   // Point ctx at a new context after restoring a simulation checkpoint (see
+   // dpi_checkpoint.h)
+   export "DPI-C" function gpiodpi_reattach;
+   function automatic void gpiodpi_reattach(input chandle new_ctx);
+     ctx = new_ctx;
+   endfunction
+
    initial begin
      ctx = gpiodpi_create(NAME, N_GPIO);
    end
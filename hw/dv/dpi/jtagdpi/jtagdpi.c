@@ -3,18 +3,52 @@
 // SPDX-License-Identifier: Apache-2.0
 
 #include "jtagdpi.h"
+#include "dpi_checkpoint.h"
 #include "tcp_server.h"
 
 #include <assert.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+// Size of the buffer for commands received from the client
+#define JTAGDPI_CMD_BUF_SIZE 4096
+// Size of the buffer for responses to the client
+#define JTAGDPI_RESP_BUF_SIZE 256
+
+// Packed scan command (an extension to the remote_bitbang protocol, see
+// README.md): 'X', flags, length in bits (2 bytes, little-endian), then the
+// TDI bits, LSB first.
+#define JTAGDPI_SCAN_CMD 'X'
+#define JTAGDPI_SCAN_HDR_LEN 4
+#define JTAGDPI_SCAN_MAX_BITS 4096
+// Set TMS for the last bit of the scan (to leave the Shift-DR/IR state)
+#define JTAGDPI_SCAN_TMS_LAST 0x1
+// Send the TDO bits back to the client once the scan is done
+#define JTAGDPI_SCAN_CAPTURE 0x2
+
 struct jtagdpi_ctx {
   // Server context
   struct tcp_server_ctx *sock;
-  // Signals
+  // Commands received from the client. Those in [cmd_pos, cmd_len) haven't
+  // been processed yet.
+  char cmd_buf[JTAGDPI_CMD_BUF_SIZE];
+  size_t cmd_pos;
+  size_t cmd_len;
+  // Responses that haven't been sent to the client yet
+  char resp_buf[JTAGDPI_RESP_BUF_SIZE];
+  size_t resp_len;
+  // Packed scan in progress (if scan_pos < scan_len)
+  uint8_t scan_tdi[JTAGDPI_SCAN_MAX_BITS / 8];
+  uint8_t scan_tdo[JTAGDPI_SCAN_MAX_BITS / 8];
+  uint32_t scan_len;
+  uint32_t scan_pos;
+  uint8_t scan_flags;
+  // True if TCK has been taken low for the bit at scan_pos
+  bool scan_tck_low;
+  // Signals (saved in simulation checkpoints, along with everything after)
   uint8_t tck;
   uint8_t tms;
   uint8_t tdi;
@@ -40,12 +74,136 @@ static void reset_jtag_signals(struct jtagdpi_ctx *ctx) {
   ctx->srst_n = 1;
 }
 
+/**
+ * Send any buffered responses to the client
+ */
+static void flush_resp(struct jtagdpi_ctx *ctx) {
+  if (ctx->resp_len) {
+    tcp_server_write_bulk(ctx->sock, ctx->resp_buf, ctx->resp_len);
+    ctx->resp_len = 0;
+  }
+}
+
+/**
+ * Queue a response to the client
+ *
+ * Responses are sent in bulk once there are no more commands waiting to be
+ * processed (see update_jtag_signals()), or when the buffer fills up.
+ */
+static void queue_resp(struct jtagdpi_ctx *ctx, const char *dat, size_t len) {
+  if (ctx->resp_len + len > sizeof(ctx->resp_buf)) {
+    flush_resp(ctx);
+    if (len > sizeof(ctx->resp_buf)) {
+      tcp_server_write_bulk(ctx->sock, dat, len);
+      return;
+    }
+  }
+  memcpy(ctx->resp_buf + ctx->resp_len, dat, len);
+  ctx->resp_len += len;
+}
+
+/**
+ * Make sure that at least len unprocessed command bytes are buffered
+ *
+ * @return true if they are, false if more are needed from the client
+ */
+static bool fill_cmd_buf(struct jtagdpi_ctx *ctx, size_t len) {
+  size_t avail = ctx->cmd_len - ctx->cmd_pos;
+  if (avail >= len) {
+    return true;
+  }
+
+  memmove(ctx->cmd_buf, ctx->cmd_buf + ctx->cmd_pos, avail);
+  ctx->cmd_pos = 0;
+  ctx->cmd_len = avail;
+  ctx->cmd_len += tcp_server_read_bulk(ctx->sock, ctx->cmd_buf + avail,
+                                       sizeof(ctx->cmd_buf) - avail);
+  return ctx->cmd_len >= len;
+}
+
+/**
+ * Start a packed scan if all of it has been received
+ *
+ * @return true if the scan has started
+ */
+static bool start_scan(struct jtagdpi_ctx *ctx) {
+  if (!fill_cmd_buf(ctx, JTAGDPI_SCAN_HDR_LEN)) {
+    return false;
+  }
+
+  const uint8_t *hdr = (const uint8_t *)ctx->cmd_buf + ctx->cmd_pos;
+  uint32_t len = hdr[2] | ((uint32_t)hdr[3] << 8);
+  if (len == 0 || len > JTAGDPI_SCAN_MAX_BITS) {
+    fprintf(stderr,
+            "JTAG DPI Protocol violation detected: bad scan length %u\n",
+            len);
+    exit(1);
+  }
+
+  size_t num_bytes = (len + 7) / 8;
+  if (!fill_cmd_buf(ctx, JTAGDPI_SCAN_HDR_LEN + num_bytes)) {
+    return false;
+  }
+
+  // fill_cmd_buf() may have moved the header
+  hdr = (const uint8_t *)ctx->cmd_buf + ctx->cmd_pos;
+  ctx->scan_flags = hdr[1];
+  ctx->scan_len = len;
+  ctx->scan_pos = 0;
+  ctx->scan_tck_low = false;
+  memcpy(ctx->scan_tdi, hdr + JTAGDPI_SCAN_HDR_LEN, num_bytes);
+  memset(ctx->scan_tdo, 0, num_bytes);
+  ctx->cmd_pos += JTAGDPI_SCAN_HDR_LEN + num_bytes;
+  return true;
+}
+
+/**
+ * Clock out the next edge of a packed scan
+ *
+ * Each bit takes two ticks, in the same way as OpenOCD would drive it: TCK
+ * goes low with the new TDI and TMS values, then TDO is sampled and TCK goes
+ * high again.
+ */
+static void step_scan(struct jtagdpi_ctx *ctx) {
+  uint32_t pos = ctx->scan_pos;
+  uint8_t mask = 1 << (pos % 8);
+
+  if (!ctx->scan_tck_low) {
+    ctx->tck = 0;
+    ctx->tdi = (ctx->scan_tdi[pos / 8] & mask) != 0;
+    ctx->tms = (pos + 1 == ctx->scan_len) &&
+               (ctx->scan_flags & JTAGDPI_SCAN_TMS_LAST);
+    ctx->scan_tck_low = true;
+    return;
+  }
+
+  if (ctx->tdo) {
+    ctx->scan_tdo[pos / 8] |= mask;
+  }
+  ctx->tck = 1;
+  ctx->scan_tck_low = false;
+  ctx->scan_pos = ++pos;
+
+  if (pos == ctx->scan_len && (ctx->scan_flags & JTAGDPI_SCAN_CAPTURE)) {
+    queue_resp(ctx, (const char *)ctx->scan_tdo, (pos + 7) / 8);
+  }
+}
+
 /**
  * Update the JTAG signals in the context structure
+ *
+ * Commands are processed until one changes a signal, which the design needs
+ * to see for (at least) a tick. Anything else, such as a read of TDO or a
+ * write that leaves the signals as they were, doesn't need a tick to itself.
  */
 static void update_jtag_signals(struct jtagdpi_ctx *ctx) {
   assert(ctx);
 
+  if (ctx->scan_pos < ctx->scan_len) {
+    step_scan(ctx);
+    return;
+  }
+
   /*
    * Documentation pointer:
    * The remote_bitbang protocol implemented below is documented in the OpenOCD
@@ -53,54 +211,67 @@ static void update_jtag_signals(struct jtagdpi_ctx *ctx) {
    * https://repo.or.cz/openocd.git/blob/HEAD:/doc/manual/jtag/drivers/remote_bitbang.txt
    */
 
-  // read a command byte
-  char cmd;
-  if (!tcp_server_read(ctx->sock, &cmd)) {
-    return;
-  }
+  while (fill_cmd_buf(ctx, 1)) {
+    char cmd = ctx->cmd_buf[ctx->cmd_pos];
 
-  bool act_send_resp = false;
-  bool act_quit = false;
-
-  // parse received command byte
-  if (cmd >= '0' && cmd <= '7') {
-    // JTAG write
-    char cmd_bit = cmd - '0';
-    ctx->tdi = (cmd_bit >> 0) & 0x1;
-    ctx->tms = (cmd_bit >> 1) & 0x1;
-    ctx->tck = (cmd_bit >> 2) & 0x1;
-  } else if (cmd >= 'r' && cmd <= 'u') {
-    // JTAG reset (active high from OpenOCD)
-    char cmd_bit = cmd - 'r';
-    ctx->srst_n = !((cmd_bit >> 0) & 0x1);
-    ctx->trst_n = !((cmd_bit >> 1) & 0x1);
-  } else if (cmd == 'R') {
-    // JTAG read
-    act_send_resp = true;
-  } else if (cmd == 'B') {
-    // printf("%s: BLINK ON!\n", ctx->display_name);
-  } else if (cmd == 'b') {
-    // printf("%s: BLINK OFF!\n", ctx->display_name);
-  } else if (cmd == 'Q') {
-    // quit (client disconnect)
-    act_quit = true;
-  } else {
-    fprintf(stderr,
-            "JTAG DPI Protocol violation detected: unsupported command %c\n",
-            cmd);
-    exit(1);
-  }
+    if (cmd == JTAGDPI_SCAN_CMD) {
+      if (!start_scan(ctx)) {
+        break;
+      }
+      step_scan(ctx);
+      return;
+    }
 
-  // send tdo as response
-  if (act_send_resp) {
-    char tdo_ascii = ctx->tdo + '0';
-    tcp_server_write(ctx->sock, tdo_ascii);
-  }
+    ctx->cmd_pos++;
 
-  if (act_quit) {
-    printf("JTAG DPI: Remote disconnected.\n");
-    tcp_server_client_close(ctx->sock);
+    // parse received command byte
+    if (cmd >= '0' && cmd <= '7') {
+      // JTAG write
+      char cmd_bit = cmd - '0';
+      uint8_t tdi = (cmd_bit >> 0) & 0x1;
+      uint8_t tms = (cmd_bit >> 1) & 0x1;
+      uint8_t tck = (cmd_bit >> 2) & 0x1;
+      if (tdi != ctx->tdi || tms != ctx->tms || tck != ctx->tck) {
+        ctx->tdi = tdi;
+        ctx->tms = tms;
+        ctx->tck = tck;
+        return;
+      }
+    } else if (cmd >= 'r' && cmd <= 'u') {
+      // JTAG reset (active high from OpenOCD)
+      char cmd_bit = cmd - 'r';
+      uint8_t srst_n = !((cmd_bit >> 0) & 0x1);
+      uint8_t trst_n = !((cmd_bit >> 1) & 0x1);
+      if (srst_n != ctx->srst_n || trst_n != ctx->trst_n) {
+        ctx->srst_n = srst_n;
+        ctx->trst_n = trst_n;
+        return;
+      }
+    } else if (cmd == 'R') {
+      // JTAG read, send tdo as response
+      char tdo_ascii = ctx->tdo + '0';
+      queue_resp(ctx, &tdo_ascii, 1);
+    } else if (cmd == 'B') {
+      // printf("%s: BLINK ON!\n", ctx->display_name);
+    } else if (cmd == 'b') {
+      // printf("%s: BLINK OFF!\n", ctx->display_name);
+    } else if (cmd == 'Q') {
+      // quit (client disconnect)
+      printf("JTAG DPI: Remote disconnected.\n");
+      ctx->cmd_pos = ctx->cmd_len = 0;
+      ctx->resp_len = 0;
+      tcp_server_client_close(ctx->sock);
+      return;
+    } else {
+      fprintf(stderr,
+              "JTAG DPI Protocol violation detected: unsupported command %c\n",
+              cmd);
+      exit(1);
+    }
   }
+
+  // The client is waiting for us, so send it the responses so far
+  flush_resp(ctx);
 }
 
 void *jtagdpi_create(const char *display_name, int listen_port) {
@@ -122,6 +293,10 @@ void *jtagdpi_create(const char *display_name, int listen_port) {
       "  remote_bitbang_port %d\n",
       display_name, listen_port, listen_port);
 
+  dpi_checkpoint_register(
+      ctx, jtagdpi_reattach, &ctx->tck,
+      sizeof(struct jtagdpi_ctx) - offsetof(struct jtagdpi_ctx, tck));
+
   return (void *)ctx;
 }
 
@@ -130,6 +305,7 @@ void jtagdpi_close(void *ctx_void) {
   if (!ctx) {
     return;
   }
+  dpi_checkpoint_unregister(ctx);
   tcp_server_close(ctx->sock);
   free(ctx);
 }
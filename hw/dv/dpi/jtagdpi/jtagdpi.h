@@ -50,6 +50,15 @@ void jtagdpi_close(void *ctx_void);
 void jtagdpi_tick(void *ctx_void, svBit *tck, svBit *tms, svBit *tdi,
                   svBit *trst_n, svBit *srst_n, const svBit tdo);
 
+/**
+ * Point the module's context handle at ctx_void (exported from jtagdpi.sv)
+ *
+ * Used when restoring a simulation checkpoint.
+ *
+ * @param ctx_void  a struct jtagdpi_ctx context object
+ */
+void jtagdpi_reattach(void *ctx_void);
+
 #ifdef __cplusplus
 }  // extern "C"
 #endif
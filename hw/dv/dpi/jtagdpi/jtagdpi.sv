@@ -17,7 +17,7 @@ module jtagdpi #(
   output logic jtag_srst_n
 );
 
-  import "DPI-C"
+  import "DPI-C" context
   function chandle jtagdpi_create(input string name, input int listen_port);
 
   import "DPI-C"
@@ -30,6 +30,13 @@ module jtagdpi #(
 
   chandle ctx;
 
+  // Point ctx at a new context after restoring a simulation checkpoint (see
+  // dpi_checkpoint.h)
+  export "DPI-C" function jtagdpi_reattach;
+  function automatic void jtagdpi_reattach(input chandle new_ctx);
+    ctx = new_ctx;
+  endfunction
+
   initial begin
     ctx = jtagdpi_create(Name, ListenPort);
   end
@@ -12,6 +12,7 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <limits.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -19,6 +20,7 @@
 #include <sys/types.h>
 #include <unistd.h>
 
+#include "dpi_checkpoint.h"
 #include "spidpi.h"
 #include "verilator_sim_ctrl.h"
 
@@ -91,6 +93,12 @@ void *spidpi_create(const char *name, int mode, int loglevel) {
       "$ tail -f %s\n",
       ctx->mon_pathname, ctx->mon_pathname);
 
+  // The pseudo-terminal and monitor can't be saved in a checkpoint, so a
+  // restored simulation uses new ones. Only the SPI host state is saved.
+  dpi_checkpoint_register(
+      ctx, spidpi_reattach, &ctx->tick,
+      sizeof(struct spidpi_ctx) - offsetof(struct spidpi_ctx, tick));
+
   return (void *)ctx;
 }
 
@@ -211,6 +219,7 @@ void spidpi_close(void *ctx_void) {
   if (!ctx) {
     return;
   }
+  dpi_checkpoint_unregister(ctx);
   fclose(ctx->mon_file);
   free(ctx);
 }
@@ -19,6 +19,7 @@ struct spidpi_ctx {
   FILE *mon_file;
   char mon_pathname[PATH_MAX];
   void *mon;
+  // Saved in simulation checkpoints, along with everything after
   int tick;
   int cpol;
   int cpha;
@@ -55,6 +56,9 @@ void *spidpi_create(const char *name, int mode, int loglevel);
 char spidpi_tick(void *ctx_void, const svLogicVecVal *d2p_data);
 void spidpi_close(void *ctx_void);
 
+// Exported from spidpi.sv
+void spidpi_reattach(void *ctx_void);
+
 // monitor
 void monitor_spi(void *mon_void, FILE *mon_file, int loglevel, int tick,
                  int p2d, int d2p);
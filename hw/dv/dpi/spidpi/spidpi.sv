@@ -23,7 +23,7 @@ module spidpi
   input  logic spi_device_sdo_en_i
 
 );
-  import "DPI-C" function
+  import "DPI-C" context function
     chandle spidpi_create(input string name, input int mode, input int loglevel);
 
   import "DPI-C" function
@@ -34,6 +34,13 @@ module spidpi
 
   chandle ctx;
 
+  // Point ctx at a new context after restoring a simulation checkpoint (see
+  // dpi_checkpoint.h)
+  export "DPI-C" function spidpi_reattach;
+  function automatic void spidpi_reattach(input chandle new_ctx);
+    ctx = new_ctx;
+  endfunction
+
   initial begin
     ctx = spidpi_create(NAME, MODE, LOG_LEVEL);
   end
@@ -4,6 +4,8 @@
 
 #include "uartdpi.h"
 
+#include "dpi_checkpoint.h"
+
 #ifdef __linux__
 #include <pty.h>
 #elif __APPLE__
@@ -19,6 +21,14 @@
 #include <string.h>
 #include <unistd.h>
 
+static uartdpi_output_hook_t output_hook = NULL;
+static void *output_hook_arg = NULL;
+
+void uartdpi_set_output_hook(uartdpi_output_hook_t hook, void *arg) {
+  output_hook = hook;
+  output_hook_arg = arg;
+}
+
 void *uartdpi_create(const char *name, const char *log_file_path) {
   struct uartdpi_ctx *ctx =
       (struct uartdpi_ctx *)malloc(sizeof(struct uartdpi_ctx));
@@ -26,6 +36,9 @@ void *uartdpi_create(const char *name, const char *log_file_path) {
 
   int rv;
 
+  ctx->name = strdup(name);
+  assert(ctx->name);
+
   // Initialize UART pseudo-terminal
   struct termios tty;
   cfmakeraw(&tty);
@@ -75,6 +88,10 @@ void *uartdpi_create(const char *name, const char *log_file_path) {
     }
   }
 
+  // The pseudo-terminal and log file can't be saved in a checkpoint, so a
+  // restored simulation uses new ones. There's no other state to save.
+  dpi_checkpoint_register(ctx, uartdpi_reattach, NULL, 0);
+
   return (void *)ctx;
 }
 
@@ -84,6 +101,8 @@ void uartdpi_close(void *ctx_void) {
     return;
   }
 
+  dpi_checkpoint_unregister(ctx);
+
   close(ctx->host);
   close(ctx->device);
 
@@ -96,6 +115,7 @@ void uartdpi_close(void *ctx_void) {
     }
   }
 
+  free(ctx->name);
   free(ctx);
 }
 
@@ -124,4 +144,8 @@ void uartdpi_write(void *ctx_void, char c) {
     rv = fwrite(&c, sizeof(char), 1, ctx->log_file);
     assert(rv == 1 && "Write to log file failed.");
   }
+
+  if (output_hook) {
+    output_hook(output_hook_arg, ctx->name, c);
+  }
 }
@@ -10,6 +10,7 @@ extern "C" {
 #include <stdio.h>
 
 struct uartdpi_ctx {
+  char *name;
   char ptyname[64];
   int host;
   int device;
@@ -22,5 +23,18 @@ void uartdpi_close(void *ctx_void);
 int uartdpi_can_read(void *ctx_void);
 char uartdpi_read(void *ctx_void);
 void uartdpi_write(void *ctx_void, char c);
+
+// Called with each character that any uartdpi instance receives from the
+// design, together with the instance name and the arg passed to
+// uartdpi_set_output_hook. There is no hook by default; pass NULL to remove it.
+//
+// In a multi-threaded model, instances can write on different model threads
+// at once, so the hook must be safe to call concurrently. The hook itself is
+// read without locking, so set it before the simulation starts.
+typedef void (*uartdpi_output_hook_t)(void *arg, const char *name, char c);
+void uartdpi_set_output_hook(uartdpi_output_hook_t hook, void *arg);
+
+// Exported from uartdpi.sv
+void uartdpi_reattach(void *ctx_void);
 }
 #endif  // OPENTITAN_HW_DV_DPI_UARTDPI_UARTDPI_H_
@@ -19,7 +19,7 @@ module uartdpi #(
   // Min cycles is 2 for fast test mode
   localparam int CYCLES_PER_SYMBOL = FREQ / BAUD;
 
-  import "DPI-C" function
+  import "DPI-C" context function
     chandle uartdpi_create(input string name, input string log_file_path);
 
   import "DPI-C" function
@@ -37,6 +37,13 @@ module uartdpi #(
   chandle ctx;
   string log_file_path = DEFAULT_LOG_FILE;
 
+  // Point ctx at a new context after restoring a simulation checkpoint (see
+  // dpi_checkpoint.h)
+  export "DPI-C" function uartdpi_reattach;
+  function automatic void uartdpi_reattach(input chandle new_ctx);
+    ctx = new_ctx;
+  endfunction
+
   initial begin
     $value$plusargs({"UARTDPI_LOG_", NAME, "=%s"}, log_file_path);
     ctx = uartdpi_create(NAME, log_file_path);
@@ -4,6 +4,8 @@
 
 #include "usbdpi.h"
 
+#include "dpi_checkpoint.h"
+
 #ifdef __linux__
 #include <pty.h>
 #elif __APPLE__
@@ -14,6 +16,7 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <limits.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -80,6 +83,12 @@ void *usbdpi_create(const char *name, int loglevel) {
       "$ tail -f %s\n",
       ctx->mon_pathname, ctx->mon_pathname);
 
+  // The monitor can't be saved in a checkpoint, so a restored simulation
+  // uses a new one. Only the USB host state is saved.
+  dpi_checkpoint_register(
+      ctx, usbdpi_reattach, &ctx->bus_state,
+      sizeof(struct usbdpi_ctx) - offsetof(struct usbdpi_ctx, bus_state));
+
   return (void *)ctx;
 }
 
@@ -966,6 +975,7 @@ void usbdpi_close(void *ctx_void) {
   if (!ctx) {
     return;
   }
+  dpi_checkpoint_unregister(ctx);
   fclose(ctx->mon_file);
   free(ctx);
 }
@@ -124,11 +124,12 @@ typedef enum usbdpi_bus_state {
 } usbdpi_bus_state_t;
 
 struct usbdpi_ctx {
-  usbdpi_bus_state_t bus_state;
   int loglevel;
   FILE *mon_file;
   char mon_pathname[PATH_MAX];
   void *mon;
+  // Saved in simulation checkpoints, along with everything after
+  usbdpi_bus_state_t bus_state;
   int retries;
   int last_pu;
   int lastrxpid;
@@ -156,6 +157,8 @@ void *usbdpi_create(const char *name, int loglevel);
 void usbdpi_device_to_host(void *ctx_void, const svBitVecVal *usb_d2p);
 char usbdpi_host_to_device(void *ctx_void, const svBitVecVal *usb_d2p);
 void usbdpi_close(void *ctx_void);
+// Exported from usbdpi.sv
+void usbdpi_reattach(void *ctx_void);
 uint32_t CRC5(uint32_t dwInput, int iBitcnt);
 uint32_t CRC16(uint8_t *data, int bytes);
 
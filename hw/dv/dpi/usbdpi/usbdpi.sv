@@ -33,7 +33,7 @@ module usbdpi #(
   input  logic pullupdp_d2p,
   input  logic pullupdn_d2p
 );
-  import "DPI-C" function
+  import "DPI-C" context function
     chandle usbdpi_create(input string name, input int loglevel);
 
   import "DPI-C" function
@@ -47,6 +47,13 @@ module usbdpi #(
 
   chandle ctx;
 
+  // Point ctx at a new context after restoring a simulation checkpoint (see
+  // dpi_checkpoint.h)
+  export "DPI-C" function usbdpi_reattach;
+  function automatic void usbdpi_reattach(input chandle new_ctx);
+    ctx = new_ctx;
+  endfunction
+
   initial begin
     ctx = usbdpi_create(NAME, LOG_LEVEL);
     sense_p2d = 1'b0;
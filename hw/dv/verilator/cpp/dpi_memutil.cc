@@ -5,13 +5,11 @@
 #include "dpi_memutil.h"
 
 #include <cassert>
+#include <chrono>
 #include <cstring>
-#include <fcntl.h>
 #include <iostream>
 #include <libelf.h>
 #include <sstream>
-#include <sys/stat.h>
-#include <unistd.h>
 #include <vector>
 
 #include "sv_scoped.h"
@@ -32,37 +30,38 @@ class ElfError : public std::exception {
   std::string msg_;
 };
 
-// Class wrapping an open ELF file
+// Initialise libelf. This only does anything on the first call, so files
+// can then be opened on several threads at once.
+void InitLibelf() {
+  static const bool ok = (elf_version(EV_CURRENT) != EV_NONE);
+  if (!ok) {
+    throw std::runtime_error(elf_errmsg(-1));
+  }
+}
+
+// Class wrapping an ELF file, which is mapped into memory. The mapping is
+// shared with segments staged from the file, so they can refer to its data
+// rather than copying it.
 class ElfFile {
  public:
   ElfFile(const std::string &path) : path_(path) {
     (void)elf_errno();
-    if (elf_version(EV_CURRENT) == EV_NONE) {
-      throw std::runtime_error(elf_errmsg(-1));
-    }
+    InitLibelf();
 
-    fd_ = open(path.c_str(), O_RDONLY, 0);
-    if (fd_ < 0) {
-      throw ElfError(path, "could not open file.");
-    }
+    file_ = std::make_shared<MappedFile>(path);
 
-    ptr_ = elf_begin(fd_, ELF_C_READ, NULL);
+    ptr_ = elf_memory(reinterpret_cast<char *>(file_->Data()), file_->Size());
     if (!ptr_) {
-      close(fd_);
       throw ElfError(path, elf_errmsg(-1));
     }
 
     if (elf_kind(ptr_) != ELF_K_ELF) {
       elf_end(ptr_);
-      close(fd_);
       throw ElfError(path, "not an ELF file.");
     }
   }
 
-  ~ElfFile() {
-    elf_end(ptr_);
-    close(fd_);
-  }
+  ~ElfFile() { elf_end(ptr_); }
 
   size_t GetPhdrNum() {
     size_t phnum;
@@ -79,8 +78,13 @@ class ElfFile {
     return phdrs;
   }
 
+  // Get a view of the file data for a segment
+  StagedSeg GetSegData(const Elf32_Phdr &phdr) const {
+    return StagedSeg(file_, file_->Data() + phdr.p_offset, phdr.p_filesz);
+  }
+
   std::string path_;
-  int fd_;
+  std::shared_ptr<MappedFile> file_;
   Elf *ptr_;
 };
 }  // namespace
@@ -119,12 +123,13 @@ static MemImageType DetectMemImageType(const std::string &filepath) {
   return image_type;
 }
 
-// Generate a single array of bytes representing the contents of PT_LOAD
-// segments of the ELF file. Like objcopy, this generates a single "giant
-// segment" whose first byte corresponds to the first byte of the lowest
-// addressed segment and whose last byte corresponds to the last byte of the
-// highest address.
-static std::vector<uint8_t> FlattenElfFile(const std::string &filepath) {
+// Stage the contents of PT_LOAD segments of the ELF file. Like objcopy, this
+// treats them as a single "giant segment" whose first byte corresponds to the
+// first byte of the lowest addressed segment and whose last byte corresponds
+// to the last byte of the highest address. Segment offsets are relative to
+// the lowest address.
+static StagedMem StageFlatElfFile(const std::string &filepath,
+                                  std::ostream &messages) {
   ElfFile elf(filepath);
 
   size_t phnum = elf.GetPhdrNum();
@@ -132,7 +137,7 @@ static std::vector<uint8_t> FlattenElfFile(const std::string &filepath) {
 
   // To mimic what objcopy does (that is, the binary target of BFD), we need to
   // iterate over all loadable program headers, find the lowest address, and
-  // then copy in our loadable data based on their offset with respect to the
+  // then stage our loadable data based on their offset with respect to the
   // found base address.
 
   bool any = false;
@@ -141,8 +146,8 @@ static std::vector<uint8_t> FlattenElfFile(const std::string &filepath) {
     const Elf32_Phdr &phdr = phdrs[i];
 
     if (phdr.p_type != PT_LOAD) {
-      std::cout << "Program header number " << i << " in `" << filepath
-                << "' is not of type PT_LOAD; ignoring." << std::endl;
+      messages << "Program header number " << i << " in `" << filepath
+               << "' is not of type PT_LOAD; ignoring.\n";
       continue;
     }
 
@@ -170,20 +175,18 @@ static std::vector<uint8_t> FlattenElfFile(const std::string &filepath) {
     any = true;
   }
 
+  StagedMem ret;
+
   // If any is false, there were no segments that contributed to the
   // file. Return nothing.
   if (!any)
-    return std::vector<uint8_t>();
+    return ret;
 
   // Otherwise, we know every valid byte of data has an address in the
   // range [low, high] (inclusive).
   assert(low <= high);
 
-  size_t file_size;
-  const char *file_data = elf_rawfile(elf.ptr_, &file_size);
-  assert(file_data);
-
-  StagedMem ret;
+  size_t file_size = elf.file_->Size();
 
   for (size_t i = 0; i < phnum; i++) {
     const Elf32_Phdr &phdr = phdrs[i];
@@ -193,7 +196,7 @@ static std::vector<uint8_t> FlattenElfFile(const std::string &filepath) {
     }
 
     // Check the segment actually fits in the file
-    if (file_size < phdr.p_offset + phdr.p_filesz) {
+    if (file_size < (size_t)phdr.p_offset + phdr.p_filesz) {
       std::ostringstream oss;
       oss << "phdr for segment " << i << " claims to end at offset 0x"
           << std::hex << phdr.p_offset + phdr.p_filesz
@@ -205,21 +208,60 @@ static std::vector<uint8_t> FlattenElfFile(const std::string &filepath) {
       continue;
 
     uint32_t off = phdr.p_paddr - low;
-    std::vector<uint8_t> seg(phdr.p_filesz, 0);
-    memcpy(&seg[0], file_data + phdr.p_offset, phdr.p_filesz);
-    ret.AddSegment(off, std::move(seg));
+    ret.AddSegment(off, elf.GetSegData(phdr));
   }
 
-  return ret.GetFlat();
+  return ret;
+}
+
+// Write staged data from StageFlatElfFile() to the memory m as a single flat
+// image, starting at word 0. As with StagedMem::GetFlat(), gaps between
+// segments are filled with zeros. Returns the number of words written.
+static uint32_t WriteFlat(const MemArea &m, const StagedMem &staged) {
+  const StagedMem::SegMap &segs = staged.GetSegs();
+  if (segs.size() == 0)
+    return 0;
+
+  uint32_t width = m.GetWidthByte();
+  uint32_t base = staged.GetBounds().first;
+
+  // A segment that starts part of the way through a memory word shares the
+  // word with the data before it. This is unusual, so just write a flattened
+  // copy in that case.
+  for (const auto &pr : segs) {
+    if ((pr.first.lo - base) % width) {
+      std::vector<uint8_t> flat = staged.GetFlat();
+      m.Write(0, flat);
+      return (flat.size() + width - 1) / width;
+    }
+  }
+
+  // Otherwise, write each segment straight from its staged data
+  std::vector<uint8_t> zeros;
+  uint32_t next_word = 0;
+  for (const auto &pr : segs) {
+    const StagedSeg &seg = pr.second;
+    uint32_t lo_word = (pr.first.lo - base) / width;
+    if (next_word < lo_word) {
+      size_t gap_bytes = (size_t)(lo_word - next_word) * width;
+      if (zeros.size() < gap_bytes) {
+        zeros.resize(gap_bytes, 0);
+      }
+      m.Write(next_word, zeros.data(), gap_bytes);
+    }
+    m.Write(lo_word, seg.data(), seg.size());
+    next_word = lo_word + (seg.size() + width - 1) / width;
+  }
+  return next_word;
 }
 
 // Merge seg0 and seg1, overwriting any overlapping data in seg0 with
 // that from seg1. rng0/rng1 is the base and top address of seg0/seg1,
 // respectively.
-static std::vector<uint8_t> MergeSegments(const AddrRange<uint32_t> &rng0,
-                                          std::vector<uint8_t> &&seg0,
-                                          const AddrRange<uint32_t> &rng1,
-                                          std::vector<uint8_t> &&seg1) {
+static StagedSeg MergeSegments(const AddrRange<uint32_t> &rng0,
+                               StagedSeg &&seg0,
+                               const AddrRange<uint32_t> &rng1,
+                               StagedSeg &&seg1) {
   // First, deal with the special case where seg1 completely contains
   // seg0 (since there's no copying needed at all).
   if (rng1.lo <= rng0.lo && rng0.hi <= rng1.hi) {
@@ -233,49 +275,16 @@ static std::vector<uint8_t> MergeSegments(const AddrRange<uint32_t> &rng0,
   assert(seg0.size() <= new_len);
   assert(seg1.size() <= new_len);
 
-  // We want to avoid copying if possible. The next most efficient
-  // case (after just returning seg1) is when seg0 doesn't stick out
-  // the left hand end. In this case, we can extend seg1 to the right
-  // (which might not cause a copy) and then copy just the bytes we
-  // need from seg0.
-  if (rng1.lo <= rng0.lo) {
-    assert(rng1.hi < rng0.hi);
-    assert(new_len == seg1.size() + (rng0.hi - rng1.hi));
-
-    size_t old_len = seg1.size();
-    std::vector<uint8_t> ret = std::move(seg1);
-    ret.resize(new_len);
-
-    // We know that that rng0 isn't completely contained in rng1 and
-    // that rng0 doesn't stick out of the left hand end. That means it
-    // must stick out of the right (so rng1.hi < rng0.hi). However, we
-    // also know that the two ranges overlap, so rng0.lo <= rng1.hi.
-    assert(rng0.lo <= rng1.hi);
-
-    // src_off is the index of the first byte that needs copying from
-    // seg0. Note that this is always at least 1 (because there is an
-    // actual overlap).
-    uint32_t src_off = 1 + (rng1.hi - rng0.lo);
-
-    assert(seg0.size() == src_off + (rng0.hi - rng1.hi));
-
-    memcpy(&ret[old_len], &seg0[src_off], rng0.hi - rng1.hi);
-    return ret;
-  }
-
-  // In this final case, seg0 sticks out the left hand end. That means
-  // we'll have to copy seg1 whatever happens (because we have to
-  // shuffle its elements to the right). Work by resizing seg0 and
-  // then writing seg1 where it's needed.
-  std::vector<uint8_t> ret = std::move(seg0);
-  ret.resize(new_len);
-
-  uint32_t off = rng1.lo - rng0.lo;
-  memcpy(&ret[off], &seg1[0], seg1.size());
-  return ret;
+  // Otherwise, the segments are (at least partly) views of mapped files, so
+  // build the merged data in a new buffer. The segments overlap, so there is
+  // no gap between them.
+  std::vector<uint8_t> ret(new_len);
+  memcpy(&ret[rng0.lo - new_bot], seg0.data(), seg0.size());
+  memcpy(&ret[rng1.lo - new_bot], seg1.data(), seg1.size());
+  return StagedSeg(std::move(ret));
 }
 
-void StagedMem::AddSegment(uint32_t offset, std::vector<uint8_t> &&seg) {
+void StagedMem::AddSegment(uint32_t offset, StagedSeg &&seg) {
   if (seg.empty())
     return;
 
@@ -296,14 +305,14 @@ std::vector<uint8_t> StagedMem::GetFlat() const {
 
   for (const auto &pr : segs_) {
     const AddrRange<uint32_t> &rng = pr.first;
-    const std::vector<uint8_t> &seg = pr.second;
+    const StagedSeg &seg = pr.second;
     assert(seg.size() == 1 + (rng.hi - rng.lo));
     assert(min_addr_ <= rng.lo);
 
     uint32_t off = rng.lo - min_addr_;
     assert(off + seg.size() <= ret.size());
 
-    memcpy(&ret[off], &seg[0], seg.size());
+    memcpy(&ret[off], seg.data(), seg.size());
   }
   return ret;
 }
@@ -373,36 +382,69 @@ void DpiMemUtil::PrintMemRegions() const {
 void DpiMemUtil::LoadFileToNamedMem(bool verbose, const std::string &name,
                                     const std::string &filepath,
                                     MemImageType type) {
+  WriteStagedImage(StageFileForNamedMem(verbose, name, filepath, type));
+}
+
+DpiMemUtil::StagedImage DpiMemUtil::StageFileForNamedMem(
+    bool verbose, const std::string &name, const std::string &filepath,
+    MemImageType type) const {
+  auto start = std::chrono::steady_clock::now();
+
   // If the image type isn't specified, try to figure it out from the file name
   if (type == kMemImageUnknown) {
     type = DetectMemImageType(filepath);
   }
   assert(type != kMemImageUnknown);
 
-  // Search for corresponding registered memory based on the name
-  auto it = name_to_mem_.find(name);
-  if (it == name_to_mem_.end()) {
-    std::ostringstream oss;
-    oss << "`" << name
-        << ("' is not the name of a known memory region. "
-            "Run with --meminit=list to get a list.");
-    throw std::runtime_error(oss.str());
-  }
+  // Check there is a corresponding registered memory
+  const MemArea &mem_area = *mem_areas_[GetRegionByName(name)];
+
+  StagedImage ret;
+  ret.name = name;
+  ret.type = type;
 
+  std::ostringstream messages;
   if (verbose) {
-    std::cout << "Loading data from file `" << filepath << "' into memory `"
-              << name << "'." << std::endl;
+    messages << "Loading data from file `" << filepath << "' into memory `"
+             << name << "'.\n";
   }
 
-  const MemArea &m = *mem_areas_[it->second];
+  switch (type) {
+    case kMemImageElf:
+      ret.elf_data = StageFlatElfFile(filepath, messages);
+      break;
+    case kMemImageVmem:
+      ret.vmem_data =
+          MemArea::ParseVmem(filepath, mem_area.GetWidth(), messages);
+      break;
+    default:
+      assert(0);
+  }
+
+  ret.messages = messages.str();
+  std::chrono::duration<double, std::milli> elapsed =
+      std::chrono::steady_clock::now() - start;
+  ret.stage_ms = elapsed.count();
+  return ret;
+}
+
+void DpiMemUtil::WriteStagedImage(const StagedImage &image) {
+  std::cout << image.messages << std::flush;
+
+  auto start = std::chrono::steady_clock::now();
+  const MemArea &m = *mem_areas_[GetRegionByName(image.name)];
+  uint64_t num_words = 0;
 
   try {
-    switch (type) {
+    switch (image.type) {
       case kMemImageElf:
-        m.Write(0, FlattenElfFile(filepath));
+        num_words = WriteFlat(m, image.elf_data);
         break;
       case kMemImageVmem:
-        m.LoadVmem(filepath);
+        m.WriteVmem(image.vmem_data);
+        for (const MemBlock &block : image.vmem_data) {
+          num_words += block.count;
+        }
         break;
       default:
         assert(0);
@@ -410,9 +452,13 @@ void DpiMemUtil::LoadFileToNamedMem(bool verbose, const std::string &name,
   } catch (const SVScoped::Error &err) {
     std::ostringstream oss;
     oss << "No memory found at `" << err.scope_name_
-        << "' (the scope associated with region `" << name << "').";
+        << "' (the scope associated with region `" << image.name << "').";
     throw std::runtime_error(oss.str());
   }
+
+  std::chrono::duration<double, std::milli> elapsed =
+      std::chrono::steady_clock::now() - start;
+  RecordLoad(image.name, num_words, image.stage_ms, elapsed.count());
 }
 
 void DpiMemUtil::LoadElfToMemories(bool verbose, const std::string &filepath) {
@@ -427,16 +473,20 @@ void DpiMemUtil::LoadElfToMemories(bool verbose, const std::string &filepath) {
     assert(mem_area_it != name_to_mem_.end());
 
     const MemArea &mem_area = *mem_areas_[mem_area_it->second];
+    auto start = std::chrono::steady_clock::now();
+    uint64_t num_words = 0;
 
     for (const auto &seg_pr : staged_mem.GetSegs()) {
       const AddrRange<uint32_t> &seg_rng = seg_pr.first;
-      const std::vector<uint8_t> &seg_data = seg_pr.second;
+      const StagedSeg &seg_data = seg_pr.second;
 
-      assert(seg_rng.lo % mem_area.GetWidthByte() == 0);
-      uint32_t lo_word = seg_rng.lo / mem_area.GetWidthByte();
+      uint32_t width = mem_area.GetWidthByte();
+      assert(seg_rng.lo % width == 0);
+      uint32_t lo_word = seg_rng.lo / width;
+      num_words += (seg_data.size() + width - 1) / width;
 
       try {
-        mem_area.Write(lo_word, seg_data);
+        mem_area.Write(lo_word, seg_data.data(), seg_data.size());
       } catch (const SVScoped::Error &err) {
         std::ostringstream oss;
         oss << "No memory found at `" << err.scope_name_
@@ -446,6 +496,10 @@ void DpiMemUtil::LoadElfToMemories(bool verbose, const std::string &filepath) {
         throw std::runtime_error(oss.str());
       }
     }
+
+    std::chrono::duration<double, std::milli> elapsed =
+        std::chrono::steady_clock::now() - start;
+    RecordLoad(mem_name, num_words, 0, elapsed.count());
   }
 }
 
@@ -458,10 +512,7 @@ void DpiMemUtil::StageElf(bool verbose, const std::string &path) {
   // Allow subclasses to get at the loaded ELF data if they need it
   OnElfLoaded(elf.ptr_);
 
-  size_t file_size;
-  const char *file_data = elf_rawfile(elf.ptr_, &file_size);
-  assert(file_data);
-
+  size_t file_size = elf.file_->Size();
   size_t phnum = elf.GetPhdrNum();
   const Elf32_Phdr *phdrs = elf.GetPhdrs();
 
@@ -514,11 +565,7 @@ void DpiMemUtil::StageElf(bool verbose, const std::string &path) {
     // there isn't one, make a new empty one.
     StagedMem &staged_mem = staging_area_[name];
 
-    const char *seg_data = file_data + phdr.p_offset;
-    std::vector<uint8_t> vec(phdr.p_filesz, 0);
-    memcpy(&vec[0], seg_data, phdr.p_filesz);
-
-    staged_mem.AddSegment(local_base, std::move(vec));
+    staged_mem.AddSegment(local_base, elf.GetSegData(phdr));
   }
 }
 
@@ -569,3 +616,25 @@ size_t DpiMemUtil::GetRegionForSegment(const std::string &path, int seg_idx,
 
   return mem_area_it->second;
 }
+
+size_t DpiMemUtil::GetRegionByName(const std::string &name) const {
+  auto it = name_to_mem_.find(name);
+  if (it == name_to_mem_.end()) {
+    std::ostringstream oss;
+    oss << "`" << name
+        << ("' is not the name of a known memory region. "
+            "Run with --meminit=list to get a list.");
+    throw std::runtime_error(oss.str());
+  }
+  return it->second;
+}
+
+void DpiMemUtil::RecordLoad(const std::string &name, uint64_t num_words,
+                            double stage_ms, double write_ms) {
+  auto pr = load_stats_.emplace(name, LoadStats{0, 0, 0, 0});
+  LoadStats &stats = pr.first->second;
+  ++stats.num_files;
+  stats.num_words += num_words;
+  stats.stage_ms += stage_ms;
+  stats.write_ms += write_ms;
+}
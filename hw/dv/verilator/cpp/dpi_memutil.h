@@ -10,6 +10,7 @@
 #include <svdpi.h>
 #include <vector>
 
+#include "mapped_file.h"
 #include "mem_area.h"
 #include "ranged_map.h"
 
@@ -22,6 +23,33 @@ enum MemImageType {
   kMemImageVmem,
 };
 
+// The data for a staged segment.
+//
+// This is normally a view of the segment's data in the mapped ELF file (which
+// the object keeps mapped), so staging a segment doesn't copy anything. A
+// segment made by merging overlapping segments owns a buffer with the merged
+// data instead.
+class StagedSeg {
+ public:
+  StagedSeg(const std::shared_ptr<MappedFile> &file, const uint8_t *data,
+            size_t size)
+      : file_(file), view_(data), view_size_(size) {}
+
+  explicit StagedSeg(std::vector<uint8_t> &&data)
+      : view_(nullptr), view_size_(0), buf_(std::move(data)) {}
+
+  const uint8_t *data() const { return file_ ? view_ : buf_.data(); }
+  size_t size() const { return file_ ? view_size_ : buf_.size(); }
+  bool empty() const { return size() == 0; }
+  const uint8_t &operator[](size_t idx) const { return data()[idx]; }
+
+ private:
+  std::shared_ptr<MappedFile> file_;
+  const uint8_t *view_;
+  size_t view_size_;
+  std::vector<uint8_t> buf_;
+};
+
 // Staged data for a given memory area.
 //
 // This is represented as an ordered list of disjoint segments (as loaded from
@@ -34,13 +62,13 @@ class StagedMem {
   StagedMem() : min_addr_(~(uint32_t)0), max_addr_(0) {}
 
   // Add a segment to the tracked memory
-  void AddSegment(uint32_t offset, std::vector<uint8_t> &&seg);
+  void AddSegment(uint32_t offset, StagedSeg &&seg);
 
   // Glob together the tracked segments, interspersing them with
   // zeros, and return as a single flat array.
   std::vector<uint8_t> GetFlat() const;
 
-  typedef RangedMap<uint32_t, std::vector<uint8_t>> SegMap;
+  typedef RangedMap<uint32_t, StagedSeg> SegMap;
 
   std::pair<uint32_t, uint32_t> GetBounds() const {
     return std::make_pair(min_addr_, max_addr_);
@@ -56,12 +84,33 @@ class StagedMem {
  * Provide various memory loading utilities for verilog simulations
  *
  * These utilities require the corresponding DPI functions:
- * simutil_memload()
+ * simutil_set_mem_block()
  * simutil_set_mem()
  * to be defined somewhere as SystemVerilog functions.
  */
 class DpiMemUtil {
  public:
+  // The contents of an image file for a named memory, read and parsed by
+  // StageFileForNamedMem() but not yet written to the memory.
+  struct StagedImage {
+    std::string name;                 // Name of the memory
+    MemImageType type;                // kMemImageElf or kMemImageVmem
+    StagedMem elf_data;               // ELF segments, relative to the lowest
+    std::vector<MemBlock> vmem_data;  // Physical words from a vmem file
+    std::string messages;             // To be printed when writing the image
+    double stage_ms;                  // Time taken to stage the file
+  };
+
+  // Statistics about the data loaded into a memory. The time taken to stage
+  // an ELF file that is loaded by LMA isn't included in stage_ms, since that
+  // is done for the whole file rather than per memory.
+  struct LoadStats {
+    unsigned num_files;
+    uint64_t num_words;
+    double stage_ms;
+    double write_ms;
+  };
+
   virtual ~DpiMemUtil() {}
 
   /**
@@ -112,6 +161,28 @@ class DpiMemUtil {
   void LoadFileToNamedMem(bool verbose, const std::string &name,
                           const std::string &filepath, MemImageType type);
 
+  /**
+   * Read and parse the file at filepath, ready to be written to the named
+   * memory with WriteStagedImage(). If type is kMemImageUnknown, the file type
+   * is determined from the path.
+   *
+   * This doesn't touch the simulation, so several files can be staged in
+   * parallel on different threads. If the file can't be staged, raises a
+   * std::exception with information about what happened.
+   */
+  StagedImage StageFileForNamedMem(bool verbose, const std::string &name,
+                                   const std::string &filepath,
+                                   MemImageType type) const;
+
+  /**
+   * Write an image from StageFileForNamedMem() to its memory
+   *
+   * ELF files are written as a single flat image, starting with the lowest
+   * addressed segment at the start of the memory. Vmem files are written by
+   * physical address.
+   */
+  void WriteStagedImage(const StagedImage &image);
+
   /**
    * Load an ELF file, placing segments in memories by LMA.
    *
@@ -133,6 +204,16 @@ class DpiMemUtil {
    */
   const StagedMem &GetMemoryData(const std::string &mem_name) const;
 
+  /**
+   * Get statistics about the data loaded into each memory (by name), since
+   * the last call to ClearLoadStats(). Memories that have not been loaded
+   * have no entry.
+   */
+  const std::map<std::string, LoadStats> &GetLoadStats() const {
+    return load_stats_;
+  }
+  void ClearLoadStats() { load_stats_.clear(); }
+
  protected:
   /**
    * A hook for subclasses to do extra computations with loaded ELF data. This
@@ -150,7 +231,8 @@ class DpiMemUtil {
   std::vector<std::string> names_;
 
   std::map<std::string, size_t> name_to_mem_;
-  RangedMap<uint32_t, size_t> addr_to_mem_;
+  // Only changed when a memory is registered, so use the faster map to search
+  SortedRangedMap<uint32_t, size_t> addr_to_mem_;
 
   // Staging area, loaded by StageElf. The map is keyed by names of memories
   // stored in name_to_mem_. We also ensure that every segment in a StagedMem
@@ -159,6 +241,16 @@ class DpiMemUtil {
   std::map<std::string, StagedMem> staging_area_;
   const StagedMem empty_;
 
+  std::map<std::string, LoadStats> load_stats_;
+
+  // Add a load to the statistics for the named memory
+  void RecordLoad(const std::string &name, uint64_t num_words, double stage_ms,
+                  double write_ms);
+
+  // Find the index of the memory area with the given name. Raises a
+  // std::exception if there is none.
+  size_t GetRegionByName(const std::string &name) const;
+
   /**
    * Find the index of a memory area containing the given segment's addresses.
    * Raises a std::exception if none is found.
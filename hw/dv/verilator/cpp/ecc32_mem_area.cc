@@ -5,6 +5,7 @@
 #include "ecc32_mem_area.h"
 #include "secded_enc.h"
 
+#include <algorithm>
 #include <cassert>
 #include <cstring>
 #include <stdexcept>
@@ -24,7 +25,7 @@ Ecc32MemArea::Ecc32MemArea(const std::string &scope, uint32_t size,
   assert(phy_width_bits <= SV_MEM_WIDTH_BITS);
 }
 
-void Ecc32MemArea::LoadVmem(const std::string &path) const {
+void Ecc32MemArea::WriteVmem(const std::vector<MemBlock> &blocks) const {
   throw std::runtime_error(
       "vmem files are not supported for memories with ECC bits");
 }
@@ -41,12 +42,16 @@ Ecc32MemArea::EccWords Ecc32MemArea::ReadWithIntegrity(
   EccWords ret;
   ret.reserve(num_words);
 
-  for (uint32_t i = 0; i < num_words; ++i) {
-    uint32_t src_word = word_offset + i;
-    uint32_t phys_addr = ToPhysAddr(src_word);
+  MemBlock block;
+
+  for (uint32_t i = 0; i < num_words; i += SV_MEM_BLOCK_WORDS) {
+    uint32_t count = std::min(num_words - i, (uint32_t)SV_MEM_BLOCK_WORDS);
+    ReadBlock(block, word_offset + i, count);
 
-    ReadToMinibuf(minibuf, phys_addr);
-    ReadBufferWithIntegrity(ret, minibuf, src_word);
+    for (uint32_t j = 0; j < count; ++j) {
+      memcpy(minibuf, block.Word(j), SV_MEM_WIDTH_BITS / 8);
+      ReadBufferWithIntegrity(ret, minibuf, word_offset + i + j);
+    }
   }
 
   return ret;
@@ -65,13 +70,16 @@ void Ecc32MemArea::WriteWithIntegrity(uint32_t word_offset,
   assert((data.size() % width_32) == 0);
   assert(word_offset + to_write <= num_words_);
 
+  MemBlock block;
+
   for (uint32_t i = 0; i < to_write; ++i) {
     uint32_t dst_word = word_offset + i;
     uint32_t phys_addr = ToPhysAddr(dst_word);
 
     WriteBufferWithIntegrity(minibuf, data, i * width_32, dst_word);
-    WriteFromMinibuf(phys_addr, minibuf, dst_word);
+    AddToBlock(block, phys_addr, minibuf, dst_word);
   }
+  FlushBlock(block);
 }
 
 // Zero enough of the buffer to fill it with a word using insert_bits
@@ -154,12 +162,32 @@ static uint8_t extract_bits(const uint8_t *buf, unsigned bit_idx,
 }
 
 void Ecc32MemArea::WriteBuffer(uint8_t buf[SV_MEM_WIDTH_BYTES],
-                               const std::vector<uint8_t> &data,
-                               size_t start_idx, uint32_t dst_word) const {
+                               const uint8_t *src, size_t src_len,
+                               uint32_t dst_word) const {
+  uint32_t num_words = width_byte_ / 4;
+  assert(num_words <= kMaxWordsPerRow);
+
+  // Zero-extend a partial word at the end of the data
+  uint8_t padded[SV_MEM_WIDTH_BYTES];
+  if (src_len < width_byte_) {
+    memset(padded, 0, sizeof padded);
+    memcpy(padded, src, src_len);
+    src = padded;
+  }
+
+  // Gather the 32-bit words for the row and encode them in one call
+  uint32_t words[kMaxWordsPerRow];
+  uint8_t check_bits[kMaxWordsPerRow];
+  for (uint32_t i = 0; i < num_words; ++i) {
+    const uint8_t *src_data = &src[4 * i];
+    words[i] = (uint32_t)src_data[0] | ((uint32_t)src_data[1] << 8) |
+               ((uint32_t)src_data[2] << 16) | ((uint32_t)src_data[3] << 24);
+  }
+  enc_secded_inv_39_32_buf(words, check_bits, num_words);
+
   zero_buffer(buf, width_byte_);
-  for (uint32_t i = 0; i < width_byte_ / 4; ++i) {
-    const uint8_t *src_data = &data[start_idx + 4 * i];
-    insert_word(buf, 39 * i, src_data, enc_secded_inv_39_32(src_data));
+  for (uint32_t i = 0; i < num_words; ++i) {
+    insert_word(buf, 39 * i, &src[4 * i], check_bits[i]);
   }
 }
 
@@ -198,19 +226,25 @@ void Ecc32MemArea::ReadBuffer(std::vector<uint8_t> &data,
 void Ecc32MemArea::ReadBufferWithIntegrity(
     EccWords &data, const uint8_t buf[SV_MEM_WIDTH_BYTES],
     uint32_t src_word) const {
-  for (uint32_t i = 0; i < width_byte_ / 4; ++i) {
-    uint8_t buf32[4];
+  uint32_t num_words = width_byte_ / 4;
+  assert(num_words <= kMaxWordsPerRow);
+
+  uint32_t words[kMaxWordsPerRow];
+  uint8_t check_bits[kMaxWordsPerRow];
+  for (uint32_t i = 0; i < num_words; ++i) {
     uint32_t w32 = 0;
     for (uint32_t j = 0; j < 4; ++j) {
-      uint8_t byte = extract_bits(buf, 39 * i + 8 * j, 8);
-      buf32[j] = byte;
-      w32 |= (uint32_t)byte << 8 * j;
+      w32 |= (uint32_t)extract_bits(buf, 39 * i + 8 * j, 8) << 8 * j;
     }
+    words[i] = w32;
+    check_bits[i] = extract_bits(buf, 39 * i + 32, 7);
+  }
 
-    uint8_t exp_check_bits = enc_secded_inv_39_32(buf32);
-    uint8_t check_bits = extract_bits(buf, 39 * i + 32, 7);
-    bool good = check_bits == exp_check_bits;
+  // Check the whole row at once. A word is good if its syndrome is zero.
+  uint8_t syndromes[kMaxWordsPerRow];
+  syndrome_secded_inv_39_32_buf(words, check_bits, syndromes, num_words);
 
-    data.push_back(std::make_pair(good, w32));
+  for (uint32_t i = 0; i < num_words; ++i) {
+    data.push_back(std::make_pair(syndromes[i] == 0, words[i]));
   }
 }
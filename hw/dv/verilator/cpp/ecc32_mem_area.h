@@ -22,7 +22,9 @@ class Ecc32MemArea : public MemArea {
    */
   Ecc32MemArea(const std::string &scope, uint32_t size, uint32_t width_32);
 
-  void LoadVmem(const std::string &path) const override;
+  // Vmem files hold raw physical words, which doesn't make sense when there
+  // are ECC bits to compute. This throws a std::runtime_error.
+  void WriteVmem(const std::vector<MemBlock> &blocks) const override;
 
   typedef std::pair<bool, uint32_t> EccWord;
   typedef std::vector<EccWord> EccWords;
@@ -38,7 +40,8 @@ class Ecc32MemArea : public MemArea {
    *
    * @param num_words   The number of words to read.
    */
-  EccWords ReadWithIntegrity(uint32_t word_offset, uint32_t num_words) const;
+  virtual EccWords ReadWithIntegrity(uint32_t word_offset,
+                                     uint32_t num_words) const;
 
   /** Write data with validity bits, starting at the given offset
    *
@@ -51,12 +54,15 @@ class Ecc32MemArea : public MemArea {
    *
    * @param data        The data that should be written.
    */
-  void WriteWithIntegrity(uint32_t word_offset, const EccWords &data) const;
+  virtual void WriteWithIntegrity(uint32_t word_offset,
+                                  const EccWords &data) const;
 
  protected:
-  void WriteBuffer(uint8_t buf[SV_MEM_WIDTH_BYTES],
-                   const std::vector<uint8_t> &data, size_t start_idx,
-                   uint32_t dst_word) const override;
+  // The most 39-bit words that fit in one physical memory row
+  static const uint32_t kMaxWordsPerRow = SV_MEM_WIDTH_BITS / 39;
+
+  void WriteBuffer(uint8_t buf[SV_MEM_WIDTH_BYTES], const uint8_t *src,
+                   size_t src_len, uint32_t dst_word) const override;
 
   void ReadBuffer(std::vector<uint8_t> &data,
                   const uint8_t buf[SV_MEM_WIDTH_BYTES],
@@ -0,0 +1,59 @@
+// Copyright lowRISC contributors.
+// Licensed under the Apache License, Version 2.0, see LICENSE for details.
+// SPDX-License-Identifier: Apache-2.0
+
+#include "mapped_file.h"
+
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sstream>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+MappedFile::MappedFile(const std::string &path)
+    : path_(path), data_(nullptr), size_(0) {
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    std::ostringstream oss;
+    oss << "Could not open `" << path << "': " << strerror(errno) << ".";
+    throw std::runtime_error(oss.str());
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    int err = errno;
+    close(fd);
+    std::ostringstream oss;
+    oss << "Could not stat `" << path << "': " << strerror(err) << ".";
+    throw std::runtime_error(oss.str());
+  }
+
+  // mmap doesn't allow empty mappings. An empty file has no data.
+  if (st.st_size == 0) {
+    close(fd);
+    return;
+  }
+
+  void *addr = mmap(nullptr, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE,
+                    fd, 0);
+  int err = errno;
+  // The mapping stays valid after the file is closed.
+  close(fd);
+  if (addr == MAP_FAILED) {
+    std::ostringstream oss;
+    oss << "Could not map `" << path << "': " << strerror(err) << ".";
+    throw std::runtime_error(oss.str());
+  }
+
+  data_ = static_cast<uint8_t *>(addr);
+  size_ = st.st_size;
+}
+
+MappedFile::~MappedFile() {
+  if (data_) {
+    munmap(data_, size_);
+  }
+}
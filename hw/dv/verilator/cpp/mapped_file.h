@@ -0,0 +1,42 @@
+// Copyright lowRISC contributors.
+// Licensed under the Apache License, Version 2.0, see LICENSE for details.
+// SPDX-License-Identifier: Apache-2.0
+#ifndef OPENTITAN_HW_DV_VERILATOR_CPP_MAPPED_FILE_H_
+#define OPENTITAN_HW_DV_VERILATOR_CPP_MAPPED_FILE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/**
+ * A file that has been mapped into memory
+ *
+ * The mapping is private and writable, so the contents can be modified in
+ * place (libelf might do this, for example) without changing the file on
+ * disk. Pages are only copied if they are written.
+ */
+class MappedFile {
+ public:
+  /**
+   * Map the file at path. Throws a std::runtime_error if it can't be opened
+   * or mapped.
+   */
+  explicit MappedFile(const std::string &path);
+  ~MappedFile();
+
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+
+  const std::string &GetPath() const { return path_; }
+
+  // The file contents. Data() is null if the file is empty.
+  uint8_t *Data() const { return data_; }
+  size_t Size() const { return size_; }
+
+ private:
+  std::string path_;
+  uint8_t *data_;
+  size_t size_;
+};
+
+#endif  // OPENTITAN_HW_DV_VERILATOR_CPP_MAPPED_FILE_H_
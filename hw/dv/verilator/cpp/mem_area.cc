@@ -8,25 +8,35 @@
 #include <cassert>
 #include <cstring>
 #include <sstream>
+#include <stdexcept>
 
+#include "mapped_file.h"
 #include "sv_scoped.h"
 
 // DPI exports, defined in prim_util_memload.svh
 extern "C" {
-void simutil_memload(const char *file);
 int simutil_set_mem(int index, const svBitVecVal *val);
 int simutil_get_mem(int index, svBitVecVal *val);
+int simutil_set_mem_block(int count, const svBitVecVal *indices,
+                          const svBitVecVal *vals);
+int simutil_get_mem_block(int count, const svBitVecVal *indices,
+                          svBitVecVal *vals);
 }
 
+bool MemArea::block_transfers_ = true;
+
 MemArea::MemArea(const std::string &scope, uint32_t num_words,
                  uint32_t width_byte)
-    : scope_(scope), num_words_(num_words), width_byte_(width_byte) {
+    : scope_(scope),
+      num_words_(num_words),
+      width_byte_(width_byte),
+      sv_scope_(nullptr) {
   assert(0 < num_words);
   assert(width_byte <= SV_MEM_WIDTH_BYTES);
 }
 
-void MemArea::Write(uint32_t word_offset,
-                    const std::vector<uint8_t> &data) const {
+void MemArea::Write(uint32_t word_offset, const uint8_t *data,
+                    size_t len) const {
   // This "mini buffer" is used to transfer each write to SystemVerilog.
   // `simutil_set_mem` takes a fixed SV_MEM_WIDTH_BITS-bit vector but it will
   // only use the bits required for the RAM width. As an example, for a 32-bit
@@ -38,16 +48,23 @@ void MemArea::Write(uint32_t word_offset,
   memset(minibuf, 0, sizeof minibuf);
   assert(width_byte_ <= sizeof minibuf);
 
-  uint32_t data_words = (data.size() + width_byte_ - 1) / width_byte_;
+  uint32_t data_words = (len + width_byte_ - 1) / width_byte_;
   assert(word_offset + data_words <= num_words_);
 
+  // Words are collected in a MemBlock and sent to SystemVerilog up to
+  // SV_MEM_BLOCK_WORDS at a time.
+  MemBlock block;
+
   for (uint32_t i = 0; i < data_words; ++i) {
     uint32_t dst_word = word_offset + i;
     uint32_t phys_addr = ToPhysAddr(dst_word);
 
-    WriteBuffer(minibuf, data, i * width_byte_, dst_word);
-    WriteFromMinibuf(phys_addr, minibuf, dst_word);
+    size_t start_idx = (size_t)i * width_byte_;
+    size_t src_len = std::min(len - start_idx, (size_t)width_byte_);
+    WriteBuffer(minibuf, data + start_idx, src_len, dst_word);
+    AddToBlock(block, phys_addr, minibuf, dst_word);
   }
+  FlushBlock(block);
 }
 
 std::vector<uint8_t> MemArea::Read(uint32_t word_offset,
@@ -65,32 +82,242 @@ std::vector<uint8_t> MemArea::Read(uint32_t word_offset,
   std::vector<uint8_t> ret;
   ret.reserve(num_bytes);
 
-  for (uint32_t i = 0; i < num_words; ++i) {
-    uint32_t src_word = word_offset + i;
-    uint32_t phys_addr = ToPhysAddr(src_word);
+  MemBlock block;
+
+  for (uint32_t i = 0; i < num_words; i += SV_MEM_BLOCK_WORDS) {
+    uint32_t count = std::min(num_words - i, (uint32_t)SV_MEM_BLOCK_WORDS);
+    ReadBlock(block, word_offset + i, count);
 
-    ReadToMinibuf(minibuf, phys_addr);
-    ReadBuffer(ret, minibuf, src_word);
+    for (uint32_t j = 0; j < count; ++j) {
+      memcpy(minibuf, block.Word(j), SV_MEM_WIDTH_BITS / 8);
+      ReadBuffer(ret, minibuf, word_offset + i + j);
+    }
   }
 
   return ret;
 }
 
-void MemArea::LoadVmem(const std::string &path) const {
-  SVScoped scoped(scope_.c_str());
-  // TODO: Add error handling.
-  simutil_memload(path.c_str());
+namespace {
+// Values in HexTable for characters that aren't hex digits
+const int8_t kHexSep = -1;  // '_', which may separate digits
+const int8_t kHexBad = -2;  // Anything else
+
+// A table giving the value of each character as a hex digit. Like the X and
+// Z bits that they stand for in a two-state simulator, the digits x and z
+// read as zero.
+struct HexTable {
+  int8_t vals[256];
+
+  HexTable() {
+    for (int i = 0; i < 256; ++i) {
+      vals[i] = kHexBad;
+    }
+    for (int i = 0; i < 10; ++i) {
+      vals['0' + i] = i;
+    }
+    for (int i = 0; i < 6; ++i) {
+      vals['a' + i] = 10 + i;
+      vals['A' + i] = 10 + i;
+    }
+    vals['x'] = vals['X'] = vals['z'] = vals['Z'] = 0;
+    vals['_'] = kHexSep;
+  }
+};
+
+const int8_t *GetHexTable() {
+  static const HexTable table;
+  return table.vals;
+}
+
+bool IsVmemSpace(char c) {
+  return c == ' ' || c == '\n' || c == '\t' || c == '\r' || c == '\f' ||
+         c == '\v';
+}
+
+[[noreturn]] void ThrowVmemError(const std::string &path, unsigned line,
+                                 const std::string &msg) {
+  std::ostringstream oss;
+  oss << "Failed to parse vmem file at `" << path << "', line " << line << ": "
+      << msg;
+  throw std::runtime_error(oss.str());
+}
+}  // namespace
+
+std::vector<MemBlock> MemArea::ParseVmem(const std::string &path,
+                                         uint32_t width_bit,
+                                         std::ostream &warnings) {
+  MappedFile file(path);
+  const char *p = reinterpret_cast<const char *>(file.Data());
+  const char *end = p + file.Size();
+  const int8_t *hex = GetHexTable();
+
+  std::vector<MemBlock> blocks;
+  uint32_t addr = 0;
+  unsigned line = 1;
+
+  // Words with set bits above width_bit (the first one's line and how many)
+  unsigned wide_line = 0;
+  unsigned num_wide = 0;
+
+  while (p < end) {
+    char c = *p;
+    if (IsVmemSpace(c)) {
+      line += (c == '\n');
+      ++p;
+      continue;
+    }
+
+    if (c == '/') {
+      if (p + 1 < end && p[1] == '/') {
+        const void *nl = memchr(p, '\n', end - p);
+        p = nl ? static_cast<const char *>(nl) : end;
+        continue;
+      }
+      if (p + 1 < end && p[1] == '*') {
+        unsigned start_line = line;
+        for (p += 2; p + 1 < end && !(p[0] == '*' && p[1] == '/'); ++p) {
+          line += (*p == '\n');
+        }
+        if (p + 1 >= end) {
+          ThrowVmemError(path, start_line, "unterminated comment.");
+        }
+        p += 2;
+        continue;
+      }
+      ThrowVmemError(path, line, "unexpected `/'.");
+    }
+
+    // Everything else is an address (@ followed by hex digits) or a word
+    bool is_addr = (c == '@');
+    if (is_addr) {
+      ++p;
+    }
+    const char *tok = p;
+    while (p < end && hex[(uint8_t)*p] != kHexBad) {
+      ++p;
+    }
+    if (p < end && !IsVmemSpace(*p) && *p != '/') {
+      std::ostringstream oss;
+      oss << "unexpected character `" << *p << "'.";
+      ThrowVmemError(path, line, oss.str());
+    }
+
+    if (is_addr) {
+      uint64_t new_addr = 0;
+      bool any_digits = false;
+      for (const char *q = tok; q != p; ++q) {
+        int8_t val = hex[(uint8_t)*q];
+        if (val == kHexSep)
+          continue;
+        new_addr = (new_addr << 4) | val;
+        any_digits = true;
+        if (new_addr >> 32) {
+          ThrowVmemError(path, line, "address doesn't fit in 32 bits.");
+        }
+      }
+      if (!any_digits) {
+        ThrowVmemError(path, line, "expected an address after `@'.");
+      }
+      addr = new_addr;
+      continue;
+    }
+
+    if (blocks.empty() || blocks.back().count == SV_MEM_BLOCK_WORDS) {
+      blocks.emplace_back();
+      blocks.back().first_word = addr;
+    }
+    MemBlock &block = blocks.back();
+
+    // Fill in the (zeroed) word from its least significant digit upwards
+    uint8_t *word = block.Word(block.count);
+    unsigned num_digits = 0;
+    unsigned num_bits = 0;
+    for (const char *q = p; q != tok;) {
+      int8_t val = hex[(uint8_t)*--q];
+      if (val == kHexSep)
+        continue;
+      if (num_digits == SV_MEM_WIDTH_BITS / 4) {
+        if (val == 0)
+          continue;
+        std::ostringstream oss;
+        oss << "word is wider than " << SV_MEM_WIDTH_BITS << " bits.";
+        ThrowVmemError(path, line, oss.str());
+      }
+      word[num_digits / 2] |= val << (4 * (num_digits % 2));
+      if (val) {
+        num_bits = 4 * num_digits + 32 - __builtin_clz(val);
+      }
+      ++num_digits;
+    }
+    if (num_digits == 0) {
+      ThrowVmemError(path, line, "expected a hex word.");
+    }
+    if (num_bits > width_bit && num_wide++ == 0) {
+      wide_line = line;
+    }
+
+    block.indices[block.count++] = addr++;
+  }
+
+  if (num_wide) {
+    warnings << "WARNING: vmem file at `" << path << "', line " << wide_line
+             << ": word is wider than the memory's " << width_bit << " bits";
+    if (num_wide > 1) {
+      warnings << " (as are " << num_wide - 1 << " later words)";
+    }
+    warnings << ". The extra bits will be discarded.\n";
+  }
+
+  return blocks;
+}
+
+void MemArea::WriteVmem(const std::vector<MemBlock> &blocks) const {
+  for (const MemBlock &block : blocks) {
+    for (uint32_t i = 0; i < block.count; ++i) {
+      if (block.indices[i] >= num_words_) {
+        std::ostringstream oss;
+        oss << "vmem data at index 0x" << std::hex << block.indices[i]
+            << " is outside the memory at `" << scope_ << "', which has 0x"
+            << num_words_ << " words.";
+        throw std::runtime_error(oss.str());
+      }
+    }
+    WriteBlock(block);
+  }
+}
+
+std::vector<MemBlock> MemArea::ReadRaw() const {
+  std::vector<MemBlock> blocks((num_words_ + SV_MEM_BLOCK_WORDS - 1) /
+                               SV_MEM_BLOCK_WORDS);
+  for (size_t i = 0; i < blocks.size(); ++i) {
+    uint32_t first_word = i * SV_MEM_BLOCK_WORDS;
+    uint32_t count =
+        std::min(num_words_ - first_word, (uint32_t)SV_MEM_BLOCK_WORDS);
+
+    // Read physical words in order, without going through ToPhysAddr(), so
+    // that a scrambled memory doesn't need its key and nonce here.
+    blocks[i].count = count;
+    blocks[i].first_word = first_word;
+    for (uint32_t j = 0; j < count; ++j) {
+      blocks[i].indices[j] = first_word + j;
+    }
+    ReadBlockIndices(blocks[i]);
+  }
+  return blocks;
+}
+
+void MemArea::WriteRaw(const std::vector<MemBlock> &blocks) const {
+  for (const MemBlock &block : blocks) {
+    WriteBlock(block);
+  }
 }
 
-void MemArea::WriteBuffer(uint8_t buf[SV_MEM_WIDTH_BYTES],
-                          const std::vector<uint8_t> &data, size_t start_idx,
-                          uint32_t dst_word) const {
-  size_t words_left = data.size() - start_idx;
-  size_t to_copy = std::min(words_left, (size_t)width_byte_);
-  if (to_copy < width_byte_) {
+void MemArea::WriteBuffer(uint8_t buf[SV_MEM_WIDTH_BYTES], const uint8_t *src,
+                          size_t src_len, uint32_t dst_word) const {
+  if (src_len < width_byte_) {
     memset(buf, 0, SV_MEM_WIDTH_BYTES);
   }
-  memcpy(buf, &data[start_idx], to_copy);
+  memcpy(buf, src, src_len);
 }
 
 void MemArea::ReadBuffer(std::vector<uint8_t> &data,
@@ -101,8 +328,19 @@ void MemArea::ReadBuffer(std::vector<uint8_t> &data,
               std::back_inserter(data));
 }
 
+svScope MemArea::GetSvScope() const {
+  // A relative scope name is resolved against whatever scope is current at
+  // the time of the call, so we can't cache the result.
+  if (!scope_.empty() && scope_[0] == '.')
+    return SVScoped::Resolve(scope_);
+
+  if (!sv_scope_)
+    sv_scope_ = SVScoped::Resolve(scope_);
+  return sv_scope_;
+}
+
 void MemArea::ReadToMinibuf(uint8_t *minibuf, uint32_t phys_addr) const {
-  SVScoped scoped(scope_);
+  SVScoped scoped(GetSvScope());
   if (!simutil_get_mem(phys_addr, (svBitVecVal *)minibuf)) {
     std::ostringstream oss;
     oss << "Could not read memory word at physical index 0x" << std::hex
@@ -113,7 +351,7 @@ void MemArea::ReadToMinibuf(uint8_t *minibuf, uint32_t phys_addr) const {
 
 void MemArea::WriteFromMinibuf(uint32_t phys_addr, const uint8_t *minibuf,
                                uint32_t dst_word) const {
-  SVScoped scoped(scope_);
+  SVScoped scoped(GetSvScope());
   if (!simutil_set_mem(phys_addr, (const svBitVecVal *)minibuf)) {
     std::ostringstream oss;
     oss << "Could not set memory at byte offset 0x" << std::hex
@@ -121,3 +359,81 @@ void MemArea::WriteFromMinibuf(uint32_t phys_addr, const uint8_t *minibuf,
     throw std::runtime_error(oss.str());
   }
 }
+
+void MemArea::AddToBlock(MemBlock &block, uint32_t phys_addr,
+                         const uint8_t *minibuf, uint32_t dst_word) const {
+  if (block.count == SV_MEM_BLOCK_WORDS) {
+    FlushBlock(block);
+  }
+  if (block.count == 0) {
+    block.first_word = dst_word;
+  }
+
+  block.indices[block.count] = phys_addr;
+  memcpy(block.Word(block.count), minibuf, SV_MEM_WIDTH_BITS / 8);
+  ++block.count;
+}
+
+void MemArea::FlushBlock(MemBlock &block) const {
+  WriteBlock(block);
+  block.count = 0;
+}
+
+void MemArea::WriteBlock(const MemBlock &block) const {
+  if (block.count == 0)
+    return;
+
+  if (!block_transfers_) {
+    uint8_t minibuf[SV_MEM_WIDTH_BYTES];
+    memset(minibuf, 0, sizeof minibuf);
+    for (uint32_t i = 0; i < block.count; ++i) {
+      memcpy(minibuf, block.Word(i), SV_MEM_WIDTH_BITS / 8);
+      WriteFromMinibuf(block.indices[i], minibuf, block.first_word + i);
+    }
+    return;
+  }
+
+  SVScoped scoped(GetSvScope());
+  if (!simutil_set_mem_block(block.count, block.indices, block.vals)) {
+    std::ostringstream oss;
+    oss << "Could not set memory block of " << std::dec << block.count
+        << " words at byte offset 0x" << std::hex
+        << block.first_word * width_byte_ << ".";
+    throw std::runtime_error(oss.str());
+  }
+}
+
+void MemArea::ReadBlock(MemBlock &block, uint32_t first_word,
+                        uint32_t count) const {
+  assert(count <= SV_MEM_BLOCK_WORDS);
+
+  block.count = count;
+  block.first_word = first_word;
+  for (uint32_t i = 0; i < count; ++i) {
+    block.indices[i] = ToPhysAddr(first_word + i);
+  }
+  ReadBlockIndices(block);
+}
+
+void MemArea::ReadBlockIndices(MemBlock &block) const {
+  assert(block.count <= SV_MEM_BLOCK_WORDS);
+
+  uint32_t count = block.count;
+  if (!block_transfers_) {
+    uint8_t minibuf[SV_MEM_WIDTH_BYTES];
+    for (uint32_t i = 0; i < count; ++i) {
+      ReadToMinibuf(minibuf, block.indices[i]);
+      memcpy(block.Word(i), minibuf, SV_MEM_WIDTH_BITS / 8);
+    }
+    return;
+  }
+
+  SVScoped scoped(GetSvScope());
+  if (!simutil_get_mem_block(count, block.indices, block.vals)) {
+    std::ostringstream oss;
+    oss << "Could not read memory block of " << std::dec << count
+        << " words at byte offset 0x" << std::hex
+        << block.first_word * width_byte_ << ".";
+    throw std::runtime_error(oss.str());
+  }
+}
@@ -6,7 +6,10 @@
 #define OPENTITAN_HW_DV_VERILATOR_CPP_MEM_AREA_H_
 
 #include <cstdint>
+#include <cstring>
+#include <iostream>
 #include <string>
+#include <svdpi.h>
 #include <vector>
 
 // This is the maximum width of a memory that's supported by the code in
@@ -18,6 +21,45 @@
 // using the svBitVecVal type, we have to round up to the next 32-bit word.
 #define SV_MEM_WIDTH_BYTES (4 * ((SV_MEM_WIDTH_BITS + 31) / 32))
 
+// This is the maximum number of memory words that can be transferred with a
+// single call to simutil_set_mem_block or simutil_get_mem_block (defined in
+// prim_util_memload.svh).
+#define SV_MEM_BLOCK_WORDS 64
+
+// The number of bytes in the data argument of simutil_set_mem_block and
+// simutil_get_mem_block. Word i of the block starts at bit
+// SV_MEM_WIDTH_BITS * i (which is byte-aligned because SV_MEM_WIDTH_BITS is a
+// multiple of 8).
+#define SV_MEM_BLOCK_BYTES (SV_MEM_BLOCK_WORDS * (SV_MEM_WIDTH_BITS / 8))
+
+/**
+ * A block of memory words that is transferred between C++ and SystemVerilog
+ * with a single DPI call.
+ *
+ * Each entry has a physical index into the memory array and up to
+ * SV_MEM_WIDTH_BITS bits of data. The indices needn't be contiguous.
+ */
+struct MemBlock {
+  MemBlock() : count(0), first_word(0) {
+    memset(indices, 0, sizeof indices);
+    memset(vals, 0, sizeof vals);
+  }
+
+  // Return a pointer to the data for the i'th word in the block
+  uint8_t *Word(uint32_t i) {
+    return reinterpret_cast<uint8_t *>(vals) + i * (SV_MEM_WIDTH_BITS / 8);
+  }
+  const uint8_t *Word(uint32_t i) const {
+    return reinterpret_cast<const uint8_t *>(vals) +
+           i * (SV_MEM_WIDTH_BITS / 8);
+  }
+
+  uint32_t count;       ///< Number of valid entries
+  uint32_t first_word;  ///< Logical address of the first entry
+  svBitVecVal indices[SV_MEM_BLOCK_WORDS];
+  svBitVecVal vals[SV_MEM_BLOCK_BYTES / 4];
+};
+
 /**
  * A "memory area", representing a memory in the simulated design.
  */
@@ -26,9 +68,9 @@ class MemArea {
   /** Constructor
    *
    * @param scope  The SystemVerilog scope where the instantiated memory can be
-   *               found. This needs to support the DPI-C interfaces \c
-   *               simutil_memload and \c simutil_set_mem (used for vmem and
-   *               ELF files, respectively).
+   *               found. This needs to support the DPI-C interfaces defined
+   *               in prim_util_memload.svh (\c simutil_set_mem_block and
+   *               friends).
    *
    * @param size   The size of the memory in bytes (must be positive and a
    *               multiple of \p width_byte)
@@ -42,8 +84,9 @@ class MemArea {
   /** Write data to this memory area at the given word offset
    *
    * This assumes that the result will fit in the memory. If the scope cannot
-   * be set, this throws an SVScoped::Error. If a call to \c simutil_set_mem
-   * fails, this throws a \c std::runtime_error.
+   * be set, this throws an SVScoped::Error. If a call to \c
+   * simutil_set_mem_block (or \c simutil_set_mem) fails, this throws a \c
+   * std::runtime_error.
    *
    * @param word_offset The offset, in words, of the first word that should be
    *                    written.
@@ -51,9 +94,15 @@ class MemArea {
    * @param data        The data that should be written. If the length is not a
    *                    multiple of \p width_byte, the last word will be
    *                    zero-extended.
+   *
+   * @param len         The length of \p data in bytes.
    */
-  virtual void Write(uint32_t word_offset,
-                     const std::vector<uint8_t> &data) const;
+  virtual void Write(uint32_t word_offset, const uint8_t *data,
+                     size_t len) const;
+
+  void Write(uint32_t word_offset, const std::vector<uint8_t> &data) const {
+    Write(word_offset, data.data(), data.size());
+  }
 
   /** Read data from this memory area, starting at the given offset.
    *
@@ -61,7 +110,8 @@ class MemArea {
    * memory. Returns a vector with <tt>num_words * width_byte_</tt> elements.
    *
    * If the scope cannot be set, this throws an SVScoped::Error. If a call to
-   * simutil_get_mem fails, this throws a std::runtime_error.
+   * simutil_get_mem_block (or simutil_get_mem) fails, this throws a
+   * std::runtime_error.
    *
    * @param word_offset The offset, in words, of the first word that should be
    *                    written.
@@ -71,8 +121,47 @@ class MemArea {
   virtual std::vector<uint8_t> Read(uint32_t word_offset,
                                     uint32_t num_words) const;
 
-  /** Use \c simutil_memload to load a vmem file into the memory */
-  virtual void LoadVmem(const std::string &path) const;
+  /** Parse a vmem file into blocks of physical memory words
+   *
+   * Like \c $readmemh, addresses in the file are indices into the physical
+   * memory array and each word is written to the array as-is. Since this
+   * doesn't touch the simulation, it is safe to call from any thread. Throws a
+   * std::runtime_error if the file can't be read or is malformed.
+   *
+   * As with \c $readmemh, a word with bits set above \p width_bit (the width
+   * of the memory the data is for) isn't an error: the extra bits are dropped
+   * by the simulation. A warning giving the file and line of the first such
+   * word is written to \p warnings.
+   */
+  static std::vector<MemBlock> ParseVmem(const std::string &path,
+                                         uint32_t width_bit,
+                                         std::ostream &warnings);
+
+  /** Write blocks returned by ParseVmem() to the memory
+   *
+   * Throws a std::runtime_error if a word's index is outside the memory (or
+   * if the memory doesn't support raw vmem data) and an SVScoped::Error if
+   * the scope cannot be set.
+   */
+  virtual void WriteVmem(const std::vector<MemBlock> &blocks) const;
+
+  /** Load a vmem file into the memory (see ParseVmem() and WriteVmem()) */
+  void LoadVmem(const std::string &path) const {
+    WriteVmem(ParseVmem(path, GetWidth(), std::cerr));
+  }
+
+  /** Read the raw contents of the whole physical memory
+   *
+   * Unlike Read(), this doesn't undo any scrambling or check ECC bits. The
+   * result can be passed to WriteRaw() to put the memory back in the same
+   * state (for example, to start each of a batch of tests with the initial
+   * memory contents). If the scope cannot be set, this throws an
+   * SVScoped::Error.
+   */
+  std::vector<MemBlock> ReadRaw() const;
+
+  /** Write blocks returned by ReadRaw() back to the memory */
+  void WriteRaw(const std::vector<MemBlock> &blocks) const;
 
   const std::string &GetScope() const { return scope_; }
   uint32_t GetSizeWords() const { return num_words_; }
@@ -80,11 +169,31 @@ class MemArea {
   uint32_t GetWidthByte() const { return width_byte_; }
   uint32_t GetWidth() const { return 8 * width_byte_; }
 
+  /** Choose whether Read() and Write() move data in blocks
+   *
+   * By default, memory contents are moved with \c simutil_set_mem_block and
+   * \c simutil_get_mem_block, transferring up to SV_MEM_BLOCK_WORDS words per
+   * DPI call. Passing false reverts to one \c simutil_set_mem or \c
+   * simutil_get_mem call per word. This is mostly useful to measure the
+   * difference.
+   */
+  static void SetBlockTransfers(bool enable) { block_transfers_ = enable; }
+  static bool GetBlockTransfers() { return block_transfers_; }
+
  protected:
   std::string scope_;    ///< Design scope (used for accesses over DPI)
   uint32_t num_words_;   ///< Size of the memory area in words
   uint32_t width_byte_;  ///< Size of each word in bytes
 
+  /** Get the SystemVerilog scope for this memory area.
+   *
+   * If scope_ is an absolute name, it is looked up on the first call and the
+   * result is cached. Relative names depend on the current scope, so they are
+   * resolved every time. Throws an SVScoped::Error if the scope does not
+   * exist.
+   */
+  svScope GetSvScope() const;
+
   /** Write to buf with the data that should be copied to the physical memory
    * for a single memory word.
    *
@@ -94,13 +203,13 @@ class MemArea {
    * further up (this is done outside of the loop).
    *
    * @param buf       Destination buffer
-   * @param data      A large buffer that contains the data to be written
-   * @param start_idx An offset into \p data for the start of the memory word
+   * @param src       The data for the memory word
+   * @param src_len   The number of bytes available at \p src. If this is less
+   *                  than the width of the memory, the word is zero-extended.
    * @param dst_word  Logical address of the location being written
    */
-  virtual void WriteBuffer(uint8_t buf[SV_MEM_WIDTH_BYTES],
-                           const std::vector<uint8_t> &data, size_t start_idx,
-                           uint32_t dst_word) const;
+  virtual void WriteBuffer(uint8_t buf[SV_MEM_WIDTH_BYTES], const uint8_t *src,
+                           size_t src_len, uint32_t dst_word) const;
 
   /** Extract the logical memory contents corresponding to the physical
    * memory contents in \p buf and append them to \p data.
@@ -145,6 +254,34 @@ class MemArea {
    */
   void WriteFromMinibuf(uint32_t phys_addr, const uint8_t *minibuf,
                         uint32_t dst_word) const;
+
+  /** Append the word in minibuf to block, to be written to phys_addr
+   *
+   * If block is already full, it is flushed to the memory first (see
+   * FlushBlock()). dst_word is the logical address of the word.
+   */
+  void AddToBlock(MemBlock &block, uint32_t phys_addr, const uint8_t *minibuf,
+                  uint32_t dst_word) const;
+
+  /** Write every word in block to the memory and then empty it */
+  void FlushBlock(MemBlock &block) const;
+
+  /** Write every word in block to the memory */
+  void WriteBlock(const MemBlock &block) const;
+
+  /** Read count words, starting at logical address first_word, into block
+   *
+   * count must be at most SV_MEM_BLOCK_WORDS. Each word is read from the
+   * physical address given by ToPhysAddr().
+   */
+  void ReadBlock(MemBlock &block, uint32_t first_word, uint32_t count) const;
+
+  /** Fill in the values of block from the physical addresses in its indices */
+  void ReadBlockIndices(MemBlock &block) const;
+
+ private:
+  mutable svScope sv_scope_;  ///< Cached scope (if scope_ is absolute)
+  static bool block_transfers_;
 };
 
 #endif  // OPENTITAN_HW_DV_VERILATOR_CPP_MEM_AREA_H_
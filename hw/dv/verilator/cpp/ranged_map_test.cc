@@ -0,0 +1,134 @@
+// Copyright lowRISC contributors.
+// Licensed under the Apache License, Version 2.0, see LICENSE for details.
+// SPDX-License-Identifier: Apache-2.0
+
+#include "ranged_map.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace {
+
+using Seg = std::vector<uint8_t>;
+using rng_t = AddrRange<uint32_t>;
+
+// A merge function like the one used by DpiMemUtil: the newer value wins
+// where the two overlap.
+Seg MergeSegs(const rng_t &rng0, Seg &&val0, const rng_t &rng1, Seg &&val1) {
+  uint32_t lo = std::min(rng0.lo, rng1.lo);
+  uint32_t hi = std::max(rng0.hi, rng1.hi);
+  Seg ret(hi - lo + 1);
+  std::copy(val0.begin(), val0.end(), ret.begin() + (rng0.lo - lo));
+  std::copy(val1.begin(), val1.end(), ret.begin() + (rng1.lo - lo));
+  return ret;
+}
+
+// A small deterministic PRNG, so that failures are repeatable
+class Lcg {
+ public:
+  explicit Lcg(uint64_t seed) : state_(seed) {}
+  uint32_t Next() {
+    state_ = state_ * 6364136223846793005ull + 1442695040888963407ull;
+    return state_ >> 32;
+  }
+
+ private:
+  uint64_t state_;
+};
+
+// Return the low address of the entry containing addr (or ~0 if there is
+// none)
+template <typename Map>
+uint32_t FindLo(const Map &map, uint32_t addr) {
+  auto it = map.find(addr);
+  return it == map.end() ? ~0u : it->first.lo;
+}
+
+template <typename Map, typename RefMap>
+void ExpectSameEntries(const Map &map, const RefMap &ref_map) {
+  ASSERT_EQ(map.size(), ref_map.size());
+
+  auto it = map.begin();
+  for (const auto &ref_entry : ref_map) {
+    EXPECT_EQ(it->first.lo, ref_entry.first.lo);
+    EXPECT_EQ(it->first.hi, ref_entry.first.hi);
+    EXPECT_EQ(it->second, ref_entry.second);
+    ++it;
+  }
+}
+
+TEST(SortedRangedMapTest, FindInEmptyMap) {
+  SortedRangedMap<uint32_t, int> map;
+  EXPECT_EQ(map.find(0), map.end());
+  EXPECT_EQ(map.find(~0u), map.end());
+}
+
+TEST(SortedRangedMapTest, EmplaceDisjointReportsOverlaps) {
+  SortedRangedMap<uint32_t, int> map;
+  EXPECT_EQ(map.EmplaceDisjoint(0x100, 0x1ff, 1), nullptr);
+  EXPECT_EQ(map.EmplaceDisjoint(0x300, 0x3ff, 2), nullptr);
+
+  // Overlapping from the left and from the right
+  const int *hit = map.EmplaceDisjoint(0x1f0, 0x20f, 3);
+  ASSERT_NE(hit, nullptr);
+  EXPECT_EQ(*hit, 1);
+  hit = map.EmplaceDisjoint(0x2f0, 0x30f, 4);
+  ASSERT_NE(hit, nullptr);
+  EXPECT_EQ(*hit, 2);
+
+  // Touching but not overlapping
+  EXPECT_EQ(map.EmplaceDisjoint(0x200, 0x2ff, 5), nullptr);
+  EXPECT_EQ(map.size(), 3u);
+
+  EXPECT_EQ(FindLo(map, 0x0ff), ~0u);
+  EXPECT_EQ(FindLo(map, 0x100), 0x100u);
+  EXPECT_EQ(FindLo(map, 0x200), 0x200u);
+  EXPECT_EQ(FindLo(map, 0x3ff), 0x300u);
+  EXPECT_EQ(FindLo(map, 0x400), ~0u);
+}
+
+// Insert overlapping, randomly placed segments with Emplace() and
+// EmplaceDisjoint() and check that SortedRangedMap matches RangedMap.
+TEST(SortedRangedMapTest, MatchesRangedMap) {
+  Lcg lcg(0x5eed);
+
+  for (int round = 0; round < 200; ++round) {
+    SCOPED_TRACE(round);
+    SortedRangedMap<uint32_t, Seg> map;
+    RangedMap<uint32_t, Seg> ref_map;
+    uint32_t space = 64 + (lcg.Next() % 4096);
+
+    for (int i = 0; i < 100; ++i) {
+      uint32_t lo = lcg.Next() % space;
+      uint32_t len = 1 + lcg.Next() % 32;
+      Seg seg(len);
+      for (uint8_t &b : seg) {
+        b = lcg.Next();
+      }
+      Seg seg_copy = seg;
+
+      if (lcg.Next() % 2) {
+        map.Emplace(lo, lo + len - 1, std::move(seg), MergeSegs);
+        ref_map.Emplace(lo, lo + len - 1, std::move(seg_copy), MergeSegs);
+      } else {
+        const Seg *hit = map.EmplaceDisjoint(lo, lo + len - 1, std::move(seg));
+        const Seg *ref_hit =
+            ref_map.EmplaceDisjoint(lo, lo + len - 1, std::move(seg_copy));
+        ASSERT_EQ(hit == nullptr, ref_hit == nullptr);
+        if (hit) {
+          EXPECT_EQ(*hit, *ref_hit);
+        }
+      }
+    }
+
+    ExpectSameEntries(map, ref_map);
+    for (uint32_t addr = 0; addr < space + 32; ++addr) {
+      ASSERT_EQ(FindLo(map, addr), FindLo(ref_map, addr)) << "addr " << addr;
+    }
+  }
+}
+
+}  // namespace
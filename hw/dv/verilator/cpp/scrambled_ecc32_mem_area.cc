@@ -17,34 +17,6 @@
 static const uint32_t kScrMaxNonceWidth = 320;
 static const uint32_t kScrMaxNonceWidthByte = (kScrMaxNonceWidth + 7) / 8;
 
-// Functions to convert from integer address to/from a little-endian vector of
-// bytes, addr_width is given in bits
-static std::vector<uint8_t> AddrIntToBytes(uint32_t addr, uint32_t addr_width) {
-  uint32_t addr_width_bytes = (addr_width + 7) / 8;
-  std::vector<uint8_t> addr_bytes(addr_width_bytes);
-
-  for (uint32_t i = 0; i < addr_width_bytes; ++i) {
-    addr_bytes[i] = addr & 0xff;
-    addr >>= 8;
-  }
-
-  return addr_bytes;
-}
-
-static uint32_t AddrBytesToInt(const std::vector<uint8_t> &addr) {
-  assert(addr.size() <= 4);
-
-  uint32_t addr_out = 0;
-  int cur_shift = 0;
-
-  for (uint8_t byte : addr) {
-    addr_out |= ((uint32_t)byte << cur_shift);
-    cur_shift += 8;
-  }
-
-  return addr_out;
-}
-
 // Converts svBitVecVal (bit[m:n] SV type) into a byte vector
 static std::vector<uint8_t> ByteVecFromSV(svBitVecVal sv_val[],
                                           uint32_t bytes) {
@@ -121,11 +93,76 @@ ScrambledEcc32MemArea::ScrambledEcc32MemArea(const std::string &scope,
           SVScoped::join_sv_scopes(
               scope, "u_prim_ram_1p_adv.u_mem.gen_generic.u_impl_generic"),
           size, width_32),
-      scr_scope_(scope) {
+      scr_scope_(scope),
+      scr_valid_(false) {
   addr_width_ = vbits(size);
   repeat_keystream_ = repeat_keystream;
 }
 
+void ScrambledEcc32MemArea::Write(uint32_t word_offset, const uint8_t *data,
+                                  size_t len) const {
+  std::lock_guard<std::mutex> lock(scr_mutex_);
+  SnapshotScrambleParams();
+  Ecc32MemArea::Write(word_offset, data, len);
+}
+
+std::vector<uint8_t> ScrambledEcc32MemArea::Read(uint32_t word_offset,
+                                                 uint32_t num_words) const {
+  std::lock_guard<std::mutex> lock(scr_mutex_);
+  SnapshotScrambleParams();
+  return Ecc32MemArea::Read(word_offset, num_words);
+}
+
+Ecc32MemArea::EccWords ScrambledEcc32MemArea::ReadWithIntegrity(
+    uint32_t word_offset, uint32_t num_words) const {
+  std::lock_guard<std::mutex> lock(scr_mutex_);
+  SnapshotScrambleParams();
+  return Ecc32MemArea::ReadWithIntegrity(word_offset, num_words);
+}
+
+void ScrambledEcc32MemArea::WriteWithIntegrity(uint32_t word_offset,
+                                               const EccWords &data) const {
+  std::lock_guard<std::mutex> lock(scr_mutex_);
+  SnapshotScrambleParams();
+  Ecc32MemArea::WriteWithIntegrity(word_offset, data);
+}
+
+static const uint32_t kNoPhysAddr = ~(uint32_t)0;
+
+void ScrambledEcc32MemArea::SnapshotScrambleParams() const {
+  std::vector<uint8_t> key = GetScrambleKey();
+  std::vector<uint8_t> nonce = GetScrambleNonce();
+
+  if (scr_valid_ && key == scr_key_ && nonce == scr_nonce_)
+    return;
+
+  scr_key_ = std::move(key);
+  scr_nonce_ = std::move(nonce);
+  phys_addrs_.assign(GetSizeWords(), kNoPhysAddr);
+  keystreams_.assign((size_t)GetSizeWords() * GetPhysWidthByte(), 0);
+  scr_valid_ = true;
+}
+
+size_t ScrambledEcc32MemArea::GetCacheEntry(uint32_t logical_addr) const {
+  // The bulk accessors take a snapshot before touching any words
+  assert(scr_valid_);
+  assert(logical_addr < phys_addrs_.size());
+
+  size_t ks_idx = (size_t)logical_addr * GetPhysWidthByte();
+  if (phys_addrs_[logical_addr] != kNoPhysAddr)
+    return ks_idx;
+
+  // Scramble logical address to get physical address
+  phys_addrs_[logical_addr] = scramble_addr_int(
+      logical_addr, addr_width_, &scr_nonce_[0], GetNonceWidth());
+
+  scramble_data_keystream_buf(&keystreams_[ks_idx], logical_addr, addr_width_,
+                              &scr_nonce_[0], &scr_key_[0], GetPhysWidth(),
+                              repeat_keystream_);
+
+  return ks_idx;
+}
+
 uint32_t ScrambledEcc32MemArea::GetPhysWidth() const {
   return (GetWidthByte() / 4) * 39;
 }
@@ -151,35 +188,43 @@ uint32_t ScrambledEcc32MemArea::GetNonceWidthByte() const {
 }
 
 void ScrambledEcc32MemArea::WriteBuffer(uint8_t buf[SV_MEM_WIDTH_BYTES],
-                                        const std::vector<uint8_t> &data,
-                                        size_t start_idx,
+                                        const uint8_t *src, size_t src_len,
                                         uint32_t dst_word) const {
   // Compute integrity
-  Ecc32MemArea::WriteBuffer(buf, data, start_idx, dst_word);
+  Ecc32MemArea::WriteBuffer(buf, src, src_len, dst_word);
   ScrambleBuffer(buf, dst_word);
 }
 
-std::vector<uint8_t> ScrambledEcc32MemArea::ReadUnscrambled(
-    const uint8_t buf[SV_MEM_WIDTH_BYTES], uint32_t src_word) const {
-  std::vector<uint8_t> scrambled_data(buf, buf + GetPhysWidthByte());
-  return scramble_decrypt_data(
-      scrambled_data, GetPhysWidth(), 39, AddrIntToBytes(src_word, addr_width_),
-      addr_width_, GetScrambleNonce(), GetScrambleKey(), repeat_keystream_);
+void ScrambledEcc32MemArea::ReadUnscrambled(
+    uint8_t out[SV_MEM_WIDTH_BYTES], const uint8_t buf[SV_MEM_WIDTH_BYTES],
+    uint32_t src_word) const {
+  uint32_t phys_width_byte = GetPhysWidthByte();
+
+  // Undo the substitution/permutation network, then XOR with the cached
+  // keystream for this address.
+  scramble_subst_perm_data_buf(buf, out, GetPhysWidth(), 39, false);
+
+  const uint8_t *keystream = &keystreams_[GetCacheEntry(src_word)];
+  for (uint32_t i = 0; i < phys_width_byte; ++i) {
+    out[i] ^= keystream[i];
+  }
 }
 
 void ScrambledEcc32MemArea::ReadBuffer(std::vector<uint8_t> &data,
                                        const uint8_t buf[SV_MEM_WIDTH_BYTES],
                                        uint32_t src_word) const {
-  std::vector<uint8_t> unscrambled_data = ReadUnscrambled(buf, src_word);
+  uint8_t unscrambled_data[SV_MEM_WIDTH_BYTES];
+  ReadUnscrambled(unscrambled_data, buf, src_word);
   // Strip integrity to give final result
-  Ecc32MemArea::ReadBuffer(data, &unscrambled_data[0], src_word);
+  Ecc32MemArea::ReadBuffer(data, unscrambled_data, src_word);
 }
 
 void ScrambledEcc32MemArea::ReadBufferWithIntegrity(
     EccWords &data, const uint8_t buf[SV_MEM_WIDTH_BYTES],
     uint32_t src_word) const {
-  std::vector<uint8_t> unscrambled_data = ReadUnscrambled(buf, src_word);
-  Ecc32MemArea::ReadBufferWithIntegrity(data, &unscrambled_data[0], src_word);
+  uint8_t unscrambled_data[SV_MEM_WIDTH_BYTES];
+  ReadUnscrambled(unscrambled_data, buf, src_word);
+  Ecc32MemArea::ReadBufferWithIntegrity(data, unscrambled_data, src_word);
 }
 
 void ScrambledEcc32MemArea::WriteBufferWithIntegrity(
@@ -191,20 +236,18 @@ void ScrambledEcc32MemArea::WriteBufferWithIntegrity(
 
 void ScrambledEcc32MemArea::ScrambleBuffer(uint8_t buf[SV_MEM_WIDTH_BYTES],
                                            uint32_t dst_word) const {
-  std::vector<uint8_t> scramble_buf(buf, buf + GetPhysWidthByte());
-
-  // Scramble data with integrity
-  scramble_buf = scramble_encrypt_data(
-      scramble_buf, GetPhysWidth(), 39, AddrIntToBytes(dst_word, addr_width_),
-      addr_width_, GetScrambleNonce(), GetScrambleKey(), repeat_keystream_);
+  uint32_t phys_width_byte = GetPhysWidthByte();
+  const uint8_t *keystream = &keystreams_[GetCacheEntry(dst_word)];
 
-  // Copy scrambled data to write buffer
-  std::copy(scramble_buf.begin(), scramble_buf.end(), &buf[0]);
+  // XOR data with integrity with the cached keystream for this address, then
+  // apply the substitution/permutation network in place.
+  for (uint32_t i = 0; i < phys_width_byte; ++i) {
+    buf[i] ^= keystream[i];
+  }
+  scramble_subst_perm_data_buf(buf, buf, GetPhysWidth(), 39, true);
 }
 
 uint32_t ScrambledEcc32MemArea::ToPhysAddr(uint32_t logical_addr) const {
-  // Scramble logical address to get physical address
-  return AddrBytesToInt(scramble_addr(AddrIntToBytes(logical_addr, addr_width_),
-                                      addr_width_, GetScrambleNonce(),
-                                      GetNonceWidth()));
+  GetCacheEntry(logical_addr);
+  return phys_addrs_[logical_addr];
 }
@@ -5,6 +5,7 @@
 #ifndef OPENTITAN_HW_DV_VERILATOR_CPP_SCRAMBLED_ECC32_MEM_AREA_H_
 #define OPENTITAN_HW_DV_VERILATOR_CPP_SCRAMBLED_ECC32_MEM_AREA_H_
 
+#include <mutex>
 #include <vector>
 
 #include "ecc32_mem_area.h"
@@ -32,13 +33,28 @@ class ScrambledEcc32MemArea : public Ecc32MemArea {
   ScrambledEcc32MemArea(const std::string &scope, uint32_t size,
                         uint32_t width_32, bool repeat_keystream = true);
 
+  // The bulk accessors below read the scrambling key and nonce from the
+  // design once at the start of each call. The address mapping and keystream
+  // for each word are cached across calls for as long as the key and nonce
+  // stay the same. Each call holds scr_mutex_ throughout, so they may be
+  // called from more than one thread.
+  using Ecc32MemArea::Write;
+  void Write(uint32_t word_offset, const uint8_t *data,
+             size_t len) const override;
+  std::vector<uint8_t> Read(uint32_t word_offset,
+                            uint32_t num_words) const override;
+  EccWords ReadWithIntegrity(uint32_t word_offset,
+                             uint32_t num_words) const override;
+  void WriteWithIntegrity(uint32_t word_offset,
+                          const EccWords &data) const override;
+
  private:
-  void WriteBuffer(uint8_t buf[SV_MEM_WIDTH_BYTES],
-                   const std::vector<uint8_t> &data, size_t start_idx,
-                   uint32_t dst_word) const override;
+  void WriteBuffer(uint8_t buf[SV_MEM_WIDTH_BYTES], const uint8_t *src,
+                   size_t src_len, uint32_t dst_word) const override;
 
-  std::vector<uint8_t> ReadUnscrambled(const uint8_t buf[SV_MEM_WIDTH_BYTES],
-                                       uint32_t src_word) const;
+  void ReadUnscrambled(uint8_t out[SV_MEM_WIDTH_BYTES],
+                       const uint8_t buf[SV_MEM_WIDTH_BYTES],
+                       uint32_t src_word) const;
 
   void ReadBuffer(std::vector<uint8_t> &data,
                   const uint8_t buf[SV_MEM_WIDTH_BYTES],
@@ -65,9 +81,29 @@ class ScrambledEcc32MemArea : public Ecc32MemArea {
   std::vector<uint8_t> GetScrambleKey() const;
   std::vector<uint8_t> GetScrambleNonce() const;
 
+  // Read the key and nonce from the design. If either has changed since the
+  // last snapshot, clear the cached address mapping and keystreams.
+  void SnapshotScrambleParams() const;
+
+  // Make sure the cache entry for logical_addr has been computed and return
+  // its index into keystreams_ (in bytes). This must be called with
+  // scr_mutex_ held, after SnapshotScrambleParams().
+  size_t GetCacheEntry(uint32_t logical_addr) const;
+
   std::string scr_scope_;
   uint32_t addr_width_;
   bool repeat_keystream_;
+
+  // Scrambling state snapshot. scr_key_ and scr_nonce_ are only meaningful
+  // if scr_valid_ is true. phys_addrs_ has an entry per logical word, which
+  // is kNoPhysAddr until it has been computed. keystreams_ holds
+  // GetPhysWidthByte() bytes of keystream for each logical word. These are
+  // only touched with scr_mutex_ held.
+  mutable std::mutex scr_mutex_;
+  mutable bool scr_valid_;
+  mutable std::vector<uint8_t> scr_key_, scr_nonce_;
+  mutable std::vector<uint32_t> phys_addrs_;
+  mutable std::vector<uint8_t> keystreams_;
 };
 
 #endif  // OPENTITAN_HW_DV_VERILATOR_CPP_SCRAMBLED_ECC32_MEM_AREA_H_
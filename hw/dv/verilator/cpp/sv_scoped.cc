@@ -87,6 +87,11 @@ static svScope SetRelScope(const std::string &name) {
 
 SVScoped::SVScoped(const std::string &name) : prev_scope_(SetRelScope(name)) {}
 
+svScope SVScoped::Resolve(const std::string &name) {
+  SVScoped scoped(name);
+  return svGetScope();
+}
+
 SVScoped::Error::Error(const std::string &scope_name)
     : scope_name_(scope_name) {
   std::ostringstream oss;
@@ -27,11 +27,19 @@
  * resolves to the scope with name "TOP.foo.baz". The string "qux" resolves to
  * the scope with name "qux".
  *
+ * There is also a constructor that takes an already-resolved svScope. This is
+ * useful for callers that switch to the same scope many times: they can look
+ * it up by name once (with Resolve()) and avoid the string lookup in
+ * svGetScopeFromName() on every subsequent switch.
+ *
  * This guard restores the previous scope at destruction.
  */
 class SVScoped {
  public:
   SVScoped(const std::string &name);
+  explicit SVScoped(svScope scope) : prev_scope_(svSetScope(scope)) {
+    assert(scope);
+  }
   ~SVScoped() { svSetScope(prev_scope_); }
 
   class Error : public std::exception {
@@ -45,6 +53,11 @@ class SVScoped {
     std::string msg_;
   };
 
+  // Resolve name to a scope, using the same rules as the constructor, but
+  // without changing the current scope. Throws an SVScoped::Error if the scope
+  // cannot be found.
+  static svScope Resolve(const std::string &name);
+
   // helper function to join two, possibly relative, scopes correctly.
   static std::string join_sv_scopes(const std::string &a, const std::string &b);
 
@@ -6,27 +6,20 @@
 
 #include <array>
 #include <cassert>
+#include <chrono>
 #include <cstring>
+#include <exception>
 #include <getopt.h>
 #include <iostream>
 #include <sstream>
+#include <stdexcept>
 #include <string>
+#include <thread>
 #include <vector>
 
-namespace {
-// An instruction to load the file at filepath to the memory called name. If
-// name is the empty string then type must be kMemImageElf and this is an
-// instruction to load an ELF file, picking memories by LMA.
-struct LoadArg {
-  std::string name;
-  std::string filepath;
-  MemImageType type;
-};
-}  // namespace
-
 // Parse a meminit command-line argument. This should be of the form
 // mem_area,file[,type]. Throw a std::runtime_error if something looks wrong.
-static LoadArg ParseMemArg(std::string mem_argument) {
+static VerilatorMemUtil::LoadArg ParseMemArg(std::string mem_argument) {
   std::array<std::string, 3> args;
   size_t pos = 0;
   size_t end_pos = 0;
@@ -80,15 +73,36 @@ static void PrintHelp() {
                "  Print registered memory regions\n\n"
                "--verbose-mem-load\n"
                "  Print a message for each memory load\n\n"
+               "--mem-load-time\n"
+               "  Print the wall time taken by each memory load and a summary\n"
+               "  for each memory\n\n"
+               "--no-block-mem-load\n"
+               "  Transfer memory contents one word per DPI call, rather than\n"
+               "  in blocks (useful for comparing load times)\n\n"
+               "--reload-mem-images\n"
+               "  With --restore-checkpoint, load the memory images given on\n"
+               "  the command line after restoring the checkpoint. Otherwise,\n"
+               "  the memories keep their contents from the checkpoint and the\n"
+               "  images are ignored.\n\n"
                "-h|--help\n"
                "  Show help\n\n";
 }
 
-VerilatorMemUtil::VerilatorMemUtil() : allocation_(new DpiMemUtil()) {
+VerilatorMemUtil::VerilatorMemUtil()
+    : allocation_(new DpiMemUtil()),
+      verbose_(false),
+      report_time_(false),
+      restoring_(false),
+      reload_images_(false) {
   mem_util_ = allocation_.get();
 }
 
-VerilatorMemUtil::VerilatorMemUtil(DpiMemUtil *mem_util) : mem_util_(mem_util) {
+VerilatorMemUtil::VerilatorMemUtil(DpiMemUtil *mem_util)
+    : mem_util_(mem_util),
+      verbose_(false),
+      report_time_(false),
+      restoring_(false),
+      reload_images_(false) {
   assert(mem_util);
 }
 
@@ -101,13 +115,15 @@ bool VerilatorMemUtil::ParseCLIArguments(int argc, char **argv,
       {"otpinit", required_argument, nullptr, 'o'},
       {"meminit", required_argument, nullptr, 'l'},
       {"verbose-mem-load", no_argument, nullptr, 'V'},
+      {"mem-load-time", no_argument, nullptr, 'T'},
+      {"no-block-mem-load", no_argument, nullptr, 'B'},
+      {"reload-mem-images", no_argument, nullptr, 'L'},
+      // Parsed by VerilatorSimCtrl. We only need to know whether it was given.
+      {"restore-checkpoint", required_argument, nullptr, 'R'},
       {"load-elf", required_argument, nullptr, 'E'},
       {"help", no_argument, nullptr, 'h'},
       {nullptr, no_argument, nullptr, 0}};
 
-  std::vector<LoadArg> load_args;
-  bool verbose = false;
-
   // Reset the command parsing index in-case other utils have already parsed
   // some arguments
   optind = 1;
@@ -125,19 +141,19 @@ bool VerilatorMemUtil::ParseCLIArguments(int argc, char **argv,
       case 1:
         break;
       case 'r':
-        load_args.push_back(
+        load_args_.push_back(
             {.name = "rom", .filepath = optarg, .type = kMemImageUnknown});
         break;
       case 'm':
-        load_args.push_back(
+        load_args_.push_back(
             {.name = "ram", .filepath = optarg, .type = kMemImageUnknown});
         break;
       case 'f':
-        load_args.push_back(
+        load_args_.push_back(
             {.name = "flash", .filepath = optarg, .type = kMemImageUnknown});
         break;
       case 'o':
-        load_args.push_back(
+        load_args_.push_back(
             {.name = "otp", .filepath = optarg, .type = kMemImageUnknown});
         break;
       case 'l':
@@ -149,17 +165,29 @@ bool VerilatorMemUtil::ParseCLIArguments(int argc, char **argv,
 
         // --meminit / -l
         try {
-          load_args.emplace_back(ParseMemArg(optarg));
+          load_args_.emplace_back(ParseMemArg(optarg));
         } catch (const std::runtime_error &err) {
           std::cerr << "ERROR: " << err.what() << std::endl;
           return false;
         }
         break;
       case 'V':
-        verbose = true;
+        verbose_ = true;
+        break;
+      case 'T':
+        report_time_ = true;
+        break;
+      case 'B':
+        MemArea::SetBlockTransfers(false);
+        break;
+      case 'L':
+        reload_images_ = true;
+        break;
+      case 'R':
+        restoring_ = true;
         break;
       case 'E':
-        load_args.push_back(
+        load_args_.push_back(
             {.name = "", .filepath = optarg, .type = kMemImageElf});
         break;
       case 'h':
@@ -175,19 +203,110 @@ bool VerilatorMemUtil::ParseCLIArguments(int argc, char **argv,
     }
   }
 
-  for (const LoadArg &arg : load_args) {
+  // The memory contents will be replaced by those in the checkpoint, so
+  // there's no point loading the images now.
+  if (restoring_) {
+    return true;
+  }
+
+  return LoadImages();
+}
+
+void VerilatorMemUtil::RestoreCheckpoint(VerilatedDeserialize &is) {
+  if (reload_images_ && !LoadImages()) {
+    throw std::runtime_error("Failed to load memory images.");
+  }
+}
+
+bool VerilatorMemUtil::LoadImages() {
+  auto all_start = std::chrono::steady_clock::now();
+  mem_util_->ClearLoadStats();
+
+  // Reading and parsing the images for named memories doesn't touch the
+  // simulation, so do that for all of them up front, in parallel if there is
+  // more than one. The images are then written to the memories from this
+  // thread (since the DPI calls must come from the simulation thread) in the
+  // order they were given, together with any ELF files loaded by LMA.
+  size_t num_args = load_args_.size();
+  std::vector<DpiMemUtil::StagedImage> staged(num_args);
+  std::vector<std::exception_ptr> errors(num_args);
+
+  auto stage = [this, &staged, &errors](size_t i) {
+    const LoadArg &arg = load_args_[i];
     try {
+      staged[i] = mem_util_->StageFileForNamedMem(verbose_, arg.name,
+                                                  arg.filepath, arg.type);
+    } catch (...) {
+      errors[i] = std::current_exception();
+    }
+  };
+
+  std::vector<size_t> named;
+  for (size_t i = 0; i < num_args; ++i) {
+    if (!load_args_[i].name.empty()) {
+      named.push_back(i);
+    }
+  }
+  if (named.size() == 1) {
+    stage(named[0]);
+  } else {
+    std::vector<std::thread> threads;
+    for (size_t i : named) {
+      threads.emplace_back(stage, i);
+    }
+    for (std::thread &thread : threads) {
+      thread.join();
+    }
+  }
+
+  for (size_t i = 0; i < num_args; ++i) {
+    const LoadArg &arg = load_args_[i];
+    auto start = std::chrono::steady_clock::now();
+    try {
+      if (errors[i]) {
+        std::rethrow_exception(errors[i]);
+      }
       if (!arg.name.empty()) {
-        mem_util_->LoadFileToNamedMem(verbose, arg.name, arg.filepath,
-                                      arg.type);
+        mem_util_->WriteStagedImage(staged[i]);
       } else {
         assert(arg.type == kMemImageElf);
-        mem_util_->LoadElfToMemories(verbose, arg.filepath);
+        mem_util_->LoadElfToMemories(verbose_, arg.filepath);
       }
     } catch (const std::exception &err) {
       std::cerr << "ERROR: " << err.what() << std::endl;
       return false;
     }
+
+    if (report_time_) {
+      std::chrono::duration<double, std::milli> elapsed =
+          std::chrono::steady_clock::now() - start;
+      std::cout << "Loaded `" << arg.filepath << "' into ";
+      if (arg.name.empty()) {
+        std::cout << "memories by LMA in " << elapsed.count() << " ms.";
+      } else {
+        std::cout << "memory `" << arg.name << "' (staged in "
+                  << staged[i].stage_ms << " ms, written in "
+                  << elapsed.count() << " ms).";
+      }
+      std::cout << std::endl;
+    }
+  }
+
+  if (report_time_ && !load_args_.empty()) {
+    std::chrono::duration<double, std::milli> elapsed =
+        std::chrono::steady_clock::now() - all_start;
+    std::cout << "Memory loading took " << elapsed.count() << " ms in total ("
+              << (MemArea::GetBlockTransfers() ? "block" : "word-by-word")
+              << " transfers)." << std::endl;
+
+    std::cout << "Load time by memory:" << std::endl;
+    for (const auto &pr : mem_util_->GetLoadStats()) {
+      const DpiMemUtil::LoadStats &stats = pr.second;
+      std::cout << "  " << pr.first << ": " << stats.num_words
+                << " words from " << stats.num_files << " file(s), staged in "
+                << stats.stage_ms << " ms, written in " << stats.write_ms
+                << " ms" << std::endl;
+    }
   }
 
   return true;
@@ -9,12 +9,23 @@
 //
 
 #include <memory>
+#include <string>
+#include <vector>
 
 #include "dpi_memutil.h"
 #include "sim_ctrl_extension.h"
 
 class VerilatorMemUtil : public SimCtrlExtension {
  public:
+  // An instruction to load the file at filepath to the memory called name. If
+  // name is the empty string then type must be kMemImageElf and this is an
+  // instruction to load an ELF file, picking memories by LMA.
+  struct LoadArg {
+    std::string name;
+    std::string filepath;
+    MemImageType type;
+  };
+
   // No-argument constructor makes a VerilatorMemUtil. Single-argument
   // constructor wraps its mem_util argument (but does not take ownership).
   VerilatorMemUtil();
@@ -23,6 +34,13 @@ class VerilatorMemUtil : public SimCtrlExtension {
   // Declared in SimCtrlExtension
   bool ParseCLIArguments(int argc, char **argv, bool &exit_app) override;
 
+  // Declared in SimCtrlExtension. A restored checkpoint includes the memory
+  // contents, so by default this does nothing. With --reload-mem-images, it
+  // loads the images given on the command line on top of the restored
+  // memories, so that runs restored from a common checkpoint can use different
+  // images.
+  void RestoreCheckpoint(VerilatedDeserialize &is) override;
+
   // Get underlying DpiMemUtil object
   DpiMemUtil *GetUnderlying() { return mem_util_; }
 
@@ -33,8 +51,19 @@ class VerilatorMemUtil : public SimCtrlExtension {
   }
 
  private:
+  // Load the images in load_args_. Returns false on error.
+  bool LoadImages();
+
   DpiMemUtil *mem_util_;
   std::unique_ptr<DpiMemUtil> allocation_;
+  std::vector<LoadArg> load_args_;
+  bool verbose_;
+  bool report_time_;
+  // Set if the simulation will restore a checkpoint (--restore-checkpoint), in
+  // which case the images aren't loaded at startup.
+  bool restoring_;
+  // Set if the images should be loaded after restoring a checkpoint
+  bool reload_images_;
 };
 
 #endif  // OPENTITAN_HW_DV_VERILATOR_CPP_VERILATOR_MEMUTIL_H_
@@ -5,8 +5,17 @@
 #ifndef OPENTITAN_HW_DV_VERILATOR_SIMUTIL_VERILATOR_CPP_SIM_CTRL_EXTENSION_H_
 #define OPENTITAN_HW_DV_VERILATOR_SIMUTIL_VERILATOR_CPP_SIM_CTRL_EXTENSION_H_
 
+class VerilatedSerialize;
+class VerilatedDeserialize;
+
 class SimCtrlExtension {
  public:
+  /**
+   * OnClock() interval for extensions that only want to be called at the
+   * cycles they ask for (see GetOnClockInterval())
+   */
+  static const unsigned long kOnDemand = 0;
+
   virtual ~SimCtrlExtension() = default;
 
   /**
@@ -36,13 +45,59 @@ class SimCtrlExtension {
 
   /**
    * Function to be called every clock cycle
+   *
+   * This is called on the rising edge of the clock, before the model is
+   * evaluated. Extensions that don't need to be called every cycle can ask to
+   * be called less often with GetOnClockInterval().
    */
   virtual void OnClock(unsigned long sim_time) {}
 
+  /**
+   * How often OnClock() should be called, in clock cycles
+   *
+   * This is queried once, when the simulation starts. The default is every
+   * cycle. Return N to be called every N cycles, or kOnDemand to only be called
+   * at the cycles requested with VerilatorSimCtrl::WakeExtension().
+   */
+  virtual unsigned long GetOnClockInterval() const { return 1; }
+
+  /**
+   * Function to be called when a run of the simulation ends
+   *
+   * A run ends on $finish, on a stop request or when the timeout is reached.
+   * An extension that runs a batch of tests in one process can return true to
+   * ask for another run. In that case, the simulation controller asserts
+   * reset straight away (for as long as at the start of the simulation) and
+   * carries on, without re-evaluating any initial blocks. This is called for
+   * every extension, in registration order.
+   *
+   * @param run_success Whether the run that has just ended was successful
+   * @return true to start another run
+   */
+  virtual bool OnRunEnd(bool run_success) { return false; }
+
   /**
    * Function to be called after executing the simulation
    */
   virtual void PostExec() {}
+
+  /**
+   * Save extension state to a simulation checkpoint
+   *
+   * Called (in registration order) when a checkpoint is saved, after the
+   * state of the Verilated model. Anything written here must be read back by
+   * RestoreCheckpoint().
+   */
+  virtual void SaveCheckpoint(VerilatedSerialize &os) {}
+
+  /**
+   * Restore extension state from a simulation checkpoint
+   *
+   * Called (in registration order) when a checkpoint is restored, after the
+   * state of the Verilated model. Report errors by throwing a
+   * std::runtime_error.
+   */
+  virtual void RestoreCheckpoint(VerilatedDeserialize &is) {}
 };
 
 #endif  // OPENTITAN_HW_DV_VERILATOR_SIMUTIL_VERILATOR_CPP_SIM_CTRL_EXTENSION_H_
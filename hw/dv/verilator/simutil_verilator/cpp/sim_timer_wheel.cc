@@ -0,0 +1,53 @@
+// Copyright lowRISC contributors.
+// Licensed under the Apache License, Version 2.0, see LICENSE for details.
+// SPDX-License-Identifier: Apache-2.0
+
+#include "sim_timer_wheel.h"
+
+#include <algorithm>
+
+void SimTimerWheel::Schedule(unsigned long time, unsigned int kind,
+                             unsigned int arg) {
+  slots_[time & kSlotMask].push_back({time, kind, arg});
+}
+
+bool SimTimerWheel::PopDueFromSlot(unsigned long time, std::vector<Event> &slot,
+                                   std::vector<Event> &due) {
+  // Keep the events that aren't due yet (in order) at the start of the slot
+  size_t num_kept = 0;
+  bool any_due = false;
+  for (size_t i = 0; i < slot.size(); ++i) {
+    if (slot[i].time == time) {
+      due.push_back(slot[i]);
+      any_due = true;
+    } else {
+      slot[num_kept++] = slot[i];
+    }
+  }
+  slot.resize(num_kept);
+  return any_due;
+}
+
+void SimTimerWheel::ClampTo(unsigned long time) {
+  std::vector<Event> early;
+  for (unsigned long i = 0; i < kNumSlots; ++i) {
+    std::vector<Event> &slot = slots_[i];
+    size_t num_kept = 0;
+    for (size_t j = 0; j < slot.size(); ++j) {
+      if (slot[j].time < time) {
+        early.push_back(slot[j]);
+      } else {
+        slot[num_kept++] = slot[j];
+      }
+    }
+    slot.resize(num_kept);
+  }
+
+  // Keep events that were due at different times in order
+  std::stable_sort(
+      early.begin(), early.end(),
+      [](const Event &a, const Event &b) { return a.time < b.time; });
+  for (const Event &event : early) {
+    Schedule(time, event.kind, event.arg);
+  }
+}
@@ -0,0 +1,68 @@
+// Copyright lowRISC contributors.
+// Licensed under the Apache License, Version 2.0, see LICENSE for details.
+// SPDX-License-Identifier: Apache-2.0
+
+#ifndef OPENTITAN_HW_DV_VERILATOR_SIMUTIL_VERILATOR_CPP_SIM_TIMER_WHEEL_H_
+#define OPENTITAN_HW_DV_VERILATOR_SIMUTIL_VERILATOR_CPP_SIM_TIMER_WHEEL_H_
+
+#include <vector>
+
+/**
+ * A hashed timer wheel of simulation events
+ *
+ * Events are kept in a fixed number of slots, indexed by their time modulo the
+ * number of slots. Finding the events due at a given time only looks at one
+ * slot, and is a single size check when nothing is due, which is the common
+ * case. Events further in the future than the size of the wheel share a slot
+ * with earlier events and are skipped until their time comes round.
+ *
+ * Times are in simulation ticks (half clock cycles in VerilatorSimCtrl).
+ */
+class SimTimerWheel {
+ public:
+  struct Event {
+    unsigned long time;
+    unsigned int kind;  // Meaning defined by the user of the wheel
+    unsigned int arg;
+  };
+
+  /**
+   * Add an event
+   *
+   * time must not be before the last time passed to PopDue(), or the event
+   * will never be returned.
+   */
+  void Schedule(unsigned long time, unsigned int kind, unsigned int arg);
+
+  /**
+   * Move all events due at the given time to due (appending to it)
+   *
+   * @return true if any events were due
+   */
+  bool PopDue(unsigned long time, std::vector<Event> &due) {
+    std::vector<Event> &slot = slots_[time & kSlotMask];
+    if (slot.empty()) {
+      return false;
+    }
+    return PopDueFromSlot(time, slot, due);
+  }
+
+  /**
+   * Move all events that are due before the given time to that time
+   *
+   * Use this when simulation time jumps forward (e.g. when restoring a
+   * checkpoint) so that events which were skipped are not lost.
+   */
+  void ClampTo(unsigned long time);
+
+ private:
+  static const unsigned long kNumSlots = 256;
+  static const unsigned long kSlotMask = kNumSlots - 1;
+
+  std::vector<Event> slots_[kNumSlots];
+
+  bool PopDueFromSlot(unsigned long time, std::vector<Event> &slot,
+                      std::vector<Event> &due);
+};
+
+#endif  // OPENTITAN_HW_DV_VERILATOR_SIMUTIL_VERILATOR_CPP_SIM_TIMER_WHEEL_H_
@@ -10,6 +10,7 @@
 #endif
 
 #include <verilated.h>
+#include <verilated_save.h>
 
 #define STR(s) #s
 #define STR_AND_EXPAND(s) STR(s)
@@ -33,6 +34,12 @@
 
 // VM_TRACE_FMT_FST must be set by the user when calling Verilator with
 // --trace-fst. VM_TRACE is set by Verilator itself.
+// VM_SAVABLE must be set by the user when calling Verilator with --savable.
+// Without it, the model can't be saved to or restored from a checkpoint.
+#ifndef VM_SAVABLE
+#define VM_SAVABLE 0
+#endif
+
 #if VM_TRACE == 1
 #ifdef VM_TRACE_FMT_FST
 #include "verilated_fst_c.h"
@@ -122,6 +129,8 @@ class VerilatedToplevel {
   virtual void final() = 0;
   virtual const char *name() const = 0;
   virtual void trace(VerilatedTracer &tfp, int levels, int options) = 0;
+  virtual void save(VerilatedSerialize &os) = 0;
+  virtual void restore(VerilatedDeserialize &is) = 0;
 
   /**
    * Get the Verilator-generated device under test
@@ -148,6 +157,20 @@ class TOPLEVEL_NAME : public VERILATED_TOPLEVEL_NAME, public VerilatedToplevel {
                                    levels, options);
 #else
     assert(0 && "Tracing not enabled.");
+#endif
+  }
+  void save(VerilatedSerialize &os) {
+#if VM_SAVABLE == 1
+    os << static_cast<VERILATED_TOPLEVEL_NAME &>(*this);
+#else
+    assert(0 && "Saving not enabled.");
+#endif
+  }
+  void restore(VerilatedDeserialize &is) {
+#if VM_SAVABLE == 1
+    is >> static_cast<VERILATED_TOPLEVEL_NAME &>(*this);
+#else
+    assert(0 && "Saving not enabled.");
 #endif
   }
 };
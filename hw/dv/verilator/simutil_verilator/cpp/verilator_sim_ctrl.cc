@@ -4,17 +4,52 @@
 
 #include "verilator_sim_ctrl.h"
 
+#include <algorithm>
+#include <climits>
+#include <cstring>
+#include <dirent.h>
+#include <fstream>
 #include <getopt.h>
+#include <iomanip>
 #include <iostream>
+#include <sched.h>
 #include <signal.h>
+#include <sstream>
+#include <stdexcept>
 #include <sys/stat.h>
+#include <unistd.h>
 #include <verilated.h>
+#include <verilated_save.h>
+
+#include "dpi_checkpoint.h"
 
 // This is defined by Verilator and passed through the command line
 #ifndef VM_TRACE
 #define VM_TRACE 0
 #endif
 
+// Time one in this many calls to eval() to split the main loop's time into
+// eval() and overhead. Reading the clock can cost more than evaluating a small
+// model, so don't do it often. This is odd so that both clock edges get
+// sampled.
+static const unsigned int kEvalSampleInterval = 255;
+
+/**
+ * Get the time it takes to read the steady clock
+ *
+ * This is subtracted from the time measured for each sampled eval().
+ */
+static std::chrono::steady_clock::duration get_clock_overhead() {
+  std::chrono::steady_clock::duration overhead =
+      std::chrono::steady_clock::duration::max();
+  for (int i = 0; i < 16; ++i) {
+    std::chrono::steady_clock::time_point begin =
+        std::chrono::steady_clock::now();
+    overhead = std::min(overhead, std::chrono::steady_clock::now() - begin);
+  }
+  return overhead;
+}
+
 /**
  * Get the current simulation time
  *
@@ -106,10 +141,127 @@ static bool read_ul_arg(unsigned long *arg_val, const char *arg_name,
   return true;
 }
 
+/**
+ * Parse a list of CPUs (e.g. "0-3,6")
+ */
+static bool read_cpu_list_arg(std::vector<int> *cpus, const char *arg_name,
+                              const char *arg_text) {
+  assert(cpus && arg_name && arg_text);
+
+  cpus->clear();
+  std::istringstream iss(arg_text);
+  std::string item;
+  while (std::getline(iss, item, ',')) {
+    size_t dash_pos = item.find('-');
+    std::string first_text = item.substr(0, dash_pos);
+    std::string last_text = (dash_pos == std::string::npos)
+                                ? first_text
+                                : item.substr(dash_pos + 1);
+
+    unsigned long first, last;
+    if (!read_ul_arg(&first, arg_name, first_text.c_str()) ||
+        !read_ul_arg(&last, arg_name, last_text.c_str())) {
+      return false;
+    }
+    if (last < first || last >= CPU_SETSIZE) {
+      std::cerr << "ERROR: Bad format for " << arg_name << " argument: `"
+                << item << "' is not a valid CPU range.\n";
+      return false;
+    }
+    for (unsigned long cpu = first; cpu <= last; ++cpu) {
+      cpus->push_back(cpu);
+    }
+  }
+
+  if (cpus->empty()) {
+    std::cerr << "ERROR: Bad format for " << arg_name << " argument: `"
+              << arg_text << "' is empty.\n";
+    return false;
+  }
+  return true;
+}
+
+/**
+ * Get the IDs of all threads in this process
+ *
+ * Returns an empty list if they can't be found (e.g. not running on Linux).
+ */
+static std::vector<long> get_thread_ids() {
+  std::vector<long> tids;
+
+  DIR *dir = opendir("/proc/self/task");
+  if (!dir) {
+    return tids;
+  }
+  struct dirent *entry;
+  while ((entry = readdir(dir)) != nullptr) {
+    char *end;
+    long tid = strtol(entry->d_name, &end, 10);
+    if (end != entry->d_name && !*end) {
+      tids.push_back(tid);
+    }
+  }
+  closedir(dir);
+
+  // List the main thread (which has the same ID as the process) first.
+  std::sort(tids.begin(), tids.end());
+  auto main_it = std::find(tids.begin(), tids.end(), (long)getpid());
+  if (main_it != tids.end()) {
+    std::rotate(tids.begin(), main_it, main_it + 1);
+  }
+  return tids;
+}
+
+/**
+ * Get the CPU time used by a thread in this process in ns (0 if unknown)
+ */
+static unsigned long long get_thread_cpu_time_ns(long tid) {
+  std::string task_dir = "/proc/self/task/" + std::to_string(tid);
+
+  // schedstat has the time spent on the CPU in ns as its first field, but
+  // needs CONFIG_SCHEDSTATS. Fall back to utime + stime from stat otherwise.
+  std::ifstream schedstat(task_dir + "/schedstat");
+  unsigned long long run_time_ns;
+  if (schedstat >> run_time_ns) {
+    return run_time_ns;
+  }
+
+  std::ifstream stat_file(task_dir + "/stat");
+  std::string stat;
+  if (!std::getline(stat_file, stat)) {
+    return 0;
+  }
+  // The second field is the command name in brackets, which might contain
+  // spaces. utime and stime are fields 14 and 15.
+  size_t comm_end = stat.rfind(')');
+  if (comm_end == std::string::npos) {
+    return 0;
+  }
+  std::istringstream iss(stat.substr(comm_end + 1));
+  std::string field;
+  for (int i = 3; i < 14; ++i) {
+    iss >> field;
+  }
+  unsigned long long utime, stime;
+  if (!(iss >> utime >> stime)) {
+    return 0;
+  }
+  return (utime + stime) * 1000000000ULL / sysconf(_SC_CLK_TCK);
+}
+
 bool VerilatorSimCtrl::ParseCommandArgs(int argc, char **argv, bool &exit_app) {
   const struct option long_options[] = {
       {"term-after-cycles", required_argument, nullptr, 'c'},
       {"trace", no_argument, nullptr, 't'},
+      {"save-checkpoint", required_argument, nullptr, 'S'},
+      {"restore-checkpoint", required_argument, nullptr, 'R'},
+      {"pin-threads", required_argument, nullptr, 'P'},
+      {"trace-start", required_argument, nullptr, 'b'},
+      {"trace-stop", required_argument, nullptr, 'e'},
+      {"trace-trigger", required_argument, nullptr, 'g'},
+      {"trace-rotate", required_argument, nullptr, 'o'},
+      {"trace-ring", required_argument, nullptr, 'r'},
+      {"trace-depth", required_argument, nullptr, 'd'},
       {"help", no_argument, nullptr, 'h'},
       {nullptr, no_argument, nullptr, 0}};
 
@@ -123,24 +275,96 @@ bool VerilatorSimCtrl::ParseCommandArgs(int argc, char **argv, bool &exit_app) {
     opterr = 0;
 
     switch (c) {
-      case 0:
-      case 1:
-        break;
       case 't':
+      case 'b':
+      case 'e':
+      case 'g':
+      case 'o':
+      case 'r':
+      case 'd':
         if (!tracing_possible_) {
           std::cerr << "ERROR: Tracing has not been enabled at compile time."
                     << std::endl;
           exit_app = true;
           return false;
         }
+        break;
+    }
+
+    switch (c) {
+      case 0:
+      case 1:
+        break;
+      case 't':
         TraceOn();
         break;
+      case 'b':
+        if (!read_ul_arg(&trace_start_cycle_, "trace-start", optarg)) {
+          exit_app = true;
+          return false;
+        }
+        // Starting at cycle 0 is the same as --trace
+        if (!trace_start_cycle_) {
+          TraceOn();
+        }
+        break;
+      case 'e':
+        if (!read_ul_arg(&trace_stop_cycle_, "trace-stop", optarg)) {
+          exit_app = true;
+          return false;
+        }
+        break;
+      case 'g':
+        if (!ParseTraceTriggerArg(optarg)) {
+          exit_app = true;
+          return false;
+        }
+        break;
+      case 'o':
+      case 'r':
+        if (!read_ul_arg(&trace_rotate_cycles_,
+                         c == 'o' ? "trace-rotate" : "trace-ring", optarg)) {
+          exit_app = true;
+          return false;
+        }
+        trace_ring_ = (c == 'r');
+        break;
+      case 'd':
+        if (!read_ul_arg(&trace_depth_, "trace-depth", optarg)) {
+          exit_app = true;
+          return false;
+        }
+        break;
       case 'c':
         if (!read_ul_arg(&term_after_cycles_, "term-after-cycles", optarg)) {
           exit_app = true;
           return false;
         }
         break;
+      case 'S':
+      case 'R':
+        if (!VM_SAVABLE) {
+          std::cerr << "ERROR: Checkpoints need a simulation built with "
+                       "Verilator's --savable option and -DVM_SAVABLE."
+                    << std::endl;
+          exit_app = true;
+          return false;
+        }
+        if (c == 'S') {
+          if (!ParseSaveCheckpointArg(optarg)) {
+            exit_app = true;
+            return false;
+          }
+        } else {
+          restore_checkpoint_file_ = optarg;
+        }
+        break;
+      case 'P':
+        if (!read_cpu_list_arg(&pin_cpus_, "pin-threads", optarg)) {
+          exit_app = true;
+          return false;
+        }
+        break;
       case 'h':
         PrintHelp();
         exit_app = true;
@@ -156,6 +380,17 @@ bool VerilatorSimCtrl::ParseCommandArgs(int argc, char **argv, bool &exit_app) {
     }
   }
 
+  if (trace_stop_cycle_ && trace_stop_cycle_ <= trace_start_cycle_) {
+    std::cerr << "ERROR: --trace-stop must be after --trace-start."
+              << std::endl;
+    exit_app = true;
+    return false;
+  }
+  // The ring buffer starts with the simulation unless told otherwise
+  if (trace_ring_ && !trace_start_cycle_ && trace_trigger_name_.empty()) {
+    TraceOn();
+  }
+
   // Pass args to verilator
   Verilated::commandArgs(argc, argv);
 
@@ -194,10 +429,12 @@ void VerilatorSimCtrl::RunSimulation() {
   // Print simulation speed info
   PrintStatistics();
   // Print helper message for tracing
-  if (TracingEverEnabled()) {
+  if (!trace_files_.empty()) {
     std::cout << std::endl
-              << "You can view the simulation traces by calling" << std::endl
-              << "$ gtkwave " << GetTraceFileName() << std::endl;
+              << "You can view the simulation traces by calling" << std::endl;
+    for (const std::string &trace_file : trace_files_) {
+      std::cout << "$ gtkwave " << trace_file << std::endl;
+    }
   }
 }
 
@@ -214,14 +451,62 @@ void VerilatorSimCtrl::SetTimeout(unsigned int cycles) {
 }
 
 void VerilatorSimCtrl::RequestStop(bool simulation_success) {
+  if (!simulation_success) {
+    simulation_success_ = false;
+    run_success_ = false;
+  }
   request_stop_ = true;
-  simulation_success_ &= simulation_success;
+}
+
+void VerilatorSimCtrl::ReportEvent(const char *name) {
+  if (!trace_trigger_name_.empty() && trace_trigger_text_.empty() &&
+      trace_trigger_name_ == name) {
+    TraceOn();
+  }
+}
+
+void VerilatorSimCtrl::ReportOutput(const char *name, char c) {
+  if (trace_trigger_text_.empty() || trace_trigger_name_ != name) {
+    return;
+  }
+
+  // Keep the last few characters, enough to match the trigger text
+  std::lock_guard<std::mutex> lock(trace_trigger_mutex_);
+  trace_trigger_window_.push_back(c);
+  if (trace_trigger_window_.size() > trace_trigger_text_.size()) {
+    trace_trigger_window_.erase(0, 1);
+  }
+  if (trace_trigger_window_ == trace_trigger_text_) {
+    TraceOn();
+  }
+}
+
+void VerilatorSimCtrl::ReportTestResult(bool passed) { test_failed_ = !passed; }
+
+void simctrl_report_event(const char *name) {
+  VerilatorSimCtrl::GetInstance().ReportEvent(name);
+}
+
+void simctrl_report_test_result(unsigned char passed) {
+  VerilatorSimCtrl::GetInstance().ReportTestResult(passed);
 }
 
 void VerilatorSimCtrl::RegisterExtension(SimCtrlExtension *ext) {
   extension_array_.push_back(ext);
 }
 
+void VerilatorSimCtrl::WakeExtension(SimCtrlExtension *ext,
+                                     unsigned long cycle) {
+  auto it = std::find(extension_array_.begin(), extension_array_.end(), ext);
+  assert(it != extension_array_.end() && "Extension not registered.");
+
+  // Events are checked before the clock changes, on both edges. If this isn't
+  // the rising edge, ClockDueExtensions() defers the call until it is.
+  unsigned long time = std::max(2 * cycle, wheel_time_);
+  timer_wheel_.Schedule(time, kEventWakeExtension,
+                        it - extension_array_.begin());
+}
+
 VerilatorSimCtrl::VerilatorSimCtrl()
     : top_(nullptr),
       time_(0),
@@ -233,8 +518,24 @@ VerilatorSimCtrl::VerilatorSimCtrl()
       reset_duration_cycles_(2),
       request_stop_(false),
       simulation_success_(true),
+      run_success_(true),
+      num_runs_(1),
       tracer_(VerilatedTracer()),
-      term_after_cycles_(0) {}
+      term_after_cycles_(0),
+      save_checkpoint_cycle_(0),
+      restored_time_(0),
+      wheel_time_(0),
+      loop_time_(std::chrono::steady_clock::duration::zero()),
+      sampled_eval_time_(std::chrono::steady_clock::duration::zero()),
+      num_loop_evals_(0),
+      num_sampled_evals_(0),
+      trace_start_cycle_(0),
+      trace_stop_cycle_(0),
+      trace_rotate_cycles_(0),
+      trace_ring_(false),
+      test_failed_(false),
+      trace_depth_(99),
+      trace_file_index_(0) {}
 
 void VerilatorSimCtrl::RegisterSignalHandler() {
   struct sigaction sigIntHandler;
@@ -268,61 +569,150 @@ void VerilatorSimCtrl::PrintHelp() const {
   std::cout << "Execute a simulation model for " << GetName() << "\n\n";
   if (tracing_possible_) {
     std::cout << "-t|--trace\n"
-                 "  Write a trace file from the start\n\n";
+                 "  Write a trace file from the start\n\n"
+                 "--trace-start=N\n"
+                 "  Start tracing at cycle N\n\n"
+                 "--trace-stop=N\n"
+                 "  Stop tracing at cycle N\n\n"
+                 "--trace-trigger=NAME\n"
+                 "--trace-trigger=NAME:TEXT\n"
+                 "  Start tracing when the event NAME is reported (e.g. by a\n"
+                 "  DPI module), or when the output stream NAME (e.g. a UART)\n"
+                 "  contains TEXT\n\n"
+                 "--trace-rotate=N\n"
+                 "  Start a new trace file every N cycles\n\n"
+                 "--trace-ring=N\n"
+                 "  Keep at least the last N cycles of the trace, in two\n"
+                 "  files of up to N cycles each. The files are deleted if\n"
+                 "  the simulation passes. Tracing starts at once unless\n"
+                 "  --trace-start or --trace-trigger is given.\n\n"
+                 "--trace-depth=N\n"
+                 "  Only trace N levels of hierarchy\n\n";
   }
   std::cout << "-c|--term-after-cycles=N\n"
-               "  Terminate simulation after N cycles. 0 means no timeout.\n\n"
-               "-h|--help\n"
+               "  Terminate simulation after N cycles. 0 means no timeout.\n\n";
+  if (VM_SAVABLE) {
+    std::cout << "--save-checkpoint=FILE@N\n"
+                 "  Save the simulation state to FILE after N cycles\n\n"
+                 "--restore-checkpoint=FILE\n"
+                 "  Start the simulation from the state saved in FILE\n\n";
+  }
+  std::cout << "--pin-threads=CPULIST\n"
+               "  Pin the model threads to the given CPUs, one CPU each, in\n"
+               "  order (e.g. 0-3,6). The main thread takes the first CPU.\n\n";
+  std::cout << "-h|--help\n"
                "  Show help\n\n"
                "All arguments are passed to the design and can be used "
                "in the design, e.g. by DPI modules.\n\n";
 }
 
 bool VerilatorSimCtrl::TraceOn() {
-  bool old_tracing_enabled = tracing_enabled_;
+  bool old_tracing_enabled = tracing_enabled_.exchange(tracing_possible_);
 
-  tracing_enabled_ = tracing_possible_;
-  tracing_ever_enabled_ = tracing_enabled_;
+  tracing_ever_enabled_ = tracing_possible_;
 
-  if (old_tracing_enabled != tracing_enabled_) {
+  if (old_tracing_enabled != tracing_possible_) {
     tracing_enabled_changed_ = true;
   }
-  return tracing_enabled_;
+  return tracing_possible_;
 }
 
 bool VerilatorSimCtrl::TraceOff() {
-  if (tracing_enabled_) {
+  if (tracing_enabled_.exchange(false)) {
     tracing_enabled_changed_ = true;
   }
-  tracing_enabled_ = false;
-  return tracing_enabled_;
+  return false;
 }
 
 void VerilatorSimCtrl::PrintStatistics() const {
-  double speed_hz = time_ / 2 / (GetExecutionTimeMs() / 1000.0);
+  // Cycles before a restored checkpoint weren't run by this process
+  unsigned long cycles = (time_ - restored_time_) / 2;
+  double speed_hz = cycles / (GetExecutionTimeMs() / 1000.0);
   double speed_khz = speed_hz / 1000.0;
 
   std::cout << std::endl
             << "Simulation statistics" << std::endl
             << "=====================" << std::endl
-            << "Executed cycles:  " << time_ / 2 << std::endl
-            << "Wallclock time:   " << GetExecutionTimeMs() / 1000.0 << " s"
+            << "Executed cycles:  " << cycles << std::endl;
+  if (num_runs_ > 1) {
+    std::cout << "Runs:             " << num_runs_ << std::endl;
+  }
+  std::cout << "Wallclock time:   " << GetExecutionTimeMs() / 1000.0 << " s"
             << std::endl
             << "Simulation speed: " << speed_hz << " cycles/s "
             << "(" << speed_khz << " kHz)" << std::endl;
 
-  int trace_size_byte;
-  if (tracing_enabled_ && FileSize(GetTraceFileName(), trace_size_byte)) {
+  // Scale up the sampled eval() time to estimate the total
+  if (num_sampled_evals_) {
+    double loop_s =
+        std::chrono::duration_cast<std::chrono::duration<double>>(loop_time_)
+            .count();
+    double eval_s =
+        std::chrono::duration_cast<std::chrono::duration<double>>(
+            sampled_eval_time_)
+            .count() *
+        num_loop_evals_ / num_sampled_evals_;
+    double overhead_s = std::max(loop_s - eval_s, 0.0);
+
+    std::cout << "Eval time:        " << eval_s << " s" << std::endl
+              << "Loop overhead:    " << overhead_s << " s ("
+              << 1e9 * overhead_s / num_loop_evals_ << " ns per eval)"
+              << std::endl;
+  }
+
+  // With a single model thread, its CPU time isn't very interesting.
+  if (model_threads_.size() > 1 || !pin_cpus_.empty()) {
+    double wallclock_ns = GetExecutionTimeMs() * 1e6;
+    std::cout << "Thread CPU time:" << std::endl;
+    for (size_t i = 0; i < model_threads_.size(); ++i) {
+      const ModelThread &thread = model_threads_[i];
+      std::ostringstream name;
+      if (i == 0) {
+        name << "main";
+      } else {
+        name << "worker " << i;
+      }
+      name << " (tid " << thread.tid;
+      if (thread.cpu >= 0) {
+        name << ", CPU " << thread.cpu;
+      }
+      name << ")";
+
+      unsigned long long cpu_time_ns =
+          thread.cpu_time_end_ns - thread.cpu_time_begin_ns;
+      std::cout << "  " << std::left << std::setw(28) << name.str()
+                << std::right << cpu_time_ns / 1e9 << " s";
+      if (wallclock_ns > 0) {
+        std::cout << " (" << std::fixed << std::setprecision(1)
+                  << 100.0 * cpu_time_ns / wallclock_ns << " %)"
+                  << std::defaultfloat;
+      }
+      std::cout << std::endl;
+    }
+  }
+
+  unsigned long long trace_size_byte = 0;
+  for (const std::string &trace_file : trace_files_) {
+    int file_size_byte;
+    if (FileSize(trace_file, file_size_byte)) {
+      trace_size_byte += file_size_byte;
+    }
+  }
+  if (!trace_files_.empty()) {
     std::cout << "Trace file size:  " << trace_size_byte << " B" << std::endl;
   }
 }
 
-const char *VerilatorSimCtrl::GetTraceFileName() const {
+std::string VerilatorSimCtrl::GetTraceFileName() const {
 #ifdef VM_TRACE_FMT_FST
-  return "sim.fst";
+  const char *extension = ".fst";
 #else
-  return "sim.vcd";
+  const char *extension = ".vcd";
 #endif
+  if (!trace_rotate_cycles_) {
+    return std::string("sim") + extension;
+  }
+  return "sim." + std::to_string(trace_file_index_) + extension;
 }
 
 void VerilatorSimCtrl::Run() {
@@ -331,69 +721,254 @@ void VerilatorSimCtrl::Run() {
   // We always need to enable this as tracing can be enabled at runtime
   if (tracing_possible_) {
     Verilated::traceEverOn(true);
-    top_->trace(tracer_, 99, 0);
+    top_->trace(tracer_, trace_depth_, 0);
   }
 
+  FindModelThreads();
+
   // Evaluate all initial blocks, including the DPI setup routines
   top_->eval();
 
+  // Pin threads after the initial blocks: threads started by DPI setup routines
+  // inherit the affinity of the thread that starts them, and shouldn't compete
+  // with the main thread for its CPU.
+  if (!PinModelThreads()) {
+    RequestStop(false);
+  }
+
   std::cout << std::endl
             << "Simulation running, end by pressing CTRL-c." << std::endl;
 
   time_begin_ = std::chrono::steady_clock::now();
+  SampleModelThreadTimes(false);
   UnsetReset();
+
+  // Restoring a checkpoint overwrites the model state (including the clock
+  // and reset signals) and the time, so the reset sequence below won't run
+  // again.
+  if (!restore_checkpoint_file_.empty() &&
+      !RestoreCheckpoint(restore_checkpoint_file_)) {
+    RequestStop(false);
+  }
+
   Trace();
 
-  unsigned long start_reset_cycle_ = initial_reset_delay_cycles_;
-  unsigned long end_reset_cycle_ = start_reset_cycle_ + reset_duration_cycles_;
+  ScheduleEvents();
 
-  while (1) {
-    unsigned long cycle_ = time_ / 2;
+  const unsigned long save_checkpoint_time =
+      save_checkpoint_cycle_ ? 2 * save_checkpoint_cycle_ : 0;
+  unsigned long timeout_time =
+      term_after_cycles_ ? 2 * term_after_cycles_ : ULONG_MAX;
+  const unsigned long loop_begin_time = time_;
+  unsigned int eval_sample_countdown = kEvalSampleInterval;
+  const std::chrono::steady_clock::duration clock_overhead =
+      get_clock_overhead();
+  std::chrono::steady_clock::time_point loop_begin =
+      std::chrono::steady_clock::now();
 
-    if (cycle_ == start_reset_cycle_) {
-      SetReset();
-    } else if (cycle_ == end_reset_cycle_) {
-      UnsetReset();
+  while (1) {
+    // Reset changes and extension calls are scheduled events, so nothing needs
+    // to be checked here unless something is due.
+    if (timer_wheel_.PopDue(time_, due_events_)) {
+      ProcessDueEvents();
     }
+    wheel_time_ = time_ + 1;
 
     *sig_clk_ = !*sig_clk_;
 
-    // Call all extension on-clock methods
     if (*sig_clk_) {
-      for (auto it = extension_array_.begin(); it != extension_array_.end();
-           ++it) {
-        (*it)->OnClock(time_);
+      for (SimCtrlExtension *ext : every_cycle_extensions_) {
+        ext->OnClock(time_);
       }
     }
+    if (!due_extensions_.empty()) {
+      ClockDueExtensions();
+    }
 
-    top_->eval();
+    if (--eval_sample_countdown) {
+      top_->eval();
+    } else {
+      std::chrono::steady_clock::time_point eval_begin =
+          std::chrono::steady_clock::now();
+      top_->eval();
+      sampled_eval_time_ += std::max(
+          std::chrono::steady_clock::now() - eval_begin - clock_overhead,
+          std::chrono::steady_clock::duration::zero());
+      ++num_sampled_evals_;
+      eval_sample_countdown = kEvalSampleInterval;
+    }
     time_++;
 
-    Trace();
-
-    if (request_stop_) {
-      std::cout << "Received stop request, shutting down simulation."
-                << std::endl;
-      break;
+    if (tracing_enabled_ || tracing_enabled_changed_) {
+      Trace();
     }
-    if (Verilated::gotFinish()) {
-      std::cout << "Received $finish() from Verilog, shutting down simulation."
-                << std::endl;
-      break;
+
+    if (time_ == save_checkpoint_time &&
+        !SaveCheckpoint(save_checkpoint_file_)) {
+      RequestStop(false);
     }
-    if (term_after_cycles_ && (time_ / 2 >= term_after_cycles_)) {
-      std::cout << "Simulation timeout of " << term_after_cycles_
-                << " cycles reached, shutting down simulation." << std::endl;
+
+    if (request_stop_ || Verilated::gotFinish() || time_ >= timeout_time) {
+      if (request_stop_) {
+        std::cout << "Received stop request, shutting down simulation."
+                  << std::endl;
+      } else if (Verilated::gotFinish()) {
+        std::cout
+            << "Received $finish() from Verilog, shutting down simulation."
+            << std::endl;
+      } else {
+        std::cout << "Simulation timeout of " << term_after_cycles_
+                  << " cycles reached, shutting down simulation." << std::endl;
+      }
+
+      if (StartNextRun()) {
+        // The timeout applies to each run separately
+        timeout_time =
+            term_after_cycles_ ? time_ + 2 * term_after_cycles_ : ULONG_MAX;
+        continue;
+      }
       break;
     }
   }
 
+  loop_time_ = std::chrono::steady_clock::now() - loop_begin;
+  num_loop_evals_ = time_ - loop_begin_time;
+
+  SampleModelThreadTimes(true);
   top_->final();
   time_end_ = std::chrono::steady_clock::now();
 
-  if (TracingEverEnabled()) {
-    tracer_.close();
+  FinishTrace();
+}
+
+void VerilatorSimCtrl::ScheduleEvents() {
+  // Calls requested before the simulation started (or before a restored
+  // checkpoint's time) are due now.
+  wheel_time_ = time_;
+  timer_wheel_.ClampTo(time_);
+
+  // A restored checkpoint may be past the reset sequence
+  unsigned long start_reset_time = 2UL * initial_reset_delay_cycles_;
+  unsigned long end_reset_time =
+      start_reset_time + 2UL * reset_duration_cycles_;
+  if (start_reset_time >= time_) {
+    timer_wheel_.Schedule(start_reset_time, kEventSetReset, 0);
+  }
+  if (end_reset_time >= time_) {
+    timer_wheel_.Schedule(end_reset_time, kEventUnsetReset, 0);
+  }
+
+  if (trace_start_cycle_ && 2 * trace_start_cycle_ >= time_) {
+    timer_wheel_.Schedule(2 * trace_start_cycle_, kEventTraceOn, 0);
+  }
+  if (trace_stop_cycle_ && 2 * trace_stop_cycle_ >= time_) {
+    timer_wheel_.Schedule(2 * trace_stop_cycle_, kEventTraceOff, 0);
+  }
+  if (trace_rotate_cycles_) {
+    // Rotate at multiples of the interval, so that a restored checkpoint
+    // rotates at the same cycles as the original run.
+    unsigned long interval = 2 * trace_rotate_cycles_;
+    timer_wheel_.Schedule((time_ / interval + 1) * interval, kEventTraceRotate,
+                          0);
+  }
+
+  every_cycle_extensions_.clear();
+  extension_intervals_.clear();
+  extension_clocked_time_.assign(extension_array_.size(), ULONG_MAX);
+  for (size_t i = 0; i < extension_array_.size(); ++i) {
+    unsigned long interval = extension_array_[i]->GetOnClockInterval();
+    extension_intervals_.push_back(interval);
+    if (interval == 1) {
+      every_cycle_extensions_.push_back(extension_array_[i]);
+    } else if (interval != SimCtrlExtension::kOnDemand) {
+      timer_wheel_.Schedule(time_, kEventWakeExtension, i);
+    }
+  }
+}
+
+bool VerilatorSimCtrl::StartNextRun() {
+  bool next_run = false;
+  for (SimCtrlExtension *ext : extension_array_) {
+    next_run |= ext->OnRunEnd(run_success_);
+  }
+  if (!next_run) {
+    return false;
+  }
+
+  ++num_runs_;
+  std::cout << "Starting run " << num_runs_ << " of the simulation."
+            << std::endl;
+
+  // Forget how the last run ended. Verilator treats a second $finish as
+  // fatal, so its flag must be cleared too. simulation_success_ is left alone,
+  // so that the simulation as a whole fails if any run failed.
+  Verilated::gotFinish(false);
+  request_stop_ = false;
+  run_success_ = true;
+
+  // Reset the design straight away, so that anything that reports errors
+  // every cycle once it has failed (and would end the next run early) is
+  // cleared. The reset lasts as long as at the start of the simulation.
+  SetReset();
+  timer_wheel_.Schedule(time_ + 2UL * reset_duration_cycles_,
+                        kEventUnsetReset, 0);
+  return true;
+}
+
+void VerilatorSimCtrl::ProcessDueEvents() {
+  for (const SimTimerWheel::Event &event : due_events_) {
+    switch (event.kind) {
+      case kEventSetReset:
+        SetReset();
+        break;
+      case kEventUnsetReset:
+        UnsetReset();
+        break;
+      case kEventWakeExtension:
+        due_extensions_.push_back(event.arg);
+        break;
+      case kEventTraceOn:
+        TraceOn();
+        break;
+      case kEventTraceOff:
+        TraceOff();
+        break;
+      case kEventTraceRotate:
+        RotateTrace();
+        timer_wheel_.Schedule(time_ + 2 * trace_rotate_cycles_,
+                              kEventTraceRotate, 0);
+        break;
+      default:
+        assert(0 && "Unknown event kind.");
+    }
   }
+  due_events_.clear();
+}
+
+void VerilatorSimCtrl::ClockDueExtensions() {
+  if (!*sig_clk_) {
+    // Not a rising edge: try again on the next tick
+    for (unsigned int idx : due_extensions_) {
+      timer_wheel_.Schedule(time_ + 1, kEventWakeExtension, idx);
+    }
+    due_extensions_.clear();
+    return;
+  }
+
+  for (unsigned int idx : due_extensions_) {
+    unsigned long interval = extension_intervals_[idx];
+    // Extensions called every cycle have already been called, and an
+    // extension woken more than once for this cycle is only called once.
+    if (interval == 1 || extension_clocked_time_[idx] == time_) {
+      continue;
+    }
+    extension_clocked_time_[idx] = time_;
+    if (interval != SimCtrlExtension::kOnDemand) {
+      timer_wheel_.Schedule(time_ + 2 * interval, kEventWakeExtension, idx);
+    }
+    extension_array_[idx]->OnClock(time_);
+  }
+  due_extensions_.clear();
 }
 
 std::string VerilatorSimCtrl::GetName() const {
@@ -454,10 +1029,289 @@ void VerilatorSimCtrl::Trace() {
   }
 
   if (!tracer_.isOpen()) {
-    tracer_.open(GetTraceFileName());
-    std::cout << "Writing simulation traces to " << GetTraceFileName()
-              << std::endl;
+    std::string trace_file = GetTraceFileName();
+    tracer_.open(trace_file.c_str());
+    trace_files_.push_back(trace_file);
+    std::cout << "Writing simulation traces to " << trace_file << std::endl;
   }
 
   tracer_.dump(GetTime());
 }
+
+void VerilatorSimCtrl::FindModelThreads() {
+  model_threads_.clear();
+  for (long tid : get_thread_ids()) {
+    model_threads_.push_back({tid, -1, 0, 0});
+  }
+}
+
+bool VerilatorSimCtrl::PinModelThreads() {
+  if (pin_cpus_.empty()) {
+    return true;
+  }
+
+#ifdef __linux__
+  if (model_threads_.empty()) {
+    std::cerr << "ERROR: Unable to find the threads of the simulation to pin."
+              << std::endl;
+    return false;
+  }
+  if (pin_cpus_.size() < model_threads_.size()) {
+    std::cerr << "WARNING: The simulation has " << model_threads_.size()
+              << " threads but --pin-threads only lists " << pin_cpus_.size()
+              << " CPUs. Not pinning the remaining threads." << std::endl;
+  }
+
+  for (size_t i = 0; i < model_threads_.size() && i < pin_cpus_.size(); ++i) {
+    ModelThread &thread = model_threads_[i];
+    cpu_set_t cpu_set;
+    CPU_ZERO(&cpu_set);
+    CPU_SET(pin_cpus_[i], &cpu_set);
+    if (sched_setaffinity(thread.tid, sizeof(cpu_set), &cpu_set) != 0) {
+      std::cerr << "ERROR: Unable to pin thread " << thread.tid << " to CPU "
+                << pin_cpus_[i] << ": " << strerror(errno) << std::endl;
+      return false;
+    }
+    thread.cpu = pin_cpus_[i];
+  }
+  return true;
+#else
+  std::cerr << "ERROR: --pin-threads is only supported on Linux." << std::endl;
+  return false;
+#endif
+}
+
+void VerilatorSimCtrl::SampleModelThreadTimes(bool end) {
+  for (ModelThread &thread : model_threads_) {
+    unsigned long long cpu_time_ns = get_thread_cpu_time_ns(thread.tid);
+    if (end) {
+      thread.cpu_time_end_ns = cpu_time_ns;
+    } else {
+      thread.cpu_time_begin_ns = cpu_time_ns;
+    }
+  }
+}
+
+bool VerilatorSimCtrl::ParseTraceTriggerArg(const char *arg_text) {
+  std::string arg(arg_text);
+  size_t colon_pos = arg.find(':');
+  if (colon_pos == 0 || arg.empty() ||
+      (colon_pos != std::string::npos && colon_pos + 1 == arg.size())) {
+    std::cerr << "ERROR: Bad format for trace-trigger argument: `" << arg
+              << "' is not of the form NAME or NAME:TEXT.\n";
+    return false;
+  }
+
+  trace_trigger_name_ = arg.substr(0, colon_pos);
+  trace_trigger_text_ =
+      (colon_pos == std::string::npos) ? "" : arg.substr(colon_pos + 1);
+  return true;
+}
+
+void VerilatorSimCtrl::RotateTrace() {
+  // Nothing has been written since the last rotation
+  if (!tracer_.isOpen()) {
+    return;
+  }
+  tracer_.close();
+
+  // In ring mode, keep only the file just closed. The next one is opened by
+  // Trace().
+  if (trace_ring_) {
+    while (trace_files_.size() > 1) {
+      unlink(trace_files_.front().c_str());
+      trace_files_.erase(trace_files_.begin());
+    }
+  }
+  ++trace_file_index_;
+}
+
+void VerilatorSimCtrl::FinishTrace() {
+  if (tracer_.isOpen()) {
+    tracer_.close();
+  }
+
+  if (!trace_ring_ || trace_files_.empty()) {
+    return;
+  }
+  if (WasSimulationSuccessful() && !test_failed_) {
+    for (const std::string &trace_file : trace_files_) {
+      unlink(trace_file.c_str());
+    }
+    trace_files_.clear();
+    std::cout << "Simulation passed, deleted the trace ring buffer files."
+              << std::endl;
+  } else {
+    std::cout << "Simulation or test failed, kept the last "
+              << trace_rotate_cycles_
+              << " or more cycles of the trace." << std::endl;
+  }
+}
+
+bool VerilatorSimCtrl::ParseSaveCheckpointArg(const char *arg_text) {
+  std::string arg(arg_text);
+  size_t at_pos = arg.rfind('@');
+  if (at_pos == std::string::npos || at_pos == 0) {
+    std::cerr << "ERROR: Bad format for save-checkpoint argument: `" << arg
+              << "' is not of the form FILE@CYCLE.\n";
+    return false;
+  }
+
+  unsigned long cycle;
+  std::string cycle_text = arg.substr(at_pos + 1);
+  if (!read_ul_arg(&cycle, "save-checkpoint", cycle_text.c_str())) {
+    return false;
+  }
+  if (cycle == 0) {
+    std::cerr << "ERROR: Cannot save a checkpoint at cycle 0.\n";
+    return false;
+  }
+
+  save_checkpoint_file_ = arg.substr(0, at_pos);
+  save_checkpoint_cycle_ = cycle;
+  return true;
+}
+
+/**
+ * Write the state of all registered DPI contexts to a checkpoint
+ */
+static void save_dpi_contexts(VerilatedSerialize &os) {
+  std::vector<DpiCheckpointEntry> entries = DpiCheckpointGetEntries();
+
+  vluint64_t num_entries = entries.size();
+  os << num_entries;
+  for (const DpiCheckpointEntry &entry : entries) {
+    std::string name = entry.name;
+    vluint64_t state_size = entry.state_size;
+    os << name << state_size;
+    os.write(entry.state, entry.state_size);
+  }
+}
+
+/**
+ * Restore the state of all registered DPI contexts from a checkpoint and
+ * re-attach them to their modules
+ *
+ * Throws a std::runtime_error if the saved contexts don't match the ones
+ * registered in this simulation.
+ */
+static void restore_dpi_contexts(VerilatedDeserialize &is) {
+  std::vector<DpiCheckpointEntry> entries = DpiCheckpointGetEntries();
+
+  vluint64_t num_entries;
+  is >> num_entries;
+  if (num_entries != entries.size()) {
+    std::ostringstream oss;
+    oss << "Checkpoint has state for " << num_entries
+        << " DPI contexts, but the simulation has " << entries.size() << ".";
+    throw std::runtime_error(oss.str());
+  }
+
+  // Saved entries are in creation order. This should match the order in this
+  // simulation, but look up by name in case it doesn't.
+  for (vluint64_t i = 0; i < num_entries; ++i) {
+    std::string name;
+    vluint64_t state_size;
+    is >> name >> state_size;
+
+    auto it = std::find_if(entries.begin(), entries.end(),
+                           [&name](const DpiCheckpointEntry &entry) {
+                             return entry.name == name;
+                           });
+    if (it == entries.end()) {
+      std::ostringstream oss;
+      oss << "Checkpoint has state for a DPI context at `" << name
+          << "', which doesn't exist in the simulation.";
+      throw std::runtime_error(oss.str());
+    }
+    if (state_size != it->state_size) {
+      std::ostringstream oss;
+      oss << "Checkpoint has " << state_size
+          << " bytes of state for the DPI context at `" << name
+          << "', but it should have " << it->state_size << ".";
+      throw std::runtime_error(oss.str());
+    }
+    is.read(it->state, it->state_size);
+  }
+
+  DpiCheckpointReattachAll();
+}
+
+bool VerilatorSimCtrl::SaveCheckpoint(const std::string &filepath) {
+  VerilatedSave os;
+  os.open(filepath.c_str());
+  if (!os.isOpen()) {
+    std::cerr << "ERROR: Unable to open checkpoint file `" << filepath
+              << "' for writing." << std::endl;
+    return false;
+  }
+
+  // The name of the toplevel lets us catch checkpoints from other simulations
+  // before Verilator does something worse.
+  std::string name = GetName();
+  vluint64_t time = time_;
+  vluint64_t num_extensions = extension_array_.size();
+
+  os << name << time;
+  top_->save(os);
+  save_dpi_contexts(os);
+  os << num_extensions;
+  for (auto it = extension_array_.begin(); it != extension_array_.end(); ++it) {
+    (*it)->SaveCheckpoint(os);
+  }
+  os.close();
+
+  std::cout << "Saved simulation checkpoint to `" << filepath << "' at cycle "
+            << time_ / 2 << "." << std::endl;
+  return true;
+}
+
+bool VerilatorSimCtrl::RestoreCheckpoint(const std::string &filepath) {
+  VerilatedRestore is;
+  is.open(filepath.c_str());
+  if (!is.isOpen()) {
+    std::cerr << "ERROR: Unable to open checkpoint file `" << filepath
+              << "' for reading." << std::endl;
+    return false;
+  }
+
+  std::string name;
+  vluint64_t time;
+  is >> name;
+  if (name != GetName()) {
+    std::cerr << "ERROR: Checkpoint file `" << filepath << "' is for `" << name
+              << "', not `" << GetName() << "'." << std::endl;
+    return false;
+  }
+  is >> time;
+  top_->restore(is);
+
+  try {
+    restore_dpi_contexts(is);
+
+    vluint64_t num_extensions;
+    is >> num_extensions;
+    if (num_extensions != extension_array_.size()) {
+      std::ostringstream oss;
+      oss << "Checkpoint has state for " << num_extensions
+          << " extensions, but the simulation has " << extension_array_.size()
+          << ".";
+      throw std::runtime_error(oss.str());
+    }
+    for (auto it = extension_array_.begin(); it != extension_array_.end();
+         ++it) {
+      (*it)->RestoreCheckpoint(is);
+    }
+  } catch (const std::exception &err) {
+    std::cerr << "ERROR: Failed to restore checkpoint `" << filepath
+              << "': " << err.what() << std::endl;
+    return false;
+  }
+  is.close();
+
+  time_ = time;
+  restored_time_ = time;
+  std::cout << "Restored simulation checkpoint from `" << filepath
+            << "' at cycle " << time_ / 2 << "." << std::endl;
+  return true;
+}
@@ -5,11 +5,14 @@
 #ifndef OPENTITAN_HW_DV_VERILATOR_SIMUTIL_VERILATOR_CPP_VERILATOR_SIM_CTRL_H_
 #define OPENTITAN_HW_DV_VERILATOR_SIMUTIL_VERILATOR_CPP_VERILATOR_SIM_CTRL_H_
 
+#include <atomic>
 #include <chrono>
+#include <mutex>
 #include <string>
 #include <vector>
 
 #include "sim_ctrl_extension.h"
+#include "sim_timer_wheel.h"
 #include "verilated_toplevel.h"
 
 enum VerilatorSimCtrlFlags {
@@ -107,7 +110,8 @@ class VerilatorSimCtrl {
   void SetTimeout(unsigned int cycles);
 
   /**
-   * Request the simulation to stop
+   * Request the simulation (or the current run, see
+   * SimCtrlExtension::OnRunEnd()) to stop
    */
   void RequestStop(bool simulation_success);
 
@@ -116,30 +120,139 @@ class VerilatorSimCtrl {
    */
   void RegisterExtension(SimCtrlExtension *ext);
 
+  /**
+   * Call the OnClock() function of a registered extension at a given cycle
+   *
+   * This is meant for extensions with an OnClock() interval of
+   * SimCtrlExtension::kOnDemand, which can call it from PreExec() or OnClock()
+   * to say when they next need to look at the design. If the cycle has already
+   * started, the extension is called at the next one. Extensions called every
+   * cycle are not called again.
+   */
+  void WakeExtension(SimCtrlExtension *ext, unsigned long cycle);
+
+  /**
+   * Report a named event, which starts tracing if it was given with
+   * --trace-trigger=NAME
+   *
+   * This may be called from DPI code on any thread (see also
+   * simctrl_report_event()).
+   */
+  void ReportEvent(const char *name);
+
+  /**
+   * Report a character of output on a named stream (such as a UART), which
+   * starts tracing if the stream outputs the text given with
+   * --trace-trigger=NAME:TEXT
+   *
+   * This may be called from DPI code on any thread (see uartdpi's output
+   * hook). The trigger name and text are only written while parsing the
+   * command line, before the model runs, and the window of recent output is
+   * protected by a mutex.
+   */
+  void ReportOutput(const char *name, char c);
+
+  /**
+   * Report the result of the software test that the simulation runs
+   *
+   * This doesn't change the result of the simulation itself. It only decides
+   * whether the trace ring buffer (--trace-ring) is kept: it is deleted only
+   * if both the simulation and the test passed.
+   */
+  void ReportTestResult(bool passed);
+
   /**
    * Get the current time in ticks
    */
   unsigned long GetTime() const { return time_; }
 
  private:
+  /**
+   * A thread of the Verilated model
+   *
+   * These are the main thread and Verilator's worker threads (when the model
+   * was built with --threads).
+   */
+  struct ModelThread {
+    long tid;
+    int cpu;  // CPU the thread is pinned to, or -1
+    unsigned long long cpu_time_begin_ns;
+    unsigned long long cpu_time_end_ns;
+  };
+
+  /**
+   * Kinds of events in timer_wheel_
+   */
+  enum SimEventKind : unsigned int {
+    kEventSetReset,
+    kEventUnsetReset,
+    kEventWakeExtension,  // arg is the index in extension_array_
+    kEventTraceOn,
+    kEventTraceOff,
+    kEventTraceRotate,
+  };
+
   VerilatedToplevel *top_;
   CData *sig_clk_;
   CData *sig_rst_;
   VerilatorSimCtrlFlags flags_;
   unsigned long time_;
-  bool tracing_enabled_;
-  bool tracing_enabled_changed_;
-  bool tracing_ever_enabled_;
+  // Tracing and stop requests can come from a signal handler or from DPI code
+  // on one of the model's threads.
+  std::atomic<bool> tracing_enabled_;
+  std::atomic<bool> tracing_enabled_changed_;
+  std::atomic<bool> tracing_ever_enabled_;
   bool tracing_possible_;
   unsigned int initial_reset_delay_cycles_;
   unsigned int reset_duration_cycles_;
-  volatile unsigned int request_stop_;
-  volatile bool simulation_success_;
+  std::atomic<bool> request_stop_;
+  std::atomic<bool> simulation_success_;
+  // Whether the current run was successful (see SimCtrlExtension::OnRunEnd())
+  // and the number of runs so far
+  std::atomic<bool> run_success_;
+  unsigned long num_runs_;
   std::chrono::steady_clock::time_point time_begin_;
   std::chrono::steady_clock::time_point time_end_;
   VerilatedTracer tracer_;
   unsigned long term_after_cycles_;
   std::vector<SimCtrlExtension *> extension_array_;
+  std::string save_checkpoint_file_;
+  unsigned long save_checkpoint_cycle_;
+  std::string restore_checkpoint_file_;
+  unsigned long restored_time_;
+  std::vector<int> pin_cpus_;
+  std::vector<ModelThread> model_threads_;
+  // OnClock() interval and last call time of each registered extension
+  std::vector<unsigned long> extension_intervals_;
+  std::vector<unsigned long> extension_clocked_time_;
+  // Extensions to call on every rising clock edge
+  std::vector<SimCtrlExtension *> every_cycle_extensions_;
+  // Scheduled reset changes and extension calls
+  SimTimerWheel timer_wheel_;
+  // The first tick whose events haven't been processed yet
+  unsigned long wheel_time_;
+  std::vector<SimTimerWheel::Event> due_events_;
+  std::vector<unsigned int> due_extensions_;
+  // Wallclock time spent in the main loop, and in the sampled calls to eval()
+  std::chrono::steady_clock::duration loop_time_;
+  std::chrono::steady_clock::duration sampled_eval_time_;
+  unsigned long num_loop_evals_;
+  unsigned long num_sampled_evals_;
+  // Trace windows (in cycles, 0 if not set)
+  unsigned long trace_start_cycle_;
+  unsigned long trace_stop_cycle_;
+  unsigned long trace_rotate_cycles_;
+  bool trace_ring_;
+  bool test_failed_;
+  unsigned long trace_depth_;
+  std::string trace_trigger_name_;
+  std::string trace_trigger_text_;
+  // The last few characters of the trigger stream (see ReportOutput())
+  std::mutex trace_trigger_mutex_;
+  std::string trace_trigger_window_;
+  // Index of the current trace file (with rotation) and the files written
+  unsigned int trace_file_index_;
+  std::vector<std::string> trace_files_;
 
   /**
    * Default constructor
@@ -205,9 +318,32 @@ class VerilatorSimCtrl {
   void PrintStatistics() const;
 
   /**
-   * Get the file name of the trace file
+   * Get the file name of the current trace file
+   *
+   * With --trace-rotate or --trace-ring, each trace file has an index in its
+   * name.
+   */
+  std::string GetTraceFileName() const;
+
+  /**
+   * Parse the argument of --trace-trigger (of the form NAME or NAME:TEXT)
    */
-  const char *GetTraceFileName() const;
+  bool ParseTraceTriggerArg(const char *arg_text);
+
+  /**
+   * Close the current trace file and start a new one (with --trace-rotate or
+   * --trace-ring)
+   *
+   * In ring mode, only the current and previous files are kept.
+   */
+  void RotateTrace();
+
+  /**
+   * Close the trace file at the end of the simulation
+   *
+   * In ring mode, the trace files are deleted if the simulation passed.
+   */
+  void FinishTrace();
 
   /**
    * Run the main loop of the simulation
@@ -216,6 +352,37 @@ class VerilatorSimCtrl {
    */
   void Run();
 
+  /**
+   * Schedule the reset sequence and periodic extension calls
+   *
+   * Called when the main loop starts (after restoring any checkpoint).
+   */
+  void ScheduleEvents();
+
+  /**
+   * Ask the extensions whether there should be another run and, if so, get
+   * ready for it
+   *
+   * Called when a run ends (see SimCtrlExtension::OnRunEnd()). This resets
+   * the design for the next run.
+   *
+   * @return true if there is another run
+   */
+  bool StartNextRun();
+
+  /**
+   * Handle the events in due_events_
+   *
+   * Reset changes are applied immediately; extensions to be called are moved
+   * to due_extensions_.
+   */
+  void ProcessDueEvents();
+
+  /**
+   * Call the extensions in due_extensions_ (on a rising clock edge)
+   */
+  void ClockDueExtensions();
+
   /**
    * Get a name for this simulation
    *
@@ -247,6 +414,73 @@ class VerilatorSimCtrl {
    * Perform tracing in Verilator if required
    */
   void Trace();
+
+  /**
+   * Find the threads of the Verilated model
+   *
+   * This must be called before the first eval() so that threads started by DPI
+   * code (e.g. TCP servers) aren't mistaken for model threads.
+   */
+  void FindModelThreads();
+
+  /**
+   * Pin the model threads to the CPUs given with --pin-threads
+   *
+   * @return true on success
+   */
+  bool PinModelThreads();
+
+  /**
+   * Record the CPU time used by each model thread so far
+   *
+   * @param end Record as the end (rather than the start) of the run
+   */
+  void SampleModelThreadTimes(bool end);
+
+  /**
+   * Parse the argument of --save-checkpoint (of the form FILE@CYCLE)
+   */
+  bool ParseSaveCheckpointArg(const char *arg_text);
+
+  /**
+   * Save the state of the simulation to a checkpoint file
+   *
+   * This saves the Verilated model, the current time, the state of registered
+   * DPI contexts (see dpi_checkpoint.h) and the state of all extensions.
+   *
+   * @return true on success
+   */
+  bool SaveCheckpoint(const std::string &filepath);
+
+  /**
+   * Restore the state of the simulation from a checkpoint file
+   *
+   * This must be called after the initial blocks have been evaluated, so that
+   * DPI contexts have been created and can be re-attached.
+   *
+   * @return true on success
+   */
+  bool RestoreCheckpoint(const std::string &filepath);
 };
 
+/**
+ * DPI functions for simulation control
+ *
+ * Import these in SystemVerilog with
+ *   import "DPI-C" function void simctrl_report_event(input string name);
+ *   import "DPI-C" function void simctrl_report_test_result(input bit passed);
+ */
+extern "C" {
+/**
+ * Report a named event (see VerilatorSimCtrl::ReportEvent())
+ */
+void simctrl_report_event(const char *name);
+
+/**
+ * Report the result of the software test (see
+ * VerilatorSimCtrl::ReportTestResult())
+ */
+void simctrl_report_test_result(unsigned char passed);
+}
+
 #endif  // OPENTITAN_HW_DV_VERILATOR_SIMUTIL_VERILATOR_CPP_VERILATOR_SIM_CTRL_H_
@@ -45,6 +45,7 @@ void OtbnMemUtil::OnElfLoaded(Elf *elf_file) {
 
   expected_end_addr_ = -1;
   loop_warp_.clear();
+  code_symbols_.clear();
 
   // Look through the symbol table of elf_file for an expected end
   // address and any loop warping symbols.
@@ -67,13 +68,30 @@ void OtbnMemUtil::OnElfLoaded(Elf *elf_file) {
       if (!sym_name)
         continue;
 
-      OnSymbol(sym_name, sym.st_value);
+      // Work out whether the symbol names something in an executable section
+      // (rather than data or an absolute value like a loop warp symbol).
+      bool is_code = false;
+      int sym_type = GELF_ST_TYPE(sym.st_info);
+      if (sym_type != STT_SECTION && sym_type != STT_FILE &&
+          sym.st_shndx != SHN_UNDEF && sym.st_shndx < SHN_LORESERVE) {
+        Elf_Scn *sym_scn = elf_getscn(elf_file, sym.st_shndx);
+        Elf32_Shdr *sym_shdr = sym_scn ? elf32_getshdr(sym_scn) : nullptr;
+        is_code = sym_shdr && (sym_shdr->sh_flags & SHF_EXECINSTR);
+      }
+
+      OnSymbol(sym_name, sym.st_value, is_code);
     }
     break;
   }
 }
 
-void OtbnMemUtil::OnSymbol(const std::string &name, uint32_t value) {
+void OtbnMemUtil::OnSymbol(const std::string &name, uint32_t value,
+                           bool is_code) {
+  // Function names and code labels (used to attribute cycles in profiles)
+  if (is_code && !name.empty()) {
+    code_symbols_.insert(std::make_pair(value, name));
+  }
+
   // Expected end address
   if (name == "_expected_end_addr") {
     expected_end_addr_ = value;
@@ -5,6 +5,7 @@
 #define OPENTITAN_HW_IP_OTBN_DV_MEMUTIL_OTBN_MEMUTIL_H_
 
 #include <map>
+#include <string>
 #include <svdpi.h>
 #include <vector>
 
@@ -14,6 +15,7 @@
 class OtbnMemUtil : public DpiMemUtil {
  public:
   typedef std::map<std::pair<uint32_t, uint32_t>, uint32_t> LoopWarps;
+  typedef std::map<uint32_t, std::string> CodeSymbols;
 
   // Constructor. top_scope is the SV scope that contains IMEM and
   // DMEM memories as u_imem and u_dmem, respectively.
@@ -43,11 +45,17 @@ class OtbnMemUtil : public DpiMemUtil {
   // Read-only access to the table of loop warps
   const LoopWarps &GetLoopWarps() const { return loop_warp_; }
 
+  // Read-only access to the symbols in executable sections of the ELF file
+  // (function names and code labels), keyed by address. If several symbols
+  // have the same address, this holds the first one in the symbol table.
+  const CodeSymbols &GetCodeSymbols() const { return code_symbols_; }
+
  private:
   void OnElfLoaded(Elf *elf_file) override;
 
-  // Called by OnElfLoaded for each symbol in the symbol table
-  void OnSymbol(const std::string &name, uint32_t value);
+  // Called by OnElfLoaded for each symbol in the symbol table. is_code is
+  // true if the symbol is defined in an executable section.
+  void OnSymbol(const std::string &name, uint32_t value, bool is_code);
 
   // Add an entry to loop_warp_
   void AddLoopWarp(uint32_t addr, uint32_t from_cnt, uint32_t to_cnt);
@@ -55,6 +63,7 @@ class OtbnMemUtil : public DpiMemUtil {
   ScrambledEcc32MemArea imem_, dmem_;
   int expected_end_addr_;
   LoopWarps loop_warp_;
+  CodeSymbols code_symbols_;
 };
 
 // DPI-accessible wrappers
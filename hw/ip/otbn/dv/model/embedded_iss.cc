@@ -0,0 +1,221 @@
+// Copyright lowRISC contributors.
+// Licensed under the Apache License, Version 2.0, see LICENSE for details.
+// SPDX-License-Identifier: Apache-2.0
+
+// Python.h has to be included before any standard headers.
+#ifdef OTBN_MODEL_EMBED_PYTHON
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+#endif
+
+#include "embedded_iss.h"
+
+#include <sstream>
+#include <stdexcept>
+
+#ifdef OTBN_MODEL_EMBED_PYTHON
+
+namespace {
+
+// Guard class to drop references to Python objects. The GIL must be held
+// when one of these is destroyed.
+struct PyDecRef {
+  void operator()(PyObject *p) const { Py_DECREF(p); }
+};
+typedef std::unique_ptr<PyObject, PyDecRef> py_ptr;
+
+// Guard class that holds the GIL for its lifetime
+class GilLock {
+ public:
+  GilLock() : state_(PyGILState_Ensure()) {}
+  ~GilLock() { PyGILState_Release(state_); }
+
+  GilLock(const GilLock &) = delete;
+  GilLock &operator=(const GilLock &) = delete;
+
+ private:
+  PyGILState_STATE state_;
+};
+
+// Start the interpreter if it isn't already running. We don't install
+// Python's signal handlers (so Ctrl-C still goes to the simulator) and we
+// never finalize the interpreter, because extension modules don't cope with
+// being initialized a second time. Once it's set up, release the GIL so that
+// any thread can take it with a GilLock.
+void start_python() {
+  if (Py_IsInitialized())
+    return;
+
+  Py_InitializeEx(0);
+  PyEval_SaveThread();
+}
+
+// Print the pending Python exception (with its traceback) to stderr and throw
+// a std::runtime_error that says what we were doing. The GIL must be held.
+[[noreturn]] void throw_python_error(const std::string &what) {
+  std::ostringstream oss;
+  oss << "OTBN ISS failed to " << what;
+
+  PyObject *type, *value, *traceback;
+  PyErr_Fetch(&type, &value, &traceback);
+  PyErr_NormalizeException(&type, &value, &traceback);
+  if (value) {
+    py_ptr str(PyObject_Str(value));
+    const char *msg = str ? PyUnicode_AsUTF8(str.get()) : nullptr;
+    if (msg)
+      oss << ": " << msg;
+    PyErr_Clear();
+    PyErr_Display(type, value, traceback);
+  }
+  Py_XDECREF(type);
+  Py_XDECREF(value);
+  Py_XDECREF(traceback);
+
+  oss << ".";
+  throw std::runtime_error(oss.str());
+}
+
+// Look up an attribute of obj, throwing a std::runtime_error on failure
+py_ptr get_attr(PyObject *obj, const char *name) {
+  py_ptr attr(PyObject_GetAttrString(obj, name));
+  if (!attr)
+    throw_python_error(std::string("find ") + name);
+  return attr;
+}
+
+// Check the result of a call into the ISS that returns a bytes object (or
+// null if it raised an exception) and copy the bytes to resp.
+void read_response(py_ptr ret, std::vector<char> *resp,
+                   const std::string &what) {
+  char *data;
+  Py_ssize_t len;
+  if (!ret || PyBytes_AsStringAndSize(ret.get(), &data, &len) != 0)
+    throw_python_error(what);
+  resp->assign(data, data + len);
+}
+
+// Check the result of a call into the ISS that returns nothing
+void check_none(py_ptr ret, const char *what) {
+  if (!ret)
+    throw_python_error(what);
+}
+
+}  // namespace
+
+// The EmbeddedSim object and its bound methods, which we look up once rather
+// than on each call.
+struct EmbeddedIss::Impl {
+  py_ptr sim;
+  py_ptr run;
+  py_ptr step;
+  py_ptr edn_events;
+  py_ptr set_keymgr_value;
+};
+
+EmbeddedIss::EmbeddedIss(const std::string &model_path, int shared_mem_fd) {
+  start_python();
+  GilLock lock;
+
+  // This is declared after lock so that, if we throw, any references that
+  // it holds are dropped while we still have the GIL.
+  std::unique_ptr<Impl> impl(new Impl);
+
+  // Put the directory that contains stepped.py (and the sim package that it
+  // uses) at the front of sys.path.
+  std::string dir = model_path.substr(0, model_path.find_last_of('/'));
+  PyObject *sys_path = PySys_GetObject("path");
+  py_ptr py_dir(PyUnicode_FromString(dir.c_str()));
+  if (!sys_path || !py_dir)
+    throw_python_error("find sys.path");
+  int found = PySequence_Contains(sys_path, py_dir.get());
+  if (found < 0 || (!found && PyList_Insert(sys_path, 0, py_dir.get()) != 0))
+    throw_python_error("add " + dir + " to sys.path");
+
+  py_ptr module(PyImport_ImportModule("stepped"));
+  if (!module)
+    throw_python_error("import " + model_path);
+
+  py_ptr sim_class = get_attr(module.get(), "EmbeddedSim");
+  impl->sim.reset(PyObject_CallFunction(sim_class.get(), "i", shared_mem_fd));
+  if (!impl->sim)
+    throw_python_error("start");
+
+  impl->run = get_attr(impl->sim.get(), "run");
+  impl->step = get_attr(impl->sim.get(), "step");
+  impl->edn_events = get_attr(impl->sim.get(), "edn_events");
+  impl->set_keymgr_value = get_attr(impl->sim.get(), "set_keymgr_value");
+
+  impl_ = std::move(impl);
+}
+
+EmbeddedIss::~EmbeddedIss() {
+  GilLock lock;
+  impl_.reset();
+}
+
+void EmbeddedIss::run(const std::string &cmd, std::vector<char> *resp) {
+  GilLock lock;
+  read_response(py_ptr(PyObject_CallFunction(impl_->run.get(), "s#",
+                                             cmd.data(),
+                                             (Py_ssize_t)cmd.size())),
+                resp, "run command '" + cmd + "'");
+}
+
+void EmbeddedIss::step(bool gen_trace, std::vector<char> *resp) {
+  GilLock lock;
+  read_response(py_ptr(PyObject_CallFunctionObjArgs(
+                    impl_->step.get(), gen_trace ? Py_True : Py_False,
+                    nullptr)),
+                resp, "step");
+}
+
+void EmbeddedIss::edn_events(const std::string &events) {
+  GilLock lock;
+  check_none(py_ptr(PyObject_CallFunction(impl_->edn_events.get(), "s#",
+                                          events.data(),
+                                          (Py_ssize_t)events.size())),
+             "run edn_events");
+}
+
+void EmbeddedIss::set_keymgr_value(const uint8_t key0[48],
+                                   const uint8_t key1[48], bool valid) {
+  GilLock lock;
+  check_none(py_ptr(PyObject_CallFunction(
+                 impl_->set_keymgr_value.get(), "y#y#O", key0,
+                 (Py_ssize_t)48, key1, (Py_ssize_t)48,
+                 valid ? Py_True : Py_False)),
+             "run set_keymgr_value");
+}
+
+#else  // OTBN_MODEL_EMBED_PYTHON
+
+struct EmbeddedIss::Impl {};
+
+[[noreturn]] static void no_python() {
+  throw std::runtime_error(
+      "Cannot run the OTBN ISS in this process: the model was built without "
+      "OTBN_MODEL_EMBED_PYTHON.");
+}
+
+EmbeddedIss::EmbeddedIss(const std::string &model_path, int shared_mem_fd) {
+  no_python();
+}
+
+EmbeddedIss::~EmbeddedIss() {}
+
+void EmbeddedIss::run(const std::string &cmd, std::vector<char> *resp) {
+  no_python();
+}
+
+void EmbeddedIss::step(bool gen_trace, std::vector<char> *resp) {
+  no_python();
+}
+
+void EmbeddedIss::edn_events(const std::string &events) { no_python(); }
+
+void EmbeddedIss::set_keymgr_value(const uint8_t key0[48],
+                                   const uint8_t key1[48], bool valid) {
+  no_python();
+}
+
+#endif  // OTBN_MODEL_EMBED_PYTHON
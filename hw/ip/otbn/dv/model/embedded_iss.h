@@ -0,0 +1,52 @@
+// Copyright lowRISC contributors.
+// Licensed under the Apache License, Version 2.0, see LICENSE for details.
+// SPDX-License-Identifier: Apache-2.0
+#ifndef OPENTITAN_HW_IP_OTBN_DV_MODEL_EMBEDDED_ISS_H_
+#define OPENTITAN_HW_IP_OTBN_DV_MODEL_EMBEDDED_ISS_H_
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+// The ISS, running in a Python interpreter that is embedded in this process.
+//
+// This wraps an instance of the EmbeddedSim class in stepped.py. Commands are
+// direct calls into the interpreter, rather than messages to a child process,
+// and return the same response payloads as the binary protocol. The contents
+// of DMEM and IMEM are still passed through the shared memory region, which
+// the ISS maps a second time.
+//
+// Embedding needs the Python headers and library, so this is only available
+// if the model is compiled with OTBN_MODEL_EMBED_PYTHON defined. Otherwise,
+// the constructor throws a std::runtime_error. All the methods throw a
+// std::runtime_error if the ISS raises an exception (after printing the
+// Python traceback to stderr).
+class EmbeddedIss {
+ public:
+  // model_path is the path to stepped.py and shared_mem_fd is the file
+  // descriptor for the shared memory region.
+  EmbeddedIss(const std::string &model_path, int shared_mem_fd);
+  ~EmbeddedIss();
+
+  // Run a command (with no trailing newline), storing the response payload
+  // in resp.
+  void run(const std::string &cmd, std::vector<char> *resp);
+
+  // Step one instruction, storing the step response in resp
+  void step(bool gen_trace, std::vector<char> *resp);
+
+  // Apply a sequence of EDN events, in the format of the argument to the
+  // edn_events command (see stepped.py)
+  void edn_events(const std::string &events);
+
+  // Set the sideload keys, which are 384-bit little-endian values
+  void set_keymgr_value(const uint8_t key0[48], const uint8_t key1[48],
+                        bool valid);
+
+ private:
+  struct Impl;
+  std::unique_ptr<Impl> impl_;
+};
+
+#endif  // OPENTITAN_HW_IP_OTBN_DV_MODEL_EMBEDDED_ISS_H_
@@ -17,9 +17,11 @@
 #include <regex>
 #include <signal.h>
 #include <sstream>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/wait.h>
 
+#include "embedded_iss.h"
 #include "otbn_trace_checker.h"
 
 // Guard class to safely delete C strings
@@ -105,6 +107,78 @@ struct TmpDir {
   }
 };
 
+// A memory region that is shared with the ISS process, used to pass the
+// contents of DMEM and IMEM. The layout is described in stepped.py: a header
+// of four 32-bit little-endian words (magic number, DMEM words, IMEM words and
+// a reserved word), followed by the records for DMEM and then for IMEM.
+//
+// On Linux, this is backed by an anonymous memfd. Elsewhere, it's backed by a
+// file in the temporary directory. Either way, the child inherits fd.
+struct SharedMem {
+  int fd;
+  uint8_t *data;
+  size_t size;
+  uint32_t dmem_words;
+
+  SharedMem(const TmpDir &tmpdir, uint32_t dmem_words, uint32_t imem_words)
+      : fd(-1), data(nullptr), size(0), dmem_words(dmem_words) {
+    size = kHeaderBytes +
+           ISSWrapper::kMemRecordBytes * ((size_t)dmem_words + imem_words);
+
+#ifdef __linux__
+    fd = memfd_create("otbn_iss_mem", MFD_CLOEXEC);
+#else
+    std::string path = tmpdir.path + "/shared_mem";
+    fd = open(path.c_str(), O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+#endif
+    if (fd < 0 || ftruncate(fd, size) != 0) {
+      fail("create");
+    }
+
+    void *addr =
+        mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (addr == MAP_FAILED) {
+      fail("map");
+    }
+    data = static_cast<uint8_t *>(addr);
+
+    uint32_t header[4] = {kMagic, dmem_words, imem_words, 0};
+    for (int i = 0; i < 16; ++i) {
+      data[i] = header[i / 4] >> (8 * (i % 4));
+    }
+  }
+
+  ~SharedMem() { cleanup(); }
+
+  uint8_t *dmem() const { return data + kHeaderBytes; }
+  uint8_t *imem() const {
+    return dmem() + ISSWrapper::kMemRecordBytes * dmem_words;
+  }
+
+ private:
+  static const size_t kHeaderBytes = 16;
+  static const uint32_t kMagic = 0x4d42544f;  // 'OTBM'
+
+  void cleanup() {
+    if (data)
+      munmap(data, size);
+    if (fd >= 0)
+      close(fd);
+    data = nullptr;
+    fd = -1;
+  }
+
+  // Clean up and throw a std::runtime_error, reporting errno
+  [[noreturn]] void fail(const char *what) {
+    int err = errno;
+    cleanup();
+    std::ostringstream oss;
+    oss << "Cannot " << what << " shared memory region for OTBN simulation: "
+        << strerror(err);
+    throw std::runtime_error(oss.str());
+  }
+};
+
 // Find the top of the OpenTitan repository
 //
 // If REPO_TOP is defined, use that. Otherwise, this will only work if we're
@@ -202,12 +276,121 @@ static std::string find_otbn_model() {
   return std::string(abs_path.get());
 }
 
-// Read 8 hex characters from str as a uint32_t.
-static uint32_t read_hex_32(const char *str) {
-  char buf[9];
-  memcpy(buf, str, 8);
-  buf[8] = '\0';
-  return strtoul(buf, nullptr, 16);
+// Return true if the OTBN_MODEL_BINARY_PROTOCOL environment variable is set
+// to 1.
+static bool should_use_binary_protocol() {
+  const char *binary_str = getenv("OTBN_MODEL_BINARY_PROTOCOL");
+  return binary_str && strcmp(binary_str, "1") == 0;
+}
+
+// Return true if the OTBN_MODEL_ISS_BACKEND environment variable asks for the
+// ISS to run in this process. Throws a std::runtime_error if it has a value
+// that we don't recognise.
+static bool should_embed_iss() {
+  const char *backend_str = getenv("OTBN_MODEL_ISS_BACKEND");
+  if (!backend_str || strcmp(backend_str, "subprocess") == 0)
+    return false;
+  if (strcmp(backend_str, "embedded") == 0)
+    return true;
+
+  std::ostringstream oss;
+  oss << "Invalid value for OTBN_MODEL_ISS_BACKEND (`" << backend_str
+      << "'): expected `subprocess' or `embedded'.";
+  throw std::runtime_error(oss.str());
+}
+
+// Read the OTBN_MODEL_STEP_BATCH environment variable, which gives the
+// maximum number of cycles that the ISS can run ahead of the RTL. Returns 1
+// (no batching) if it isn't set. Throws a std::runtime_error if it isn't a
+// positive integer.
+static uint32_t get_step_batch() {
+  const char *batch_str = getenv("OTBN_MODEL_STEP_BATCH");
+  if (!batch_str)
+    return 1;
+
+  char *end;
+  unsigned long batch = strtoul(batch_str, &end, 0);
+  if (!*batch_str || *end || batch == 0 || batch > 0xffffffff) {
+    std::ostringstream oss;
+    oss << "Invalid value for OTBN_MODEL_STEP_BATCH (`" << batch_str
+        << "'): expected a positive integer.";
+    throw std::runtime_error(oss.str());
+  }
+  return batch;
+}
+
+// Read a 32-bit little-endian number from buf
+static uint32_t read_le32(const char *buf) {
+  uint32_t ret = 0;
+  for (int i = 0; i < 4; ++i) {
+    ret |= (uint32_t)(uint8_t)buf[i] << (8 * i);
+  }
+  return ret;
+}
+
+// The header of the response to a step command in the binary protocol. This
+// must match _STEP_HDR and the STEP_* flags in stepped.py. The fields are
+// little-endian, like the hosts that we run on, so the header can be copied
+// straight out of the response.
+struct IssStepResponse {
+  uint32_t status;
+  uint32_t insn_cnt;
+  uint32_t err_bits;
+  uint32_t stop_pc;
+  uint32_t flags;
+  // The offset of the trace records in the response payload
+  uint32_t trace_off;
+
+  enum {
+    kStatus = 1 << 0,
+    kInsnCnt = 1 << 1,
+    kErrBits = 1 << 2,
+    kStopPc = 1 << 3,
+    kRndReq = 1 << 4,
+    kRndReqVal = 1 << 5,
+    kWipeStart = 1 << 6,
+    kWipeStartVal = 1 << 7
+  };
+};
+static_assert(sizeof(IssStepResponse) == 24,
+              "IssStepResponse must match the layout in stepped.py");
+
+// Append each line in the len bytes at buf to dst (stripping newlines)
+static void split_lines(const char *buf, size_t len,
+                        std::vector<std::string> *dst) {
+  const char *end = buf + len;
+  while (buf < end) {
+    const char *nl = static_cast<const char *>(memchr(buf, '\n', end - buf));
+    const char *line_end = nl ? nl : end;
+    dst->emplace_back(buf, line_end);
+    buf = nl ? nl + 1 : end;
+  }
+}
+
+// Decode str, which should be exactly 2 * len hex characters, into len bytes
+// at dst. Returns false if str has the wrong length or a bad character.
+static bool read_hex_bytes(const std::string &str, uint8_t *dst, size_t len) {
+  if (str.size() != 2 * len)
+    return false;
+
+  for (size_t i = 0; i < 2 * len; ++i) {
+    char c = str[i];
+    uint8_t nibble;
+    if ('0' <= c && c <= '9') {
+      nibble = c - '0';
+    } else if ('a' <= c && c <= 'f') {
+      nibble = c - 'a' + 10;
+    } else {
+      return false;
+    }
+
+    if (i % 2 == 0) {
+      dst[i / 2] = nibble << 4;
+    } else {
+      dst[i / 2] |= nibble;
+    }
+  }
+  return true;
 }
 
 // Read through trace output (in the lines argument) to pick up any write to
@@ -257,10 +440,61 @@ static bool read_ext_flag(const std::string &reg_name,
   return true;
 }
 
-ISSWrapper::ISSWrapper(bool enable_secure_wipe)
-    : tmpdir(new TmpDir()), enable_secure_wipe(enable_secure_wipe) {
+ISSWrapper::ISSWrapper(bool enable_secure_wipe, uint32_t dmem_words,
+                       uint32_t imem_words)
+    : child_pid(-1),
+      child_write_file(nullptr),
+      child_read_file(nullptr),
+      tmpdir(new TmpDir()),
+      dmem_words(dmem_words),
+      imem_words(imem_words),
+      shared_mem(new SharedMem(*tmpdir, dmem_words, imem_words)),
+      enable_secure_wipe(enable_secure_wipe),
+      step_batch(get_step_batch()),
+      batch_pos(0) {
+  binary_protocol = step_batch > 1 || should_use_binary_protocol();
+
   std::string model_path(find_otbn_model());
 
+  if (should_embed_iss()) {
+    embedded_iss.reset(new EmbeddedIss(model_path, shared_mem->fd));
+    binary_protocol = true;
+  } else {
+    start_child(model_path);
+  }
+}
+
+ISSWrapper::~ISSWrapper() {
+  if (child_pid == -1)
+    return;
+
+  // Stop the child process if it's still running. No need to be nice: we'll
+  // just send a SIGKILL. Also, no need to check whether it's running first: we
+  // can just fire off the signal and ignore whether it worked or not.
+  kill(child_pid, SIGKILL);
+
+  // Now wait for the child. This should be a very short wait.
+  waitpid(child_pid, NULL, 0);
+
+  // Close the child file handles.
+  fclose(child_write_file);
+  fclose(child_read_file);
+}
+
+void ISSWrapper::start_child(const std::string &model_path) {
+  // Construct the arguments for the child process now: it shouldn't allocate
+  // memory between the fork and the exec.
+  std::string shared_fd_str = std::to_string(shared_mem->fd);
+  std::vector<const char *> child_argv = {"/usr/bin/env",
+                                          "python3",
+                                          "-u",
+                                          model_path.c_str(),
+                                          "--shared-mem",
+                                          shared_fd_str.c_str()};
+  if (binary_protocol)
+    child_argv.push_back("--binary");
+  child_argv.push_back(nullptr);
+
   // We want two pipes: one for writing to the child process, and the other for
   // reading from it. We set the O_CLOEXEC flag so that the child process will
   // drop all the fds when it execs.
@@ -306,9 +540,11 @@ ISSWrapper::ISSWrapper(bool enable_secure_wipe)
                 << "\n";
       abort();
     }
+    // The child should inherit the fd for the shared memory region.
+    fcntl(shared_mem->fd, F_SETFD, 0);
+
     // Finally, exec the ISS
-    execl("/usr/bin/env", "/usr/bin/env", "python3", "-u", model_path.c_str(),
-          NULL);
+    execv("/usr/bin/env", const_cast<char *const *>(child_argv.data()));
   }
 
   // We are the parent process and pid is the PID of the child. Close the pipe
@@ -329,29 +565,31 @@ ISSWrapper::ISSWrapper(bool enable_secure_wipe)
   assert(child_read_file);
 }
 
-ISSWrapper::~ISSWrapper() {
-  // Stop the child process if it's still running. No need to be nice: we'll
-  // just send a SIGKILL. Also, no need to check whether it's running first: we
-  // can just fire off the signal and ignore whether it worked or not.
-  kill(child_pid, SIGKILL);
-
-  // Now wait for the child. This should be a very short wait.
-  waitpid(child_pid, NULL, 0);
-
-  // Close the child file handles.
-  fclose(child_write_file);
-  fclose(child_read_file);
-}
+void ISSWrapper::load_d(const Ecc32MemArea::EccWords &words) {
+  if (words.size() > dmem_words) {
+    std::ostringstream oss;
+    oss << "Cannot load " << words.size() << " words into DMEM, which only has "
+        << dmem_words << ".";
+    throw std::runtime_error(oss.str());
+  }
+  pack_mem_words(shared_mem->dmem(), words);
 
-void ISSWrapper::load_d(const std::string &path) {
   std::ostringstream oss;
-  oss << "load_d " << path << "\n";
+  oss << "load_d_shared " << words.size() << "\n";
   run_command(oss.str(), nullptr);
 }
 
-void ISSWrapper::load_i(const std::string &path) {
+void ISSWrapper::load_i(const Ecc32MemArea::EccWords &words) {
+  if (words.size() > imem_words) {
+    std::ostringstream oss;
+    oss << "Cannot load " << words.size() << " words into IMEM, which only has "
+        << imem_words << ".";
+    throw std::runtime_error(oss.str());
+  }
+  pack_mem_words(shared_mem->imem(), words);
+
   std::ostringstream oss;
-  oss << "load_i " << path << "\n";
+  oss << "load_i_shared " << words.size() << "\n";
   run_command(oss.str(), nullptr);
 }
 
@@ -367,10 +605,47 @@ void ISSWrapper::clear_loop_warps() {
   run_command("clear_loop_warps\n", nullptr);
 }
 
-void ISSWrapper::dump_d(const std::string &path) const {
-  std::ostringstream oss;
-  oss << "dump_d " << path << "\n";
-  run_command(oss.str(), nullptr);
+const uint8_t *ISSWrapper::dump_d() {
+  run_command("dump_d_shared\n", nullptr);
+  return shared_mem->dmem();
+}
+
+void ISSWrapper::pack_mem_words(uint8_t *dst,
+                                const Ecc32MemArea::EccWords &words) {
+  for (const Ecc32MemArea::EccWord &word : words) {
+    uint32_t w32 = word.first ? word.second : 0;
+    dst[0] = word.first ? 1 : 0;
+    for (int j = 0; j < 4; ++j) {
+      dst[j + 1] = (w32 >> (8 * j)) & 0xff;
+    }
+    dst += kMemRecordBytes;
+  }
+}
+
+Ecc32MemArea::EccWords ISSWrapper::unpack_mem_words(const uint8_t *src,
+                                                    size_t num_words) {
+  Ecc32MemArea::EccWords ret;
+  ret.reserve(num_words);
+
+  for (size_t i = 0; i < num_words; ++i) {
+    uint8_t vld_byte = src[0];
+    if (vld_byte > 1) {
+      std::ostringstream oss;
+      oss << "Word " << i << " from the ISS had a validity byte with value "
+          << (int)vld_byte << "; not 0 or 1.";
+      throw std::runtime_error(oss.str());
+    }
+
+    uint32_t word = 0;
+    for (int j = 0; j < 4; ++j) {
+      word |= (uint32_t)src[j + 1] << (8 * j);
+    }
+
+    ret.push_back(std::make_pair(vld_byte == 1, word));
+    src += kMemRecordBytes;
+  }
+
+  return ret;
 }
 
 void ISSWrapper::start_operation(command_t command) {
@@ -410,30 +685,77 @@ void ISSWrapper::otp_key_cdc_done() {
 }
 
 void ISSWrapper::edn_rnd_cdc_done() {
-  run_command("edn_rnd_cdc_done\n", nullptr);
+  queue_edn_event("edn_rnd_cdc_done", "R");
 }
 
 void ISSWrapper::edn_urnd_cdc_done() {
-  run_command("edn_urnd_cdc_done\n", nullptr);
+  queue_edn_event("edn_urnd_cdc_done", "U");
 }
 
-void ISSWrapper::edn_flush() { run_command("edn_flush\n", nullptr); }
+void ISSWrapper::edn_flush() {
+  // The RTL calls this on every EDN clock edge while the EDN is in reset. A
+  // second flush has no effect, so don't queue one.
+  size_t len = pending_edn.size();
+  if (len && pending_edn[len - 1] == 'F' &&
+      (len == 1 || pending_edn[len - 2] == ','))
+    return;
+
+  queue_edn_event("edn_flush", "F");
+}
 
 void ISSWrapper::edn_rnd_step(uint32_t edn_rnd_data) {
-  std::ostringstream oss;
-  oss << "edn_rnd_step " << std::hex << "0x" << edn_rnd_data << "\n";
-  run_command(oss.str(), nullptr);
+  char event[10];
+  snprintf(event, sizeof event, "r%x", edn_rnd_data);
+  queue_edn_event("edn_rnd_step", event);
 }
 
 void ISSWrapper::edn_urnd_step(uint32_t edn_urnd_data) {
-  std::ostringstream oss;
-  oss << "edn_urnd_step " << std::hex << "0x" << edn_urnd_data << "\n";
-  run_command(oss.str(), nullptr);
+  char event[10];
+  snprintf(event, sizeof event, "u%x", edn_urnd_data);
+  queue_edn_event("edn_urnd_step", event);
+}
+
+void ISSWrapper::queue_edn_event(const char *cmd_name, const char *event) {
+  check_not_run_ahead(cmd_name);
+  if (!pending_edn.empty())
+    pending_edn += ',';
+  pending_edn += event;
+}
+
+bool ISSWrapper::take_edn_events(std::string *dst) {
+  if (pending_edn.empty())
+    return false;
+
+  // With the embedded ISS, we pass the events directly.
+  if (embedded_iss) {
+    std::string events;
+    events.swap(pending_edn);
+    embedded_iss->edn_events(events);
+    return false;
+  }
+
+  *dst = "edn_events " + pending_edn;
+  pending_edn.clear();
+  return true;
 }
 
 void ISSWrapper::set_keymgr_value(const std::array<uint32_t, 12> &key0_arr,
                                   const std::array<uint32_t, 12> &key1_arr,
                                   bool valid) {
+  if (embedded_iss) {
+    check_not_run_ahead("set_keymgr_value");
+    take_edn_events(nullptr);
+
+    // Pass the keys as little-endian bytes. Word 0 is the least significant.
+    uint8_t key0[48], key1[48];
+    for (int i = 0; i < 48; ++i) {
+      key0[i] = key0_arr[i / 4] >> (8 * (i % 4));
+      key1[i] = key1_arr[i / 4] >> (8 * (i % 4));
+    }
+    embedded_iss->set_keymgr_value(key0, key1, valid);
+    return;
+  }
+
   std::ostringstream oss;
 
   oss << "set_keymgr_value 0x" << std::hex << std::setfill('0');
@@ -450,6 +772,9 @@ void ISSWrapper::set_keymgr_value(const std::array<uint32_t, 12> &key0_arr,
 }
 
 int ISSWrapper::step(bool gen_trace) {
+  if (binary_protocol)
+    return step_binary(gen_trace);
+
   std::vector<std::string> lines;
 
   run_command("step\n", &lines);
@@ -482,6 +807,96 @@ int ISSWrapper::step(bool gen_trace) {
   return done ? 1 : 0;
 }
 
+int ISSWrapper::step_binary(bool gen_trace) {
+  if (step_batch <= 1) {
+    if (embedded_iss) {
+      take_edn_events(nullptr);
+      embedded_iss->step(gen_trace, &resp_buf);
+    } else {
+      run_binary_command(gen_trace ? "step 1" : "step 0");
+    }
+    return apply_step_response(resp_buf.data(), resp_buf.size(), gen_trace);
+  }
+
+  // If we've replayed everything from the last batch, ask the ISS to run
+  // ahead again.
+  if (batch_pos == batch_buf.size()) {
+    std::ostringstream oss;
+    oss << "step_batch " << step_batch << " " << (int)gen_trace;
+    run_binary_command(oss.str());
+    batch_buf.swap(resp_buf);
+    batch_pos = 0;
+  }
+
+  // Each response in the batch has a 32-bit length prefix.
+  size_t avail = batch_buf.size() - batch_pos;
+  uint32_t len = avail < 4 ? 0 : read_le32(&batch_buf[batch_pos]);
+  if (avail < 4 || len > avail - 4) {
+    batch_pos = batch_buf.size();
+    throw std::runtime_error("Truncated step response in batch from ISS.");
+  }
+  const char *resp = &batch_buf[batch_pos + 4];
+  batch_pos += 4 + len;
+
+  return apply_step_response(resp, len, gen_trace);
+}
+
+int ISSWrapper::apply_step_response(const char *buf, size_t len,
+                                    bool gen_trace) {
+  IssStepResponse resp;
+  if (len < sizeof resp) {
+    std::ostringstream oss;
+    oss << "Step response from ISS has " << len
+        << " bytes, but the header alone should be " << sizeof resp << ".";
+    throw std::runtime_error(oss.str());
+  }
+  memcpy(&resp, buf, sizeof resp);
+  if (resp.trace_off < sizeof resp || resp.trace_off > len) {
+    std::ostringstream oss;
+    oss << "Invalid trace offset in step response from ISS: "
+        << resp.trace_off << ".";
+    throw std::runtime_error(oss.str());
+  }
+
+  size_t trace_len = len - resp.trace_off;
+  if (trace_len % sizeof(OtbnTraceRecord)) {
+    std::ostringstream oss;
+    oss << "Trace in step response from ISS has " << trace_len
+        << " bytes, which isn't a whole number of trace records.";
+    throw std::runtime_error(oss.str());
+  }
+  if (gen_trace && trace_len) {
+    // Copy the records out of the response, which needn't be aligned.
+    trace_records.resize(trace_len / sizeof(OtbnTraceRecord));
+    memcpy(trace_records.data(), buf + resp.trace_off, trace_len);
+    if (!OtbnTraceChecker::get().OnIssTraceRecords(trace_records.data(),
+                                                   trace_records.size())) {
+      return -1;
+    }
+  }
+
+  // This mirrors the register updates in step(), except that the ISS has
+  // already told us which registers were written.
+  bool was_stopped = mirrored_.stopped();
+  if (resp.flags & IssStepResponse::kStatus)
+    mirrored_.status = resp.status;
+  bool is_stopped = mirrored_.stopped();
+  bool done = is_stopped && !was_stopped;
+
+  if (resp.flags & IssStepResponse::kInsnCnt)
+    mirrored_.insn_cnt = resp.insn_cnt;
+  if (resp.flags & IssStepResponse::kErrBits)
+    mirrored_.err_bits = resp.err_bits;
+  if (resp.flags & IssStepResponse::kStopPc)
+    mirrored_.stop_pc = resp.stop_pc;
+  if (resp.flags & IssStepResponse::kRndReq)
+    mirrored_.rnd_req = (resp.flags & IssStepResponse::kRndReqVal) != 0;
+  if (resp.flags & IssStepResponse::kWipeStart)
+    mirrored_.wipe_start = (resp.flags & IssStepResponse::kWipeStartVal) != 0;
+
+  return done ? 1 : 0;
+}
+
 void ISSWrapper::invalidate_imem() {
   run_command("invalidate_imem\n", nullptr);
 }
@@ -499,7 +914,7 @@ void ISSWrapper::set_software_errs_fatal(bool new_val) {
 }
 
 uint32_t ISSWrapper::step_crc(const std::array<uint8_t, 6> &item,
-                              uint32_t state) const {
+                              uint32_t state) {
   std::vector<std::string> lines;
 
   std::ostringstream oss;
@@ -518,6 +933,10 @@ void ISSWrapper::reset(bool gen_trace) {
   if (gen_trace)
     OtbnTraceChecker::get().Flush();
 
+  // The ISS is about to be replaced, so drop any cycles that it ran ahead.
+  batch_buf.clear();
+  batch_pos = 0;
+
   run_command("reset\n", nullptr);
 
   // Zero our mirror of INSN_CNT. We'll get the corresponding zero value from
@@ -538,124 +957,32 @@ void ISSWrapper::send_err_escalation(uint32_t err_val) {
   run_command(oss.str(), nullptr);
 }
 
-void ISSWrapper::get_regs(std::array<uint32_t, 32> *gprs,
-                          std::array<u256_t, 32> *wdrs) {
-  assert(gprs && wdrs);
+void ISSWrapper::get_reg_snapshot(OtbnRegSnapshot *dst) {
+  assert(dst);
 
   std::vector<std::string> lines;
-  run_command("print_regs\n", &lines);
-
-  // A record of which registers we've seen (to check we see each
-  // register exactly once). GPR i sets bit i. WDR i sets bit 32 + i.
-  uint64_t seen_mask = 0;
-
-  // Lines look like
-  //
-  //  x3  = 0x12345678
-  //  w10 = 0x0123456789abcdef0123456789abcdef0123456789abcdef0123456789abcdef
-
-  std::regex re("\\s*([wx][0-9]{1,2})\\s*=\\s*0x([0-9a-f]+)");
-  std::smatch match;
+  run_command("dump_regs\n", binary_protocol ? nullptr : &lines);
 
-  for (const std::string &line : lines) {
-    if (line == "PRINT_REGS")
-      continue;
-
-    if (!std::regex_match(line, match, re)) {
+  // With the binary protocol, the response is the snapshot itself.
+  if (binary_protocol) {
+    if (resp_buf.size() != sizeof *dst) {
       std::ostringstream oss;
-      oss << "Invalid line in ISS print_register output (`" << line << "').";
+      oss << "ISS register snapshot has " << resp_buf.size()
+          << " bytes, but we expected " << sizeof *dst << ".";
       throw std::runtime_error(oss.str());
     }
-
-    assert(match.size() == 3);
-
-    std::string reg_name = match[1].str();
-    std::string str_value = match[2].str();
-
-    assert(reg_name.size() <= 3);
-    assert(reg_name[0] == 'w' || reg_name[0] == 'x');
-    bool is_wide = reg_name[0] == 'w';
-    int reg_idx = atoi(reg_name.c_str() + 1);
-
-    assert(reg_idx >= 0);
-    if (reg_idx >= 32) {
-      std::ostringstream oss;
-      oss << "Invalid register name in ISS output (`" << reg_name
-          << "'). Line was `" << line << "'.";
-      throw std::runtime_error(oss.str());
-    }
-
-    unsigned idx_seen = reg_idx + (is_wide ? 32 : 0);
-    if ((seen_mask >> idx_seen) & 1) {
-      std::ostringstream oss;
-      oss << "Duplicate lines writing register " << reg_name << ".";
-      throw std::runtime_error(oss.str());
-    }
-
-    unsigned num_u32s = is_wide ? 8 : 1;
-    unsigned expected_value_len = 8 * num_u32s;
-    if (str_value.size() != expected_value_len) {
-      std::ostringstream oss;
-      oss << "Value for register " << reg_name << " has " << str_value.size()
-          << " hex characters, but we expected " << expected_value_len << ".";
-      throw std::runtime_error(oss.str());
-    }
-
-    uint32_t *dst = is_wide ? &(*wdrs)[reg_idx].words[7] : &(*gprs)[reg_idx];
-    for (unsigned i = 0; i < num_u32s; ++i) {
-      *dst = read_hex_32(&str_value[8 * i]);
-      --dst;
-    }
-
-    seen_mask |= ((uint64_t)1 << idx_seen);
+    memcpy(dst, resp_buf.data(), sizeof *dst);
+    return;
   }
 
-  // Check that we've seen all the registers
-  if (~seen_mask) {
-    std::ostringstream oss;
-    oss << "Some registers were missing from print_register output. Mask: 0x"
-        << std::hex << seen_mask << ".";
-    throw std::runtime_error(oss.str());
+  // Otherwise, it is sent as a line of hex after a DUMP_REGS line.
+  if (lines.size() != 2 || lines[0] != "DUMP_REGS" ||
+      !read_hex_bytes(lines[1], reinterpret_cast<uint8_t *>(dst),
+                      sizeof *dst)) {
+    throw std::runtime_error("Invalid ISS dump_regs output.");
   }
 }
 
-std::vector<uint32_t> ISSWrapper::get_call_stack() {
-  std::vector<std::string> lines;
-  run_command("print_call_stack\n", &lines);
-
-  std::regex re("\\s*0x([0-9a-f]+)");
-  std::smatch match;
-  std::vector<uint32_t> call_stack;
-
-  for (const std::string &line : lines) {
-    if (line == "PRINT_CALL_STACK")
-      continue;
-
-    if (!std::regex_match(line, match, re)) {
-      std::ostringstream oss;
-      oss << "Invalid line in ISS print_call_stack output (`" << line << "').";
-      throw std::runtime_error(oss.str());
-    }
-
-    assert(match.size() == 2);
-
-    std::string str_value = match[1];
-
-    if (str_value.size() != 8) {
-      std::ostringstream oss;
-      oss << "Value from call stack " << str_value << " has "
-          << str_value.size() << " hex characters, but we expected 8.";
-      throw std::runtime_error(oss.str());
-    }
-
-    uint32_t call_stack_entry = read_hex_32(str_value.c_str());
-
-    call_stack.push_back(call_stack_entry);
-  }
-
-  return call_stack;
-}
-
 std::string ISSWrapper::make_tmp_path(const std::string &relative) const {
   return tmpdir->path + "/" + relative;
 }
@@ -710,16 +1037,88 @@ bool ISSWrapper::read_child_response(std::vector<std::string> *dst) const {
 }
 
 void ISSWrapper::run_command(const std::string &cmd,
-                             std::vector<std::string> *dst) const {
+                             std::vector<std::string> *dst) {
   assert(cmd.size() > 0);
   assert(cmd.back() == '\n');
 
+  if (batch_pos < batch_buf.size())
+    check_not_run_ahead(cmd.substr(0, cmd.size() - 1));
+
+  if (binary_protocol) {
+    run_binary_command(cmd.substr(0, cmd.size() - 1));
+    if (dst)
+      split_lines(resp_buf.data(), resp_buf.size(), dst);
+    return;
+  }
+
+  // Send any queued EDN events first, reading (and discarding) the empty
+  // response to them after sending the command.
+  std::string edn_cmd;
+  bool sent_edn = take_edn_events(&edn_cmd);
+  if (sent_edn) {
+    fputs(edn_cmd.c_str(), child_write_file);
+    fputc('\n', child_write_file);
+  }
+
   fputs(cmd.c_str(), child_write_file);
   fflush(child_write_file);
-  if (!read_child_response(dst)) {
+  if ((sent_edn && !read_child_response(nullptr)) ||
+      !read_child_response(dst)) {
     std::ostringstream oss;
     std::string cmd_line = cmd.substr(0, cmd.size() - 1);
     oss << "Failed to run command '" << cmd_line << "': EOF from ISS.";
     throw std::runtime_error(oss.str());
   }
 }
+
+void ISSWrapper::check_not_run_ahead(const std::string &cmd_line) const {
+  if (batch_pos == batch_buf.size())
+    return;
+
+  // The ISS has already run the cycles that we've not replayed yet, so it
+  // would see this command too late.
+  std::ostringstream oss;
+  oss << "Cannot run command '" << cmd_line
+      << "' while the ISS has run ahead of the RTL (unset "
+         "OTBN_MODEL_STEP_BATCH if there are inputs during a run).";
+  throw std::runtime_error(oss.str());
+}
+
+void ISSWrapper::run_binary_command(const std::string &cmd) {
+  // Any queued EDN events go in the same frame, before the command.
+  std::string frame;
+  if (take_edn_events(&frame)) {
+    frame += '\n';
+    frame += cmd;
+  }
+  const std::string &payload = frame.empty() ? cmd : frame;
+
+  if (embedded_iss) {
+    embedded_iss->run(payload, &resp_buf);
+    return;
+  }
+
+  // Each frame starts with its length as a 32-bit little-endian number
+  uint32_t len = payload.size();
+  uint8_t len_bytes[4];
+  for (int i = 0; i < 4; ++i) {
+    len_bytes[i] = len >> (8 * i);
+  }
+  fwrite(len_bytes, 1, sizeof len_bytes, child_write_file);
+  fwrite(payload.data(), 1, payload.size(), child_write_file);
+  fflush(child_write_file);
+
+  bool got_resp = fread(len_bytes, 1, sizeof len_bytes, child_read_file) ==
+                  sizeof len_bytes;
+  if (got_resp) {
+    len = read_le32(reinterpret_cast<const char *>(len_bytes));
+    resp_buf.resize(len);
+    got_resp = fread(resp_buf.data(), 1, len, child_read_file) == len;
+  }
+
+  if (!got_resp) {
+    std::ostringstream oss;
+    oss << "Failed to run command '" << cmd << "': EOF from ISS.";
+    throw std::runtime_error(oss.str());
+  }
+}
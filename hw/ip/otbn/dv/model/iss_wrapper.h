@@ -12,8 +12,14 @@
 #include <unistd.h>
 #include <vector>
 
-// Forward declaration (the implementation is private in iss_wrapper.cc)
+#include "ecc32_mem_area.h"
+#include "otbn_trace_record.h"
+
+// Forward declarations (the implementations are private in iss_wrapper.cc)
 struct TmpDir;
+struct SharedMem;
+
+class EmbeddedIss;
 
 // OTBN has some externally visible CSRs that can be updated by hardware
 // (without explicit writes from software). The ISSWrapper mirrors the ISS's
@@ -47,22 +53,41 @@ class MirroredRegs {
   bool stopped() const { return status == 0 || status == 0xff; }
 };
 
-// An object wrapping the ISS subprocess.
-struct ISSWrapper {
-  // A 256-bit unsigned integer value, stored in "LSB order". Thus, words[0]
-  // contains the LSB and words[7] contains the MSB.
-  struct u256_t {
-    uint32_t words[256 / 32];
-  };
+// A snapshot of the registers and call stack, which are checked against the
+// RTL at the end of an operation. The ISS sends the same structure in its
+// response to the dump_regs command (see stepped.py), so the layout is fixed
+// and two snapshots can be compared with memcmp.
+struct OtbnRegSnapshot {
+  static const unsigned kCallStackDepth = 8;
+
+  uint32_t gprs[32];
+  // The WDRs, with the least significant word of each first
+  uint32_t wdrs[32][8];
+  // The number of entries on the call stack and the entries themselves,
+  // bottom first. Unused entries are zero.
+  uint32_t call_stack_size;
+  uint32_t call_stack[kCallStackDepth];
+};
+static_assert(sizeof(OtbnRegSnapshot) == 1188,
+              "OtbnRegSnapshot must match the layout in stepped.py");
 
+// An object wrapping the ISS. By default, the ISS runs in a subprocess. If the
+// OTBN_MODEL_ISS_BACKEND environment variable is set to "embedded", it runs in
+// an embedded Python interpreter instead (see embedded_iss.h).
+struct ISSWrapper {
   enum command_t { Execute, DmemWipe, ImemWipe };
 
-  ISSWrapper(bool enable_secure_wipe);
+  // dmem_words and imem_words are the sizes of DMEM and IMEM in 32-bit words.
+  // The contents of these memories are passed to and from the ISS through a
+  // memory region that is shared with the child process.
+  ISSWrapper(bool enable_secure_wipe, uint32_t dmem_words,
+             uint32_t imem_words);
   ~ISSWrapper();
 
-  // Load new contents of DMEM / IMEM
-  void load_d(const std::string &path);
-  void load_i(const std::string &path);
+  // Load new contents of DMEM / IMEM. words can be shorter than the memory,
+  // in which case only the start of the memory is replaced.
+  void load_d(const Ecc32MemArea::EccWords &words);
+  void load_i(const Ecc32MemArea::EccWords &words);
 
   // Add a loop warp instruction to the simulation
   void add_loop_warp(uint32_t addr, uint32_t from_cnt, uint32_t to_cnt);
@@ -70,12 +95,37 @@ struct ISSWrapper {
   // Clear any loop warp instructions from the simulation
   void clear_loop_warps();
 
-  // Dump the contents of DMEM to a file
-  void dump_d(const std::string &path) const;
+  // Dump the contents of DMEM. Returns a pointer to dmem_words records in the
+  // format described for pack_mem_words(), which is valid until the next
+  // call to dump_d().
+  const uint8_t *dump_d();
+
+  // The format of memory contents as passed to and from the ISS. Each 32-bit
+  // word is represented by a 5-byte record: a validity byte (0 or 1) followed
+  // by the word itself in little-endian order. The data of an invalid word is
+  // meaningless, so pack_mem_words() writes zeros (like the ISS), which means
+  // that two equivalent memories pack to the same bytes.
+  static const size_t kMemRecordBytes = 5;
+
+  // Pack words into records at dst, which must have space for
+  // kMemRecordBytes * words.size() bytes.
+  static void pack_mem_words(uint8_t *dst, const Ecc32MemArea::EccWords &words);
+
+  // Unpack num_words records from src. Throws a std::runtime_error if a
+  // validity byte is not 0 or 1.
+  static Ecc32MemArea::EccWords unpack_mem_words(const uint8_t *src,
+                                                 size_t num_words);
 
   // Start an operation (execute, dmem wipe or imem wipe)
   void start_operation(command_t command);
 
+  // The EDN functions below don't talk to the ISS straight away. Instead, they
+  // queue an event, and the events are sent to the ISS (as a single edn_events
+  // command) along with the next command, which is normally a step. Since the
+  // ISS only sees the events before it does anything else, this behaves as if
+  // each had been sent immediately, but costs no extra round trips. If the ISS
+  // rejects an event, the error is reported by the command that carries it.
+
   // Flush EDN related content in model because of edn_rst_n
   void edn_flush();
 
@@ -127,7 +177,7 @@ struct ISSWrapper {
   void set_software_errs_fatal(bool new_val);
 
   // Step a CRC calculation with 48 bits of data
-  uint32_t step_crc(const std::array<uint8_t, 6> &item, uint32_t state) const;
+  uint32_t step_crc(const std::array<uint8_t, 6> &item, uint32_t state);
 
   // Reset simulation
   //
@@ -141,11 +191,9 @@ struct ISSWrapper {
 
   const MirroredRegs &get_mirrored() const { return mirrored_; }
 
-  // Read contents of the register file
-  void get_regs(std::array<uint32_t, 32> *gprs, std::array<u256_t, 32> *wdrs);
-
-  // Read the contents of the call stack
-  std::vector<uint32_t> get_call_stack();
+  // Read the contents of the register files and the call stack. Throws a
+  // std::runtime_error if the ISS sends a bad response.
+  void get_reg_snapshot(OtbnRegSnapshot *dst);
 
   // Resolve a path relative to the convenience temporary directory.
   // relative should be a relative path (it is just appended to the
@@ -160,17 +208,87 @@ struct ISSWrapper {
 
   // Send a command to the child and wait for its response. If no
   // response, raise a runtime_error.
-  void run_command(const std::string &cmd, std::vector<std::string> *dst) const;
+  void run_command(const std::string &cmd, std::vector<std::string> *dst);
 
+  // Send a command to the child using the binary protocol and read the
+  // payload of its response into resp_buf. cmd should not have a trailing
+  // newline. If no response, raise a runtime_error.
+  void run_binary_command(const std::string &cmd);
+
+  // Start the ISS as a child process, running the model at model_path
+  void start_child(const std::string &model_path);
+
+  // Throw a std::runtime_error if the ISS has run ahead of the RTL, in which
+  // case it would see the command in cmd_line too late.
+  void check_not_run_ahead(const std::string &cmd_line) const;
+
+  // Queue an EDN event (in the format used by the edn_events command) for
+  // the command called cmd_name.
+  void queue_edn_event(const char *cmd_name, const char *event);
+
+  // If there are queued EDN events, clear the queue and return true, writing
+  // the edn_events command to send them (with no trailing newline) to dst.
+  // With the embedded ISS, this sends the events itself and returns false (so
+  // dst can be null).
+  bool take_edn_events(std::string *dst);
+
+  // The binary protocol version of step()
+  int step_binary(bool gen_trace);
+
+  // Update mirrored registers (and possibly pass trace data to the
+  // OtbnTraceChecker) from a binary step response with len bytes at resp.
+  // Returns the same values as step().
+  int apply_step_response(const char *resp, size_t len, bool gen_trace);
+
+  // The child process and pipes to it, if the ISS runs in a subprocess
   pid_t child_pid;
   FILE *child_write_file;
   FILE *child_read_file;
 
+  // The ISS, if it runs in this process. When this is set, we use the binary
+  // protocol (without the framing) and the frequent commands are direct calls.
+  std::unique_ptr<EmbeddedIss> embedded_iss;
+
   // A temporary directory for communicating with the child process
   std::unique_ptr<TmpDir> tmpdir;
 
+  // The sizes of DMEM and IMEM in words and the memory region that we use to
+  // pass their contents to and from the child process.
+  uint32_t dmem_words;
+  uint32_t imem_words;
+  std::unique_ptr<SharedMem> shared_mem;
+
   bool enable_secure_wipe;
 
+  // True if we talk to the child with length-prefixed frames rather than
+  // lines of text (see stepped.py). This is enabled by setting the
+  // OTBN_MODEL_BINARY_PROTOCOL environment variable to 1.
+  bool binary_protocol;
+
+  // The payload of the last response when using the binary protocol
+  std::vector<char> resp_buf;
+
+  // The maximum number of cycles that the ISS may run ahead of the RTL. If
+  // this is more than 1, step() asks the ISS to run until there is an
+  // externally visible event (up to this many cycles) and then replays the
+  // buffered cycles on the following calls. Since the ISS has already run
+  // these cycles, any other command sent while some are buffered causes an
+  // error. This is set with the OTBN_MODEL_STEP_BATCH environment variable
+  // and implies the binary protocol.
+  uint32_t step_batch;
+
+  // Buffered step responses from the last step_batch command and the offset
+  // of the next one to replay.
+  std::vector<char> batch_buf;
+  size_t batch_pos;
+
+  // EDN events that haven't been sent to the ISS yet, as a comma-separated
+  // list (see queue_edn_event)
+  std::string pending_edn;
+
+  // Trace records from the last binary step response
+  std::vector<OtbnTraceRecord> trace_records;
+
   // Mirrored copies of registers
   MirroredRegs mirrored_;
 };
@@ -7,7 +7,6 @@
 #include <algorithm>
 #include <cassert>
 #include <cstring>
-#include <fstream>
 #include <iomanip>
 #include <iostream>
 #include <sstream>
@@ -19,8 +18,8 @@
 #include "sv_utils.h"
 
 extern "C" {
-int otbn_rf_peek(int index, svBitVecVal *val);
-int otbn_stack_element_peek(int index, svBitVecVal *val);
+int otbn_rf_peek_all(svBitVecVal *vals);
+int otbn_stack_peek_all(svBitVecVal *vals);
 }
 
 #define RUNNING_BIT (1U << 0)
@@ -32,160 +31,68 @@ int otbn_stack_element_peek(int index, svBitVecVal *val);
 #define CMD_SECWIPE_DMEM 0xC3
 #define CMD_SECWIPE_IMEM 0x1E
 
-// Read (the start of) the contents of a file at path as a vector of bytes.
-// Expects num_bytes bytes of data. On failure, throws a std::runtime_error.
-static Ecc32MemArea::EccWords read_words_from_file(const std::string &path,
-                                                   size_t num_words) {
-  std::filebuf fb;
-  if (!fb.open(path.c_str(), std::ios::in | std::ios::binary)) {
-    std::ostringstream oss;
-    oss << "Cannot open the file '" << path << "'.";
-    throw std::runtime_error(oss.str());
-  }
-
-  Ecc32MemArea::EccWords ret;
-  ret.reserve(num_words);
-
-  char minibuf[5];
-  for (size_t i = 0; i < num_words; ++i) {
-    std::streamsize chars_in = fb.sgetn(minibuf, 5);
-    if (chars_in != 5) {
-      std::ostringstream oss;
-      oss << "Cannot read word " << i << " from " << path
-          << " (expected 5 bytes, but actually got " << chars_in << ").";
-      throw std::runtime_error(oss.str());
-    }
-
-    // The layout should be a validity byte (either 0 or 1), followed
-    // by 4 bytes with a little-endian 32-bit word.
-    uint8_t vld_byte = minibuf[0];
-    if (vld_byte > 2) {
-      std::ostringstream oss;
-      oss << "Word " << i << " at " << path
-          << " had a validity byte with value " << (int)vld_byte
-          << "; not 0 or 1.";
-      throw std::runtime_error(oss.str());
-    }
-    bool valid = vld_byte == 1;
-
-    uint32_t word = 0;
-    for (int j = 0; j < 4; ++j) {
-      word |= (uint32_t)(uint8_t)minibuf[j + 1] << 8 * j;
-    }
-
-    ret.push_back(std::make_pair(valid, word));
-  }
-
-  return ret;
-}
-
-// Write some words to a new file at path. On failure, throws a
-// std::runtime_error.
-static void write_words_to_file(const std::string &path,
-                                const Ecc32MemArea::EccWords &words) {
-  std::filebuf fb;
-  if (!fb.open(path.c_str(), std::ios::out | std::ios::binary)) {
-    std::ostringstream oss;
-    oss << "Cannot open the file '" << path << "'.";
-    throw std::runtime_error(oss.str());
-  }
-
-  for (const Ecc32MemArea::EccWord &word : words) {
-    uint8_t bytes[5];
-
-    bool valid = word.first;
-    uint32_t w32 = word.second;
-
-    bytes[0] = valid ? 1 : 0;
-    for (int j = 0; j < 4; ++j) {
-      bytes[j + 1] = (w32 >> (8 * j)) & 0xff;
-    }
+// Print a message to stderr for each difference between the RTL and ISS
+// register snapshots
+static void print_reg_snapshot_diff(const OtbnRegSnapshot &rtl,
+                                    const OtbnRegSnapshot &iss) {
+  std::ios old_state(nullptr);
+  old_state.copyfmt(std::cerr);
 
-    std::streamsize chars_out =
-        fb.sputn(reinterpret_cast<const char *>(&bytes), 5);
-    if (chars_out != 5) {
-      std::ostringstream oss;
-      oss << "Failed to write to " << path << ".";
-      throw std::runtime_error(oss.str());
+  for (int i = 0; i < 32; ++i) {
+    if (rtl.gprs[i] != iss.gprs[i]) {
+      std::cerr << std::setfill('0') << "RTL computed x" << std::dec << i
+                << " as 0x" << std::hex << rtl.gprs[i] << ", but ISS got 0x"
+                << iss.gprs[i] << ".\n";
     }
   }
-}
-
-template <typename T>
-static std::array<T, 32> get_rtl_regs(const std::string &reg_scope) {
-  std::array<T, 32> ret;
-  static_assert(sizeof(T) <= 256 / 8, "Can only copy 256 bits");
-
-  SVScoped scoped(reg_scope);
-
-  // otbn_rf_peek passes data as a packed array of svBitVecVal words (for a
-  // "bit [255:0]" argument). Allocate 256 bits (= 32 bytes) as
-  // 32/sizeof(svBitVecVal) words on the stack.
-  svBitVecVal buf[256 / 8 / sizeof(svBitVecVal)];
 
   for (int i = 0; i < 32; ++i) {
-    if (!otbn_rf_peek(i, buf)) {
-      std::ostringstream oss;
-      oss << "Failed to peek into RTL to get value of register " << i
-          << " at scope `" << reg_scope << "'.";
-      throw std::runtime_error(oss.str());
+    if (0 != memcmp(rtl.wdrs[i], iss.wdrs[i], sizeof(rtl.wdrs[i]))) {
+      std::cerr << "RTL computed w" << std::dec << i << " as 0x" << std::hex
+                << std::setfill('0');
+      for (int j = 0; j < 8; ++j) {
+        if (j)
+          std::cerr << "_";
+        std::cerr << std::setw(8) << rtl.wdrs[i][7 - j];
+      }
+      std::cerr << ", but ISS got 0x";
+      for (int j = 0; j < 8; ++j) {
+        if (j)
+          std::cerr << "_";
+        std::cerr << std::setw(8) << iss.wdrs[i][7 - j];
+      }
+      std::cerr << ".\n";
     }
-    memcpy(&ret[i], buf, sizeof(T));
   }
 
-  return ret;
-}
-
-template <typename T>
-static std::vector<T> get_stack(const std::string &stack_scope) {
-  std::vector<T> ret;
-  static_assert(sizeof(T) <= 256 / 8, "Can only copy 256 bits");
-
-  SVScoped scoped(stack_scope);
-
-  // otbn_stack_element_peek passes data as a packed array of svBitVecVal words
-  // (for a "bit [255:0]" argument). Allocate 256 bits (= 32 bytes) as
-  // 32/sizeof(svBitVecVal) words on the stack.
-  svBitVecVal buf[256 / 8 / sizeof(svBitVecVal)];
-
-  int i = 0;
-
-  while (1) {
-    int peek_result = otbn_stack_element_peek(i, buf);
-
-    // otbn_stack_element_peek is defined in otbn_stack_snooper_if.sv. Possible
-    // return values are: 0 on success, if we've returned an element. 1 if the
-    // stack doesn't have an element at index i. 2 if something terrible has
-    // gone wrong (such as a completely bogus index).
-    assert(peek_result <= 2);
-
-    if (peek_result == 2) {
-      std::ostringstream oss;
-      oss << "Failed to peek into RTL to get value of stack element " << i
-          << " at scope `" << stack_scope << "'.";
-      throw std::runtime_error(oss.str());
-    }
+  if (rtl.call_stack_size != iss.call_stack_size) {
+    std::cerr << std::dec << "Call stack size mismatch, RTL call stack has "
+              << rtl.call_stack_size << " elements and ISS call stack has "
+              << iss.call_stack_size << " elements\n";
+  }
 
-    if (peek_result == 1) {
-      // No more elements on stack
-      break;
+  // Compare the call stacks where both have elements
+  uint32_t call_stack_size =
+      std::min(rtl.call_stack_size, iss.call_stack_size);
+  for (uint32_t i = 0; i < call_stack_size; ++i) {
+    if (rtl.call_stack[i] != iss.call_stack[i]) {
+      std::cerr << std::setfill('0') << "RTL call stack element " << std::dec
+                << i << " is 0x" << std::hex << rtl.call_stack[i]
+                << ", but ISS has 0x" << iss.call_stack[i] << ".\n";
     }
-
-    T stack_element;
-    memcpy(&stack_element, buf, sizeof(T));
-    ret.push_back(stack_element);
-
-    ++i;
   }
 
-  return ret;
+  std::cerr.copyfmt(old_state);
 }
 
 OtbnModel::OtbnModel(const std::string &mem_scope,
                      const std::string &design_scope, bool enable_secure_wipe)
     : mem_util_(mem_scope),
       design_scope_(design_scope),
-      enable_secure_wipe_(enable_secure_wipe) {
+      enable_secure_wipe_(enable_secure_wipe),
+      rf_base_scope_(nullptr),
+      rf_bignum_scope_(nullptr),
+      call_stack_scope_(nullptr) {
   assert(mem_scope.size() && design_scope.size());
 }
 
@@ -233,14 +140,8 @@ int OtbnModel::start_operation(command_t command) {
         cmd_desc = "execute";
         iss_command = ISSWrapper::Execute;
 
-        std::string dfname(iss->make_tmp_path("dmem"));
-        std::string ifname(iss->make_tmp_path("imem"));
-
-        write_words_to_file(dfname, get_sim_memory(false));
-        write_words_to_file(ifname, get_sim_memory(true));
-
-        iss->load_d(dfname);
-        iss->load_i(ifname);
+        iss->load_d(get_sim_memory(false));
+        iss->load_i(get_sim_memory(true));
       } break;
 
       case DmemWipe:
@@ -468,13 +369,6 @@ int OtbnModel::check() const {
     return -1;
   }
 
-  try {
-    good &= check_call_stack(*iss);
-  } catch (const std::exception &err) {
-    std::cerr << "Failed to check call stack: " << err.what() << "\n";
-    return -1;
-  }
-
   return good ? 1 : 0;
 }
 
@@ -487,12 +381,10 @@ int OtbnModel::load_dmem() {
 
   const MemArea &dmem = mem_util_.GetMemArea(false);
 
-  std::string dfname(iss->make_tmp_path("dmem_out"));
   try {
     // Read DMEM from the ISS
-    iss->dump_d(dfname);
-    set_sim_memory(false,
-                   read_words_from_file(dfname, dmem.GetSizeBytes() / 4));
+    set_sim_memory(false, ISSWrapper::unpack_mem_words(
+                              iss->dump_d(), dmem.GetSizeBytes() / 4));
   } catch (const std::exception &err) {
     std::cerr << "Error when loading dmem from ISS: " << err.what() << "\n";
     return -1;
@@ -615,7 +507,9 @@ bool OtbnModel::is_at_start_of_wipe() const {
 ISSWrapper *OtbnModel::ensure_wrapper() {
   if (!iss_) {
     try {
-      iss_.reset(new ISSWrapper(enable_secure_wipe_));
+      uint32_t dmem_words = mem_util_.GetMemArea(false).GetSizeBytes() / 4;
+      uint32_t imem_words = mem_util_.GetMemArea(true).GetSizeBytes() / 4;
+      iss_.reset(new ISSWrapper(enable_secure_wipe_, dmem_words, imem_words));
     } catch (const std::runtime_error &err) {
       std::cerr << "Error when constructing ISS wrapper: " << err.what()
                 << "\n";
@@ -640,16 +534,24 @@ bool OtbnModel::check_dmem(ISSWrapper &iss) const {
   const MemArea &dmem = mem_util_.GetMemArea(false);
   uint32_t dmem_bytes = dmem.GetSizeBytes();
 
-  std::string dfname(iss.make_tmp_path("dmem_out"));
-
-  iss.dump_d(dfname);
-  Ecc32MemArea::EccWords iss_words =
-      read_words_from_file(dfname, dmem_bytes / 4);
-  assert(iss_words.size() == dmem_bytes / 4);
+  const uint8_t *iss_records = iss.dump_d();
 
   Ecc32MemArea::EccWords rtl_words = get_sim_memory(false);
   assert(rtl_words.size() == dmem_bytes / 4);
 
+  // Pack the RTL words in the same format as the ISS dump. Since both sides
+  // write zeros for the data of invalid words, the memories match exactly if
+  // the records are equal. That's the usual case, and we only need to look at
+  // individual words if not.
+  std::vector<uint8_t> rtl_records(ISSWrapper::kMemRecordBytes *
+                                   rtl_words.size());
+  ISSWrapper::pack_mem_words(rtl_records.data(), rtl_words);
+  if (memcmp(iss_records, rtl_records.data(), rtl_records.size()) == 0)
+    return true;
+
+  Ecc32MemArea::EccWords iss_words =
+      ISSWrapper::unpack_mem_words(iss_records, dmem_bytes / 4);
+
   std::ios old_state(nullptr);
   old_state.copyfmt(std::cerr);
 
@@ -702,99 +604,81 @@ bool OtbnModel::check_dmem(ISSWrapper &iss) const {
   return bad_count == 0;
 }
 
-bool OtbnModel::check_regs(ISSWrapper &iss) const {
-  std::string base_scope =
-      design_scope_ +
-      ".u_otbn_rf_base.gen_rf_base_ff.u_otbn_rf_base_inner.u_snooper";
-  std::string wide_scope =
-      design_scope_ +
-      ".u_otbn_rf_bignum.gen_rf_bignum_ff.u_otbn_rf_bignum_inner.u_snooper";
+void OtbnModel::get_rtl_reg_snapshot(OtbnRegSnapshot *dst) const {
+  assert(dst);
 
-  auto rtl_gprs = get_rtl_regs<uint32_t>(base_scope);
-  auto rtl_wdrs = get_rtl_regs<ISSWrapper::u256_t>(wide_scope);
+  // Look up the scopes of the snooper interfaces the first time through
+  if (!rf_base_scope_) {
+    rf_base_scope_ = SVScoped::Resolve(
+        design_scope_ +
+        ".u_otbn_rf_base.gen_rf_base_ff.u_otbn_rf_base_inner.u_snooper");
+    rf_bignum_scope_ = SVScoped::Resolve(
+        design_scope_ +
+        ".u_otbn_rf_bignum.gen_rf_bignum_ff.u_otbn_rf_bignum_inner.u_snooper");
+    call_stack_scope_ = SVScoped::Resolve(
+        design_scope_ + ".u_otbn_rf_base.u_call_stack_snooper");
+  }
 
-  std::array<uint32_t, 32> iss_gprs;
-  std::array<ISSWrapper::u256_t, 32> iss_wdrs;
-  iss.get_regs(&iss_gprs, &iss_wdrs);
+  memset(dst, 0, sizeof *dst);
 
-  bool good = true;
+  // otbn_rf_peek_all passes data as a packed array of svBitVecVal words (for a
+  // "bit [32*256-1:0]" argument), with 256 bits for each register.
+  svBitVecVal rf_buf[32 * 256 / 8 / sizeof(svBitVecVal)];
+  static_assert(sizeof rf_buf == sizeof dst->wdrs,
+                "WDRs should be laid out like otbn_rf_peek_all's output");
 
-  for (int i = 0; i < 32; ++i) {
-    // Register index 1 is call stack, which is checked separately
-    if (i == 1)
-      continue;
-
-    if (rtl_gprs[i] != iss_gprs[i]) {
-      std::ios old_state(nullptr);
-      old_state.copyfmt(std::cerr);
-      std::cerr << std::setfill('0') << "RTL computed x" << i << " as 0x"
-                << std::hex << rtl_gprs[i] << ", but ISS got 0x" << iss_gprs[i]
-                << ".\n";
-      std::cerr.copyfmt(old_state);
-      good = false;
+  {
+    SVScoped scoped(rf_base_scope_);
+    if (!otbn_rf_peek_all(rf_buf)) {
+      throw std::runtime_error("Failed to peek into RTL to get GPR values.");
     }
   }
   for (int i = 0; i < 32; ++i) {
-    if (0 != memcmp(rtl_wdrs[i].words, iss_wdrs[i].words,
-                    sizeof(rtl_wdrs[i].words))) {
-      std::ios old_state(nullptr);
-      old_state.copyfmt(std::cerr);
-      std::cerr << "RTL computed w" << i << " as 0x" << std::hex
-                << std::setfill('0');
-      for (int j = 0; j < 8; ++j) {
-        if (j)
-          std::cerr << "_";
-        std::cerr << std::setw(8) << rtl_wdrs[i].words[7 - j];
-      }
-      std::cerr << ", but ISS got 0x";
-      for (int j = 0; j < 8; ++j) {
-        if (j)
-          std::cerr << "_";
-        std::cerr << std::setw(8) << iss_wdrs[i].words[7 - j];
-      }
-      std::cerr << ".\n";
-      std::cerr.copyfmt(old_state);
-      good = false;
+    memcpy(&dst->gprs[i], &rf_buf[i * 256 / 8 / sizeof(svBitVecVal)], 4);
+  }
+
+  {
+    SVScoped scoped(rf_bignum_scope_);
+    if (!otbn_rf_peek_all(rf_buf)) {
+      throw std::runtime_error("Failed to peek into RTL to get WDR values.");
     }
   }
+  memcpy(dst->wdrs, rf_buf, sizeof dst->wdrs);
 
-  return good;
+  // otbn_stack_peek_all passes the stack as a "bit [255:0]", with 32 bits for
+  // each element, and returns the number of elements (or -1 on failure).
+  svBitVecVal stack_buf[256 / 8 / sizeof(svBitVecVal)];
+  int stack_size;
+  {
+    SVScoped scoped(call_stack_scope_);
+    stack_size = otbn_stack_peek_all(stack_buf);
+  }
+  if (stack_size < 0 || stack_size > (int)OtbnRegSnapshot::kCallStackDepth) {
+    std::ostringstream oss;
+    oss << "Failed to peek into RTL to get call stack (got size "
+        << stack_size << ").";
+    throw std::runtime_error(oss.str());
+  }
+  dst->call_stack_size = stack_size;
+  memcpy(dst->call_stack, stack_buf, stack_size * sizeof(uint32_t));
 }
 
-bool OtbnModel::check_call_stack(ISSWrapper &iss) const {
-  std::string call_stack_snooper_scope =
-      design_scope_ + ".u_otbn_rf_base.u_call_stack_snooper";
-
-  auto rtl_call_stack = get_stack<uint32_t>(call_stack_snooper_scope);
+bool OtbnModel::check_regs(ISSWrapper &iss) const {
+  OtbnRegSnapshot rtl_regs, iss_regs;
+  get_rtl_reg_snapshot(&rtl_regs);
+  iss.get_reg_snapshot(&iss_regs);
 
-  auto iss_call_stack = iss.get_call_stack();
+  // Register index 1 is the call stack, which is checked through
+  // call_stack_size and call_stack.
+  rtl_regs.gprs[1] = 0;
+  iss_regs.gprs[1] = 0;
 
-  bool good = true;
-
-  if (iss_call_stack.size() != rtl_call_stack.size()) {
-    std::cerr << "Call stack size mismatch, RTL call stack has "
-              << rtl_call_stack.size() << " elements and ISS call stack has "
-              << iss_call_stack.size() << " elements\n";
-
-    good = false;
-  }
-
-  // Iterate through both call stacks where both have elements
-  std::size_t call_stack_size =
-      std::min(rtl_call_stack.size(), iss_call_stack.size());
-  for (std::size_t i = 0; i < call_stack_size; ++i) {
-    if (iss_call_stack[i] != rtl_call_stack[i]) {
-      std::ios old_state(nullptr);
-      old_state.copyfmt(std::cerr);
-      std::cerr << std::setfill('0') << "RTL call stack element " << i
-                << " is 0x" << std::hex << rtl_call_stack[i]
-                << ", but ISS has 0x" << iss_call_stack[i] << ".\n";
-      std::cerr.copyfmt(old_state);
-      good = false;
-    }
+  if (0 == memcmp(&rtl_regs, &iss_regs, sizeof rtl_regs)) {
+    return true;
   }
 
-  return good;
+  print_reg_snapshot_diff(rtl_regs, iss_regs);
+  return false;
 }
 
 OtbnModel *otbn_model_init(const char *mem_scope, const char *design_scope,
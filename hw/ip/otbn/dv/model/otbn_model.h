@@ -13,6 +13,7 @@
 #include "otbn_memutil.h"
 
 struct ISSWrapper;
+struct OtbnRegSnapshot;
 
 class OtbnModel {
  public:
@@ -133,15 +134,15 @@ class OtbnModel {
   // on mismatch. Throws a std::runtime_error on failure.
   bool check_dmem(ISSWrapper &iss) const;
 
-  // Compare contents of ISS registers with those from the design. Prints
-  // messages to stderr on failure or mismatch. Returns true on success; false
-  // on mismatch. Throws a std::runtime_error on failure.
-  bool check_regs(ISSWrapper &iss) const;
+  // Read the register files and call stack from the design (through the
+  // snooper interfaces that otbn_core_model.sv binds into it). Throws a
+  // std::runtime_error on failure.
+  void get_rtl_reg_snapshot(OtbnRegSnapshot *dst) const;
 
-  // Compare contents of ISS call stack with those from the design. Prints
-  // messages to stderr on failure or mismatch. Returns true on success; false
-  // on mismatch. Throws a std::runtime_error on failure.
-  bool check_call_stack(ISSWrapper &iss) const;
+  // Compare contents of ISS registers and call stack with those from the
+  // design. Prints messages to stderr on failure or mismatch. Returns true on
+  // success; false on mismatch. Throws a std::runtime_error on failure.
+  bool check_regs(ISSWrapper &iss) const;
 
   // We want to create the model in an initial block in the SystemVerilog
   // simulation, but might not actually want to spawn the ISS. To handle that
@@ -152,6 +153,12 @@ class OtbnModel {
   OtbnMemUtil mem_util_;
   std::string design_scope_;
   bool enable_secure_wipe_;
+
+  // The scopes of the snooper interfaces for the GPRs, WDRs and call stack
+  // in the design. These are looked up the first time they are needed.
+  mutable svScope rf_base_scope_;
+  mutable svScope rf_bignum_scope_;
+  mutable svScope call_stack_scope_;
 };
 
 #endif  // OPENTITAN_HW_IP_OTBN_DV_MODEL_OTBN_MODEL_H_
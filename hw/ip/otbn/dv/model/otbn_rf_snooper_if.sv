@@ -14,7 +14,7 @@ interface otbn_rf_snooper_if #(
    input logic [Width-1:0] rf [Depth]
 );
 
-  export "DPI-C" function otbn_rf_peek;
+  export "DPI-C" function otbn_rf_peek_all;
 
   // Number of data bits per integrity code
   localparam int IntgGranule = IntegrityEnabled ? 32 : Width;
@@ -25,19 +25,19 @@ interface otbn_rf_snooper_if #(
   localparam int DataWidth = IntgGranules * IntgGranule;
   localparam int IntgWidth = IntgGranule + IntgBitsPerGranule;
 
-  function automatic int otbn_rf_peek(input int index, output bit [255:0] val);
-    // Function only works for register files with 256 data bits or fewer
-    if (DataWidth > 256) begin
+  // Read every register in one call. Register i is returned in vals[i * 256 +: 256]. This only
+  // works for register files with at most 32 registers of 256 data bits or fewer. Returns 1 on
+  // success and 0 otherwise.
+  function automatic int otbn_rf_peek_all(output bit [32*256-1:0] vals);
+    if ((DataWidth > 256) || (Depth > 32)) begin
       return 0;
     end
 
-    if (index > Depth) begin
-      return 0;
-    end
-
-    val = '0;
-    for (int i = 0; i < IntgGranules; ++i) begin
-      val[i * IntgGranule +: IntgGranule] = rf[index][i * IntgWidth +: IntgGranule];
+    vals = '0;
+    for (int r = 0; r < Depth; ++r) begin
+      for (int i = 0; i < IntgGranules; ++i) begin
+        vals[r * 256 + i * IntgGranule +: IntgGranule] = rf[r][i * IntgWidth +: IntgGranule];
+      end
     end
 
     return 1;
@@ -16,25 +16,24 @@ interface otbn_stack_snooper_if #(
   input logic [StackDepthW:0] stack_wr_ptr_q
 );
 
-  export "DPI-C" function otbn_stack_element_peek;
-
-  function automatic int otbn_stack_element_peek(input int index, output bit [255:0] val);
-    // Return 2 for issues indicating a broken usage of otbn_stack_element_peek
-    // Function only works for stacks <= 256 bits wide
-    if ((StackWidth > 256) || (index > StackDepth)) begin
-      return 2;
+  export "DPI-C" function otbn_stack_peek_all;
+
+  // Read every valid stack element in one call, with element i in vals[i * 32 +: 32] (and zeros
+  // above the top of the stack). This only works for stacks of 32-bit elements that are at most 8
+  // deep. Returns the number of valid elements, or -1 if the stack has the wrong shape.
+  function automatic int otbn_stack_peek_all(output bit [255:0] vals);
+    if ((StackWidth != 32) || (StackDepth > 8)) begin
+      return -1;
     end
 
-    // Return 1 where usage is correct but there's no more valid stack elements
-    if (index >= stack_wr_ptr_q) begin
-      return 1;
+    vals = '0;
+    for (int i = 0; i < StackDepth; ++i) begin
+      if (i < stack_wr_ptr_q) begin
+        vals[i * 32 +: 32] = stack_storage[i][31:0];
+      end
     end
 
-    val = '0;
-    val[StackWidth-1:0] = stack_storage[index][StackWidth-1:0];
-
-    // Return 0 to indicate a valid stack element
-    return 0;
+    return int'(stack_wr_ptr_q);
   endfunction
 
 endinterface
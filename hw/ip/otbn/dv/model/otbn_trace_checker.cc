@@ -48,11 +48,30 @@ void OtbnTraceChecker::AcceptTraceString(const std::string &trace,
     return;
 
   done_ = false;
-  OtbnTraceEntry trace_entry;
-  if (!trace_entry.from_rtl_trace(trace)) {
+  if (!rtl_new_entry_.from_rtl_trace(trace)) {
     seen_err_ = true;
     return;
   }
+  OnRtlEntry();
+}
+
+void OtbnTraceChecker::AcceptTraceRecords(
+    const std::vector<OtbnTraceRecord> &records, unsigned int cycle_count) {
+  assert(!(rtl_pending_ && iss_pending_));
+
+  if (seen_err_)
+    return;
+
+  done_ = false;
+  if (!rtl_new_entry_.from_rtl_records(records)) {
+    seen_err_ = true;
+    return;
+  }
+  OnRtlEntry();
+}
+
+void OtbnTraceChecker::OnRtlEntry() {
+  OtbnTraceEntry &trace_entry = rtl_new_entry_;
   if (trace_entry.trace_type() == OtbnTraceEntry::Invalid) {
     std::cerr << "ERROR: Invalid RTL trace entry with invalid header:\n";
     trace_entry.print("  ", std::cerr);
@@ -104,7 +123,7 @@ void OtbnTraceChecker::AcceptTraceString(const std::string &trace,
       // This is the first partial entry. Set the rtl_started_ flag and save
       // trace_entry.
       rtl_started_ = true;
-      rtl_entry_ = trace_entry;
+      rtl_entry_.swap(trace_entry);
     }
     return;
   }
@@ -132,7 +151,7 @@ void OtbnTraceChecker::AcceptTraceString(const std::string &trace,
 
   rtl_pending_ = true;
   rtl_started_ = false;
-  rtl_entry_ = trace_entry;
+  rtl_entry_.swap(trace_entry);
 
   if (!MatchPair()) {
     seen_err_ = true;
@@ -146,13 +165,33 @@ bool OtbnTraceChecker::OnIssTrace(const std::vector<std::string> &lines) {
     return false;
   }
 
-  OtbnIssTraceEntry trace_entry;
-  if (!trace_entry.from_iss_trace(lines)) {
+  if (!iss_new_entry_.from_iss_trace(lines)) {
     // Error parsing ISS trace. This has already printed a message to stderr.
     // Just return false to pass the error code along.
     return false;
   }
 
+  return OnIssEntry();
+}
+
+bool OtbnTraceChecker::OnIssTraceRecords(const OtbnTraceRecord *records,
+                                         size_t num_records) {
+  assert(!(rtl_pending_ && iss_pending_));
+
+  if (seen_err_) {
+    return false;
+  }
+
+  if (!iss_new_entry_.from_iss_records(records, num_records)) {
+    // Error in ISS trace. This has already printed a message to stderr.
+    return false;
+  }
+
+  return OnIssEntry();
+}
+
+bool OtbnTraceChecker::OnIssEntry() {
+  OtbnIssTraceEntry &trace_entry = iss_new_entry_;
   done_ = false;
 
   if (iss_pending_) {
@@ -178,7 +217,7 @@ bool OtbnTraceChecker::OnIssTrace(const std::vector<std::string> &lines) {
   }
 
   iss_started_ = true;
-  iss_entry_ = trace_entry;
+  iss_entry_.swap(trace_entry);
 
   // Set the pending flag if we've got the end of an event (either E or V).
   if (iss_entry_.is_final()) {
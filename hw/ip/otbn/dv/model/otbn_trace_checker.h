@@ -55,11 +55,20 @@ class OtbnTraceChecker : public OtbnTraceListener {
   void AcceptTraceString(const std::string &trace,
                          unsigned int cycle_count) override;
 
+  // Take a trace entry from the wrapped RTL in binary form. This behaves like
+  // AcceptTraceString, but doesn't need to parse any text.
+  void AcceptTraceRecords(const std::vector<OtbnTraceRecord> &records,
+                          unsigned int cycle_count) override;
+
   // Take a trace entry from the wrapped ISS.
   //
   // Prints an error message to stderr and returns false on mismatch.
   bool OnIssTrace(const std::vector<std::string> &lines);
 
+  // Take a trace entry from the wrapped ISS in binary form (as sent with the
+  // ISS's binary protocol). This behaves like OnIssTrace.
+  bool OnIssTraceRecords(const OtbnTraceRecord *records, size_t num_records);
+
   // Flush any pending entries. We need to do this on reset, to handle
   // the case where we reset the processor in the middle of a stall.
   void Flush();
@@ -81,6 +90,14 @@ class OtbnTraceChecker : public OtbnTraceListener {
   void set_no_sec_wipe_chk();
 
  private:
+  // Handle the RTL trace entry in rtl_new_entry_, which has just been filled
+  // in by AcceptTraceString or AcceptTraceRecords.
+  void OnRtlEntry();
+
+  // Handle the ISS trace entry in iss_new_entry_, which has just been filled
+  // in by OnIssTrace or OnIssTraceRecords.
+  bool OnIssEntry();
+
   // If rtl_pending_ and iss_pending_ are not both true, return true
   // immediately with no other change. Otherwise, compare the two pending trace
   // entries. If they match, clear them both and return true. If not, print a
@@ -95,6 +112,13 @@ class OtbnTraceChecker : public OtbnTraceListener {
   bool iss_pending_;
   OtbnIssTraceEntry iss_entry_;
 
+  // Entries that are filled from each new trace entry. These are swapped with
+  // rtl_entry_ and iss_entry_ (rather than copied) and then refilled, so
+  // checking a trace doesn't need any allocation once their storage has
+  // grown large enough.
+  OtbnTraceEntry rtl_new_entry_;
+  OtbnIssTraceEntry iss_new_entry_;
+
   bool done_;
   bool seen_err_;
 
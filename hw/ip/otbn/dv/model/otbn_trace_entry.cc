@@ -5,57 +5,72 @@
 #include "otbn_trace_entry.h"
 
 #include <cassert>
+#include <cstring>
 #include <iostream>
-#include <regex>
 #include <sstream>
+#include <utility>
 
-bool OtbnTraceBodyLine::fill_from_string(const std::string &src,
-                                         const std::string &line) {
-  // A valid line matches the following regex
-  std::regex re("(.) ([^:]+): (.+)");
-  std::smatch match;
+void OtbnTraceEntry::clear() {
+  trace_type_ = Invalid;
+  memset(&hdr_, 0, sizeof hdr_);
+  writes_.clear();
+}
 
-  if (!std::regex_match(line, match, re)) {
-    std::cerr << "OTBN trace body line from " << src
-              << " does not have expected format. Saw: `" << line << "'.\n";
-    return false;
-  }
+void OtbnTraceEntry::swap(OtbnTraceEntry &other) {
+  std::swap(trace_type_, other.trace_type_);
+  std::swap(hdr_, other.hdr_);
+  writes_.swap(other.writes_);
+}
 
-  assert(match.size() == 4);
+bool OtbnTraceEntry::from_rtl_records(
+    const std::vector<OtbnTraceRecord> &records) {
+  clear();
+  if (records.empty())
+    return true;
 
-  raw_ = line;
-  type_ = match[1].str()[0];
-  loc_ = match[2].str();
-  value_ = match[3].str();
+  set_hdr(records.front());
+  for (size_t i = 1; i < records.size(); ++i) {
+    // We're only interested in register writes
+    if (records[i].type == '>')
+      writes_.push_back(records[i]);
+  }
+  sort_writes();
   return true;
 }
 
-bool OtbnTraceBodyLine::operator==(const OtbnTraceBodyLine &other) const {
-  return raw_ == other.raw_;
-}
-
 bool OtbnTraceEntry::from_rtl_trace(const std::string &trace) {
-  size_t eol = trace.find('\n');
-  hdr_ = trace.substr(0, eol);
-  trace_type_ = hdr_to_trace_type(hdr_);
-
-  while (eol != std::string::npos) {
-    size_t bol = eol + 1;
-    eol = trace.find('\n', bol);
-    size_t line_len =
-        (eol == std::string::npos) ? std::string::npos : eol - bol;
-    std::string line = trace.substr(bol, line_len);
-
-    // We're only interested in register writes
-    if (!(line.size() > 0 && line[0] == '>'))
+  clear();
+
+  // Each line is parsed straight onto the end of writes_. The header is the
+  // first line, so it is taken off again before we parse anything else.
+  size_t bol = 0;
+  bool first = true;
+  while (bol < trace.size()) {
+    size_t eol = trace.find('\n', bol);
+    if (eol == std::string::npos)
+      eol = trace.size();
+    const char *line = trace.data() + bol;
+    size_t line_len = eol - bol;
+    bol = eol + 1;
+
+    // We're only interested in the header and register writes
+    if (!first && !(line_len > 0 && line[0] == '>'))
       continue;
 
-    OtbnTraceBodyLine parsed_line;
-    if (!parsed_line.fill_from_string("RTL", line)) {
+    if (!OtbnTraceRecord::Parse(line, line_len, &writes_)) {
+      std::cerr << "OTBN trace " << (first ? "header" : "body")
+                << " line from RTL does not have expected format. Saw: `"
+                << std::string(line, line_len) << "'.\n";
       return false;
     }
-    writes_[parsed_line.get_loc()].push_back(parsed_line);
+
+    if (first) {
+      set_hdr(writes_.back());
+      writes_.clear();
+      first = false;
+    }
   }
+  sort_writes();
   return true;
 }
 
@@ -69,26 +84,64 @@ bool OtbnTraceEntry::compare_rtl_iss_entries(const OtbnTraceEntry &other,
     return false;
   }
 
-  for (const auto &rtlptr : writes_) {
-    auto isskey = other.writes_.find(rtlptr.first);
-    if (isskey == other.writes_.end()) {
+  // Both lists of writes are sorted by location, so we can walk through them
+  // together, a location at a time. rtl_locs and iss_locs count the distinct
+  // locations that we've seen on each side.
+  const OtbnTraceRecord *rtl = writes_.data();
+  const OtbnTraceRecord *rtl_end = rtl + writes_.size();
+  const OtbnTraceRecord *iss = other.writes_.data();
+  const OtbnTraceRecord *iss_end = iss + other.writes_.size();
+  size_t rtl_locs = 0, iss_locs = 0;
+
+  while (rtl != rtl_end) {
+    uint16_t key = rtl->LocKey();
+    const OtbnTraceRecord *rtl_grp_end = rtl;
+    while (rtl_grp_end != rtl_end && rtl_grp_end->LocKey() == key)
+      ++rtl_grp_end;
+    ++rtl_locs;
+
+    // Skip over any locations that only the ISS wrote
+    while (iss != iss_end && iss->LocKey() < key) {
+      uint16_t iss_key = iss->LocKey();
+      while (iss != iss_end && iss->LocKey() == iss_key)
+        ++iss;
+      ++iss_locs;
+    }
+
+    if (iss == iss_end || iss->LocKey() != key) {
       std::ostringstream oss;
-      oss << "RTL had a write to `" << rtlptr.first
-          << "', but the ISS doesn't have a write to that location.";
+      oss << "RTL had a write to `";
+      rtl->PrintLoc(oss);
+      oss << "', but the ISS doesn't have a write to that location.";
       *err_desc = oss.str();
       return false;
     }
-    // compare rtlptr.second and isskey.second
-    if (!check_entries_compatible(trace_type_, rtlptr.first, rtlptr.second,
-                                  isskey->second, no_sec_wipe_data_chk,
+
+    const OtbnTraceRecord *iss_grp_end = iss;
+    while (iss_grp_end != iss_end && iss_grp_end->LocKey() == key)
+      ++iss_grp_end;
+    ++iss_locs;
+
+    if (!check_entries_compatible(trace_type_, rtl, rtl_grp_end, iss,
+                                  iss_grp_end, no_sec_wipe_data_chk,
                                   err_desc))
       return false;
+
+    rtl = rtl_grp_end;
+    iss = iss_grp_end;
   }
 
-  if (writes_.size() != other.writes_.size()) {
+  while (iss != iss_end) {
+    uint16_t iss_key = iss->LocKey();
+    while (iss != iss_end && iss->LocKey() == iss_key)
+      ++iss;
+    ++iss_locs;
+  }
+
+  if (rtl_locs != iss_locs) {
     std::ostringstream oss;
-    oss << "RTL wrote to " << writes_.size() << " locations; the ISS wrote to "
-        << other.writes_.size() << ".";
+    oss << "RTL wrote to " << rtl_locs << " locations; the ISS wrote to "
+        << iss_locs << ".";
     *err_desc = oss.str();
     return false;
   }
@@ -97,31 +150,25 @@ bool OtbnTraceEntry::compare_rtl_iss_entries(const OtbnTraceEntry &other,
 }
 
 void OtbnTraceEntry::print(const std::string &indent, std::ostream &os) const {
-  os << indent << hdr_ << "\n";
-  for (const auto &pr : writes_) {
-    for (const auto &line : pr.second) {
-      os << indent << line.get_string() << "\n";
-    }
+  os << indent;
+  if (hdr_.type)
+    hdr_.Print(os);
+  os << "\n";
+  for (const auto &write : writes_) {
+    os << indent;
+    write.Print(os);
+    os << "\n";
   }
 }
 
 void OtbnTraceEntry::take_writes(const OtbnTraceEntry &other,
                                  bool other_first) {
-  for (const auto &pr : other.writes_) {
-    std::vector<OtbnTraceBodyLine> &so_far = writes_[pr.first];
-    if (other_first) {
-      // If other_first is true, we should prepend the writes from other. We do
-      // so by creating a temporary vector (with a copy of the writes from
-      // other) and then appending any writes we had before.
-      std::vector<OtbnTraceBodyLine> tmp(pr.second);
-      tmp.insert(tmp.end(), so_far.begin(), so_far.end());
-      writes_[pr.first] = tmp;
-    } else {
-      // If other_first is false, we should append the writes from other. We
-      // can do that with just a call to insert.
-      so_far.insert(so_far.end(), pr.second.begin(), pr.second.end());
-    }
-  }
+  // If other_first is true, we should put the writes from other before ours.
+  // Either way, insert them and then sort by location: the sort is stable, so
+  // writes to each location stay in the right order.
+  writes_.insert(other_first ? writes_.begin() : writes_.end(),
+                 other.writes_.begin(), other.writes_.end());
+  sort_writes();
 }
 
 bool OtbnTraceEntry::is_compatible(const OtbnTraceEntry &prev) const {
@@ -169,16 +216,19 @@ bool OtbnTraceEntry::is_compatible(const OtbnTraceEntry &prev) const {
   if (!matching_types)
     return false;
 
-  bool exact_match =
-      0 == hdr_.compare(1, std::string::npos, prev.hdr_, 1, std::string::npos);
-  if (exact_match)
+  // Compare everything but the types of the two headers
+  OtbnTraceRecord prev_hdr = prev.hdr_;
+  prev_hdr.type = hdr_.type;
+  if (hdr_ == prev_hdr)
     return true;
 
-  size_t first_qm = hdr_.find('?', 1);
-  if (first_qm == std::string::npos)
+  // The '?' case: an instruction that couldn't be fetched
+  if (!(hdr_.flags & OtbnTraceRecord::kInsnErr))
     return false;
 
-  return 0 == hdr_.compare(1, first_qm - 1, prev.hdr_, 1, first_qm - 1);
+  return hdr_.addr == prev_hdr.addr &&
+         (hdr_.flags & OtbnTraceRecord::kNoPc) ==
+             (prev_hdr.flags & OtbnTraceRecord::kNoPc);
 }
 
 bool OtbnTraceEntry::is_partial() const {
@@ -192,33 +242,43 @@ bool OtbnTraceEntry::is_final() const {
 }
 
 bool OtbnTraceEntry::check_entries_compatible(
-    trace_type_t type, const std::string &key,
-    const std::vector<OtbnTraceBodyLine> &rtl_lines,
-    const std::vector<OtbnTraceBodyLine> &iss_lines, bool no_sec_wipe_data_chk,
+    trace_type_t type, const OtbnTraceRecord *rtl_begin,
+    const OtbnTraceRecord *rtl_end, const OtbnTraceRecord *iss_begin,
+    const OtbnTraceRecord *iss_end, bool no_sec_wipe_data_chk,
     std::string *err_desc) {
-  assert(rtl_lines.size() && iss_lines.size());
+  assert(rtl_begin != rtl_end && iss_begin != iss_end);
   assert(type == WipeComplete || type == Exec);
   assert(err_desc);
 
-  if (type == WipeComplete && key != "FLAGS0" && key != "FLAGS1") {
-    if (rtl_lines.size() != 2) {
+  const OtbnTraceRecord &rtl_first = *rtl_begin;
+  const OtbnTraceRecord &rtl_last = *(rtl_end - 1);
+  const OtbnTraceRecord &iss_last = *(iss_end - 1);
+
+  if (type == WipeComplete && rtl_first.loc != OtbnTraceRecord::kFlags) {
+    size_t num_rtl = rtl_end - rtl_begin;
+    if (num_rtl != 2) {
       std::ostringstream oss;
-      oss << "There are " << rtl_lines.size() << "RTL lines for key `" << key
-          << "'; we expected 2.";
+      oss << "There are " << num_rtl << " RTL lines for key `";
+      rtl_first.PrintLoc(oss);
+      oss << "'; we expected 2.";
       *err_desc = oss.str();
       return false;
     }
-    if (!no_sec_wipe_data_chk && rtl_lines.front() == rtl_lines.back()) {
+    if (!no_sec_wipe_data_chk && rtl_first == rtl_last) {
       std::ostringstream oss;
-      oss << "Repeated identical RTL lines for key `" << key << "'.";
+      oss << "Repeated identical RTL lines for key `";
+      rtl_first.PrintLoc(oss);
+      oss << "'.";
       *err_desc = oss.str();
       return false;
     }
   }
 
-  if (!(rtl_lines.back() == iss_lines.back())) {
+  if (rtl_last != iss_last) {
     std::ostringstream oss;
-    oss << "Final values of ISS and RTL don't match for key `" << key << "'.";
+    oss << "Final values of ISS and RTL don't match for key `";
+    rtl_first.PrintLoc(oss);
+    oss << "'.";
     *err_desc = oss.str();
     return false;
   }
@@ -227,12 +287,8 @@ bool OtbnTraceEntry::check_entries_compatible(
 }
 
 OtbnTraceEntry::trace_type_t OtbnTraceEntry::hdr_to_trace_type(
-    const std::string &hdr) {
-  if (hdr.empty()) {
-    return Invalid;
-  }
-
-  switch (hdr[0]) {
+    const OtbnTraceRecord &hdr) {
+  switch (hdr.type) {
     case 'S':
       return Stall;
     case 'E':
@@ -246,66 +302,126 @@ OtbnTraceEntry::trace_type_t OtbnTraceEntry::hdr_to_trace_type(
   }
 }
 
-bool OtbnIssTraceEntry::from_iss_trace(const std::vector<std::string> &lines) {
-  // Read FSM. state 0 = read header; state 1 = read mnemonic (for E
-  // lines); state 2 = read writes
-  int state = 0;
+void OtbnTraceEntry::set_hdr(const OtbnTraceRecord &hdr) {
+  hdr_ = hdr;
+  trace_type_ = hdr_to_trace_type(hdr_);
+}
 
-  std::regex re("# @0x([0-9a-f]{8}): (.*)");
-  std::smatch match;
+void OtbnTraceEntry::sort_writes() {
+  // There are normally only a handful of writes, so an insertion sort is
+  // quickest. It's also stable and doesn't allocate.
+  for (size_t i = 1; i < writes_.size(); ++i) {
+    if (writes_[i - 1].LocKey() <= writes_[i].LocKey())
+      continue;
+
+    OtbnTraceRecord tmp = writes_[i];
+    size_t j = i;
+    for (; j > 0 && writes_[j - 1].LocKey() > tmp.LocKey(); --j) {
+      writes_[j] = writes_[j - 1];
+    }
+    writes_[j] = tmp;
+  }
+}
+
+void OtbnIssTraceEntry::swap(OtbnIssTraceEntry &other) {
+  OtbnTraceEntry::swap(other);
+  std::swap(data_.insn_addr, other.data_.insn_addr);
+  data_.mnemonic.swap(other.data_.mnemonic);
+}
+
+bool OtbnIssTraceEntry::from_iss_trace(const std::vector<std::string> &lines) {
+  clear();
 
+  int state = 0;
   for (const std::string &line : lines) {
-    switch (state) {
-      case 0:
-        hdr_ = line;
-        trace_type_ = hdr_to_trace_type(hdr_);
-        state = (!line.empty() && line[0] == 'E') ? 1 : 2;
-        break;
-
-      case 1:
-        // This some "special" extra data from the ISS that we use for
-        // functional coverage calculations. The line should be of the form
-        //
-        //  # @ADDR: MNEMONIC
-        //
-        // where ADDR is an 8-digit instruction address (in hex) and mnemonic
-        // is the string mnemonic.
-        if (!std::regex_match(line, match, re)) {
-          std::cerr << "Bad 'special' line for ISS trace with header `" << hdr_
-                    << "': `" << line << "'.\n";
-          return false;
-        }
-        assert(match.size() == 3);
-        data_.insn_addr =
-            (uint32_t)strtoul(match[1].str().c_str(), nullptr, 16);
-        data_.mnemonic = match[2].str();
-        state = 2;
-        break;
-
-      default: {
-        assert(state == 2);
-        // Ignore '!' lines (which are used to tell the simulation about
-        // external register changes, not tracked by the RTL core simulation)
-        bool is_bang = (line.size() > 0 && line[0] == '!');
-        if (!is_bang) {
-          OtbnTraceBodyLine parsed_line;
-          if (!parsed_line.fill_from_string("ISS", line)) {
-            return false;
-          }
-          writes_[parsed_line.get_loc()].push_back(parsed_line);
-        }
-        break;
+    // Ignore '!' lines (which are used to tell the simulation about
+    // external register changes, not tracked by the RTL core simulation)
+    if (state == 2 && line.size() > 0 && line[0] == '!')
+      continue;
+
+    // Parse the line onto the end of writes_. The header and special line
+    // come before any writes, so we can take them off again afterwards.
+    size_t num_writes = writes_.size();
+    if (!OtbnTraceRecord::Parse(line.data(), line.size(), &writes_)) {
+      if (state == 1) {
+        std::cerr << "Bad 'special' line for ISS trace with header `";
+        hdr_.Print(std::cerr);
+        std::cerr << "': `" << line << "'.\n";
+      } else {
+        std::cerr << "OTBN trace " << (state == 0 ? "header" : "body")
+                  << " line from ISS does not have expected format. Saw: `"
+                  << line << "'.\n";
       }
+      return false;
     }
+    if (state == 2)
+      continue;
+
+    assert(num_writes == 0 && writes_.size() == 1);
+    OtbnTraceRecord record = writes_.back();
+    writes_.clear();
+    if (!take_iss_record(record, &state))
+      return false;
   }
 
+  return finish_iss_records(state);
+}
+
+bool OtbnIssTraceEntry::from_iss_records(const OtbnTraceRecord *records,
+                                         size_t num_records) {
+  clear();
+
+  int state = 0;
+  for (size_t i = 0; i < num_records; ++i) {
+    if (!take_iss_record(records[i], &state))
+      return false;
+  }
+
+  return finish_iss_records(state);
+}
+
+bool OtbnIssTraceEntry::take_iss_record(const OtbnTraceRecord &record,
+                                        int *state) {
+  switch (*state) {
+    case 0:
+      set_hdr(record);
+      *state = (record.type == 'E') ? 1 : 2;
+      return true;
+
+    case 1:
+      // This some "special" extra data from the ISS that we use for
+      // functional coverage calculations. It should be a '#' record, giving
+      // the instruction address and mnemonic.
+      if (record.type != '#') {
+        std::cerr << "Bad 'special' line for ISS trace with header `";
+        hdr_.Print(std::cerr);
+        std::cerr << "': `";
+        record.Print(std::cerr);
+        std::cerr << "'.\n";
+        return false;
+      }
+      data_.insn_addr = record.addr;
+      data_.mnemonic = record.Mnemonic();
+      *state = 2;
+      return true;
+
+    default:
+      assert(*state == 2);
+      writes_.push_back(record);
+      return true;
+  }
+}
+
+bool OtbnIssTraceEntry::finish_iss_records(int state) {
   // We shouldn't be in state 1 here: that would mean an E line with no
   // follow-up '#' line.
   if (state == 1) {
-    std::cerr << "No 'special' line for ISS trace with header `" << hdr_
-              << "'.\n";
+    std::cerr << "No 'special' line for ISS trace with header `";
+    hdr_.Print(std::cerr);
+    std::cerr << "'.\n";
     return false;
   }
 
+  sort_writes();
   return true;
 }
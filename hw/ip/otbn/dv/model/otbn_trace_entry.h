@@ -4,39 +4,11 @@
 #ifndef OPENTITAN_HW_IP_OTBN_DV_MODEL_OTBN_TRACE_ENTRY_H_
 #define OPENTITAN_HW_IP_OTBN_DV_MODEL_OTBN_TRACE_ENTRY_H_
 
-#include <map>
+#include <iosfwd>
 #include <string>
 #include <vector>
 
-// This models a body line in an OTBN trace entry (type '<', '>', 'R' or 'W').
-// Each of these lines is of the format
-//
-//   TYPE ' ' LOC ': ' VALUE
-//
-// and we parse them accordingly here. The point is that we want to merge
-// successive writes to the same location and thus need to unpack things enough
-// to see them.
-class OtbnTraceBodyLine {
- public:
-  // Parse a line into this object, based on the format above. On success,
-  // return true. On failure, write an error message to stderr (using src to
-  // say where the line came from) and return false.
-  bool fill_from_string(const std::string &src, const std::string &line);
-
-  bool operator==(const OtbnTraceBodyLine &other) const;
-
-  // Return the location that is being read or written
-  const std::string &get_loc() const { return loc_; }
-
-  // Return the original string format for the entry
-  const std::string &get_string() const { return raw_; }
-
- private:
-  std::string raw_;
-  char type_;
-  std::string loc_;
-  std::string value_;
-};
+#include "otbn_trace_record.h"
 
 class OtbnTraceEntry {
  public:
@@ -48,10 +20,23 @@ class OtbnTraceEntry {
     WipeComplete,
   };
 
+  OtbnTraceEntry() : trace_type_(Invalid) { clear(); }
   virtual ~OtbnTraceEntry(){};
 
-  // Parse a trace entry from the RTL into this object. On an error, print a
-  // message to stderr and return false.
+  // Clear this entry so that it can be filled again. This keeps the storage
+  // for writes_, so refilling the entry doesn't allocate.
+  void clear();
+
+  // Swap the contents of this entry with other (which is much cheaper than a
+  // copy).
+  void swap(OtbnTraceEntry &other);
+
+  // Fill this object from the records for one cycle of trace from the RTL. On
+  // an error, print a message to stderr and return false.
+  bool from_rtl_records(const std::vector<OtbnTraceRecord> &records);
+
+  // Parse a trace entry from the RTL in text form into this object. On an
+  // error, print a message to stderr and return false.
   bool from_rtl_trace(const std::string &trace);
 
   bool compare_rtl_iss_entries(const OtbnTraceEntry &other,
@@ -76,23 +61,38 @@ class OtbnTraceEntry {
 
  protected:
   static bool check_entries_compatible(
-      trace_type_t type, const std::string &key,
-      const std::vector<OtbnTraceBodyLine> &rtl_lines,
-      const std::vector<OtbnTraceBodyLine> &iss_lines,
-      bool no_sec_wipe_data_chk, std::string *err_desc);
+      trace_type_t type, const OtbnTraceRecord *rtl_begin,
+      const OtbnTraceRecord *rtl_end, const OtbnTraceRecord *iss_begin,
+      const OtbnTraceRecord *iss_end, bool no_sec_wipe_data_chk,
+      std::string *err_desc);
+
+  static trace_type_t hdr_to_trace_type(const OtbnTraceRecord &hdr);
+
+  void set_hdr(const OtbnTraceRecord &hdr);
 
-  static trace_type_t hdr_to_trace_type(const std::string &hdr);
+  // Sort writes_ by location, keeping writes to the same location in order
+  void sort_writes();
 
   trace_type_t trace_type_;
-  std::string hdr_;
-  // The register writes for this trace entry, keyed by destination
-  std::map<std::string, std::vector<OtbnTraceBodyLine>> writes_;
+  OtbnTraceRecord hdr_;
+  // The register writes for this trace entry. This is sorted by location
+  // (see OtbnTraceRecord::LocKey) and writes to the same location appear in
+  // the order that they happened.
+  std::vector<OtbnTraceRecord> writes_;
 };
 
 class OtbnIssTraceEntry : public OtbnTraceEntry {
  public:
+  // Parse a trace entry from the ISS in text form into this object. On an
+  // error, print a message to stderr and return false.
   bool from_iss_trace(const std::vector<std::string> &lines);
 
+  // Fill this object from trace records sent by the ISS. On an error, print a
+  // message to stderr and return false.
+  bool from_iss_records(const OtbnTraceRecord *records, size_t num_records);
+
+  void swap(OtbnIssTraceEntry &other);
+
   // Fields that are populated from the "special" line for ISS entries
   struct IssData {
     uint32_t insn_addr;
@@ -100,6 +100,16 @@ class OtbnIssTraceEntry : public OtbnTraceEntry {
   };
 
   IssData data_;
+
+ private:
+  // Add a record to the entry that is being filled by from_iss_trace or
+  // from_iss_records. state is the state of the read FSM: 0 = read header; 1
+  // = read mnemonic (for E lines); 2 = read writes. On an error, print a
+  // message to stderr and return false.
+  bool take_iss_record(const OtbnTraceRecord &record, int *state);
+
+  // Check the read FSM finished in a sensible state and sort the writes.
+  bool finish_iss_records(int state);
 };
 
 #endif  // OPENTITAN_HW_IP_OTBN_DV_MODEL_OTBN_TRACE_ENTRY_H_
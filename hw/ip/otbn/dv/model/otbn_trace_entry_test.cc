@@ -0,0 +1,252 @@
+// Copyright lowRISC contributors.
+// Licensed under the Apache License, Version 2.0, see LICENSE for details.
+// SPDX-License-Identifier: Apache-2.0
+
+#include "otbn_trace_entry.h"
+
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace {
+
+// A small deterministic PRNG, so that failures are repeatable
+class Lcg {
+ public:
+  explicit Lcg(uint64_t seed) : state_(seed) {}
+  uint32_t Next() {
+    state_ = state_ * 6364136223846793005ull + 1442695040888963407ull;
+    return state_ >> 32;
+  }
+
+ private:
+  uint64_t state_;
+};
+
+OtbnTraceRecord MakeRecord(char type, uint8_t loc, uint8_t idx,
+                           uint32_t addr) {
+  OtbnTraceRecord rec;
+  memset(&rec, 0, sizeof rec);
+  rec.type = type;
+  rec.loc = loc;
+  rec.idx = idx;
+  rec.addr = addr;
+  return rec;
+}
+
+// A random register access with the given type ('<' or '>'), with a value
+// that is the right width for its location
+OtbnTraceRecord RandomRegAccess(Lcg &lcg, char type) {
+  static const uint8_t kLocs[] = {
+      OtbnTraceRecord::kGpr, OtbnTraceRecord::kGpr, OtbnTraceRecord::kWdr,
+      OtbnTraceRecord::kWdr, OtbnTraceRecord::kWdr, OtbnTraceRecord::kAcc,
+      OtbnTraceRecord::kMod, OtbnTraceRecord::kFlags};
+  uint8_t loc = kLocs[lcg.Next() % sizeof kLocs];
+  uint8_t idx = 0;
+  if (loc == OtbnTraceRecord::kGpr)
+    idx = 1 + lcg.Next() % 31;
+  else if (loc == OtbnTraceRecord::kWdr)
+    idx = lcg.Next() % 32;
+  else if (loc == OtbnTraceRecord::kFlags)
+    idx = lcg.Next() % 2;
+
+  OtbnTraceRecord rec = MakeRecord(type, loc, idx, 0);
+  switch (loc) {
+    case OtbnTraceRecord::kGpr:
+      rec.value[0] = lcg.Next();
+      break;
+    case OtbnTraceRecord::kFlags:
+      rec.value[0] = lcg.Next() & 0xf;
+      break;
+    default:
+      for (int i = 0; i < 8; ++i)
+        rec.value[i] = lcg.Next();
+      break;
+  }
+  return rec;
+}
+
+// One executed instruction, as seen by the RTL and by the ISS
+struct Insn {
+  std::vector<OtbnTraceRecord> rtl_records;
+  std::vector<OtbnTraceRecord> iss_records;
+  // True if the ISS side has been changed so that it shouldn't match
+  bool mismatch;
+};
+
+// Generate an instruction: an 'E' header, a couple of register reads and up
+// to three writes on the RTL side; the matching header, special line and
+// writes on the ISS side. One instruction in 16 has a mismatch of some sort.
+Insn RandomInsn(Lcg &lcg, uint32_t pc) {
+  Insn insn;
+  OtbnTraceRecord hdr = MakeRecord('E', OtbnTraceRecord::kNone, 0, pc);
+  hdr.value[0] = lcg.Next();
+
+  std::vector<OtbnTraceRecord> writes;
+  unsigned num_writes = lcg.Next() % 4;
+  for (unsigned i = 0; i < num_writes; ++i) {
+    OtbnTraceRecord write = RandomRegAccess(lcg, '>');
+    bool dup = false;
+    for (const auto &other : writes)
+      dup |= other.LocKey() == write.LocKey();
+    if (!dup)
+      writes.push_back(write);
+  }
+
+  insn.rtl_records.push_back(hdr);
+  for (int i = 0; i < 2; ++i)
+    insn.rtl_records.push_back(RandomRegAccess(lcg, '<'));
+  insn.rtl_records.insert(insn.rtl_records.end(), writes.begin(),
+                          writes.end());
+
+  OtbnTraceRecord special = MakeRecord('#', OtbnTraceRecord::kNone, 0, pc);
+  const char *mnemonic = (lcg.Next() & 1) ? "bn.mulqacc.wo" : "addi";
+  memcpy(special.value, mnemonic, strlen(mnemonic));
+  insn.iss_records.push_back(hdr);
+  insn.iss_records.push_back(special);
+  insn.iss_records.insert(insn.iss_records.end(), writes.begin(),
+                          writes.end());
+
+  insn.mismatch = true;
+  switch (lcg.Next() % 16) {
+    case 0:
+      insn.iss_records[0].value[0] ^= 1;
+      break;
+    case 1: {
+      OtbnTraceRecord extra = RandomRegAccess(lcg, '>');
+      extra.loc = OtbnTraceRecord::kMod;
+      extra.idx = 0;
+      insn.iss_records.push_back(extra);
+      break;
+    }
+    case 2:
+      if (writes.empty())
+        insn.iss_records.push_back(RandomRegAccess(lcg, '>'));
+      else
+        insn.iss_records.back().value[0] ^= 1;
+      break;
+    default:
+      insn.mismatch = false;
+      break;
+  }
+
+  return insn;
+}
+
+// Split rendered records into lines (with no newlines)
+std::vector<std::string> RenderLines(
+    const std::vector<OtbnTraceRecord> &records) {
+  std::string text;
+  OtbnTraceRecord::Render(records, &text);
+
+  std::vector<std::string> lines;
+  std::istringstream iss(text);
+  std::string line;
+  while (std::getline(iss, line))
+    lines.push_back(line);
+  return lines;
+}
+
+// Example lines from the tracer README, and some unusual ones
+const char *const kGoodLines[] = {
+    "E PC: 0x00000158, insn: 0x01acd08b",
+    "S PC: 0x0000014c, insn: 0x01800d13",
+    "E PC: 0x00000010, insn: ??",
+    "STALL",
+    "U ",
+    "V ",
+    "< w20: 0x78fccc06_2228e9d6_89c9b54f_887cf14e_c79af825_69be57d4_"
+    "fecd21a1_b9dd0141",
+    "< x25: 0x00000020",
+    "> x26: 0x00000015",
+    "> ACC: 0x00000000_00000000_00311bcb_5e157313_a2fd5453_c7eb58ce_"
+    "1a1d070d_673963ce",
+    "> URND: 0x00000000_00000000_00311bcb_5e157313_a2fd5453_c7eb58ce_"
+    "1a1d070d_673963ce",
+    "> FLAGS0: {C: 1, M: 1, L: 1, Z: 0}",
+    "R [0x00000040]: 0xcccccccc_bbbbbbbb_aaaaaaaa_facefeed_deadbeef_"
+    "cafed00d_baadf00d_1234abcd",
+    "W [0x00000004]: 0xd0beb533",
+    "W [0x00000080]: Mask ERR Mask: 0xfffff800_0000ffff_ffffffff_00000000_"
+    "00000000_00000000_00000000_00000000 Data: 0xcccccccc_bbbbbbbb_"
+    "aaaaaaaa_facefeed_deadbeef_cafed00d_baadf00d_1234abcd",
+    "# @0x00000010: bn.mulqacc.wo.z",
+};
+
+const char *const kBadLines[] = {
+    "",
+    "E PC: 0x00000158",
+    "> x32: 0x00000000",
+    "> y01: 0x00000000",
+    "> FLAGS0: {C: 2, M: 1, L: 1, Z: 0}",
+    "> w01: 0x",
+    "Q",
+};
+
+TEST(OtbnTraceRecordTest, ParseRenderRoundTrip) {
+  for (const char *line : kGoodLines) {
+    std::vector<OtbnTraceRecord> records;
+    ASSERT_TRUE(OtbnTraceRecord::Parse(line, strlen(line), &records)) << line;
+
+    std::string text;
+    OtbnTraceRecord::Render(records, &text);
+    EXPECT_EQ(text, std::string(line) + "\n");
+  }
+}
+
+TEST(OtbnTraceRecordTest, ParseRejectsBadLines) {
+  for (const char *line : kBadLines) {
+    std::vector<OtbnTraceRecord> records;
+    EXPECT_FALSE(OtbnTraceRecord::Parse(line, strlen(line), &records))
+        << "`" << line << "'";
+  }
+}
+
+// Compare random instructions from text and from trace records. Both should
+// spot exactly the deliberate mismatches.
+TEST(OtbnTraceEntryTest, TextAndRecordsAgree) {
+  Lcg lcg(0x5eed);
+
+  // Mismatches are reported on stderr, so silence it while we run.
+  std::streambuf *cerr_buf = std::cerr.rdbuf(nullptr);
+
+  // The checker reuses its entries for each instruction, so we do too.
+  OtbnTraceEntry rtl;
+  OtbnIssTraceEntry iss;
+  std::string err;
+  size_t num_mismatches = 0;
+
+  for (uint32_t i = 0; i < 4000; ++i) {
+    Insn insn = RandomInsn(lcg, 4 * i);
+    num_mismatches += insn.mismatch;
+
+    std::string rtl_text;
+    OtbnTraceRecord::Render(insn.rtl_records, &rtl_text);
+    std::vector<std::string> iss_lines = RenderLines(insn.iss_records);
+    iss_lines.push_back("! otbn.INSN_CNT: 0x00000001");
+
+    ASSERT_TRUE(rtl.from_rtl_trace(rtl_text)) << rtl_text;
+    ASSERT_TRUE(iss.from_iss_trace(iss_lines));
+    bool text_match = rtl.compare_rtl_iss_entries(iss, false, &err);
+
+    ASSERT_TRUE(rtl.from_rtl_records(insn.rtl_records));
+    ASSERT_TRUE(
+        iss.from_iss_records(insn.iss_records.data(), insn.iss_records.size()));
+    bool bin_match = rtl.compare_rtl_iss_entries(iss, false, &err);
+
+    EXPECT_EQ(text_match, !insn.mismatch) << "instruction " << i;
+    EXPECT_EQ(bin_match, !insn.mismatch) << "instruction " << i;
+  }
+
+  std::cerr.rdbuf(cerr_buf);
+
+  // Make sure that the mismatch cases were actually exercised
+  EXPECT_GT(num_mismatches, 0u);
+}
+
+}  // namespace
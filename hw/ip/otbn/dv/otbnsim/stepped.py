@@ -41,8 +41,20 @@ prefixed with "0x" if they are hexadecimal.
     dump_d <path>           Write the current contents of DMEM to <path> (same
                             format as for load).
 
+    load_d_shared <words>   Like load_d, but read the first <words> words from
+                            the shared memory region (see --shared-mem below)
+
+    load_i_shared <words>   Like load_i, but read the first <words> words from
+                            the shared memory region
+
+    dump_d_shared           Like dump_d, but write to the shared memory region
+
     print_regs              Write the hex contents of all registers to stdout
 
+    dump_regs               Write a snapshot of the registers and call stack
+                            in the binary format described below, as a single
+                            line of hex.
+
     edn_rnd_step            Send 32b RND Data to the model.
 
     edn_rnd_cdc_done        Finish the RND data write process by signalling RTL
@@ -57,6 +69,13 @@ prefixed with "0x" if they are hexadecimal.
     edn_flush               Flush EDN data from model because of reset signal
                             in EDN clock domain
 
+    edn_events <events>     Apply a sequence of the EDN commands above, in
+                            order. <events> is a comma-separated list, where
+                            each item is r<hex> (edn_rnd_step with that
+                            data), u<hex> (edn_urnd_step), R
+                            (edn_rnd_cdc_done), U (edn_urnd_cdc_done) or F
+                            (edn_flush).
+
     otp_key_cdc_done        Lowers the request flag for any external secure
                             wipe operation. Gets called when we acknowledge
                             incoming scrambling key in RTL.
@@ -74,15 +93,190 @@ prefixed with "0x" if they are hexadecimal.
     send_err_escalation     React to an injected error.
 
     set_software_errs_fatal Set software_errs_fatal bit.
+
+If the simulator is started with --shared-mem <fd>, the file descriptor <fd>
+(which the parent process leaves open for us) refers to a memory region that
+is used to pass the contents of DMEM and IMEM. It starts with a header of four
+32-bit little-endian words (a magic number, the number of words of DMEM, the
+number of words of IMEM and a reserved word). The DMEM words follow and then
+the IMEM words, each in the same 5-byte format as for load_d.
+
+The simulator can also run inside another process, which uses the
+EmbeddedSim class instead of sending commands on stdin.
+
+If the simulator is started with --binary, commands and their responses are
+sent in length-prefixed frames instead of lines. Each frame is a 32-bit
+little-endian byte count, followed by that many bytes of payload. A request
+payload is a command, as above, with no trailing newline. A response payload
+is the text that the command would have printed (with no "." terminator).
+A request payload can also hold several commands, separated by newlines. They
+are run in order and the response is the one for the last command (the
+output of the others is discarded).
+
+The exception is the step command, which takes an optional argument (1 to
+generate trace output, the default, or 0 to skip it). Its response payload is
+a header of six 32-bit little-endian words:
+
+    status, insn_cnt, err_bits, stop_pc, flags, trace_off
+
+where flags says which of the external registers were written in the cycle
+(see the STEP_* constants below) and trace_off is the offset in the payload
+of the trace, which runs to the end of the frame. The trace is a sequence of
+40-byte binary records (see _TRACE_REC below), rather than text.
+
+Binary mode also supports a step_batch command:
+
+    step_batch <max_cycles> [<trace>]
+
+                            Run up to <max_cycles> cycles, stopping after the
+                            first cycle that has an externally visible event
+                            or that might depend on an input. The response is
+                            the step response for each cycle, with a 32-bit
+                            length prefix for each.
+
+The snapshot that dump_regs returns (as raw bytes in binary mode) matches
+OtbnRegSnapshot in iss_wrapper.h. It is the 32 GPRs as 32-bit words, then the
+32 WDRs as 256-bit values, then the size of the call stack and its entries
+(bottom first, padded with zeros to the maximum depth). Everything is
+little-endian.
 '''
 
+import argparse
 import binascii
+import contextlib
+import io
+import mmap
+import struct
 import sys
-from typing import List, Optional
+from typing import BinaryIO, List, Optional, Sequence, Tuple
 
-from sim.decode import decode_file
+from sim.decode import decode_bytes, decode_file
+from sim.ext_regs import TraceExtRegChange
+from sim.flags import TraceFlags
+from sim.isa import OTBNInsn
 from sim.load_elf import load_elf
+from sim.reg import TraceRegister
 from sim.sim import OTBNSim
+from sim.state import FsmState
+from sim.trace import Trace
+from sim.wsr import TraceWSR
+
+# Bits in the flags word of a binary step response. The first four say that
+# the corresponding register value in the header was written in this cycle.
+# RND_REQ and WIPE_START are flags, so their values are sent in the flags word
+# too.
+STEP_STATUS = 1 << 0
+STEP_INSN_CNT = 1 << 1
+STEP_ERR_BITS = 1 << 2
+STEP_STOP_PC = 1 << 3
+STEP_RND_REQ = 1 << 4
+STEP_RND_REQ_VAL = 1 << 5
+STEP_WIPE_START = 1 << 6
+STEP_WIPE_START_VAL = 1 << 7
+
+_STEP_HDR = struct.Struct('<6I')
+
+# The index in the step header and the flag for each external register that
+# it reports.
+_STEP_REGS = {
+    'STATUS': (0, STEP_STATUS),
+    'INSN_CNT': (1, STEP_INSN_CNT),
+    'ERR_BITS': (2, STEP_ERR_BITS),
+    'STOP_PC': (3, STEP_STOP_PC)
+}
+
+# The written and value flags for each external register that is a boolean
+# flag.
+_STEP_FLAGS = {
+    'RND_REQ': (STEP_RND_REQ, STEP_RND_REQ_VAL),
+    'WIPE_START': (STEP_WIPE_START, STEP_WIPE_START_VAL)
+}
+
+
+# A binary trace record (see OtbnTraceRecord in otbn_trace_record.h). The
+# fields are the record type, location, index, flags, address (or PC) and a
+# 256-bit little-endian value.
+_TRACE_REC = struct.Struct('<cBBBI32s')
+
+# The maximum depth of the call stack in a register snapshot (see dump_regs)
+_CALL_STACK_DEPTH = 8
+
+# Locations for trace records. These must match OtbnTraceRecord::Loc.
+TRACE_LOC_GPR = 1
+TRACE_LOC_WDR = 2
+TRACE_LOC_MOD = 3
+TRACE_LOC_ACC = 4
+TRACE_LOC_RND = 5
+TRACE_LOC_URND = 6
+TRACE_LOC_FLAGS = 7
+
+# Flags for trace records. These must match OtbnTraceRecord::Flag.
+TRACE_REC_INSN_ERR = 1 << 0
+TRACE_REC_NO_PC = 1 << 1
+
+_TRACE_WSR_LOCS = {
+    'MOD': TRACE_LOC_MOD,
+    'ACC': TRACE_LOC_ACC,
+    'RND': TRACE_LOC_RND,
+    'URND': TRACE_LOC_URND
+}
+
+
+class SharedMem:
+    '''A memory region, shared with our parent, holding DMEM and IMEM'''
+    _HDR = struct.Struct('<4I')
+    _MAGIC = 0x4d42544f  # 'OTBM'
+
+    def __init__(self, fd: int):
+        self._mem = mmap.mmap(fd, 0)
+        hdr = SharedMem._HDR.unpack_from(self._mem)
+        magic, dmem_words, imem_words = hdr[:3]
+        if magic != SharedMem._MAGIC:
+            raise ValueError(f'Bad magic number for shared memory region: '
+                             f'{magic:#x}.')
+
+        self._dmem_words = dmem_words
+        self._imem_words = imem_words
+
+        expected_size = SharedMem._HDR.size + 5 * (dmem_words + imem_words)
+        if len(self._mem) < expected_size:
+            raise ValueError(f'Shared memory region is {len(self._mem)} '
+                             f'bytes long, but its header needs '
+                             f'{expected_size}.')
+
+    def _region(self, is_imem: bool) -> Tuple[int, int]:
+        '''Return the offset and length in words of DMEM or IMEM'''
+        dmem_off = SharedMem._HDR.size
+        if is_imem:
+            return (dmem_off + 5 * self._dmem_words, self._imem_words)
+        return (dmem_off, self._dmem_words)
+
+    def read(self, is_imem: bool, num_words: int) -> bytes:
+        '''Read the first num_words words of DMEM or IMEM'''
+        off, words = self._region(is_imem)
+        if num_words > words:
+            raise ValueError(f'Cannot read {num_words} words from shared '
+                             f'memory: the region only has {words}.')
+        return self._mem[off:off + 5 * num_words]
+
+    def write_dmem(self, data: bytes) -> None:
+        '''Fill the DMEM region with the start of data'''
+        off, words = self._region(False)
+        if len(data) < 5 * words:
+            raise ValueError(f'Cannot fill {words} words of shared memory '
+                             f'with only {len(data)} bytes.')
+        self._mem[off:off + 5 * words] = data[:5 * words]
+
+
+# The shared memory region, if there is one (see --shared-mem)
+_SHARED_MEM = None  # type: Optional[SharedMem]
+
+
+def get_shared_mem(cmd: str) -> SharedMem:
+    if _SHARED_MEM is None:
+        raise RuntimeError(f'Cannot run {cmd}: no shared memory region. '
+                           f'Use the --shared-mem argument.')
+    return _SHARED_MEM
 
 
 def read_word(arg_name: str, word_data: str, bits: int) -> int:
@@ -145,24 +339,57 @@ def on_configure(sim: OTBNSim, args: List[str]) -> Optional[OTBNSim]:
     return None
 
 
-def on_step(sim: OTBNSim, args: List[str]) -> Optional[OTBNSim]:
-    '''Step one instruction'''
-    check_arg_count('step', 0, args)
+def _step(sim: OTBNSim) -> Tuple[int,
+                                  Optional[OTBNInsn],
+                                  Optional[str],
+                                  Sequence[Trace]]:
+    '''Step one instruction
+
+    Returns the PC at the start of the cycle, the instruction that completed
+    (if any), the type of the trace header for the cycle and the changes from
+    the step. The header type is 'E' (if an instruction completed), 'U' or 'V'
+    (for a secure wipe), 'S' (for a stall) or None.
 
+    '''
     pc = sim.state.pc
     assert 0 == pc & 3
 
     was_wiping = sim.state.wiping() and sim.state.secure_wipe_enabled
 
     insn, changes = sim.step(verbose=False)
+
     if insn is not None:
-        hdr = insn.rtl_trace(pc)  # type: Optional[str]
+        hdr_type = 'E'  # type: Optional[str]
     elif was_wiping:
-        # The trailing space is a bit naff but matches the behaviour in the RTL
-        # tracer, where it's rather difficult to change.
-        hdr = 'U ' if sim.state.wiping() else 'V '
+        hdr_type = 'U' if sim.state.wiping() else 'V'
     elif (sim.state.executing() or
           (changes and not sim.state.secure_wipe_enabled)):
+        hdr_type = 'S'
+    else:
+        hdr_type = None
+
+    return (pc, insn, hdr_type, changes)
+
+
+def step_sim(sim: OTBNSim,
+             gen_trace: bool) -> Tuple[Sequence[Trace], List[str]]:
+    '''Step one instruction
+
+    Returns the changes from the step, together with the lines of trace
+    output (which is empty if gen_trace is false).
+
+    '''
+    pc, insn, hdr_type, changes = _step(sim)
+    if not gen_trace:
+        return (changes, [])
+
+    if insn is not None:
+        hdr = insn.rtl_trace(pc)  # type: Optional[str]
+    elif hdr_type in ['U', 'V']:
+        # The trailing space is a bit naff but matches the behaviour in the RTL
+        # tracer, where it's rather difficult to change.
+        hdr = hdr_type + ' '
+    elif hdr_type == 'S':
         hdr = 'STALL'
     else:
         hdr = None
@@ -182,14 +409,184 @@ def on_step(sim: OTBNSim, args: List[str]) -> Optional[OTBNSim]:
     if hdr is None and rtl_changes:
         hdr = 'STALL'
 
-    if hdr is not None:
-        print(hdr)
-        for rt in rtl_changes:
-            print(rt)
+    if hdr is None:
+        return (changes, [])
+
+    return (changes, [hdr] + rtl_changes)
+
+
+def trace_record(change: Trace) -> Optional[bytes]:
+    '''Return the binary trace record for a change, if it has one
+
+    Writes to external registers have no record: the RTL trace doesn't see
+    them and the wrapper gets their values in the step response header.
+
+    '''
+    if isinstance(change, TraceRegister):
+        loc = TRACE_LOC_GPR if change.name[0] == 'x' else TRACE_LOC_WDR
+        return _TRACE_REC.pack(b'>', loc, int(change.name[1:]), 0, 0,
+                               change.new_value.to_bytes(32, 'little'))
+
+    if isinstance(change, TraceWSR):
+        loc = _TRACE_WSR_LOCS[change.wsr_name]
+        return _TRACE_REC.pack(b'>', loc, 0, 0, 0,
+                               change.new_value.to_bytes(32, 'little'))
+
+    if isinstance(change, TraceFlags):
+        fv = change.value
+        value = int(fv.C) | int(fv.M) << 1 | int(fv.L) << 2 | int(fv.Z) << 3
+        return _TRACE_REC.pack(b'>', TRACE_LOC_FLAGS, change.group, 0, 0,
+                               value.to_bytes(32, 'little'))
 
     return None
 
 
+def step_sim_records(sim: OTBNSim,
+                     gen_trace: bool) -> Tuple[Sequence[Trace], bytes]:
+    '''Step one instruction, generating binary trace records
+
+    This is like step_sim, but returns the trace as a sequence of packed
+    records (see _TRACE_REC), which is empty if gen_trace is false.
+
+    '''
+    pc, insn, hdr_type, changes = _step(sim)
+    if not gen_trace:
+        return (changes, b'')
+
+    records = []
+    traced = False
+    for c in changes:
+        if isinstance(c, TraceExtRegChange):
+            traced = True
+            continue
+        rec = trace_record(c)
+        if rec is not None:
+            records.append(rec)
+            traced = True
+
+    # As in step_sim, use a STALL header if there are traced changes but
+    # nothing else.
+    if hdr_type is None and traced:
+        hdr_type = 'S'
+
+    if insn is not None:
+        if insn.has_bits:
+            hdr = _TRACE_REC.pack(b'E', 0, 0, 0, pc,
+                                  insn.raw.to_bytes(32, 'little'))
+        else:
+            hdr = _TRACE_REC.pack(b'E', 0, 0, TRACE_REC_INSN_ERR, pc,
+                                  bytes(32))
+        mnemonic = insn.insn.mnemonic if insn.has_bits else '??'
+        hdr += _TRACE_REC.pack(b'#', 0, 0, 0, pc, mnemonic.encode())
+    elif hdr_type in ['U', 'V']:
+        hdr = _TRACE_REC.pack(hdr_type.encode(), 0, 0, 0, 0, bytes(32))
+    elif hdr_type == 'S':
+        hdr = _TRACE_REC.pack(b'S', 0, 0, TRACE_REC_NO_PC, 0, bytes(32))
+    else:
+        return (changes, b'')
+
+    return (changes, hdr + b''.join(records))
+
+
+def on_step(sim: OTBNSim, args: List[str]) -> Optional[OTBNSim]:
+    '''Step one instruction'''
+    check_arg_count('step', 0, args)
+
+    for line in step_sim(sim, True)[1]:
+        print(line)
+
+    return None
+
+
+def step_binary(sim: OTBNSim, gen_trace: bool) -> Tuple[bytes, int]:
+    '''Step one instruction, returning a binary step response
+
+    Also returns the flags word from the response header.
+
+    '''
+    changes, trace = step_sim_records(sim, gen_trace)
+
+    # Pick out the writes to external registers that the wrapper mirrors. If
+    # a register is written more than once, the last write wins.
+    hdr = [0] * 6
+    flags = 0
+    for c in changes:
+        if not isinstance(c, TraceExtRegChange):
+            continue
+
+        value = c.erc.new_value
+        reg = _STEP_REGS.get(c.name)
+        if reg is not None:
+            hdr[reg[0]] = value
+            flags |= reg[1]
+            continue
+
+        flag = _STEP_FLAGS.get(c.name)
+        if flag is not None:
+            if value > 1:
+                raise ValueError(f'Unexpected update to {c.name} with value '
+                                 f'{value:#x} when we expected a boolean '
+                                 f'flag.')
+            flags = (flags & ~flag[1]) | flag[0] | (flag[1] if value else 0)
+
+    hdr[4] = flags
+    hdr[5] = _STEP_HDR.size
+
+    return (_STEP_HDR.pack(*hdr) + trace, flags)
+
+
+def read_gen_trace(cmd: str, args: List[str], max_args: int) -> bool:
+    '''Read the optional gen_trace argument, which comes last'''
+    if len(args) > max_args:
+        raise ValueError(f'{cmd} expects at most {max_args} arguments. '
+                         f'Got {args}.')
+    if len(args) < max_args:
+        return True
+    return read_word('gen_trace', args[-1], 1) != 0
+
+
+def on_step_binary(sim: OTBNSim, args: List[str]) -> bytes:
+    '''Step one instruction, returning a binary step response'''
+    return step_binary(sim, read_gen_trace('step', args, 1))[0]
+
+
+def can_run_ahead(sim: OTBNSim) -> bool:
+    '''Return true if the next cycle can't depend on any input
+
+    This is true when we're executing instructions and aren't waiting for
+    data from EDN. Other inputs (like an error escalation or a change to the
+    keymgr keys) can still arrive, but the wrapper only asks us to run ahead
+    if it has been told that they won't.
+
+    '''
+    return (sim.state.get_fsm_state() == FsmState.EXEC and
+            sim.state.ext_regs.read('RND_REQ', True) == 0)
+
+
+def on_step_batch_binary(sim: OTBNSim, args: List[str]) -> bytes:
+    '''Step up to max_cycles instructions, stopping at the first event
+
+    The response is a sequence of step responses, each with a 32-bit
+    little-endian length prefix. We always step at least once. After that, we
+    stop early at the first cycle that writes an external register other than
+    INSN_CNT or when can_run_ahead() is false.
+
+    '''
+    if not args:
+        raise ValueError('step_batch expects a <max_cycles> argument.')
+    max_cycles = read_word('max_cycles', args[0], 32)
+    gen_trace = read_gen_trace('step_batch', args, 2)
+
+    frames = []
+    for _ in range(max(max_cycles, 1)):
+        resp, flags = step_binary(sim, gen_trace)
+        frames.append(struct.pack('<I', len(resp)) + resp)
+        if flags & ~STEP_INSN_CNT or not can_run_ahead(sim):
+            break
+
+    return b''.join(frames)
+
+
 def on_load_elf(sim: OTBNSim, args: List[str]) -> Optional[OTBNSim]:
     '''Load contents of ELF at path given by only argument'''
     check_arg_count('load_elf', 1, args)
@@ -274,6 +671,45 @@ def on_dump_d(sim: OTBNSim, args: List[str]) -> Optional[OTBNSim]:
     return None
 
 
+def on_load_d_shared(sim: OTBNSim, args: List[str]) -> Optional[OTBNSim]:
+    '''Load contents of data memory from the shared memory region'''
+    check_arg_count('load_d_shared', 1, args)
+
+    num_words = read_word('words', args[0], 32)
+    shared_mem = get_shared_mem('load_d_shared')
+
+    print('LOAD_D_SHARED {}'.format(num_words))
+    sim.load_data(shared_mem.read(False, num_words), has_validity=True)
+
+    return None
+
+
+def on_load_i_shared(sim: OTBNSim, args: List[str]) -> Optional[OTBNSim]:
+    '''Load contents of insn memory from the shared memory region'''
+    check_arg_count('load_i_shared', 1, args)
+
+    num_words = read_word('words', args[0], 32)
+    shared_mem = get_shared_mem('load_i_shared')
+
+    print('LOAD_I_SHARED {}'.format(num_words))
+    sim.load_program(decode_bytes(0, shared_mem.read(True, num_words),
+                                  'shared IMEM'))
+
+    return None
+
+
+def on_dump_d_shared(sim: OTBNSim, args: List[str]) -> Optional[OTBNSim]:
+    '''Dump contents of data memory to the shared memory region'''
+    check_arg_count('dump_d_shared', 0, args)
+
+    shared_mem = get_shared_mem('dump_d_shared')
+
+    print('DUMP_D_SHARED')
+    shared_mem.write_dmem(sim.state.dmem.dump_le_words())
+
+    return None
+
+
 def on_print_regs(sim: OTBNSim, args: List[str]) -> Optional[OTBNSim]:
     '''Print registers to stdout'''
     check_arg_count('print_regs', 0, args)
@@ -287,6 +723,33 @@ def on_print_regs(sim: OTBNSim, args: List[str]) -> Optional[OTBNSim]:
     return None
 
 
+def pack_reg_snapshot(sim: OTBNSim) -> bytes:
+    '''Pack the registers and call stack into a snapshot for dump_regs'''
+    gprs = sim.state.gprs.peek_unsigned_values()
+    wdrs = sim.state.wdrs.peek_unsigned_values()
+    call_stack = sim.state.peek_call_stack()
+    if len(call_stack) > _CALL_STACK_DEPTH:
+        raise RuntimeError('Call stack has {} entries, but a register '
+                           'snapshot can only hold {}.'
+                           .format(len(call_stack), _CALL_STACK_DEPTH))
+
+    padding = [0] * (_CALL_STACK_DEPTH - len(call_stack))
+    return (struct.pack('<32I', *gprs) +
+            b''.join(value.to_bytes(32, 'little') for value in wdrs) +
+            struct.pack('<{}I'.format(1 + _CALL_STACK_DEPTH),
+                        len(call_stack), *call_stack, *padding))
+
+
+def on_dump_regs(sim: OTBNSim, args: List[str]) -> Optional[OTBNSim]:
+    '''Print a snapshot of the registers and call stack as a line of hex'''
+    check_arg_count('dump_regs', 0, args)
+
+    print('DUMP_REGS')
+    print(pack_reg_snapshot(sim).hex())
+
+    return None
+
+
 def on_print_call_stack(sim: OTBNSim, args: List[str]) -> Optional[OTBNSim]:
     '''Print call stack to stdout. First element is the bottom of the stack'''
     check_arg_count('print_call_stack', 0, args)
@@ -335,6 +798,27 @@ def on_edn_rnd_cdc_done(sim: OTBNSim, args: List[str]) -> Optional[OTBNSim]:
     return None
 
 
+def on_edn_events(sim: OTBNSim, args: List[str]) -> Optional[OTBNSim]:
+    check_arg_count('edn_events', 1, args)
+    for event in args[0].split(','):
+        kind = event[:1]
+        if kind in 'ru' and len(event) > 1:
+            data = read_word('edn_events', '0x' + event[1:], 32)
+            if kind == 'r':
+                sim.state.edn_rnd_step(data)
+            else:
+                sim.state.edn_urnd_step(data)
+        elif event == 'R':
+            sim.state.rnd_completed()
+        elif event == 'U':
+            sim.state.urnd_completed()
+        elif event == 'F':
+            sim.state.edn_flush()
+        else:
+            raise ValueError(f'Unknown EDN event: {event!r}.')
+    return None
+
+
 def on_invalidate_imem(sim: OTBNSim, args: List[str]) -> Optional[OTBNSim]:
     check_arg_count('invalidate_imem', 0, args)
 
@@ -407,14 +891,19 @@ _HANDLERS = {
     'load_d': on_load_d,
     'load_i': on_load_i,
     'dump_d': on_dump_d,
+    'load_d_shared': on_load_d_shared,
+    'load_i_shared': on_load_i_shared,
+    'dump_d_shared': on_dump_d_shared,
     'print_regs': on_print_regs,
     'print_call_stack': on_print_call_stack,
+    'dump_regs': on_dump_regs,
     'reset': on_reset,
     'edn_rnd_step': on_edn_rnd_step,
     'edn_urnd_step': on_edn_urnd_step,
     'edn_rnd_cdc_done': on_edn_rnd_cdc_done,
     'edn_urnd_cdc_done': on_edn_urnd_cdc_done,
     'edn_flush': on_edn_flush,
+    'edn_events': on_edn_events,
     'invalidate_imem': on_invalidate_imem,
     'invalidate_dmem': on_invalidate_dmem,
     'set_keymgr_value': on_set_keymgr_value,
@@ -444,13 +933,140 @@ def on_input(sim: OTBNSim, line: str) -> Optional[OTBNSim]:
     return ret
 
 
+def read_frame(stream: BinaryIO) -> Optional[bytes]:
+    '''Read a length-prefixed frame. Returns None on EOF.'''
+    hdr = stream.read(4)
+    if len(hdr) < 4:
+        return None
+
+    length = struct.unpack('<I', hdr)[0]
+    payload = stream.read(length)
+    if len(payload) < length:
+        return None
+
+    return payload
+
+
+def write_frame(stream: BinaryIO, payload: bytes) -> None:
+    '''Write a length-prefixed frame and flush'''
+    stream.write(struct.pack('<I', len(payload)) + payload)
+    stream.flush()
+
+
+def on_binary_input(sim: OTBNSim,
+                    cmd: str) -> Tuple[Optional[OTBNSim], bytes]:
+    '''Process the commands in a frame, returning the response payload'''
+    lines = cmd.split('\n')
+    new_sim = None  # type: Optional[OTBNSim]
+    for line in lines[:-1]:
+        ret, _ = on_binary_command(new_sim or sim, line)
+        if ret is not None:
+            new_sim = ret
+
+    ret, payload = on_binary_command(new_sim or sim, lines[-1])
+    return (ret if ret is not None else new_sim, payload)
+
+
+def on_binary_command(sim: OTBNSim,
+                      cmd: str) -> Tuple[Optional[OTBNSim], bytes]:
+    '''Process an input command, returning the response payload'''
+    words = cmd.split()
+    if not words:
+        return (None, b'')
+
+    verb = words[0]
+    if verb == 'step':
+        return (None, on_step_binary(sim, words[1:]))
+    if verb == 'step_batch':
+        return (None, on_step_batch_binary(sim, words[1:]))
+    if verb == 'dump_regs':
+        check_arg_count('dump_regs', 0, words[1:])
+        return (None, pack_reg_snapshot(sim))
+
+    handler = _HANDLERS.get(verb)
+    if handler is None:
+        raise RuntimeError('Unknown command: {!r}'.format(verb))
+
+    # Collect anything that the handler prints to send back as the response.
+    buf = io.StringIO()
+    with contextlib.redirect_stdout(buf):
+        ret = handler(sim, words[1:])
+
+    return (ret, buf.getvalue().encode())
+
+
+class EmbeddedSim:
+    '''The ISS as seen by a simulator that runs it in its own process
+
+    The OTBN model (iss_wrapper.cc) can embed a Python interpreter and use
+    this class instead of starting stepped.py as a child process. Each method
+    is called directly and returns what the binary protocol would send in the
+    response frame. The frequent commands have their own methods, which avoid
+    formatting and parsing a command string.
+
+    '''
+    def __init__(self, shared_mem_fd: int) -> None:
+        self.shared_mem = SharedMem(shared_mem_fd)
+        self.sim = OTBNSim()
+
+    def run(self, cmd: str) -> bytes:
+        '''Run a command, like a frame in binary mode'''
+        # The command handlers find the shared memory region through a global.
+        # Point it at ours, in case another EmbeddedSim has changed it.
+        global _SHARED_MEM
+        _SHARED_MEM = self.shared_mem
+
+        ret, payload = on_binary_input(self.sim, cmd)
+        if ret is not None:
+            self.sim = ret
+        return payload
+
+    def step(self, gen_trace: bool) -> bytes:
+        '''Step one instruction, returning a binary step response'''
+        return step_binary(self.sim, gen_trace)[0]
+
+    def edn_events(self, events: str) -> None:
+        '''Apply EDN events, in the format of the edn_events command'''
+        on_edn_events(self.sim, [events])
+
+    def set_keymgr_value(self, key0: bytes, key1: bytes, valid: bool) -> None:
+        '''Set the sideload keys from 48-byte little-endian values'''
+        self.sim.state.wsrs.set_sideload_keys(
+            int.from_bytes(key0, 'little') if valid else None,
+            int.from_bytes(key1, 'little') if valid else None)
+
+
 def main() -> int:
+    parser = argparse.ArgumentParser()
+    parser.add_argument('--binary', action='store_true',
+                        help='Use length-prefixed frames for commands and '
+                        'responses, rather than lines')
+    parser.add_argument('--shared-mem', type=int, metavar='FD',
+                        help='An open file descriptor for a shared memory '
+                        'region holding DMEM and IMEM')
+    args = parser.parse_args()
+
+    if args.shared_mem is not None:
+        global _SHARED_MEM
+        _SHARED_MEM = SharedMem(args.shared_mem)
+
     sim = OTBNSim()
     try:
-        for line in sys.stdin:
-            ret = on_input(sim, line)
-            if ret is not None:
-                sim = ret
+        if args.binary:
+            while True:
+                frame = read_frame(sys.stdin.buffer)
+                if frame is None:
+                    break
+
+                ret, payload = on_binary_input(sim, frame.decode())
+                write_frame(sys.stdout.buffer, payload)
+                if ret is not None:
+                    sim = ret
+        else:
+            for line in sys.stdin:
+                ret = on_input(sim, line)
+                if ret is not None:
+                    sim = ret
 
     except KeyboardInterrupt:
         print("Received shutdown request, ending OTBN simulation.")
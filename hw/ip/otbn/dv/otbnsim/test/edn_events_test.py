@@ -0,0 +1,101 @@
+# Copyright lowRISC contributors.
+# Licensed under the Apache License, Version 2.0, see LICENSE for details.
+# SPDX-License-Identifier: Apache-2.0
+
+'''Test that queued EDN events behave like the individual commands.'''
+
+from typing import List, Tuple
+
+import py
+
+from stepped import on_binary_input
+from testutil import prepare_sim_for_asm_str
+
+# A program that reads RND over and over again, so that the ISS stalls for EDN
+# data on almost every instruction.
+_RND_HAMMER_ASM = """
+    loopi 32, 1
+      bn.wsrr w1, 0x1 /* RND */
+    ecall
+"""
+
+_MAX_CYCLES = 10000
+
+# The individual command for each type of EDN event (see edn_events in
+# stepped.py)
+_EVENT_CMDS = {
+    'r': 'edn_rnd_step 0x',
+    'u': 'edn_urnd_step 0x',
+    'R': 'edn_rnd_cdc_done',
+    'U': 'edn_urnd_cdc_done'
+}
+
+
+def run_rnd_hammer(tmpdir: py.path.local,
+                   queued: bool) -> Tuple[List[bytes], int]:
+    '''Run _RND_HAMMER_ASM, feeding EDN data whenever the ISS asks for it
+
+    If queued is true, the EDN words and CDC completions are sent as an
+    edn_events command in the same frame as the next step (as ISSWrapper does
+    now). Otherwise, each goes in its own frame (as ISSWrapper used to do).
+    Returns the step responses and the number of frames that were sent.
+
+    '''
+    sim = prepare_sim_for_asm_str(_RND_HAMMER_ASM, tmpdir, False)
+
+    # The ISS waits for a URND seed before it starts
+    events = ['u{:x}'.format(0x1000 + i) for i in range(8)] + ['U']
+    responses = []  # type: List[bytes]
+    frames = 0
+    rnd_req = False
+    rnd_words = 0
+
+    for _ in range(_MAX_CYCLES):
+        # Supply 256 bits of RND data when the ISS starts asking for it
+        new_rnd_req = sim.state.ext_regs.read('RND_REQ', True) != 0
+        if new_rnd_req and not rnd_req:
+            for _ in range(8):
+                events.append('r{:x}'.format(0x5eed0000 + rnd_words))
+                rnd_words += 1
+            events.append('R')
+        rnd_req = new_rnd_req
+
+        if queued:
+            cmds = ['edn_events ' + ','.join(events)] if events else []
+            cmds.append('step 1')
+            frame = '\n'.join(cmds)
+        else:
+            for event in events:
+                cmd = _EVENT_CMDS[event[0]] + event[1:]
+                ret, _ = on_binary_input(sim, cmd)
+                assert ret is None
+                frames += 1
+            frame = 'step 1'
+        events = []
+
+        ret, resp = on_binary_input(sim, frame)
+        assert ret is None
+        frames += 1
+        responses.append(resp)
+
+        if not sim.state.executing():
+            break
+    else:
+        assert False, 'Program did not finish.'
+
+    # Make sure that the program really did read RND many times
+    assert rnd_words >= 32 * 8
+    return (responses, frames)
+
+
+def test_edn_events(tmpdir: py.path.local) -> None:
+    '''Check queued EDN events give the same results with fewer frames.'''
+    single, single_frames = run_rnd_hammer(tmpdir, False)
+    queued, queued_frames = run_rnd_hammer(tmpdir, True)
+
+    assert queued == single
+
+    # With queued events, there is exactly one frame per cycle. Sending each
+    # EDN event separately costs 9 extra frames for each 256-bit RND value.
+    assert queued_frames == len(queued)
+    assert single_frames >= queued_frames + 9 * 32
@@ -3,65 +3,383 @@
 // SPDX-License-Identifier: Apache-2.0
 
 #include <cassert>
-#include <iomanip>
-#include <ios>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <pthread.h>
+#include <signal.h>
 #include <sstream>
 #include <stdexcept>
 #include <string>
+#include <sys/wait.h>
+#include <unistd.h>
 
 #include "log_trace_listener.h"
 
-LogTraceListener::LogTraceListener(const std::string &log_filename)
-    : trace_log(log_filename, std::fstream::out) {
-  if (!trace_log.is_open()) {
+namespace {
+
+// The number of records in the ring (which must be a power of two). At 40
+// bytes a record, this is 2.5MiB, which is many thousands of cycles of trace.
+const size_t kRingRecords = 1 << 16;
+
+// The writer thread collects output until it has at least this many bytes
+// (or runs out of trace) and then writes it to the file.
+const size_t kWriteBlockBytes = 1 << 16;
+
+const char kBinaryMagic[] = "OTBNTRC1";
+
+bool EndsWith(const std::string &str, const char *suffix) {
+  size_t len = strlen(suffix);
+  return str.size() >= len && str.compare(str.size() - len, len, suffix) == 0;
+}
+
+void AppendU32(std::string *out, uint32_t val) {
+  for (int i = 0; i < 4; ++i) {
+    out->push_back((char)(val >> (8 * i)));
+  }
+}
+
+}  // namespace
+
+LogTraceListener::LogTraceListener(const std::string &log_filename,
+                                   Format format)
+    : format_(format),
+      log_filename_(log_filename),
+      out_fd_(-1),
+      compressor_pid_(-1),
+      ring_(kRingRecords),
+      head_(0),
+      tail_(0),
+      stopping_(false),
+      writer_waiting_(false),
+      write_failed_(false) {
+  // O_CLOEXEC (here and for the compressor's pipe) stops the fds leaking
+  // into the compressor or any other child of the simulation. The
+  // compressor's stdin and stdout are dup2'd copies, which don't inherit it.
+  out_fd_ = open(log_filename.c_str(),
+                 O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+  if (out_fd_ < 0) {
     std::ostringstream oss;
-    oss << "Could not open log file: " << log_filename;
+    oss << "Could not open log file: " << log_filename << ": "
+        << strerror(errno);
     throw std::runtime_error(oss.str());
   }
+
+  try {
+    if (EndsWith(log_filename, ".gz")) {
+      StartCompressor("gzip");
+    } else if (EndsWith(log_filename, ".zst")) {
+      StartCompressor("zstd");
+    }
+  } catch (...) {
+    close(out_fd_);
+    throw;
+  }
+
+  if (format_ == kBinary) {
+    out_buf_.append(kBinaryMagic, sizeof kBinaryMagic - 1);
+  }
+
+  writer_ = std::thread(&LogTraceListener::WriterMain, this);
+}
+
+LogTraceListener::~LogTraceListener() {
+  {
+    // Set stopping_ with wake_mutex_ held, so the writer thread can't miss it
+    // between checking its wait condition and going to sleep.
+    std::lock_guard<std::mutex> lock(wake_mutex_);
+    stopping_.store(true, std::memory_order_release);
+  }
+  wake_cv_.notify_one();
+  writer_.join();
+
+  close(out_fd_);
+  if (compressor_pid_ != -1) {
+    int status;
+    if (waitpid(compressor_pid_, &status, 0) != compressor_pid_ ||
+        !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+      std::cerr << "ERROR: Compressor for OTBN trace log " << log_filename_
+                << " failed.\n";
+    }
+  }
+}
+
+void LogTraceListener::StartCompressor(const char *compressor) {
+  // The simulation may have other threads, so the child can only make
+  // async-signal-safe calls between the fork and the exec. Prepare its error
+  // message now, and run the compressor through /usr/bin/env (as ISSWrapper
+  // does) rather than searching PATH with execlp.
+  std::string child_err = std::string("ERROR: Failed to run ") + compressor +
+                          " for OTBN trace log.\n";
+
+  // We are using pipe and fcntl instead of pipe2 to support both MacOS and
+  // Linux
+  int fds[2];
+  if (pipe(fds) != 0) {
+    std::ostringstream oss;
+    oss << "Failed to create pipe for " << compressor << ": "
+        << strerror(errno);
+    throw std::runtime_error(oss.str());
+  }
+  fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+  fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+
+  pid_t pid = fork();
+  if (pid == -1) {
+    close(fds[0]);
+    close(fds[1]);
+    std::ostringstream oss;
+    oss << "Failed to fork to run " << compressor << ": " << strerror(errno);
+    throw std::runtime_error(oss.str());
+  }
+
+  if (pid == 0) {
+    // We are the child. Read the trace from the pipe and write the
+    // compressed result to the log file.
+    if (dup2(fds[0], 0) == 0 && dup2(out_fd_, 1) == 1) {
+      execl("/usr/bin/env", "env", compressor, "-q", "-c", (char *)nullptr);
+    }
+    ssize_t ignored = write(2, child_err.data(), child_err.size());
+    (void)ignored;
+    _exit(1);
+  }
+
+  // We are the parent. Write to the pipe rather than the file.
+  close(fds[0]);
+  close(out_fd_);
+  out_fd_ = fds[1];
+  compressor_pid_ = pid;
 }
 
 void LogTraceListener::AcceptTraceString(const std::string &trace,
                                          unsigned int cycle_count) {
-  assert(trace_log.is_open());
+  // The tracer sends records, so this path is only used by something that
+  // calls the accept_otbn_trace_string DPI function. Parse the lines so that
+  // we can queue them like any other trace.
+  parsed_records_.clear();
+  size_t pos = 0;
+  while (pos < trace.size()) {
+    size_t eol = trace.find('\n', pos);
+    if (eol == std::string::npos)
+      eol = trace.size();
+    if (!OtbnTraceRecord::Parse(trace.data() + pos, eol - pos,
+                                &parsed_records_)) {
+      std::cerr << "ERROR: Dropping bad OTBN trace line at cycle "
+                << cycle_count << ": " << trace.substr(pos, eol - pos)
+                << "\n";
+    }
+    pos = eol + 1;
+  }
 
-  // Split the trace up into a vector of strings, one per line
-  auto trace_lines = SplitTraceLines(trace);
+  AcceptTraceRecords(parsed_records_, cycle_count);
+}
 
-  // Write out the lines from the trace
-  bool first_line = true;
-  for (auto &line : trace_lines) {
-    if (first_line) {
-      if (line.size() > 1) {
-        // It is expected the first line of any trace output is an 'E' or 'S'
-        // line (instruction execute or instruction stall)
-        bool is_e_or_s_line = line[0] == 'E' || line[0] == 'S';
-
-        // Output the beginning of the first line adding a cycle count. A
-        // special '!' line, only giving the cycle count, is output if the first
-        // line isn't an 'E' or 'S' line.
-        std::ios old_state(nullptr);
-        old_state.copyfmt(trace_log);
-        trace_log << (is_e_or_s_line ? line[0] : '!') << " " << std::setw(9)
-                  << std::setfill('0') << cycle_count;
-        trace_log.copyfmt(old_state);
-
-        if (is_e_or_s_line) {
-          // If this is an expected 'E' or 'S' line write the rest of it out
-          trace_log << line.substr(1) << "\n";
-        } else {
-          // Otherwise leave the '!' line on it's own and dump this line out
-          // indented.
-          trace_log << "\n    " << line << "\n";
-        }
+void LogTraceListener::AcceptTraceRecords(
+    const std::vector<OtbnTraceRecord> &records, unsigned int cycle_count) {
+  if (records.empty())
+    return;
+
+  Push(records.data(), records.size(), cycle_count);
+}
+
+void LogTraceListener::Push(const OtbnTraceRecord *records,
+                            size_t num_records, unsigned int cycle_count) {
+  size_t needed = num_records + 1;
+  if (needed > ring_.size()) {
+    // This can't happen with trace from the tracer (which sends a few tens of
+    // records per cycle at most), and we're called from DPI, so report the
+    // problem rather than throwing.
+    std::cerr << "ERROR: Dropping OTBN trace for cycle " << cycle_count
+              << ", which has too many records (" << num_records << ").\n";
+    return;
+  }
+
+  // We are the only thread that writes head_, so a relaxed load is fine. The
+  // acquire load of tail_ pairs with the release store in the writer thread,
+  // so we don't overwrite records until it has finished with them.
+  size_t head = head_.load(std::memory_order_relaxed);
+  while (ring_.size() - (head - tail_.load(std::memory_order_acquire)) <
+         needed) {
+    std::this_thread::yield();
+  }
+
+  size_t mask = ring_.size() - 1;
+  OtbnTraceRecord &marker = ring_[head & mask];
+  memset(&marker, 0, sizeof marker);
+  marker.addr = cycle_count;
+  marker.value[0] = num_records;
+
+  for (size_t i = 0; i < num_records; ++i) {
+    ring_[(head + 1 + i) & mask] = records[i];
+  }
+
+  // Publish the cycle and wake the writer thread if it is waiting for trace.
+  // This store and the load of writer_waiting_ are sequentially consistent,
+  // pairing with WaitForTrace: either we see that the writer is waiting or it
+  // sees the new head_ before it goes to sleep.
+  head_.store(head + needed, std::memory_order_seq_cst);
+  if (writer_waiting_.load(std::memory_order_seq_cst)) {
+    {
+      std::lock_guard<std::mutex> lock(wake_mutex_);
+    }
+    wake_cv_.notify_one();
+  }
+}
+
+void LogTraceListener::WaitForTrace(size_t tail) {
+  std::unique_lock<std::mutex> lock(wake_mutex_);
+  writer_waiting_.store(true, std::memory_order_seq_cst);
+  wake_cv_.wait(lock, [this, tail]() {
+    return head_.load(std::memory_order_seq_cst) != tail ||
+           stopping_.load(std::memory_order_acquire);
+  });
+  writer_waiting_.store(false, std::memory_order_relaxed);
+}
+
+void LogTraceListener::WriterMain() {
+  // If the compressor dies, writing to its pipe raises SIGPIPE, which would
+  // kill the simulation. Block it on this thread (the only one that writes to
+  // out_fd_), so that the write fails with EPIPE and WriteOut reports it.
+  sigset_t sigpipe_set;
+  sigemptyset(&sigpipe_set);
+  sigaddset(&sigpipe_set, SIGPIPE);
+  pthread_sigmask(SIG_BLOCK, &sigpipe_set, nullptr);
+
+  size_t mask = ring_.size() - 1;
+  size_t tail = tail_.load(std::memory_order_relaxed);
+
+  while (true) {
+    // Check whether we've been told to stop before loading head_: the
+    // destructor runs after the last push, so if we see stopping_ then we
+    // also see every record.
+    bool stopping = stopping_.load(std::memory_order_acquire);
+    size_t head = head_.load(std::memory_order_acquire);
+
+    if (head == tail) {
+      // The ring is empty. Write out anything that we have collected so that
+      // the log doesn't lag far behind the simulation when it is slow.
+      if (!out_buf_.empty())
+        WriteOut();
+      if (stopping)
+        break;
+      WaitForTrace(tail);
+      continue;
+    }
+
+    // The simulation thread only publishes whole cycles, so everything
+    // between tail and head is a sequence of marker records, each followed by
+    // its cycle's records.
+    while (tail != head) {
+      const OtbnTraceRecord &marker = ring_[tail & mask];
+      unsigned int cycle_count = marker.addr;
+      size_t num_records = marker.value[0];
+      ++tail;
+
+      cycle_records_.clear();
+      for (size_t i = 0; i < num_records; ++i) {
+        cycle_records_.push_back(ring_[(tail + i) & mask]);
+      }
+      tail += num_records;
+
+      if (format_ == kBinary) {
+        FormatBinary(cycle_records_, cycle_count);
       } else {
-        trace_log << "ERR: Bad line at " << cycle_count
-                  << " line should be more than 1 character: " << line << "\n";
+        FormatText(cycle_records_, cycle_count);
       }
+    }
+    tail_.store(tail, std::memory_order_release);
 
-      first_line = false;
-    } else {
+    if (out_buf_.size() >= kWriteBlockBytes)
+      WriteOut();
+  }
+}
+
+void LogTraceListener::FormatText(const std::vector<OtbnTraceRecord> &records,
+                                  unsigned int cycle_count) {
+  text_buf_.clear();
+  OtbnTraceRecord::Render(records, &text_buf_);
+
+  // Write out the lines from the trace
+  bool first_line = true;
+  size_t pos = 0;
+  while (pos < text_buf_.size()) {
+    size_t eol = text_buf_.find('\n', pos);
+    assert(eol != std::string::npos);
+    const char *line = text_buf_.data() + pos;
+    size_t len = eol - pos;
+    pos = eol + 1;
+
+    if (!first_line) {
       // All lines other than the first are indented.
-      trace_log << "    " << line << "\n";
+      out_buf_.append("    ");
+      out_buf_.append(line, len);
+      out_buf_.push_back('\n');
+      continue;
+    }
+    first_line = false;
+
+    if (len <= 1) {
+      out_buf_.append("ERR: Bad line at ");
+      out_buf_.append(std::to_string(cycle_count));
+      out_buf_.append(" line should be more than 1 character: ");
+      out_buf_.append(line, len);
+      out_buf_.push_back('\n');
+      continue;
+    }
+
+    // It is expected the first line of any trace output is an 'E' or 'S' line
+    // (instruction execute or instruction stall)
+    bool is_e_or_s_line = line[0] == 'E' || line[0] == 'S';
+
+    // Output the beginning of the first line adding a cycle count. A special
+    // '!' line, only giving the cycle count, is output if the first line isn't
+    // an 'E' or 'S' line.
+    char prefix[16];
+    int prefix_len = snprintf(prefix, sizeof prefix, "%c %09u",
+                              is_e_or_s_line ? line[0] : '!', cycle_count);
+    out_buf_.append(prefix, prefix_len);
+
+    if (is_e_or_s_line) {
+      // If this is an expected 'E' or 'S' line write the rest of it out
+      out_buf_.append(line + 1, len - 1);
+      out_buf_.push_back('\n');
+    } else {
+      // Otherwise leave the '!' line on it's own and dump this line out
+      // indented.
+      out_buf_.append("\n    ");
+      out_buf_.append(line, len);
+      out_buf_.push_back('\n');
     }
   }
 }
+
+void LogTraceListener::FormatBinary(
+    const std::vector<OtbnTraceRecord> &records, unsigned int cycle_count) {
+  AppendU32(&out_buf_, cycle_count);
+  AppendU32(&out_buf_, records.size());
+  out_buf_.append(reinterpret_cast<const char *>(records.data()),
+                  records.size() * sizeof(OtbnTraceRecord));
+}
+
+void LogTraceListener::WriteOut() {
+  const char *data = out_buf_.data();
+  size_t left = out_buf_.size();
+
+  while (left && !write_failed_) {
+    ssize_t written = write(out_fd_, data, left);
+    if (written < 0) {
+      if (errno == EINTR)
+        continue;
+      std::cerr << "ERROR: Failed to write OTBN trace log " << log_filename_
+                << ": " << strerror(errno) << ". Discarding later trace.\n";
+      write_failed_ = true;
+      break;
+    }
+    data += written;
+    left -= written;
+  }
+
+  out_buf_.clear();
+}
@@ -5,8 +5,14 @@
 #ifndef OPENTITAN_HW_IP_OTBN_DV_TRACER_CPP_LOG_TRACE_LISTENER_H_
 #define OPENTITAN_HW_IP_OTBN_DV_TRACER_CPP_LOG_TRACE_LISTENER_H_
 
-#include <fstream>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
 #include <string>
+#include <sys/types.h>
+#include <thread>
+#include <vector>
 
 #include "otbn_trace_listener.h"
 
@@ -22,19 +28,114 @@
  * If an 'E' or 'S' line isn't seen as the first line it prints a special '!'
  * line that gives the cycle count and dumps the rest of the trace indented by
  * four spaces.
+ *
+ * The listener doesn't format or write anything on the simulation thread.
+ * Instead, it copies the trace records for each cycle into a single-producer,
+ * single-consumer ring, which is drained by a writer thread. The writer
+ * sleeps on a condition variable when the ring is empty, and the simulation
+ * thread only wakes it (which needs the mutex) if it is asleep. If the writer
+ * falls a long way behind, the simulation waits for it to catch up, so no
+ * trace is lost.
+ *
+ * With Format::kBinary, the writer dumps the trace records themselves, rather
+ * than the text above. The file starts with the 8 bytes "OTBNTRC1". This is
+ * followed by a block for each cycle with trace output: a 32-bit cycle count
+ * and a 32-bit record count (both little-endian), followed by that many
+ * OtbnTraceRecord structures. otbn_trace_to_text.py converts a file like this
+ * to the text format.
+ *
+ * If the log filename ends in ".gz" or ".zst", the output (in either format)
+ * is piped through gzip or zstd, which run in a child process.
  */
 class LogTraceListener : public OtbnTraceListener {
- private:
-  std::ofstream trace_log;
-
  public:
+  enum Format { kText, kBinary };
+
   /**
    * Constructor that takes a log filename to write trace output to. It throws
-   * std::runtime_error if the file cannot be opened.
+   * std::runtime_error if the file cannot be opened or the compressor cannot
+   * be started.
    */
-  LogTraceListener(const std::string &log_filename);
+  LogTraceListener(const std::string &log_filename, Format format = kText);
+
+  /**
+   * Wait for the writer thread to write out all the trace that has been
+   * queued and then close the log file.
+   */
+  ~LogTraceListener();
+
   void AcceptTraceString(const std::string &trace,
                          unsigned int cycle_count) override;
+  void AcceptTraceRecords(const std::vector<OtbnTraceRecord> &records,
+                          unsigned int cycle_count) override;
+
+ private:
+  // Copy a cycle's records into the ring, waiting for space if necessary.
+  // This is only called on the simulation thread.
+  void Push(const OtbnTraceRecord *records, size_t num_records,
+            unsigned int cycle_count);
+
+  // The body of the writer thread
+  void WriterMain();
+
+  // Sleep until the simulation thread pushes past tail or the destructor
+  // sets stopping_. This is only called on the writer thread.
+  void WaitForTrace(size_t tail);
+
+  // Append the trace for one cycle to out_buf_ in the text or binary format
+  void FormatText(const std::vector<OtbnTraceRecord> &records,
+                  unsigned int cycle_count);
+  void FormatBinary(const std::vector<OtbnTraceRecord> &records,
+                    unsigned int cycle_count);
+
+  // Write out_buf_ to the log file and clear it. On an error, print a message
+  // to stderr and discard any later output.
+  void WriteOut();
+
+  // Start a compressor (like "gzip") with its output going to out_fd_ and
+  // replace out_fd_ with a pipe to its input. Throws std::runtime_error on
+  // failure.
+  void StartCompressor(const char *compressor);
+
+  Format format_;
+  std::string log_filename_;
+
+  // The file descriptor that we write to (the log file itself or a pipe to
+  // the compressor) and the PID of the compressor (or -1 if there is none).
+  int out_fd_;
+  pid_t compressor_pid_;
+
+  // The ring of trace records. Each cycle is stored as a marker record
+  // (type '\0') with the cycle count in addr and the number of records that
+  // follow in value[0], followed by the records themselves. head_ and tail_
+  // count records pushed and popped (modulo the size of size_t) and an index
+  // into ring_ is found by masking with ring_.size() - 1.
+  std::vector<OtbnTraceRecord> ring_;
+  std::atomic<size_t> head_;
+  std::atomic<size_t> tail_;
+
+  // Set by the destructor to tell the writer thread to exit when the ring is
+  // empty.
+  std::atomic<bool> stopping_;
+
+  // Set by the writer thread while it is waiting on wake_cv_ for more trace.
+  // The simulation thread only takes wake_mutex_ and notifies wake_cv_ when
+  // this is set.
+  std::atomic<bool> writer_waiting_;
+  std::mutex wake_mutex_;
+  std::condition_variable wake_cv_;
+
+  // The following are only used by the writer thread (which owns out_fd_
+  // once it has started)
+  std::vector<OtbnTraceRecord> cycle_records_;
+  std::string text_buf_;
+  std::string out_buf_;
+  bool write_failed_;
+
+  // Scratch space for AcceptTraceString
+  std::vector<OtbnTraceRecord> parsed_records_;
+
+  std::thread writer_;
 };
 
 #endif  // OPENTITAN_HW_IP_OTBN_DV_TRACER_CPP_LOG_TRACE_LISTENER_H_
@@ -0,0 +1,241 @@
+// Copyright lowRISC contributors.
+// Licensed under the Apache License, Version 2.0, see LICENSE for details.
+// SPDX-License-Identifier: Apache-2.0
+
+#include "log_trace_listener.h"
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace {
+
+// A small deterministic PRNG, so that failures are repeatable
+class Lcg {
+ public:
+  explicit Lcg(uint64_t seed) : state_(seed) {}
+  uint32_t Next() {
+    state_ = state_ * 6364136223846793005ull + 1442695040888963407ull;
+    return state_ >> 32;
+  }
+
+ private:
+  uint64_t state_;
+};
+
+OtbnTraceRecord MakeRecord(char type, uint8_t loc, uint8_t idx,
+                           uint32_t addr) {
+  OtbnTraceRecord rec;
+  memset(&rec, 0, sizeof rec);
+  rec.type = type;
+  rec.loc = loc;
+  rec.idx = idx;
+  rec.addr = addr;
+  return rec;
+}
+
+// Generate the records for one cycle. Most cycles execute an instruction that
+// reads a couple of registers and writes one, and a few are stalls or have
+// some other first line (which the listener prints with a '!' line).
+std::vector<OtbnTraceRecord> RandomCycle(Lcg &lcg, uint32_t pc) {
+  std::vector<OtbnTraceRecord> records;
+  uint32_t kind = lcg.Next() % 16;
+  if (kind == 0) {
+    records.push_back(MakeRecord('U', OtbnTraceRecord::kNone, 0, 0));
+  } else {
+    OtbnTraceRecord hdr =
+        MakeRecord(kind == 1 ? 'S' : 'E', OtbnTraceRecord::kNone, 0, pc);
+    hdr.value[0] = lcg.Next();
+    records.push_back(hdr);
+  }
+
+  for (int i = 0; i < 2; ++i) {
+    OtbnTraceRecord rec =
+        MakeRecord('<', OtbnTraceRecord::kWdr, lcg.Next() % 32, 0);
+    for (int j = 0; j < 8; ++j)
+      rec.value[j] = lcg.Next();
+    records.push_back(rec);
+  }
+
+  OtbnTraceRecord wr = MakeRecord('>', OtbnTraceRecord::kGpr, 0, 0);
+  switch (lcg.Next() % 3) {
+    case 0:
+      wr.idx = lcg.Next() % 32;
+      wr.value[0] = lcg.Next();
+      break;
+    case 1:
+      wr.loc = OtbnTraceRecord::kFlags;
+      wr.idx = lcg.Next() % 2;
+      wr.value[0] = lcg.Next() % 16;
+      break;
+    default:
+      wr = MakeRecord('W', OtbnTraceRecord::kDmem, 0, 4 * (lcg.Next() % 1024));
+      wr.flags = OtbnTraceRecord::kWord;
+      wr.value[0] = lcg.Next();
+      break;
+  }
+  records.push_back(wr);
+  return records;
+}
+
+std::vector<std::vector<OtbnTraceRecord>> RandomCycles(size_t num_cycles) {
+  Lcg lcg(0x5eed);
+  std::vector<std::vector<OtbnTraceRecord>> cycles;
+  for (size_t i = 0; i < num_cycles; ++i)
+    cycles.push_back(RandomCycle(lcg, 4 * i));
+  return cycles;
+}
+
+// The text that LogTraceListener should write for a cycle (see the format
+// described in log_trace_listener.h)
+std::string ExpectedText(const std::vector<OtbnTraceRecord> &records,
+                         unsigned int cycle_count) {
+  std::string lines;
+  OtbnTraceRecord::Render(records, &lines);
+
+  std::string text;
+  bool first_line = true;
+  size_t pos = 0;
+  while (pos < lines.size()) {
+    size_t eol = lines.find('\n', pos);
+    std::string line = lines.substr(pos, eol - pos);
+    pos = eol + 1;
+
+    if (!first_line) {
+      text += "    " + line + "\n";
+      continue;
+    }
+    first_line = false;
+
+    char prefix[16];
+    bool is_e_or_s_line = line[0] == 'E' || line[0] == 'S';
+    snprintf(prefix, sizeof prefix, "%c %09u", is_e_or_s_line ? line[0] : '!',
+             cycle_count);
+    text += prefix;
+    if (is_e_or_s_line) {
+      text += line.substr(1) + "\n";
+    } else {
+      text += "\n    " + line + "\n";
+    }
+  }
+  return text;
+}
+
+std::string ReadFile(const std::string &path) {
+  std::ifstream in(path, std::ios::binary);
+  return std::string(std::istreambuf_iterator<char>(in),
+                     std::istreambuf_iterator<char>());
+}
+
+uint32_t ReadU32(const std::string &data, size_t pos) {
+  uint32_t val = 0;
+  for (int i = 0; i < 4; ++i)
+    val |= (uint32_t)(uint8_t)data[pos + i] << (8 * i);
+  return val;
+}
+
+// Enough cycles to go round the listener's ring a few times
+const size_t kNumCycles = 50000;
+
+TEST(LogTraceListenerTest, TextLog) {
+  std::vector<std::vector<OtbnTraceRecord>> cycles = RandomCycles(kNumCycles);
+  std::string path = testing::TempDir() + "/otbn_trace_text.log";
+
+  std::string expected;
+  {
+    LogTraceListener listener(path);
+    for (size_t i = 0; i < cycles.size(); ++i) {
+      listener.AcceptTraceRecords(cycles[i], i);
+      expected += ExpectedText(cycles[i], i);
+
+      // Slow down now and again, so that the writer thread empties the ring
+      // and has to be woken up.
+      if (i % 10000 < 10)
+        std::this_thread::sleep_for(std::chrono::microseconds(200));
+    }
+  }
+
+  // This is EXPECT_TRUE rather than EXPECT_EQ so that a failure doesn't print
+  // megabytes of log.
+  EXPECT_TRUE(ReadFile(path) == expected);
+}
+
+TEST(LogTraceListenerTest, TraceStrings) {
+  std::vector<std::vector<OtbnTraceRecord>> cycles = RandomCycles(1000);
+  std::string path = testing::TempDir() + "/otbn_trace_strings.log";
+
+  std::string expected;
+  {
+    LogTraceListener listener(path);
+    for (size_t i = 0; i < cycles.size(); ++i) {
+      std::string trace;
+      OtbnTraceRecord::Render(cycles[i], &trace);
+      listener.AcceptTraceString(trace, i);
+      expected += ExpectedText(cycles[i], i);
+    }
+  }
+
+  EXPECT_TRUE(ReadFile(path) == expected);
+}
+
+TEST(LogTraceListenerTest, BinaryLog) {
+  std::vector<std::vector<OtbnTraceRecord>> cycles = RandomCycles(kNumCycles);
+  std::string path = testing::TempDir() + "/otbn_trace_binary.log";
+
+  {
+    LogTraceListener listener(path, LogTraceListener::kBinary);
+    for (size_t i = 0; i < cycles.size(); ++i)
+      listener.AcceptTraceRecords(cycles[i], i);
+  }
+
+  std::string data = ReadFile(path);
+  ASSERT_EQ(data.substr(0, 8), "OTBNTRC1");
+  size_t pos = 8;
+  for (size_t i = 0; i < cycles.size(); ++i) {
+    ASSERT_LE(pos + 8, data.size());
+    ASSERT_EQ(ReadU32(data, pos), i);
+    ASSERT_EQ(ReadU32(data, pos + 4), cycles[i].size());
+    pos += 8;
+
+    for (const OtbnTraceRecord &exp_rec : cycles[i]) {
+      ASSERT_LE(pos + sizeof(OtbnTraceRecord), data.size());
+      OtbnTraceRecord rec;
+      memcpy(&rec, data.data() + pos, sizeof rec);
+      EXPECT_EQ(rec, exp_rec) << "cycle " << i;
+      pos += sizeof rec;
+    }
+  }
+  EXPECT_EQ(pos, data.size());
+}
+
+TEST(LogTraceListenerTest, GzipLog) {
+  if (system("gzip --version >/dev/null 2>&1") != 0)
+    GTEST_SKIP() << "gzip is not available";
+
+  std::vector<std::vector<OtbnTraceRecord>> cycles = RandomCycles(kNumCycles);
+  std::string path = testing::TempDir() + "/otbn_trace_text.log.gz";
+
+  std::string expected;
+  {
+    LogTraceListener listener(path);
+    for (size_t i = 0; i < cycles.size(); ++i) {
+      listener.AcceptTraceRecords(cycles[i], i);
+      expected += ExpectedText(cycles[i], i);
+    }
+  }
+
+  std::string cmd = "gzip -dc " + path + " > " + path + ".txt";
+  ASSERT_EQ(system(cmd.c_str()), 0);
+  EXPECT_TRUE(ReadFile(path + ".txt") == expected);
+}
+
+}  // namespace
@@ -9,6 +9,8 @@
 #include <string>
 #include <vector>
 
+#include "otbn_trace_record.h"
+
 /**
  * Base class for anything that wants to examine trace output from OTBN. The
  * simulation that hosts the tracer is responsible for setting up listeners and
@@ -43,6 +45,25 @@ class OtbnTraceListener {
    */
   virtual void AcceptTraceString(const std::string &trace,
                                  unsigned int cycle_count) = 0;
+
+  /**
+   * Called to process an OTBN trace output in binary form, called a maximum
+   * of once per cycle
+   *
+   * The default implementation renders the records to text and passes the
+   * result to AcceptTraceString. Listeners that can work with the records
+   * directly should override this to avoid the cost of rendering.
+   *
+   * @param records Trace records from OTBN, one per line of trace output
+   * @param cycle_count The cycle count associated with the trace output
+   */
+  virtual void AcceptTraceRecords(const std::vector<OtbnTraceRecord> &records,
+                                  unsigned int cycle_count) {
+    std::string trace;
+    OtbnTraceRecord::Render(records, &trace);
+    AcceptTraceString(trace, cycle_count);
+  }
+
   virtual ~OtbnTraceListener() {}
 };
 
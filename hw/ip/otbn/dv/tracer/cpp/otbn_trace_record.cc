@@ -0,0 +1,429 @@
+// Copyright lowRISC contributors.
+// Licensed under the Apache License, Version 2.0, see LICENSE for details.
+// SPDX-License-Identifier: Apache-2.0
+
+#include "otbn_trace_record.h"
+
+#include <cassert>
+#include <cstring>
+#include <ostream>
+
+namespace {
+
+// Names for the special registers, indexed by Loc
+const char *const kSpecialNames[] = {nullptr, nullptr, nullptr, "MOD",
+                                     "ACC",   "RND",   "URND",  "FLAGS"};
+
+const char kHexDigits[] = "0123456789abcdef";
+
+// The text before each of C, M, L and Z in the value of a flag group
+const char *const kFlagPrefixes[] = {"{C: ", ", M: ", ", L: ", ", Z: "};
+
+// The number of bytes needed to format the longest single record
+const size_t kMaxLineLen = 128;
+
+// A simple cursor over a line of text, used to parse trace lines without any
+// allocation.
+class LineCursor {
+ public:
+  LineCursor(const char *line, size_t len) : pos_(line), end_(line + len) {}
+
+  bool AtEnd() const { return pos_ == end_; }
+
+  void Advance(size_t n) { pos_ += n; }
+
+  // Consume str if the line continues with it
+  bool Skip(const char *str) {
+    size_t len = strlen(str);
+    if ((size_t)(end_ - pos_) < len || memcmp(pos_, str, len) != 0)
+      return false;
+    pos_ += len;
+    return true;
+  }
+
+  // Read a decimal number of up to max_digits digits
+  bool Dec(unsigned max_digits, unsigned *out) {
+    unsigned val = 0, digits = 0;
+    while (pos_ != end_ && '0' <= *pos_ && *pos_ <= '9') {
+      if (++digits > max_digits)
+        return false;
+      val = 10 * val + (*pos_++ - '0');
+    }
+    *out = val;
+    return digits > 0;
+  }
+
+  // Read a value of the form 0xHHHHHHHH or 0xHHHHHHHH_HHHHHHHH_..., up to
+  // 256 bits wide, into value (least significant word first). On success,
+  // num_digits is the number of hex digits that were read.
+  bool Hex(uint32_t value[8], unsigned *num_digits) {
+    if (!Skip("0x"))
+      return false;
+
+    const char *start = pos_;
+    while (pos_ != end_ && (HexDigit(*pos_) >= 0 || *pos_ == '_'))
+      ++pos_;
+
+    // Now walk back from the end, filling in nibbles from the bottom.
+    memset(value, 0, 8 * sizeof(uint32_t));
+    unsigned nibble = 0;
+    for (const char *p = pos_; p != start;) {
+      int digit = HexDigit(*--p);
+      if (digit < 0)
+        continue;
+      if (nibble == 64)
+        return false;
+      value[nibble / 8] |= (uint32_t)digit << (4 * (nibble % 8));
+      ++nibble;
+    }
+    *num_digits = nibble;
+    return nibble > 0;
+  }
+
+  // Read a 32-bit value of the form 0xHHHHHHHH
+  bool Hex32(uint32_t *out) {
+    uint32_t value[8];
+    unsigned num_digits;
+    if (!Hex(value, &num_digits) || num_digits > 8)
+      return false;
+    *out = value[0];
+    return true;
+  }
+
+  const char *Pos() const { return pos_; }
+  size_t Left() const { return end_ - pos_; }
+
+ private:
+  static int HexDigit(char c) {
+    if ('0' <= c && c <= '9')
+      return c - '0';
+    if ('a' <= c && c <= 'f')
+      return c - 'a' + 10;
+    if ('A' <= c && c <= 'F')
+      return c - 'A' + 10;
+    return -1;
+  }
+
+  const char *pos_;
+  const char *end_;
+};
+
+// Parse the location and value of a register read or write, like
+// "w03: 0x..." or "FLAGS0: {C: 1, M: 0, L: 1, Z: 0}".
+bool ParseRegAccess(LineCursor *cur, OtbnTraceRecord *rec) {
+  unsigned idx = 0;
+  if (cur->Skip("x")) {
+    rec->loc = OtbnTraceRecord::kGpr;
+    if (!cur->Dec(2, &idx) || idx >= 32)
+      return false;
+  } else if (cur->Skip("w")) {
+    rec->loc = OtbnTraceRecord::kWdr;
+    if (!cur->Dec(2, &idx) || idx >= 32)
+      return false;
+  } else if (cur->Skip("FLAGS")) {
+    rec->loc = OtbnTraceRecord::kFlags;
+    if (!cur->Dec(1, &idx))
+      return false;
+  } else if (cur->Skip("MOD")) {
+    rec->loc = OtbnTraceRecord::kMod;
+  } else if (cur->Skip("ACC")) {
+    rec->loc = OtbnTraceRecord::kAcc;
+  } else if (cur->Skip("RND")) {
+    rec->loc = OtbnTraceRecord::kRnd;
+  } else if (cur->Skip("URND")) {
+    rec->loc = OtbnTraceRecord::kUrnd;
+  } else {
+    return false;
+  }
+  rec->idx = idx;
+
+  if (!cur->Skip(": "))
+    return false;
+
+  if (rec->loc == OtbnTraceRecord::kFlags) {
+    for (int i = 0; i < 4; ++i) {
+      unsigned bit;
+      if (!cur->Skip(kFlagPrefixes[i]) || !cur->Dec(1, &bit) || bit > 1)
+        return false;
+      rec->value[0] |= bit << i;
+    }
+    return cur->Skip("}");
+  }
+
+  unsigned num_digits;
+  return cur->Hex(rec->value, &num_digits);
+}
+
+// Parse the address and value of a memory access, like
+// "[0x00000040]: 0x...". A write with a bad mask appends an extra record.
+bool ParseMemAccess(LineCursor *cur, OtbnTraceRecord *rec,
+                    std::vector<OtbnTraceRecord> *out) {
+  rec->loc = OtbnTraceRecord::kDmem;
+  if (!cur->Skip("[") || !cur->Hex32(&rec->addr) || !cur->Skip("]: "))
+    return false;
+
+  if (rec->type == 'W' && cur->Skip("Mask ERR Mask: ")) {
+    OtbnTraceRecord data_rec = *rec;
+    unsigned num_digits;
+    rec->flags |= OtbnTraceRecord::kMaskErr;
+    if (!cur->Hex(rec->value, &num_digits) || !cur->Skip(" Data: ") ||
+        !cur->Hex(data_rec.value, &num_digits))
+      return false;
+    out->push_back(*rec);
+    *rec = data_rec;
+    return true;
+  }
+
+  unsigned num_digits;
+  if (!cur->Hex(rec->value, &num_digits))
+    return false;
+  if (rec->type == 'W' && num_digits <= 8)
+    rec->flags |= OtbnTraceRecord::kWord;
+  return true;
+}
+
+// Write the 8 hex digits of val
+char *FormatHexDigits(char *p, uint32_t val) {
+  for (int i = 7; i >= 0; --i) {
+    *p++ = kHexDigits[(val >> (4 * i)) & 0xf];
+  }
+  return p;
+}
+
+char *FormatHex32(char *p, uint32_t val) {
+  *p++ = '0';
+  *p++ = 'x';
+  return FormatHexDigits(p, val);
+}
+
+char *FormatHex256(char *p, const uint32_t value[8]) {
+  p = FormatHex32(p, value[7]);
+  for (int i = 6; i >= 0; --i) {
+    *p++ = '_';
+    p = FormatHexDigits(p, value[i]);
+  }
+  return p;
+}
+
+char *FormatStr(char *p, const char *str) {
+  size_t len = strlen(str);
+  memcpy(p, str, len);
+  return p + len;
+}
+
+char *FormatLoc(char *p, const OtbnTraceRecord &rec) {
+  switch (rec.loc) {
+    case OtbnTraceRecord::kGpr:
+    case OtbnTraceRecord::kWdr:
+      *p++ = rec.loc == OtbnTraceRecord::kGpr ? 'x' : 'w';
+      *p++ = '0' + (rec.idx / 10) % 10;
+      *p++ = '0' + rec.idx % 10;
+      return p;
+    case OtbnTraceRecord::kFlags:
+      p = FormatStr(p, kSpecialNames[rec.loc]);
+      *p++ = '0' + rec.idx % 10;
+      return p;
+    case OtbnTraceRecord::kMod:
+    case OtbnTraceRecord::kAcc:
+    case OtbnTraceRecord::kRnd:
+    case OtbnTraceRecord::kUrnd:
+      return FormatStr(p, kSpecialNames[rec.loc]);
+    case OtbnTraceRecord::kDmem:
+      *p++ = '[';
+      p = FormatHex32(p, rec.addr);
+      *p++ = ']';
+      return p;
+    default:
+      return FormatStr(p, "UNKNOWN");
+  }
+}
+
+// Format the value in a register or memory access record
+char *FormatValue(char *p, const OtbnTraceRecord &rec) {
+  switch (rec.loc) {
+    case OtbnTraceRecord::kGpr:
+      return FormatHex32(p, rec.value[0]);
+    case OtbnTraceRecord::kFlags: {
+      for (int i = 0; i < 4; ++i) {
+        p = FormatStr(p, kFlagPrefixes[i]);
+        *p++ = '0' + ((rec.value[0] >> i) & 1);
+      }
+      *p++ = '}';
+      return p;
+    }
+    case OtbnTraceRecord::kDmem:
+      if (rec.flags & OtbnTraceRecord::kWord)
+        return FormatHex32(p, rec.value[0]);
+      return FormatHex256(p, rec.value);
+    default:
+      return FormatHex256(p, rec.value);
+  }
+}
+
+// Format rec into buf (which must have space for at least kMaxLineLen bytes)
+// and return the number of bytes written.
+size_t FormatRecord(const OtbnTraceRecord &rec, char *buf) {
+  char *p = buf;
+  switch (rec.type) {
+    case 'E':
+    case 'S':
+      if (rec.flags & OtbnTraceRecord::kNoPc)
+        return FormatStr(p, "STALL") - buf;
+      *p++ = rec.type;
+      p = FormatStr(p, " PC: ");
+      p = FormatHex32(p, rec.addr);
+      p = FormatStr(p, ", insn: ");
+      if (rec.flags & OtbnTraceRecord::kInsnErr)
+        p = FormatStr(p, "??");
+      else
+        p = FormatHex32(p, rec.value[0]);
+      break;
+
+    case 'U':
+    case 'V':
+      // The tracer always prints a space after the type character, even when
+      // there's nothing else on the line.
+      *p++ = rec.type;
+      *p++ = ' ';
+      break;
+
+    case '#':
+      p = FormatStr(p, "# @");
+      p = FormatHex32(p, rec.addr);
+      p = FormatStr(p, ": ");
+      for (size_t i = 0; i < sizeof rec.value; ++i) {
+        char c = reinterpret_cast<const char *>(rec.value)[i];
+        if (!c)
+          break;
+        *p++ = c;
+      }
+      break;
+
+    default:
+      *p++ = rec.type;
+      *p++ = ' ';
+      p = FormatLoc(p, rec);
+      p = FormatStr(p, ": ");
+      if (rec.flags & OtbnTraceRecord::kMaskErr) {
+        p = FormatStr(p, "Mask ERR Mask: ");
+        p = FormatHex256(p, rec.value);
+      } else {
+        p = FormatValue(p, rec);
+      }
+      break;
+  }
+  assert((size_t)(p - buf) <= kMaxLineLen);
+  return p - buf;
+}
+
+}  // namespace
+
+bool OtbnTraceRecord::operator==(const OtbnTraceRecord &other) const {
+  return type == other.type && loc == other.loc && idx == other.idx &&
+         flags == other.flags && addr == other.addr &&
+         memcmp(value, other.value, sizeof value) == 0;
+}
+
+void OtbnTraceRecord::PrintLoc(std::ostream &os) const {
+  char buf[kMaxLineLen];
+  os.write(buf, FormatLoc(buf, *this) - buf);
+}
+
+void OtbnTraceRecord::Print(std::ostream &os) const {
+  char buf[kMaxLineLen];
+  os.write(buf, FormatRecord(*this, buf));
+}
+
+std::string OtbnTraceRecord::Mnemonic() const {
+  const char *str = reinterpret_cast<const char *>(value);
+  return std::string(str, strnlen(str, sizeof value));
+}
+
+bool OtbnTraceRecord::Parse(const char *line, size_t len,
+                            std::vector<OtbnTraceRecord> *out) {
+  OtbnTraceRecord rec;
+  memset(&rec, 0, sizeof rec);
+
+  LineCursor cur(line, len);
+  if (cur.Skip("STALL")) {
+    rec.type = 'S';
+    rec.flags = kNoPc;
+    if (!cur.AtEnd())
+      return false;
+    out->push_back(rec);
+    return true;
+  }
+
+  if (len == 0)
+    return false;
+  rec.type = line[0];
+  cur.Advance(1);
+
+  bool ok;
+  switch (rec.type) {
+    case 'E':
+    case 'S':
+      ok = cur.Skip(" PC: ") && cur.Hex32(&rec.addr) && cur.Skip(", insn: ");
+      if (ok && rec.type == 'E' && cur.Skip("??")) {
+        rec.flags |= kInsnErr;
+      } else {
+        ok = ok && cur.Hex32(&rec.value[0]);
+      }
+      break;
+
+    case 'U':
+    case 'V':
+      cur.Skip(" ");
+      ok = true;
+      break;
+
+    case '#':
+      // The rest of the line is the mnemonic
+      ok = cur.Skip(" @") && cur.Hex32(&rec.addr) && cur.Skip(": ") &&
+           cur.Left() <= sizeof rec.value;
+      if (ok) {
+        memcpy(rec.value, cur.Pos(), cur.Left());
+        cur.Advance(cur.Left());
+      }
+      break;
+
+    case '<':
+    case '>':
+      ok = cur.Skip(" ") && ParseRegAccess(&cur, &rec);
+      break;
+
+    case 'R':
+    case 'W':
+      ok = cur.Skip(" ") && ParseMemAccess(&cur, &rec, out);
+      break;
+
+    default:
+      ok = false;
+      break;
+  }
+
+  if (!ok || !cur.AtEnd())
+    return false;
+
+  out->push_back(rec);
+  return true;
+}
+
+void OtbnTraceRecord::Render(const std::vector<OtbnTraceRecord> &records,
+                             std::string *out) {
+  char buf[kMaxLineLen];
+  for (size_t i = 0; i < records.size(); ++i) {
+    const OtbnTraceRecord &rec = records[i];
+    out->append(buf, FormatRecord(rec, buf));
+
+    // A write with a bad mask is printed on a single line, with the mask
+    // followed by the data from the next record.
+    if ((rec.flags & kMaskErr) && i + 1 < records.size() &&
+        records[i + 1].type == 'W') {
+      ++i;
+      out->append(" Data: ");
+      out->append(buf, FormatValue(buf, records[i]) - buf);
+    }
+    out->push_back('\n');
+  }
+}
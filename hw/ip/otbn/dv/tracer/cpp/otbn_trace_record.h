@@ -0,0 +1,108 @@
+// Copyright lowRISC contributors.
+// Licensed under the Apache License, Version 2.0, see LICENSE for details.
+// SPDX-License-Identifier: Apache-2.0
+#ifndef OPENTITAN_HW_IP_OTBN_DV_TRACER_CPP_OTBN_TRACE_RECORD_H_
+#define OPENTITAN_HW_IP_OTBN_DV_TRACER_CPP_OTBN_TRACE_RECORD_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+/**
+ * A binary form of one line of OTBN trace output
+ *
+ * The tracer (otbn_tracer.sv) sends one of these over DPI for each line that
+ * it would have printed and the stepped ISS sends them in its binary step
+ * responses. The text format in README.md is only generated (by Render) for
+ * listeners that need it.
+ *
+ * The type field is the character that starts the line in the text format
+ * ('E', 'S', 'U', 'V', '<', '>', 'R' or 'W'). The ISS also sends '#' records,
+ * which hold the address and mnemonic of the instruction that just executed.
+ *
+ * The layout is fixed, because the ISS packs records with Python's struct
+ * module (see stepped.py) and otbn_tracer.sv uses the Loc and Flag values.
+ */
+struct OtbnTraceRecord {
+  // The register file, special register or memory that is accessed
+  enum Loc : uint8_t {
+    kNone,   // Header lines
+    kGpr,    // x0 .. x31 (idx is the register index)
+    kWdr,    // w0 .. w31 (idx is the register index)
+    kMod,
+    kAcc,
+    kRnd,
+    kUrnd,
+    kFlags,  // idx is the flag group
+    kDmem,   // addr is the byte address
+  };
+
+  enum Flag : uint8_t {
+    // An 'E' header line for an instruction whose bits couldn't be fetched
+    // ("insn: ??" in the text format)
+    kInsnErr = 1 << 0,
+    // A header line with no PC. The ISS uses an 'S' record like this for a
+    // cycle with changes but no instruction in flight ("STALL").
+    kNoPc = 1 << 1,
+    // A 'W' record that only wrote 32 bits (in the bottom word of value)
+    kWord = 1 << 2,
+    // A 'W' record for a write with a bad mask. value holds the mask and the
+    // next record is an ordinary 'W' record with the data that was written.
+    kMaskErr = 1 << 3,
+  };
+
+  char type;
+  uint8_t loc;
+  uint8_t idx;
+  uint8_t flags;
+  // The PC for header and '#' records, or the address for 'R' and 'W' records
+  uint32_t addr;
+  // The value that was read or written, least significant word first. For
+  // 'E' and 'S' records, value[0] holds the instruction bits. For a flag
+  // group, bits 0 to 3 are C, M, L and Z. For a '#' record, this holds the
+  // mnemonic (padded with zeros).
+  uint32_t value[8];
+
+  bool operator==(const OtbnTraceRecord &other) const;
+  bool operator!=(const OtbnTraceRecord &other) const {
+    return !(*this == other);
+  }
+
+  // True if this is a header line ('E', 'S', 'U' or 'V')
+  bool IsHeader() const {
+    return type == 'E' || type == 'S' || type == 'U' || type == 'V';
+  }
+
+  // A key for the location that is accessed. Records with the same key
+  // access the same register.
+  uint16_t LocKey() const { return (uint16_t)((loc << 8) | idx); }
+
+  // Write the name of the location (like "x05" or "FLAGS1") to os
+  void PrintLoc(std::ostream &os) const;
+
+  // Write the text form of this record (with no newline) to os. A record with
+  // kMaskErr set is printed on its own, rather than merged with the data
+  // record that follows it as in Render().
+  void Print(std::ostream &os) const;
+
+  // Return the mnemonic from a '#' record
+  std::string Mnemonic() const;
+
+  // Parse a line of text trace output (with no newline) and append the
+  // resulting record to out. A 'W' line with a bad mask appends two records.
+  // Returns false if the line doesn't have the expected format.
+  static bool Parse(const char *line, size_t len,
+                    std::vector<OtbnTraceRecord> *out);
+
+  // Render records to text, one line each with a trailing newline, appending
+  // the result to out.
+  static void Render(const std::vector<OtbnTraceRecord> &records,
+                     std::string *out);
+};
+
+static_assert(sizeof(OtbnTraceRecord) == 40,
+              "OtbnTraceRecord must match the layout used by the ISS");
+
+#endif  // OPENTITAN_HW_IP_OTBN_DV_TRACER_CPP_OTBN_TRACE_RECORD_H_
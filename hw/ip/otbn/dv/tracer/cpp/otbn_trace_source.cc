@@ -6,7 +6,9 @@
 
 #include <algorithm>
 #include <cassert>
+#include <cstring>
 #include <memory>
+#include <svdpi.h>
 
 static std::unique_ptr<OtbnTraceSource> trace_source;
 
@@ -34,8 +36,50 @@ void OtbnTraceSource::Broadcast(const std::string &trace,
   }
 }
 
+void OtbnTraceSource::AddRecord(const OtbnTraceRecord &record) {
+  records_.push_back(record);
+}
+
+void OtbnTraceSource::FlushRecords(unsigned cycle_count) {
+  for (OtbnTraceListener *listener : listeners_) {
+    listener->AcceptTraceRecords(records_, cycle_count);
+  }
+  records_.clear();
+}
+
 extern "C" void accept_otbn_trace_string(const char *trace,
                                          unsigned int cycle_count) {
   assert(trace != nullptr);
   OtbnTraceSource::get().Broadcast(trace, cycle_count);
 }
+
+// Exposed over DPI as:
+//
+//  import "DPI-C" function void
+//    otbn_trace_record(byte unsigned rec_type, byte unsigned loc,
+//                      byte unsigned idx, byte unsigned flags,
+//                      int unsigned addr, bit [255:0] value);
+//
+// See OtbnTraceRecord for the meaning of the arguments.
+extern "C" void otbn_trace_record(unsigned char rec_type, unsigned char loc,
+                                  unsigned char idx, unsigned char flags,
+                                  unsigned int addr,
+                                  const svBitVecVal *value) {
+  assert(value != nullptr);
+
+  OtbnTraceRecord record;
+  record.type = rec_type;
+  record.loc = loc;
+  record.idx = idx;
+  record.flags = flags;
+  record.addr = addr;
+  memcpy(record.value, value, sizeof record.value);
+  OtbnTraceSource::get().AddRecord(record);
+}
+
+// Exposed over DPI as:
+//
+//  import "DPI-C" function void otbn_trace_flush(int unsigned cycle_count);
+extern "C" void otbn_trace_flush(unsigned int cycle_count) {
+  OtbnTraceSource::get().FlushRecords(cycle_count);
+}
@@ -13,9 +13,12 @@
 // This is a singleton class, which will be constructed on the first call to
 // get() or the first trace data that comes back from the simulation.
 //
-// The object is in charge of taking trace data from the simulation (which is
-// sent by calling the accept_otbn_trace_string DPI function) and passing it
-// out to registered listeners.
+// The object is in charge of taking trace data from the simulation and
+// passing it out to registered listeners. The tracer sends binary records
+// (with a call to the otbn_trace_record DPI function for each line of trace
+// and then a call to otbn_trace_flush at the end of the cycle), which are
+// buffered here until the flush. Text trace, sent by calling the
+// accept_otbn_trace_string DPI function, is passed straight through.
 
 class OtbnTraceSource {
  public:
@@ -31,8 +34,19 @@ class OtbnTraceSource {
   // Send a trace string to all listeners
   void Broadcast(const std::string &trace, unsigned cycle_count);
 
+  // Add a trace record to the records for the current cycle
+  void AddRecord(const OtbnTraceRecord &record);
+
+  // Send the records for the current cycle to all listeners and then clear
+  // them
+  void FlushRecords(unsigned cycle_count);
+
  private:
   std::vector<OtbnTraceListener *> listeners_;
+
+  // The records for the current cycle. These are cleared after each flush,
+  // which keeps the allocated storage.
+  std::vector<OtbnTraceRecord> records_;
 };
 
 #endif  // OPENTITAN_HW_IP_OTBN_DV_TRACER_CPP_OTBN_TRACE_SOURCE_H_
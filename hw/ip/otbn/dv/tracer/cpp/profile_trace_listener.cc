@@ -0,0 +1,355 @@
+// Copyright lowRISC contributors.
+// Licensed under the Apache License, Version 2.0, see LICENSE for details.
+// SPDX-License-Identifier: Apache-2.0
+
+#include "profile_trace_listener.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+namespace {
+
+// The number of entries in the "hottest instructions" table
+const size_t kNumHotInsns = 20;
+
+// Loops that take less than this fraction of the cycles (or that run fewer
+// than kMinWarpIters times) aren't worth warping.
+const double kMinWarpFraction = 0.02;
+const uint32_t kMinWarpIters = 3;
+
+// LOOP and LOOPI use the custom-3 major opcode with funct3 of 0 and 1
+// respectively. Both have the body size (minus one) in bits 31:20.
+bool IsLoopInsn(uint32_t insn) {
+  return (insn & 0x7f) == 0x7b && ((insn >> 12) & 0x7) <= 1;
+}
+
+bool IsLoopiInsn(uint32_t insn) { return ((insn >> 12) & 0x7) == 1; }
+
+uint32_t LoopBodySize(uint32_t insn) { return (insn >> 20) + 1; }
+
+// The GPR that holds the iteration count for LOOP
+uint32_t LoopGrs(uint32_t insn) { return (insn >> 15) & 0x1f; }
+
+// The iteration count for LOOPI, which is split between bits 19:15 and 11:7
+uint32_t LoopiIters(uint32_t insn) {
+  return (((insn >> 15) & 0x1f) << 5) | ((insn >> 7) & 0x1f);
+}
+
+// Format a percentage of total
+std::string Percent(uint64_t value, uint64_t total) {
+  std::ostringstream oss;
+  oss << std::fixed << std::setprecision(1)
+      << (total ? 100.0 * value / total : 0.0) << "%";
+  return oss.str();
+}
+
+// Format an address as "symbol+0xoff" using the nearest symbol at or below
+// addr (or just as a hex address if there isn't one)
+std::string SymbolicAddr(const ProfileTraceListener::SymbolMap &symbols,
+                         uint32_t addr) {
+  std::ostringstream oss;
+  auto it = symbols.upper_bound(addr);
+  if (it == symbols.begin()) {
+    oss << "0x" << std::hex << addr;
+    return oss.str();
+  }
+  --it;
+  oss << it->second;
+  if (it->first != addr) {
+    oss << "+0x" << std::hex << (addr - it->first);
+  }
+  return oss.str();
+}
+
+}  // namespace
+
+ProfileTraceListener::ProfileTraceListener() { Reset(); }
+
+void ProfileTraceListener::Reset() {
+  pc_stats_.clear();
+  num_cycles_ = 0;
+  num_insns_ = 0;
+  num_stalls_ = 0;
+  num_other_cycles_ = 0;
+}
+
+ProfileTraceListener::PcStats &ProfileTraceListener::StatsAt(uint32_t pc) {
+  size_t idx = pc / 4;
+  if (idx >= pc_stats_.size()) {
+    PcStats zero;
+    memset(&zero, 0, sizeof zero);
+    pc_stats_.resize(std::max(idx + 1, 2 * pc_stats_.size()), zero);
+  }
+  return pc_stats_[idx];
+}
+
+void ProfileTraceListener::AcceptTraceString(const std::string &trace,
+                                             unsigned int cycle_count) {
+  parsed_records_.clear();
+  size_t pos = 0;
+  while (pos < trace.size()) {
+    size_t eol = trace.find('\n', pos);
+    if (eol == std::string::npos)
+      eol = trace.size();
+    OtbnTraceRecord::Parse(trace.data() + pos, eol - pos, &parsed_records_);
+    pos = eol + 1;
+  }
+
+  AcceptTraceRecords(parsed_records_, cycle_count);
+}
+
+void ProfileTraceListener::AcceptTraceRecords(
+    const std::vector<OtbnTraceRecord> &records, unsigned int cycle_count) {
+  bool saw_header = false, saw_insn = false;
+
+  for (const OtbnTraceRecord &rec : records) {
+    if (!rec.IsHeader())
+      continue;
+    saw_header = true;
+
+    if ((rec.type != 'E' && rec.type != 'S') ||
+        (rec.flags & OtbnTraceRecord::kNoPc)) {
+      continue;
+    }
+    saw_insn = true;
+
+    PcStats &stats = StatsAt(rec.addr);
+    if (rec.type == 'S') {
+      ++stats.stalls;
+      ++num_stalls_;
+      continue;
+    }
+
+    ++stats.insns;
+    ++num_insns_;
+    if (!(rec.flags & OtbnTraceRecord::kInsnErr)) {
+      stats.insn = rec.value[0];
+      if (IsLoopInsn(stats.insn)) {
+        NoteLoop(stats, records);
+      }
+    }
+  }
+
+  if (saw_header) {
+    ++num_cycles_;
+    if (!saw_insn) {
+      ++num_other_cycles_;
+    }
+  }
+}
+
+void ProfileTraceListener::NoteLoop(
+    PcStats &stats, const std::vector<OtbnTraceRecord> &records) {
+  uint32_t iters = 0;
+  if (IsLoopiInsn(stats.insn)) {
+    iters = LoopiIters(stats.insn);
+  } else {
+    // The iteration count for LOOP comes from a GPR, which we should see
+    // being read in this cycle.
+    uint32_t grs = LoopGrs(stats.insn);
+    for (const OtbnTraceRecord &rec : records) {
+      if (rec.type == '<' && rec.loc == OtbnTraceRecord::kGpr &&
+          rec.idx == grs) {
+        iters = rec.value[0];
+        break;
+      }
+    }
+    if (iters == 0) {
+      // We don't know the count (or the loop is about to fail). Mark the
+      // counts as unknown so that we don't suggest a warp.
+      stats.min_iters = 0;
+      stats.max_iters = 0;
+      return;
+    }
+  }
+
+  bool first = stats.insns == 1;
+  if (first || (stats.max_iters != 0 && iters < stats.min_iters)) {
+    stats.min_iters = iters;
+  }
+  if (first || (stats.max_iters != 0 && iters > stats.max_iters)) {
+    stats.max_iters = iters;
+  }
+}
+
+std::vector<ProfileTraceListener::LoopInfo> ProfileTraceListener::FindLoops()
+    const {
+  std::vector<LoopInfo> loops;
+
+  for (size_t idx = 0; idx < pc_stats_.size(); ++idx) {
+    const PcStats &stats = pc_stats_[idx];
+    if (!stats.insns || !IsLoopInsn(stats.insn))
+      continue;
+
+    LoopInfo loop;
+    loop.addr = idx * 4;
+    loop.body_size = LoopBodySize(stats.insn);
+    loop.entries = stats.insns;
+    loop.iterations = 0;
+    loop.cycles = 0;
+    loop.stats = stats;
+
+    size_t body_end = std::min(pc_stats_.size(), idx + 1 + loop.body_size);
+    if (idx + 1 < body_end) {
+      loop.iterations = pc_stats_[idx + 1].insns;
+    }
+    for (size_t i = idx + 1; i < body_end; ++i) {
+      loop.cycles += pc_stats_[i].insns + pc_stats_[i].stalls;
+    }
+    loops.push_back(loop);
+  }
+
+  std::stable_sort(loops.begin(), loops.end(),
+                   [](const LoopInfo &a, const LoopInfo &b) {
+                     return a.cycles > b.cycles;
+                   });
+  return loops;
+}
+
+void ProfileTraceListener::WriteReport(
+    std::ostream &os, const SymbolMap &symbols,
+    const std::set<uint32_t> &warp_addrs) const {
+  uint64_t total = num_cycles_;
+
+  os << "OTBN profile\n"
+     << "============\n\n"
+     << "Cycles:             " << num_cycles_ << "\n"
+     << "Instructions:       " << num_insns_ << "\n"
+     << "Stall cycles:       " << num_stalls_ << "\n"
+     << "Other cycles:       " << num_other_cycles_ << " (wipes)\n\n";
+
+  // Cycles by symbol. Addresses below the first symbol are grouped together
+  // as "(no symbol)".
+  struct SymStats {
+    uint64_t insns, stalls;
+  };
+  std::map<std::string, SymStats> by_sym;
+  for (size_t idx = 0; idx < pc_stats_.size(); ++idx) {
+    const PcStats &stats = pc_stats_[idx];
+    if (!stats.insns && !stats.stalls)
+      continue;
+
+    uint32_t addr = idx * 4;
+    auto it = symbols.upper_bound(addr);
+    std::string name = (it == symbols.begin()) ? "(no symbol)"
+                                               : std::prev(it)->second;
+    SymStats &sym_stats = by_sym[name];
+    sym_stats.insns += stats.insns;
+    sym_stats.stalls += stats.stalls;
+  }
+
+  std::vector<std::pair<std::string, SymStats>> sorted_syms(by_sym.begin(),
+                                                            by_sym.end());
+  std::stable_sort(sorted_syms.begin(), sorted_syms.end(),
+                   [](const std::pair<std::string, SymStats> &a,
+                      const std::pair<std::string, SymStats> &b) {
+                     return a.second.insns + a.second.stalls >
+                            b.second.insns + b.second.stalls;
+                   });
+
+  os << "Cycles by symbol:\n"
+     << std::setw(12) << "cycles" << std::setw(8) << "%" << std::setw(12)
+     << "insns" << std::setw(12) << "stalls"
+     << "  symbol\n";
+  for (const auto &pr : sorted_syms) {
+    uint64_t cycles = pr.second.insns + pr.second.stalls;
+    os << std::setw(12) << cycles << std::setw(8) << Percent(cycles, total)
+       << std::setw(12) << pr.second.insns << std::setw(12)
+       << pr.second.stalls << "  " << pr.first << "\n";
+  }
+  os << "\n";
+
+  std::vector<LoopInfo> loops = FindLoops();
+  os << "Loops by cycles in body:\n"
+     << std::setw(12) << "cycles" << std::setw(8) << "%" << std::setw(10)
+     << "entries" << std::setw(16) << "iterations"
+     << "  loop\n";
+  for (const LoopInfo &loop : loops) {
+    std::ostringstream iters;
+    if (loop.stats.max_iters == 0) {
+      iters << "?";
+    } else if (loop.stats.min_iters == loop.stats.max_iters) {
+      iters << loop.stats.min_iters;
+    } else {
+      iters << loop.stats.min_iters << ".." << loop.stats.max_iters;
+    }
+    os << std::setw(12) << loop.cycles << std::setw(8)
+       << Percent(loop.cycles, total) << std::setw(10) << loop.entries
+       << std::setw(16) << iters.str() << "  "
+       << SymbolicAddr(symbols, loop.addr) << " (0x" << std::hex
+       << loop.addr << std::dec << ", " << loop.body_size
+       << " instructions)\n";
+  }
+  os << "\n";
+
+  // The hottest instructions
+  std::vector<uint32_t> hot;
+  for (size_t idx = 0; idx < pc_stats_.size(); ++idx) {
+    if (pc_stats_[idx].insns || pc_stats_[idx].stalls)
+      hot.push_back(idx);
+  }
+  auto pc_cycles = [this](uint32_t idx) {
+    return pc_stats_[idx].insns + pc_stats_[idx].stalls;
+  };
+  std::stable_sort(hot.begin(), hot.end(), [&](uint32_t a, uint32_t b) {
+    return pc_cycles(a) > pc_cycles(b);
+  });
+  if (hot.size() > kNumHotInsns)
+    hot.resize(kNumHotInsns);
+
+  os << "Hottest instructions:\n"
+     << std::setw(12) << "cycles" << std::setw(8) << "%" << std::setw(12)
+     << "insns" << std::setw(12) << "stalls"
+     << "  address\n";
+  for (uint32_t idx : hot) {
+    const PcStats &stats = pc_stats_[idx];
+    os << std::setw(12) << pc_cycles(idx) << std::setw(8)
+       << Percent(pc_cycles(idx), total) << std::setw(12) << stats.insns
+       << std::setw(12) << stats.stalls << "  "
+       << SymbolicAddr(symbols, idx * 4) << " (0x" << std::hex << idx * 4
+       << std::dec << ")\n";
+  }
+  os << "\n";
+
+  // Suggest warps for the loops that take a significant fraction of the
+  // cycles. A warp from iteration 1 to iteration N - 1 at the start of the
+  // loop body leaves just the first and last iterations. Using the smallest
+  // iteration count seen means that the warp is valid every time the loop
+  // runs.
+  os << "Suggested loop warps (these change the result of the program):\n";
+  bool suggested = false;
+  for (const LoopInfo &loop : loops) {
+    if (loop.cycles < kMinWarpFraction * total)
+      break;
+
+    uint32_t body_start = loop.addr + 4;
+    uint32_t body_end = loop.addr + 4 * loop.body_size;
+    auto warp_it = warp_addrs.lower_bound(body_start);
+    if (warp_it != warp_addrs.end() && *warp_it <= body_end) {
+      os << "  # Loop at 0x" << std::hex << loop.addr << std::dec
+         << " already has a warp.\n";
+      continue;
+    }
+
+    uint32_t iters = loop.stats.min_iters;
+    if (loop.stats.max_iters == 0 || iters < kMinWarpIters ||
+        !loop.iterations)
+      continue;
+
+    // The warp skips iters - 2 iterations each time the loop runs. Estimate
+    // the saving by assuming that each iteration takes the same time.
+    uint64_t saving =
+        loop.entries * (iters - 2) * loop.cycles / loop.iterations;
+    os << "  _loop_warp_1_" << (iters - 1) << "_at_0x" << std::hex
+       << body_start << " = 0x" << body_start << ";" << std::dec
+       << "  /* " << SymbolicAddr(symbols, loop.addr) << ", saves about "
+       << saving << " cycles */\n";
+    suggested = true;
+  }
+  if (!suggested) {
+    os << "  (none)\n";
+  }
+}
@@ -0,0 +1,113 @@
+// Copyright lowRISC contributors.
+// Licensed under the Apache License, Version 2.0, see LICENSE for details.
+// SPDX-License-Identifier: Apache-2.0
+
+#ifndef OPENTITAN_HW_IP_OTBN_DV_TRACER_CPP_PROFILE_TRACE_LISTENER_H_
+#define OPENTITAN_HW_IP_OTBN_DV_TRACER_CPP_PROFILE_TRACE_LISTENER_H_
+
+#include <cstdint>
+#include <iosfwd>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "otbn_trace_listener.h"
+
+/**
+ * An OtbnTraceListener that builds an execution profile of the program that
+ * OTBN is running.
+ *
+ * For each instruction address, it counts the number of times an instruction
+ * was executed there ('E' lines) and the number of cycles that it stalled
+ * ('S' lines). It also keeps the instruction bits, which lets it find LOOP and
+ * LOOPI instructions, and the iteration counts that each loop was started
+ * with.
+ *
+ * The per-cycle work is a couple of array updates, so profiling doesn't slow
+ * the simulation down much. The report (see WriteReport) is generated at the
+ * end of a run, when the caller can supply the symbols from the ELF file.
+ */
+class ProfileTraceListener : public OtbnTraceListener {
+ public:
+  // Code symbols, keyed by address
+  typedef std::map<uint32_t, std::string> SymbolMap;
+
+  ProfileTraceListener();
+
+  void AcceptTraceString(const std::string &trace,
+                         unsigned int cycle_count) override;
+  void AcceptTraceRecords(const std::vector<OtbnTraceRecord> &records,
+                          unsigned int cycle_count) override;
+
+  // Forget everything that has been counted so far
+  void Reset();
+
+  // True if no instructions have been seen since construction or the last
+  // call to Reset()
+  bool Empty() const { return num_insns_ == 0; }
+
+  /**
+   * Write a hotspot report to os.
+   *
+   * Cycles are attributed to the nearest symbol in symbols at or below each
+   * address, which gives a breakdown by function (and by labelled block
+   * within a function). Loops are listed with the cycles spent on the
+   * instructions in their bodies (not counting any code that the body
+   * calls).
+   *
+   * The report ends with suggested loop warps for the loops that take the
+   * most cycles, in the form of linker script symbol assignments. A warp
+   * skips from the second iteration of a loop to its last, so it changes the
+   * result of the program. Loops with a warp at any address in their body
+   * (from warp_addrs) are not suggested again.
+   */
+  void WriteReport(std::ostream &os, const SymbolMap &symbols,
+                   const std::set<uint32_t> &warp_addrs) const;
+
+ private:
+  struct PcStats {
+    uint64_t insns;
+    uint64_t stalls;
+    // The instruction bits seen at this address (valid if insns is nonzero)
+    uint32_t insn;
+    // For a LOOP or LOOPI instruction, the smallest and largest iteration
+    // counts it has been started with. If a LOOP instruction's count can't be
+    // seen in the trace, max_iters is zero.
+    uint32_t min_iters;
+    uint32_t max_iters;
+  };
+
+  struct LoopInfo {
+    uint32_t addr;
+    uint32_t body_size;
+    uint64_t entries;
+    // The number of iterations (summed over all entries), counted by the
+    // number of times the first instruction of the body was executed.
+    uint64_t iterations;
+    uint64_t cycles;
+    PcStats stats;
+  };
+
+  PcStats &StatsAt(uint32_t pc);
+
+  // Update the iteration counts for a LOOP or LOOPI instruction at pc, using
+  // the register reads in records for LOOP.
+  void NoteLoop(PcStats &stats, const std::vector<OtbnTraceRecord> &records);
+
+  // Find the loops in the program, sorted by cycles (most first)
+  std::vector<LoopInfo> FindLoops() const;
+
+  // Per-instruction statistics, indexed by PC / 4
+  std::vector<PcStats> pc_stats_;
+
+  uint64_t num_cycles_;
+  uint64_t num_insns_;
+  uint64_t num_stalls_;
+  uint64_t num_other_cycles_;
+
+  // Scratch space for AcceptTraceString
+  std::vector<OtbnTraceRecord> parsed_records_;
+};
+
+#endif  // OPENTITAN_HW_IP_OTBN_DV_TRACER_CPP_PROFILE_TRACE_LISTENER_H_
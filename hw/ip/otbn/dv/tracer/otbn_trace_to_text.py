@@ -0,0 +1,193 @@
+#!/usr/bin/env python3
+# Copyright lowRISC contributors.
+# Licensed under the Apache License, Version 2.0, see LICENSE for details.
+# SPDX-License-Identifier: Apache-2.0
+
+'''Convert a binary OTBN trace log to the text format
+
+A binary trace log is written by otbn_top_sim when it is run with
+--otbn-trace-format=binary (see LogTraceListener in
+cpp/log_trace_listener.h for the format). This script prints the text log
+that the simulation would have written with --otbn-trace-format=text. Input
+files whose names end in .gz or .zst are decompressed first (the latter with
+the zstd command line tool).
+
+'''
+
+import argparse
+import gzip
+import struct
+import subprocess
+import sys
+from typing import BinaryIO, Iterator, List, Tuple
+
+_MAGIC = b'OTBNTRC1'
+_CYCLE_HDR = struct.Struct('<II')
+
+# This must match OtbnTraceRecord in cpp/otbn_trace_record.h
+_RECORD = struct.Struct('<cBBBI32s')
+
+# Locations (OtbnTraceRecord::Loc)
+_LOC_GPR = 1
+_LOC_WDR = 2
+_LOC_FLAGS = 7
+_LOC_DMEM = 8
+_SPECIAL_NAMES = {3: 'MOD', 4: 'ACC', 5: 'RND', 6: 'URND'}
+
+# Flags (OtbnTraceRecord::Flag)
+_FLAG_INSN_ERR = 1 << 0
+_FLAG_NO_PC = 1 << 1
+_FLAG_WORD = 1 << 2
+_FLAG_MASK_ERR = 1 << 3
+
+Record = Tuple[str, int, int, int, int, bytes]
+
+
+def read_exact(handle: BinaryIO, size: int) -> bytes:
+    data = handle.read(size)
+    if len(data) != size:
+        raise ValueError('Truncated trace file.')
+    return data
+
+
+def read_cycles(handle: BinaryIO) -> Iterator[Tuple[int, List[Record]]]:
+    '''Yield (cycle_count, records) for each cycle in a binary trace'''
+    if handle.read(len(_MAGIC)) != _MAGIC:
+        raise ValueError('Not a binary OTBN trace file.')
+
+    while True:
+        hdr = handle.read(_CYCLE_HDR.size)
+        if not hdr:
+            return
+        if len(hdr) != _CYCLE_HDR.size:
+            raise ValueError('Truncated trace file.')
+        cycle_count, num_records = _CYCLE_HDR.unpack(hdr)
+
+        data = read_exact(handle, num_records * _RECORD.size)
+        records = []
+        for fields in _RECORD.iter_unpack(data):
+            rec_type, loc, idx, flags, addr, value = fields
+            records.append((rec_type.decode('ascii'), loc, idx, flags, addr,
+                            value))
+        yield (cycle_count, records)
+
+
+def fmt_value(value: bytes, num_words: int) -> str:
+    words = struct.unpack('<8I', value)[:num_words]
+    return '0x' + '_'.join('{:08x}'.format(w) for w in reversed(words))
+
+
+def fmt_loc(loc: int, idx: int, addr: int) -> str:
+    if loc == _LOC_GPR:
+        return 'x{:02}'.format(idx)
+    if loc == _LOC_WDR:
+        return 'w{:02}'.format(idx)
+    if loc == _LOC_FLAGS:
+        return 'FLAGS{}'.format(idx)
+    if loc == _LOC_DMEM:
+        return '[0x{:08x}]'.format(addr)
+    return _SPECIAL_NAMES.get(loc, 'UNKNOWN')
+
+
+def fmt_access_value(loc: int, flags: int, value: bytes) -> str:
+    if loc == _LOC_GPR or (loc == _LOC_DMEM and flags & _FLAG_WORD):
+        return fmt_value(value, 1)
+    if loc == _LOC_FLAGS:
+        bits = value[0]
+        return ('{{C: {}, M: {}, L: {}, Z: {}}}'
+                .format(bits & 1, (bits >> 1) & 1,
+                        (bits >> 2) & 1, (bits >> 3) & 1))
+    return fmt_value(value, 8)
+
+
+def render(records: List[Record]) -> List[str]:
+    '''Render records to lines of text, like OtbnTraceRecord::Render'''
+    lines = []
+    i = 0
+    while i < len(records):
+        rec_type, loc, idx, flags, addr, value = records[i]
+        i += 1
+
+        if rec_type in 'ES':
+            if flags & _FLAG_NO_PC:
+                lines.append('STALL')
+                continue
+            insn = ('??' if flags & _FLAG_INSN_ERR else fmt_value(value, 1))
+            lines.append('{} PC: 0x{:08x}, insn: {}'
+                         .format(rec_type, addr, insn))
+        elif rec_type in 'UV':
+            lines.append(rec_type + ' ')
+        elif rec_type == '#':
+            mnem = value.split(b'\0', 1)[0].decode('ascii')
+            lines.append('# @0x{:08x}: {}'.format(addr, mnem))
+        else:
+            line = '{} {}: '.format(rec_type, fmt_loc(loc, idx, addr))
+            if flags & _FLAG_MASK_ERR:
+                line += 'Mask ERR Mask: ' + fmt_value(value, 8)
+                if i < len(records) and records[i][0] == 'W':
+                    _, d_loc, _, d_flags, _, d_value = records[i]
+                    i += 1
+                    line += (' Data: ' +
+                             fmt_access_value(d_loc, d_flags, d_value))
+            else:
+                line += fmt_access_value(loc, flags, value)
+            lines.append(line)
+
+    return lines
+
+
+def write_cycle(out: BinaryIO, cycle_count: int, lines: List[str]) -> None:
+    '''Write the trace for a cycle like LogTraceListener'''
+    first = lines[0]
+    if len(first) <= 1:
+        out.write('ERR: Bad line at {} line should be more than 1 '
+                  'character: {}\n'.format(cycle_count, first).encode())
+    elif first[0] in 'ES':
+        out.write('{} {:09}{}\n'.format(first[0], cycle_count,
+                                        first[1:]).encode())
+    else:
+        out.write('! {:09}\n    {}\n'.format(cycle_count, first).encode())
+
+    for line in lines[1:]:
+        out.write('    {}\n'.format(line).encode())
+
+
+def open_trace(path: str) -> BinaryIO:
+    if path.endswith('.gz'):
+        return gzip.open(path, 'rb')
+    if path.endswith('.zst'):
+        proc = subprocess.Popen(['zstd', '-q', '-d', '-c', path],
+                                stdout=subprocess.PIPE)
+        assert proc.stdout is not None
+        return proc.stdout
+    return open(path, 'rb')
+
+
+def main() -> int:
+    parser = argparse.ArgumentParser()
+    parser.add_argument('trace', help='Binary trace file')
+    parser.add_argument('output', nargs='?',
+                        help='Text output file (default: stdout)')
+    args = parser.parse_args()
+
+    out = (open(args.output, 'wb') if args.output is not None
+           else sys.stdout.buffer)
+    try:
+        with open_trace(args.trace) as handle:
+            for cycle_count, records in read_cycles(handle):
+                lines = render(records)
+                if lines:
+                    write_cycle(out, cycle_count, lines)
+    except ValueError as err:
+        print('Error reading {}: {}'.format(args.trace, err),
+              file=sys.stderr)
+        return 1
+    finally:
+        if args.output is not None:
+            out.close()
+
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
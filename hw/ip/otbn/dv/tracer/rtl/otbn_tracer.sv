@@ -5,9 +5,9 @@
 `ifndef SYNTHESIS
 
 /**
- * Tracer module for OTBN. This produces a multi-line string as trace output at most once every
- * cycle and provides it to the simulation environment via a DPI call. It uses `otbn_trace_if` to
- * get the information it needs. For further information see `hw/ip/otbn/dv/tracer/README.md`.
+ * Tracer module for OTBN. This produces a set of trace records at most once every cycle and
+ * provides them to the simulation environment via DPI calls. It uses `otbn_trace_if` to get the
+ * information it needs. For further information see `hw/ip/otbn/dv/tracer/README.md`.
  */
 module otbn_tracer
 #(
@@ -21,44 +21,56 @@ module otbn_tracer
 );
   import otbn_pkg::*;
 
-  // Prefixes used in trace lines. Formats are documented in `hw/ip/otbn/dv/tracer/README.md`
-  parameter string InsnExecutePrefix = "E";
-  parameter string InsnStallPrefix = "S";
-  parameter string WipeInProgressPrefix = "U";
-  parameter string WipeCompletePrefix = "V";
-  parameter string RegReadPrefix = "<";
-  parameter string RegWritePrefix = ">";
-  parameter string MemWritePrefix = "W";
-  parameter string MemReadPrefix = "R";
-
-  string trace_output_buffer;
+  // Record types, which are the characters that start each line in the text format. Formats are
+  // documented in `hw/ip/otbn/dv/tracer/README.md`
+  parameter byte unsigned InsnExecuteType = "E";
+  parameter byte unsigned InsnStallType = "S";
+  parameter byte unsigned WipeInProgressType = "U";
+  parameter byte unsigned WipeCompleteType = "V";
+  parameter byte unsigned RegReadType = "<";
+  parameter byte unsigned RegWriteType = ">";
+  parameter byte unsigned MemWriteType = "W";
+  parameter byte unsigned MemReadType = "R";
+
+  // Locations and flags for trace records. These must match the Loc and Flag enums in
+  // OtbnTraceRecord (see `cpp/otbn_trace_record.h`).
+  localparam byte unsigned LocNone = 0;
+  localparam byte unsigned LocGpr = 1;
+  localparam byte unsigned LocWdr = 2;
+  localparam byte unsigned LocMod = 3;
+  localparam byte unsigned LocAcc = 4;
+  localparam byte unsigned LocRnd = 5;
+  localparam byte unsigned LocUrnd = 6;
+  localparam byte unsigned LocFlags = 7;
+  localparam byte unsigned LocDmem = 8;
+
+  localparam byte unsigned FlagInsnErr = 8'h01;
+  localparam byte unsigned FlagWord = 8'h04;
+  localparam byte unsigned FlagMaskErr = 8'h08;
 
   logic [31:0] cycle_count;
 
-  // Given a WLEN size word output a hex string with the data split into 32-bit chunks separated
-  // with '_'. WLEN must be a multiple of 32.
-  function automatic string otbn_wlen_data_str(logic [WLEN-1:0] data);
-    string data_str;
-
-    assert ((WLEN % 32) == 0) else $error("WLEN must be a multiple of 32 in otbn_wlen_data_str");
-
-    for (int i = WLEN; i > 0; i-= 32) begin
-      if (i != WLEN) begin
-        data_str = $sformatf("%s_", data_str);
-      end else begin
-        data_str = "0x";
-      end
-
-      data_str = $sformatf("%s%08x", data_str, data[i-1 -: 32]);
-    end
-
-    return data_str;
+  // Set if there is at least one trace record for this cycle
+  bit trace_pending;
+
+  import "DPI-C" function void otbn_trace_record(byte unsigned rec_type, byte unsigned loc,
+                                                 byte unsigned idx, byte unsigned flags,
+                                                 int unsigned addr, bit [WLEN-1:0] value);
+  import "DPI-C" function void otbn_trace_flush(int unsigned cycle_count);
+
+  // Called by other trace functions to send a trace record. The text for each record is only
+  // generated (in C++) if a trace listener asks for it.
+  function automatic void output_trace(byte unsigned rec_type, byte unsigned loc,
+                                       byte unsigned idx, byte unsigned flags, logic [31:0] addr,
+                                       logic [WLEN-1:0] value);
+    otbn_trace_record(rec_type, loc, idx, flags, addr, value);
+    trace_pending = 1'b1;
   endfunction
 
-  // Produce trace output string for dmem writes. For a 256-bit write, the address and full data is
+  // Produce trace output for dmem writes. For a 256-bit write, the address and full data is
   // output. For 32-bit writes (determined by looking at the mask) only the relevant 32-bit chunk is
   // output along with the address modified so it refers to that chunk.
-  function automatic string otbn_dmem_write_str(logic [31:0] addr,
+  function automatic void otbn_dmem_write_trace(logic [31:0] addr,
                                                 logic [WLEN-1:0] data,
                                                 logic [WLEN-1:0] wmask);
 
@@ -66,7 +78,8 @@ module otbn_tracer
 
     // For a full WLEN write output all of the data.
     if (wmask == '1) begin
-      return $sformatf("[0x%08x]: %s", addr, otbn_wlen_data_str(data));
+      output_trace(MemWriteType, LocDmem, 8'h00, 8'h00, addr, data);
+      return;
     end
 
     // Iterate through the possible 32-bit chunks
@@ -75,85 +88,76 @@ module otbn_tracer
     for (int i = 0; i < WLEN; i += 32) begin
       // If mask matches current chunk alone output trace indicating a single 32-bit write.
       if (wmask == cur_base_mask) begin
-        return $sformatf("[0x%08x]: 0x%08x", addr + (i / 8), data[i*32 +: 32]);
+        output_trace(MemWriteType, LocDmem, 8'h00, FlagWord, addr + (i / 8),
+                     WLEN'(data[i +: 32]));
+        return;
       end
 
       cur_base_mask = cur_base_mask << 32;
     end
 
     // Fallback where mask isn't as expected, indicate ERR in the trace and provide both full mask
-    // and data.
-    return $sformatf("[0x%08x]: Mask ERR Mask: %s Data: %s", addr, otbn_wlen_data_str(wmask),
-      otbn_wlen_data_str(data));
+    // and data (in a pair of records).
+    output_trace(MemWriteType, LocDmem, 8'h00, FlagMaskErr, addr, wmask);
+    output_trace(MemWriteType, LocDmem, 8'h00, 8'h00, addr, data);
   endfunction
 
-  // Determine name for an ISPR
-  function automatic string otbn_ispr_name_str(ispr_e ispr);
+  // Determine location for an ISPR
+  function automatic byte unsigned otbn_ispr_loc(ispr_e ispr);
     unique case (ispr)
-      IsprMod: return "MOD";
-      IsprAcc: return "ACC";
-      IsprRnd: return "RND";
-      IsprFlags: return "FLAGS";
-      IsprUrnd: return "URND";
-      default: return "UNKNOWN_ISPR";
+      IsprMod: return LocMod;
+      IsprAcc: return LocAcc;
+      IsprRnd: return LocRnd;
+      IsprFlags: return LocFlags;
+      IsprUrnd: return LocUrnd;
+      default: return LocNone;
     endcase
   endfunction
 
-  // Format flag information into a string
-  function automatic string otbn_flags_str(flags_t f);
-    return $sformatf("{C: %d, M: %d, L: %d, Z: %d}", f.C, f.M, f.L, f.Z);
-  endfunction
-
-  // Called by other trace functions to append their trace lines to the output buffer
-  function automatic void output_trace(string prefix, string trace_line);
-    trace_output_buffer = $sformatf("%s%s %s\n", trace_output_buffer, prefix, trace_line);
-  endfunction
-
   function automatic void trace_base_rf();
     if (otbn_trace.rf_base_rd_en_a) begin
-      output_trace(RegReadPrefix, $sformatf("x%02d: 0x%08x", otbn_trace.rf_base_rd_addr_a,
-                                            otbn_trace.rf_base_rd_data_a));
+      output_trace(RegReadType, LocGpr, 8'(otbn_trace.rf_base_rd_addr_a), 8'h00, '0,
+                   WLEN'(otbn_trace.rf_base_rd_data_a));
     end
 
     if (otbn_trace.rf_base_rd_en_b) begin
-      output_trace(RegReadPrefix, $sformatf("x%02d: 0x%08x", otbn_trace.rf_base_rd_addr_b,
-                                            otbn_trace.rf_base_rd_data_b));
+      output_trace(RegReadType, LocGpr, 8'(otbn_trace.rf_base_rd_addr_b), 8'h00, '0,
+                   WLEN'(otbn_trace.rf_base_rd_data_b));
     end
 
     if (|otbn_trace.rf_base_wr_en && otbn_trace.rf_base_wr_commit &&
         otbn_trace.rf_base_wr_addr != '0) begin
-      output_trace(RegWritePrefix, $sformatf("x%02d: 0x%08x", otbn_trace.rf_base_wr_addr,
-                                             otbn_trace.rf_base_wr_data));
+      output_trace(RegWriteType, LocGpr, 8'(otbn_trace.rf_base_wr_addr), 8'h00, '0,
+                   WLEN'(otbn_trace.rf_base_wr_data));
     end
   endfunction
 
   function automatic void trace_bignum_rf();
     if (otbn_trace.rf_bignum_rd_en_a) begin
-      output_trace(RegReadPrefix, $sformatf("w%02d: %s", otbn_trace.rf_bignum_rd_addr_a,
-                                            otbn_wlen_data_str(otbn_trace.rf_bignum_rd_data_a)));
+      output_trace(RegReadType, LocWdr, 8'(otbn_trace.rf_bignum_rd_addr_a), 8'h00, '0,
+                   otbn_trace.rf_bignum_rd_data_a);
     end
 
     if (otbn_trace.rf_bignum_rd_en_b) begin
-      output_trace(RegReadPrefix, $sformatf("w%02d: %s", otbn_trace.rf_bignum_rd_addr_b,
-                                            otbn_wlen_data_str(otbn_trace.rf_bignum_rd_data_b)));
+      output_trace(RegReadType, LocWdr, 8'(otbn_trace.rf_bignum_rd_addr_b), 8'h00, '0,
+                   otbn_trace.rf_bignum_rd_data_b);
     end
 
     if (|otbn_trace.rf_bignum_wr_en & otbn_trace.rf_bignum_wr_commit) begin
-      output_trace(RegWritePrefix, $sformatf("w%02d: %s", otbn_trace.rf_bignum_wr_addr,
-                                             otbn_wlen_data_str(otbn_trace.rf_bignum_wr_data)));
+      output_trace(RegWriteType, LocWdr, 8'(otbn_trace.rf_bignum_wr_addr), 8'h00, '0,
+                   otbn_trace.rf_bignum_wr_data);
     end
   endfunction
 
   function automatic void trace_bignum_mem();
     if (otbn_trace.dmem_write) begin
-      output_trace(MemWritePrefix, otbn_dmem_write_str(otbn_trace.dmem_write_addr,
-                                                       otbn_trace.dmem_write_data,
-                                                       otbn_trace.dmem_write_mask));
+      otbn_dmem_write_trace(otbn_trace.dmem_write_addr, otbn_trace.dmem_write_data,
+                            otbn_trace.dmem_write_mask);
     end
 
     if (otbn_trace.dmem_read) begin
-      output_trace(MemReadPrefix, $sformatf("[0x%08x]: %s", otbn_trace.dmem_read_addr,
-                                            otbn_wlen_data_str(otbn_trace.dmem_read_data)));
+      output_trace(MemReadType, LocDmem, 8'h00, 8'h00, otbn_trace.dmem_read_addr,
+                   otbn_trace.dmem_read_data);
     end
   endfunction
 
@@ -161,32 +165,29 @@ module otbn_tracer
     // Iterate through all ISPRs outputting reg reads and writes where ISPR accesses have occurred
     for (int i_ispr = 0; i_ispr < NIspr; i_ispr++) begin
       if (ispr_e'(i_ispr) == IsprFlags) begin
-        // Special handling for flags ISPR to provide per flag field output
+        // Special handling for flags ISPR to provide per flag field output (with C, M, L and Z in
+        // bits 0 to 3 of the value)
         for (int i_fg = 0; i_fg < NFlagGroups; i_fg++) begin
           if (otbn_trace.flags_read[i_fg]) begin
-            output_trace(RegReadPrefix,
-                         $sformatf("%s%1d: %s", otbn_ispr_name_str(ispr_e'(i_ispr)), i_fg,
-                                   otbn_flags_str(otbn_trace.flags_read_data[i_fg])));
+            output_trace(RegReadType, LocFlags, 8'(i_fg), 8'h00, '0,
+                         WLEN'(otbn_trace.flags_read_data[i_fg]));
           end
 
           if (otbn_trace.flags_write[i_fg]) begin
-            output_trace(RegWritePrefix,
-                         $sformatf("%s%1d: %s", otbn_ispr_name_str(ispr_e'(i_ispr)), i_fg,
-                                   otbn_flags_str(otbn_trace.flags_write_data[i_fg])));
+            output_trace(RegWriteType, LocFlags, 8'(i_fg), 8'h00, '0,
+                         WLEN'(otbn_trace.flags_write_data[i_fg]));
           end
         end
       end else begin
         // For all other ISPRs just dump out the full 256-bits of data being read/written
         if (otbn_trace.ispr_read[i_ispr]) begin
-          output_trace(RegReadPrefix,
-                       $sformatf("%s: %s", otbn_ispr_name_str(ispr_e'(i_ispr)),
-                                 otbn_wlen_data_str(otbn_trace.ispr_read_data[i_ispr])));
+          output_trace(RegReadType, otbn_ispr_loc(ispr_e'(i_ispr)), 8'h00, 8'h00, '0,
+                       otbn_trace.ispr_read_data[i_ispr]);
         end
 
         if (otbn_trace.ispr_write[i_ispr]) begin
-          output_trace(RegWritePrefix,
-                       $sformatf("%s: %s", otbn_ispr_name_str(ispr_e'(i_ispr)),
-                                 otbn_wlen_data_str(otbn_trace.ispr_write_data[i_ispr])));
+          output_trace(RegWriteType, otbn_ispr_loc(ispr_e'(i_ispr)), 8'h00, 8'h00, '0,
+                       otbn_trace.ispr_write_data[i_ispr]);
         end
       end
     end
@@ -197,28 +198,24 @@ module otbn_tracer
       if (otbn_trace.insn_fetch_err) begin
         // This means that we've seen an IMEM integrity error. Squash the reported instruction bits
         // and ignore any stall: this will be the last cycle of the instruction either way.
-        output_trace(InsnExecutePrefix,
-                     $sformatf("PC: 0x%08x, insn: ??", otbn_trace.insn_addr));
+        output_trace(InsnExecuteType, LocNone, 8'h00, FlagInsnErr, otbn_trace.insn_addr, '0);
       end else begin
         // We have a valid instruction, either stalled or completing its execution
-        output_trace(otbn_trace.insn_stall ? InsnStallPrefix : InsnExecutePrefix,
-                     $sformatf("PC: 0x%08x, insn: 0x%08x", otbn_trace.insn_addr,
-                               otbn_trace.insn_data));
+        output_trace(otbn_trace.insn_stall ? InsnStallType : InsnExecuteType, LocNone, 8'h00, 8'h00,
+                     otbn_trace.insn_addr, WLEN'(otbn_trace.insn_data));
       end
     end
     if (SecWipeEn) begin
       if (otbn_trace.secure_wipe_done) begin
-        output_trace(WipeCompletePrefix, "");
+        output_trace(WipeCompleteType, LocNone, 8'h00, 8'h00, '0, '0);
       end else if (otbn_trace.secure_wipe_running) begin
-        output_trace(WipeInProgressPrefix, "");
+        output_trace(WipeInProgressType, LocNone, 8'h00, 8'h00, '0, '0);
       end
     end
   endfunction
 
-  import "DPI-C" function void accept_otbn_trace_string(string trace, int unsigned cycle_count);
-
   function automatic void do_trace();
-    trace_output_buffer = "";
+    trace_pending = 1'b0;
 
     trace_header();
     trace_bignum_rf();
@@ -226,8 +223,8 @@ module otbn_tracer
     trace_bignum_mem();
     trace_ispr_accesses();
 
-    if (trace_output_buffer != "") begin
-      accept_otbn_trace_string(trace_output_buffer, cycle_count);
+    if (trace_pending) begin
+      otbn_trace_flush(cycle_count);
     end
   endfunction
 
@@ -2,11 +2,13 @@
 // Licensed under the Apache License, Version 2.0, see LICENSE for details.
 // SPDX-License-Identifier: Apache-2.0
 
+#include <cstring>
 #include <fstream>
 #include <getopt.h>
 #include <iomanip>
 #include <iostream>
 #include <memory>
+#include <set>
 #include <string>
 #include <svdpi.h>
 
@@ -16,6 +18,7 @@
 #include "otbn_model.h"
 #include "otbn_trace_checker.h"
 #include "otbn_trace_source.h"
+#include "profile_trace_listener.h"
 #include "sv_scoped.h"
 #include "verilated_toplevel.h"
 #include "verilator_memutil.h"
@@ -33,15 +36,18 @@ extern int otbn_core_get_stop_pc();
 /**
  * SimCtrlExtension that adds a '--otbn-trace-file' command line option. If set
  * it sets up a LogTraceListener that will dump out the trace to the given log
- * file
+ * file. The '--otbn-trace-format' option chooses between the text and binary
+ * log formats.
  */
 class OtbnTraceUtil : public SimCtrlExtension {
  private:
   std::unique_ptr<LogTraceListener> log_trace_listener_;
 
-  bool SetupTraceLog(const std::string &log_filename) {
+  bool SetupTraceLog(const std::string &log_filename,
+                     LogTraceListener::Format format) {
     try {
-      log_trace_listener_ = std::make_unique<LogTraceListener>(log_filename);
+      log_trace_listener_ =
+          std::make_unique<LogTraceListener>(log_filename, format);
       OtbnTraceSource::get().AddListener(log_trace_listener_.get());
       return true;
     } catch (const std::runtime_error &err) {
@@ -56,19 +62,27 @@ class OtbnTraceUtil : public SimCtrlExtension {
   void PrintHelp() {
     std::cout << "Trace log utilities:\n\n"
                  "--otbn-trace-file=FILE\n"
-                 "  Write OTBN trace log to FILE\n\n";
+                 "  Write OTBN trace log to FILE. If FILE ends in .gz or\n"
+                 "  .zst, compress it with gzip or zstd.\n\n"
+                 "--otbn-trace-format=text|binary\n"
+                 "  Format of the OTBN trace log (default: text). Use\n"
+                 "  hw/ip/otbn/dv/tracer/otbn_trace_to_text.py to convert a\n"
+                 "  binary log to text.\n\n";
   }
 
  public:
   virtual bool ParseCLIArguments(int argc, char **argv, bool &exit_app) {
     const struct option long_options[] = {
         {"otbn-trace-file", required_argument, nullptr, 'l'},
+        {"otbn-trace-format", required_argument, nullptr, 'f'},
         {"help", no_argument, nullptr, 'h'},
         {nullptr, no_argument, nullptr, 0}};
 
     // Reset the command parsing index in-case other utils have already parsed
     // some arguments
     optind = 1;
+    std::string log_filename;
+    LogTraceListener::Format format = LogTraceListener::kText;
     while (1) {
       int c = getopt_long(argc, argv, "-h", long_options, nullptr);
       if (c == -1) {
@@ -80,13 +94,28 @@ class OtbnTraceUtil : public SimCtrlExtension {
         case 1:
           break;
         case 'l':
-          return SetupTraceLog(optarg);
+          log_filename = optarg;
+          break;
+        case 'f':
+          if (!strcmp(optarg, "text")) {
+            format = LogTraceListener::kText;
+          } else if (!strcmp(optarg, "binary")) {
+            format = LogTraceListener::kBinary;
+          } else {
+            std::cerr << "ERROR: Unknown OTBN trace format: " << optarg
+                      << " (expected text or binary)" << std::endl;
+            return false;
+          }
+          break;
         case 'h':
           PrintHelp();
           break;
       }
     }
 
+    if (!log_filename.empty())
+      return SetupTraceLog(log_filename, format);
+
     return true;
   }
 
@@ -99,9 +128,310 @@ class OtbnTraceUtil : public SimCtrlExtension {
 static otbn_top_sim *verilator_top;
 static OtbnMemUtil otbn_memutil("TOP.otbn_top_sim");
 
+// The loop stack as seen by OtbnTopApplyLoopWarp. This is cleared between the
+// runs of a batch, in case a run ended in the middle of a loop.
+static std::vector<uint32_t> loop_count_stack;
+
+// Check the result of a run of the simulation (after it has finished), writing
+// a message to stderr for any problem. Returns true if the run passed.
+static bool CheckRunResult() {
+  svSetScope(svGetScopeFromName("TOP.otbn_top_sim"));
+
+  svBit model_err = otbn_err_get();
+  if (model_err) {
+    return false;
+  }
+
+  int exp_stop_pc = otbn_memutil.GetExpEndAddr();
+  if (exp_stop_pc >= 0) {
+    SVScoped core_scope("TOP.otbn_top_sim.u_otbn_core_model");
+    int act_stop_pc = otbn_core_get_stop_pc();
+    if (exp_stop_pc != act_stop_pc) {
+      std::cerr << "ERROR: Expected stop PC from ELF file was 0x" << std::hex
+                << exp_stop_pc << ", but simulation actually stopped at 0x"
+                << act_stop_pc << std::dec << ".\n";
+      return false;
+    }
+  }
+
+  return true;
+}
+
+/**
+ * SimCtrlExtension that adds a '--otbn-profile' command line option. If set,
+ * it sets up a ProfileTraceListener and, at the end of each run, writes a
+ * hotspot report to the given file (using the symbols from the ELF file that
+ * was loaded). The report ends with suggested loop warps for long-running
+ * loops, which can be added to a test's linker script to fast-forward it.
+ */
+class OtbnProfileUtil : public SimCtrlExtension {
+ private:
+  std::string report_filename_;
+  std::ofstream report_;
+  std::unique_ptr<ProfileTraceListener> listener_;
+  unsigned num_reports_;
+
+  void PrintHelp() {
+    std::cout << "Profiling utilities:\n\n"
+                 "--otbn-profile=FILE\n"
+                 "  Count the cycles spent at each OTBN instruction and write\n"
+                 "  a hotspot report (with suggested loop warps) to FILE at\n"
+                 "  the end of the simulation.\n\n";
+  }
+
+ public:
+  OtbnProfileUtil() : num_reports_(0) {}
+
+  virtual bool ParseCLIArguments(int argc, char **argv, bool &exit_app) {
+    const struct option long_options[] = {
+        {"otbn-profile", required_argument, nullptr, 'p'},
+        {"help", no_argument, nullptr, 'h'},
+        {nullptr, no_argument, nullptr, 0}};
+
+    // Reset the command parsing index in-case other utils have already parsed
+    // some arguments
+    optind = 1;
+    while (1) {
+      int c = getopt_long(argc, argv, "-h", long_options, nullptr);
+      if (c == -1) {
+        break;
+      }
+
+      switch (c) {
+        case 0:
+        case 1:
+          break;
+        case 'p':
+          report_filename_ = optarg;
+          break;
+        case 'h':
+          PrintHelp();
+          break;
+      }
+    }
+
+    if (report_filename_.empty()) {
+      return true;
+    }
+
+    report_.open(report_filename_);
+    if (!report_.is_open()) {
+      std::cerr << "ERROR: Could not open profile report file: "
+                << report_filename_ << std::endl;
+      return false;
+    }
+
+    listener_ = std::make_unique<ProfileTraceListener>();
+    OtbnTraceSource::get().AddListener(listener_.get());
+    return true;
+  }
+
+  // Write the report for the run that just finished (which is still loaded in
+  // otbn_memutil) and start counting again for the next one.
+  virtual bool OnRunEnd(bool run_success) {
+    if (!listener_ || listener_->Empty()) {
+      return false;
+    }
+
+    // Label the reports, since there's one for each run in batch mode
+    if (num_reports_) {
+      report_ << "\n\n";
+    }
+    report_ << "Run " << ++num_reports_ << "\n";
+
+    std::set<uint32_t> warp_addrs;
+    for (const auto &pr : otbn_memutil.GetLoopWarps()) {
+      warp_addrs.insert(pr.first.first);
+    }
+
+    listener_->WriteReport(report_, otbn_memutil.GetCodeSymbols(),
+                           warp_addrs);
+    report_.flush();
+    listener_->Reset();
+    return false;
+  }
+
+  ~OtbnProfileUtil() {
+    if (listener_) {
+      OtbnTraceSource::get().RemoveListener(listener_.get());
+    }
+  }
+};
+
+/**
+ * SimCtrlExtension that adds a '--otbn-batch' command line option, which runs
+ * a batch of ELF files one after the other in a single process. Between
+ * programs, the design is reset, IMEM and DMEM are put back in their initial
+ * state and the next ELF file is loaded. The Verilated model and the ISS
+ * subprocess are kept, so their setup cost is only paid once.
+ *
+ * The argument is a file that lists the ELF files, one per line. If it is
+ * '-', each ELF file is read from stdin when the previous program has
+ * finished, which lets a driver (like run-pool.py) feed a long-running
+ * simulation with work. When each program finishes, this prints a line of the
+ * form "OTBN batch: PASS <path>" (or FAIL) to stdout.
+ */
+class OtbnBatchUtil : public SimCtrlExtension {
+ private:
+  std::string list_path_;
+  std::ifstream list_file_;
+  std::istream *list_;
+
+  // The raw contents of IMEM and DMEM when the simulation started
+  std::vector<MemBlock> imem_init_, dmem_init_;
+
+  // The ELF file for the current run (empty if there is none)
+  std::string elf_path_;
+
+  unsigned num_programs_;
+  unsigned num_failed_;
+
+  void PrintHelp() {
+    std::cout << "Batch utilities:\n\n"
+                 "--otbn-batch=FILE\n"
+                 "  Run each of the ELF files listed in FILE (one per line)\n"
+                 "  in turn, resetting the design between them. If FILE is\n"
+                 "  -, read the ELF files from stdin.\n\n";
+  }
+
+  void ReportResult(const std::string &elf_path, bool passed) {
+    ++num_programs_;
+    if (!passed) {
+      ++num_failed_;
+    }
+    std::cout << "OTBN batch: " << (passed ? "PASS " : "FAIL ") << elf_path
+              << std::endl;
+  }
+
+  // Load the next ELF file from the list (after putting the memories back in
+  // their initial state), skipping any that can't be loaded. Returns false if
+  // there are no more.
+  bool LoadNextElf() {
+    elf_path_.clear();
+
+    std::string line;
+    while (std::getline(*list_, line)) {
+      if (line.empty()) {
+        continue;
+      }
+
+      try {
+        otbn_memutil.GetMemArea(true).WriteRaw(imem_init_);
+        otbn_memutil.GetMemArea(false).WriteRaw(dmem_init_);
+        otbn_memutil.LoadElf(line);
+      } catch (const std::exception &err) {
+        std::cerr << "ERROR: Failed to load ELF file `" << line
+                  << "': " << err.what() << std::endl;
+        ReportResult(line, false);
+        continue;
+      }
+
+      elf_path_ = line;
+      return true;
+    }
+
+    return false;
+  }
+
+ public:
+  OtbnBatchUtil() : list_(nullptr), num_programs_(0), num_failed_(0) {}
+
+  bool Enabled() const { return list_ != nullptr; }
+
+  bool AllPassed() const { return num_failed_ == 0; }
+
+  virtual bool ParseCLIArguments(int argc, char **argv, bool &exit_app) {
+    const struct option long_options[] = {
+        {"otbn-batch", required_argument, nullptr, 'b'},
+        {"help", no_argument, nullptr, 'h'},
+        {nullptr, no_argument, nullptr, 0}};
+
+    // Reset the command parsing index in-case other utils have already parsed
+    // some arguments
+    optind = 1;
+    while (1) {
+      int c = getopt_long(argc, argv, "-h", long_options, nullptr);
+      if (c == -1) {
+        break;
+      }
+
+      switch (c) {
+        case 0:
+        case 1:
+          break;
+        case 'b':
+          list_path_ = optarg;
+          break;
+        case 'h':
+          PrintHelp();
+          break;
+      }
+    }
+
+    if (list_path_.empty()) {
+      return true;
+    }
+
+    if (list_path_ == "-") {
+      list_ = &std::cin;
+    } else {
+      list_file_.open(list_path_);
+      if (!list_file_.is_open()) {
+        std::cerr << "ERROR: Could not open batch file: " << list_path_
+                  << std::endl;
+        return false;
+      }
+      list_ = &list_file_;
+    }
+
+    return true;
+  }
+
+  virtual void PreExec() {
+    if (!Enabled()) {
+      return;
+    }
+
+    imem_init_ = otbn_memutil.GetMemArea(true).ReadRaw();
+    dmem_init_ = otbn_memutil.GetMemArea(false).ReadRaw();
+
+    // If there's nothing to run, stop straight away.
+    if (!LoadNextElf()) {
+      VerilatorSimCtrl::GetInstance().RequestStop(true);
+    }
+  }
+
+  virtual bool OnRunEnd(bool run_success) {
+    if (!Enabled()) {
+      return false;
+    }
+
+    if (!elf_path_.empty()) {
+      bool passed = CheckRunResult() && run_success;
+      ReportResult(elf_path_, passed);
+    }
+
+    if (!LoadNextElf()) {
+      return false;
+    }
+
+    loop_count_stack.clear();
+    return true;
+  }
+
+  virtual void PostExec() {
+    if (Enabled()) {
+      std::cout << "OTBN batch: ran " << num_programs_ << " programs, "
+                << num_failed_ << " failed." << std::endl;
+    }
+  }
+};
+
 int main(int argc, char **argv) {
   VerilatorMemUtil memutil(&otbn_memutil);
   OtbnTraceUtil traceutil;
+  OtbnProfileUtil profileutil;
+  OtbnBatchUtil batchutil;
 
   otbn_top_sim top;
   // Make the otbn_top_sim object visible to OtbnTopApplyLoopWarp.
@@ -115,6 +445,10 @@ int main(int argc, char **argv) {
                  VerilatorSimCtrlFlags::ResetPolarityNegative);
   simctrl.RegisterExtension(&memutil);
   simctrl.RegisterExtension(&traceutil);
+  // This must be registered before batchutil, so that it writes the report
+  // for a run before batchutil loads the next ELF file.
+  simctrl.RegisterExtension(&profileutil);
+  simctrl.RegisterExtension(&batchutil);
 
   std::cout << "Simulation of OTBN" << std::endl
             << "==================" << std::endl
@@ -128,26 +462,12 @@ int main(int argc, char **argv) {
     return ret_code;
   }
 
-  svSetScope(svGetScopeFromName("TOP.otbn_top_sim"));
-
-  svBit model_err = otbn_err_get();
-  if (model_err) {
-    return 1;
-  }
-
-  int exp_stop_pc = otbn_memutil.GetExpEndAddr();
-  if (exp_stop_pc >= 0) {
-    SVScoped core_scope("TOP.otbn_top_sim.u_otbn_core_model");
-    int act_stop_pc = otbn_core_get_stop_pc();
-    if (exp_stop_pc != act_stop_pc) {
-      std::cerr << "ERROR: Expected stop PC from ELF file was 0x" << std::hex
-                << exp_stop_pc << ", but simulation actually stopped at 0x"
-                << act_stop_pc << ".\n";
-      return 1;
-    }
+  // In batch mode, each run has already been checked by batchutil.
+  if (batchutil.Enabled()) {
+    return batchutil.AllPassed() ? 0 : 1;
   }
 
-  return 0;
+  return CheckRunResult() ? 0 : 1;
 }
 
 // This is executed over DPI on the first posedge of the clock after each
@@ -233,8 +553,6 @@ auto get_loop_counter(LoopControllerT *loop_controller, uint32_t counter_idx)
 // updating the top of the loop stack if necessary to match loop warp symbols
 // in the ELF file.
 extern "C" void OtbnTopApplyLoopWarp() {
-  static std::vector<uint32_t> loop_count_stack;
-
   // See not in OtbnTopInstallLoopWarps for why this upcast is needed.
   Votbn_top_sim &top = *verilator_top;
 
@@ -0,0 +1,202 @@
+#!/usr/bin/env python3
+# Copyright lowRISC contributors.
+# Licensed under the Apache License, Version 2.0, see LICENSE for details.
+# SPDX-License-Identifier: Apache-2.0
+
+'''Run a set of OTBN ELF files on a pool of Verilated simulations
+
+Use this with a command line like
+
+    run-pool.py --jobs=8 --logdir=logs path/to/*.elf
+
+which will start 8 copies of otbn_top_sim in batch mode (see --otbn-batch in
+otbn_top_sim.cc) and hand each of them ELF files to run until they have all
+been run. Each simulation builds its Verilated model and starts its ISS once,
+rather than once per ELF file.
+
+With --per-elf, this runs a separate simulation for each ELF file instead
+(with --load-elf, like run-some.py), which is useful to compare wall times.
+
+'''
+
+import argparse
+import os
+import queue
+import subprocess
+import sys
+import threading
+import time
+from typing import Dict, List, Optional, Tuple
+
+_SCRIPT_DIR = os.path.dirname(__file__)
+_DEFAULT_SIM = 'build/lowrisc_ip_otbn_top_sim_0.1/sim-verilator/Votbn_top_sim'
+_RESULT_PREFIX = 'OTBN batch: '
+
+# The result for an ELF file: whether it passed and its simulation output
+Result = Tuple[bool, List[str]]
+
+
+def get_projdir() -> str:
+    '''Return the path to the top of the project'''
+    path = os.path.join(_SCRIPT_DIR, '../../../../..')
+    return os.path.normpath(path)
+
+
+class PoolWorker:
+    '''A thread that feeds ELF files to a simulation in batch mode'''
+    def __init__(self,
+                 sim_cmd: List[str],
+                 todo: 'queue.Queue[str]',
+                 results: Dict[str, Result]) -> None:
+        self.sim_cmd = sim_cmd + ['--otbn-batch=-']
+        self.todo = todo
+        self.results = results
+        self.proc = None  # type: Optional[subprocess.Popen[str]]
+        self.thread = threading.Thread(target=self.run)
+
+    def start_sim(self) -> 'subprocess.Popen[str]':
+        return subprocess.Popen(self.sim_cmd,
+                                stdin=subprocess.PIPE,
+                                stdout=subprocess.PIPE,
+                                stderr=subprocess.STDOUT,
+                                universal_newlines=True,
+                                bufsize=1)
+
+    def run_elf(self, elf: str) -> Result:
+        '''Send an ELF file to the simulation and wait for its result'''
+        if self.proc is None:
+            self.proc = self.start_sim()
+        assert self.proc.stdin is not None
+        assert self.proc.stdout is not None
+
+        lines = []
+        try:
+            self.proc.stdin.write(elf + '\n')
+            self.proc.stdin.flush()
+        except BrokenPipeError:
+            pass
+        else:
+            for line in self.proc.stdout:
+                if line.startswith(_RESULT_PREFIX):
+                    status, _, path = (line[len(_RESULT_PREFIX):]
+                                       .rstrip('\n').partition(' '))
+                    if path == elf:
+                        return (status == 'PASS', lines)
+                lines.append(line)
+
+        # The simulation exited (or crashed) without giving a result. Fail
+        # this ELF file and start a new simulation for the next one.
+        self.proc.wait()
+        lines.append('Simulation exited with status {} without a result.\n'
+                     .format(self.proc.returncode))
+        self.proc = None
+        return (False, lines)
+
+    def run(self) -> None:
+        while True:
+            try:
+                elf = self.todo.get_nowait()
+            except queue.Empty:
+                break
+            self.results[elf] = self.run_elf(elf)
+
+        # Closing the simulation's stdin tells it that there are no more ELF
+        # files. Discard what it prints as it exits.
+        if self.proc is not None:
+            assert self.proc.stdin is not None
+            assert self.proc.stdout is not None
+            self.proc.stdin.close()
+            self.proc.stdout.read()
+            self.proc.wait()
+
+
+def run_per_elf(sim_cmd: List[str], elf: str) -> Result:
+    '''Run a separate simulation for an ELF file'''
+    proc = subprocess.run(sim_cmd + ['--load-elf', elf],
+                          stdout=subprocess.PIPE,
+                          stderr=subprocess.STDOUT,
+                          universal_newlines=True,
+                          check=False)
+    return (proc.returncode == 0, proc.stdout.splitlines(keepends=True))
+
+
+def per_elf_worker(sim_cmd: List[str],
+                   todo: 'queue.Queue[str]',
+                   results: Dict[str, Result]) -> None:
+    while True:
+        try:
+            elf = todo.get_nowait()
+        except queue.Empty:
+            break
+        results[elf] = run_per_elf(sim_cmd, elf)
+
+
+def main() -> int:
+    parser = argparse.ArgumentParser()
+    parser.add_argument('--sim', default=_DEFAULT_SIM,
+                        help='Path to the Verilated otbn_top_sim binary')
+    parser.add_argument('--jobs', '-j', type=int, default=os.cpu_count(),
+                        help='Number of simulations to run in parallel')
+    parser.add_argument('--per-elf', action='store_true',
+                        help='Run a separate simulation for each ELF file')
+    parser.add_argument('--logdir',
+                        help='Write the output for each ELF file to a log '
+                             'in this directory')
+    parser.add_argument('--sim-arg', action='append', default=[],
+                        help='Extra argument for the simulation')
+    parser.add_argument('elfs', nargs='+', metavar='elf')
+
+    args = parser.parse_args()
+
+    if not os.path.exists(args.sim):
+        print(f'No such simulation binary: {args.sim}', file=sys.stderr)
+        return 1
+
+    # The model finds the ISS through REPO_TOP
+    os.environ.setdefault('REPO_TOP', get_projdir())
+
+    sim_cmd = [args.sim] + args.sim_arg
+    todo = queue.Queue()  # type: queue.Queue[str]
+    for elf in args.elfs:
+        todo.put(elf)
+    results = {}  # type: Dict[str, Result]
+
+    start = time.monotonic()
+    threads = []
+    for _ in range(max(1, min(args.jobs, len(args.elfs)))):
+        if args.per_elf:
+            thread = threading.Thread(target=per_elf_worker,
+                                      args=(sim_cmd, todo, results))
+        else:
+            thread = PoolWorker(sim_cmd, todo, results).thread
+        thread.start()
+        threads.append(thread)
+    for thread in threads:
+        thread.join()
+    wall_time = time.monotonic() - start
+
+    if args.logdir is not None:
+        os.makedirs(args.logdir, exist_ok=True)
+
+    failed = []
+    for elf in args.elfs:
+        passed, lines = results[elf]
+        if not passed:
+            failed.append(elf)
+        if args.logdir is not None:
+            log_name = os.path.splitext(os.path.basename(elf))[0] + '.log'
+            with open(os.path.join(args.logdir, log_name), 'w') as log:
+                log.writelines(lines)
+
+    for elf in failed:
+        print(f'FAIL: {elf}')
+    print('{} of {} ELF files passed in {:.1f}s ({} {}).'
+          .format(len(args.elfs) - len(failed), len(args.elfs), wall_time,
+                  len(threads),
+                  'jobs, one simulation per ELF file' if args.per_elf
+                  else 'simulations in batch mode'))
+    return 1 if failed else 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -6,8 +6,7 @@
 
 #include <algorithm>
 #include <cassert>
-#include <functional>
-#include <iostream>
+#include <cstring>
 #include <stdint.h>
 #include <vector>
 
@@ -23,299 +22,430 @@ static const uint32_t kNumAddrSubstPermRounds = 2;
 static const uint32_t kNumDataSubstPermRounds = 2;
 static const uint32_t kNumPrinceHalfRounds = 2;
 
-static std::vector<uint8_t> byte_reverse_vector(
-    const std::vector<uint8_t> &vec_in) {
-  std::vector<uint8_t> vec_out(vec_in.size());
+namespace {
+// Byte-wide versions of the SBOXes, which substitute both nibbles of a byte
+// with a single lookup.
+struct ByteSboxes {
+  ByteSboxes() {
+    for (uint32_t i = 0; i < 256; ++i) {
+      enc[i] = PRESENT_SBOX4[i & 0xf] | (PRESENT_SBOX4[i >> 4] << 4);
+      dec[i] = PRESENT_SBOX4_INV[i & 0xf] | (PRESENT_SBOX4_INV[i >> 4] << 4);
+    }
+  }
 
-  std::reverse_copy(std::begin(vec_in), std::end(vec_in), std::begin(vec_out));
+  uint8_t enc[256];
+  uint8_t dec[256];
+};
+}  // namespace
 
-  return vec_out;
+static const ByteSboxes &get_byte_sboxes() {
+  static const ByteSboxes sboxes;
+  return sboxes;
 }
 
-static uint8_t read_vector_bit(const std::vector<uint8_t> &vec,
-                               uint32_t bit_pos) {
-  assert(bit_pos / 8 < vec.size());
+namespace {
+// Tables for a faster version of prince_enc_dec_uint64 (encryption with the
+// new key schedule only), built from the reference model's own layers. The S
+// layer works on bytes and the M' layer is linear, so M'(S(x)) is the XOR of
+// one table entry for each byte of x.
+struct PrinceTables {
+  PrinceTables() {
+    for (uint32_t b = 0; b < 256; ++b) {
+      uint8_t s = prince_sbox(b) | (prince_sbox(b >> 4) << 4);
+      sbox_inv[b] = prince_sbox_inv(b) | (prince_sbox_inv(b >> 4) << 4);
+
+      for (uint32_t i = 0; i < 8; ++i) {
+        m_prime[i][b] = prince_m_prime_layer((uint64_t)b << (8 * i));
+        s_m_prime[i][b] = prince_m_prime_layer((uint64_t)s << (8 * i));
+      }
+    }
+  }
+
+  uint8_t sbox_inv[256];
+  // M'(b << 8i) and M'(S(b) << 8i) for each byte b at byte position i
+  uint64_t m_prime[8][256];
+  uint64_t s_m_prime[8][256];
+};
+}  // namespace
 
-  return (vec[bit_pos / 8] >> (bit_pos % 8)) & 1;
+static const PrinceTables &get_prince_tables() {
+  static const PrinceTables tables;
+  return tables;
 }
 
-static void or_vector_bit(std::vector<uint8_t> &vec, uint32_t bit_pos,
-                          uint8_t bit) {
-  assert(bit_pos / 8 < vec.size());
+static inline uint64_t prince_table_layer(uint64_t in,
+                                          const uint64_t table[8][256]) {
+  uint64_t out = 0;
+  for (uint32_t i = 0; i < 8; ++i) {
+    out ^= table[i][(in >> (8 * i)) & 0xff];
+  }
+  return out;
+}
 
-  vec[bit_pos / 8] |= bit << (bit_pos % 8);
+static inline uint64_t prince_s_inv_bytes(uint64_t in,
+                                          const uint8_t sbox_inv[256]) {
+  uint64_t out = 0;
+  for (uint32_t i = 0; i < 8; ++i) {
+    out |= (uint64_t)sbox_inv[(in >> (8 * i)) & 0xff] << (8 * i);
+  }
+  return out;
 }
 
-static std::vector<uint8_t> xor_vectors(const std::vector<uint8_t> &vec_a,
-                                        const std::vector<uint8_t> &vec_b) {
-  assert(vec_a.size() == vec_b.size());
+// Equivalent to prince_enc_dec_uint64(in, k0, k1, 0, num_half_rounds, 0),
+// which spends most of its time in bit-by-bit S and M' layers. Generating the
+// keystream is the most expensive part of scrambling a word, so this matters
+// when whole memory images are scrambled.
+static uint64_t prince_encrypt_fast(uint64_t in, uint64_t k0, uint64_t k1,
+                                    int num_half_rounds) {
+  const PrinceTables &tables = get_prince_tables();
+
+  uint64_t state = in ^ k0 ^ k1 ^ prince_round_constant(0);
+  for (int round = 1; round <= num_half_rounds; round++) {
+    state = prince_shift_rows(prince_table_layer(state, tables.s_m_prime), 0);
+    state ^= ((round % 2 == 1) ? k0 : k1) ^ prince_round_constant(round);
+  }
 
-  std::vector<uint8_t> vec_out(vec_a.size());
+  state = prince_s_inv_bytes(prince_table_layer(state, tables.s_m_prime),
+                             tables.sbox_inv);
 
-  std::transform(vec_a.begin(), vec_a.end(), vec_b.begin(), vec_out.begin(),
-                 std::bit_xor<uint8_t>{});
+  for (int round = 1; round <= num_half_rounds; round++) {
+    int constant_idx = 10 - num_half_rounds + round;
+    state ^= (((num_half_rounds + round + 1) % 2 == 1) ? k0 : k1) ^
+             prince_round_constant(constant_idx);
+    state = prince_table_layer(prince_shift_rows(state, 1), tables.m_prime);
+    state = prince_s_inv_bytes(state, tables.sbox_inv);
+  }
 
-  return vec_out;
+  return state ^ k1 ^ prince_round_constant(11) ^ prince_k0_to_k0_prime(k0);
 }
 
-// Run each 4-bit chunk of bytes from `in` through the SBOX. Where `bit_width`
-// isn't a multiple of 4 the remaining bits are just copied straight through.
-// `invert` choose whether to use the inverted SBOX or not.
-static std::vector<uint8_t> scramble_sbox_layer(const std::vector<uint8_t> &in,
-                                                uint32_t bit_width,
-                                                uint8_t sbox[16]) {
-  assert(in.size() == ((bit_width + 7) / 8));
-  std::vector<uint8_t> out(in.size(), 0);
+// Return a mask with the bottom width bits set
+static inline uint64_t width_mask(uint32_t width) {
+  assert(width <= 64);
+  return (width == 64) ? ~(uint64_t)0 : (((uint64_t)1 << width) - 1);
+}
+
+// Swap the bits of x selected by mask with the bits shift places above them
+// (a "delta swap"). mask must not overlap with itself shifted by shift.
+static inline uint64_t bit_permute_step(uint64_t x, uint64_t mask,
+                                        unsigned shift) {
+  uint64_t t = ((x >> shift) ^ x) & mask;
+  return x ^ t ^ (t << shift);
+}
 
-  // Iterate through each 4 bit chunk of the data and apply the appropriate SBOX
-  for (uint32_t i = 0; i < bit_width / 4; ++i) {
-    uint8_t sbox_in, sbox_out;
+// Read width bits (at most 64) from the little-endian buffer buf, starting at
+// bit_pos.
+static uint64_t read_buf_bits(const uint8_t *buf, uint32_t bit_pos,
+                              uint32_t width) {
+  assert(width <= 64);
+
+  uint64_t ret = 0;
+  uint32_t got = 0;
+  buf += bit_pos / 8;
+  uint32_t shift = bit_pos % 8;
+
+  while (got < width) {
+    ret |= (uint64_t)(*buf >> shift) << got;
+    got += 8 - shift;
+    shift = 0;
+    ++buf;
+  }
 
-    sbox_in = in[i / 2];
+  return ret & width_mask(width);
+}
 
-    int shift = (i % 2) ? 4 : 0;
-    sbox_in = (sbox_in >> shift) & 0xf;
+// Replace width bits (at most 64) of the little-endian buffer buf, starting
+// at bit_pos, with the bottom bits of val. Other bits are left unchanged.
+static void write_buf_bits(uint8_t *buf, uint32_t bit_pos, uint32_t width,
+                           uint64_t val) {
+  assert(width <= 64);
 
-    sbox_out = sbox[sbox_in];
+  buf += bit_pos / 8;
+  uint32_t shift = bit_pos % 8;
 
-    out[i / 2] |= sbox_out << shift;
-  }
+  while (width) {
+    uint32_t to_take = std::min(8 - shift, width);
+    uint8_t mask = ((1u << to_take) - 1) << shift;
 
-  // Where bit_width is not a multiple of 4 copy over the remaining bits
-  if (bit_width % 4) {
-    int shift = ((bit_width % 8) >= 4) ? 4 : 0;
-    uint8_t nibble = (in[bit_width / 8] >> shift) & 0xf;
-    out[bit_width / 8] |= nibble << shift;
-  }
+    *buf = (*buf & ~mask) | ((uint8_t)(val << shift) & mask);
 
-  return out;
+    val >>= to_take;
+    width -= to_take;
+    shift = 0;
+    ++buf;
+  }
 }
 
-// Reverse bits from incoming byte vector
-static std::vector<uint8_t> scramble_flip_layer(const std::vector<uint8_t> &in,
-                                                uint32_t bit_width) {
-  assert(in.size() == ((bit_width + 7) / 8));
-  std::vector<uint8_t> out(in.size(), 0);
+static uint64_t read_u64_le(const uint8_t *buf) {
+  uint64_t ret = 0;
+  for (int i = 7; i >= 0; --i) {
+    ret = (ret << 8) | buf[i];
+  }
+  return ret;
+}
 
-  for (uint32_t i = 0; i < bit_width; ++i) {
-    or_vector_bit(out, bit_width - i - 1, read_vector_bit(in, i));
+// Run each 4-bit chunk of `in` through the SBOX, two at a time using the
+// byte-wide table. Where `bit_width` isn't a multiple of 4 the remaining bits
+// are just copied straight through.
+static uint64_t scramble_sbox_layer(uint64_t in, uint32_t bit_width,
+                                    const uint8_t byte_sbox[256],
+                                    const uint8_t sbox[16]) {
+  uint32_t nibbles = bit_width / 4;
+  uint64_t out = in & width_mask(bit_width) & ~width_mask(4 * nibbles);
+
+  uint32_t i = 0;
+  for (; i + 2 <= nibbles; i += 2) {
+    out |= (uint64_t)byte_sbox[(in >> (4 * i)) & 0xff] << (4 * i);
+  }
+  if (i < nibbles) {
+    out |= (uint64_t)sbox[(in >> (4 * i)) & 0xf] << (4 * i);
   }
 
   return out;
 }
 
-// Apply butterfly to incoming byte vector. Even bits are placed in the lower
-// half of the output, odd bits are placed in the upper half of the output.
-static std::vector<uint8_t> scramble_perm_layer(const std::vector<uint8_t> &in,
-                                                uint32_t bit_width,
-                                                bool invert) {
-  assert(in.size() == ((bit_width + 7) / 8));
-  std::vector<uint8_t> out(in.size(), 0);
-
-  for (uint32_t i = 0; i < bit_width / 2; ++i) {
-    if (invert) {
-      or_vector_bit(out, i * 2, read_vector_bit(in, i));
-      or_vector_bit(out, i * 2 + 1, read_vector_bit(in, i + (bit_width / 2)));
-    } else {
-      or_vector_bit(out, i, read_vector_bit(in, i * 2));
-      or_vector_bit(out, i + (bit_width / 2), read_vector_bit(in, i * 2 + 1));
-    }
-  }
+// Reverse the bottom bit_width bits of `in`
+static uint64_t scramble_flip_layer(uint64_t in, uint32_t bit_width) {
+  assert(0 < bit_width && bit_width <= 64);
 
-  if (bit_width % 2) {
-    // Where bit_width isn't even, the final bit is copied across to the same
-    // position
-    or_vector_bit(out, bit_width - 1, read_vector_bit(in, bit_width - 1));
+  uint64_t x = __builtin_bswap64(in & width_mask(bit_width));
+  x = ((x >> 4) & 0x0f0f0f0f0f0f0f0full) | ((x & 0x0f0f0f0f0f0f0f0full) << 4);
+  x = ((x >> 2) & 0x3333333333333333ull) | ((x & 0x3333333333333333ull) << 2);
+  x = ((x >> 1) & 0x5555555555555555ull) | ((x & 0x5555555555555555ull) << 1);
+
+  return x >> (64 - bit_width);
+}
+
+// Apply butterfly to `in`. Even bits are placed in the lower half of the
+// output, odd bits are placed in the upper half of the output. Where
+// bit_width isn't even, the final bit is copied across to the same position.
+//
+// This is done with a perfect outer unshuffle (or shuffle if invert is true)
+// of a 64-bit word, built from delta swaps. The unshuffle gathers even bits in
+// the bottom 32 bits and odd bits in the top 32 bits.
+static uint64_t scramble_perm_layer(uint64_t in, uint32_t bit_width,
+                                    bool invert) {
+  uint32_t half = bit_width / 2;
+  uint64_t half_mask = width_mask(half);
+  uint64_t out = in & width_mask(bit_width) & ~width_mask(2 * half);
+
+  if (invert) {
+    uint64_t x = (in & half_mask) | (((in >> half) & half_mask) << 32);
+    x = bit_permute_step(x, 0x00000000ffff0000ull, 16);
+    x = bit_permute_step(x, 0x0000ff000000ff00ull, 8);
+    x = bit_permute_step(x, 0x00f000f000f000f0ull, 4);
+    x = bit_permute_step(x, 0x0c0c0c0c0c0c0c0cull, 2);
+    x = bit_permute_step(x, 0x2222222222222222ull, 1);
+    out |= x & width_mask(2 * half);
+  } else {
+    uint64_t x = in & width_mask(2 * half);
+    x = bit_permute_step(x, 0x2222222222222222ull, 1);
+    x = bit_permute_step(x, 0x0c0c0c0c0c0c0c0cull, 2);
+    x = bit_permute_step(x, 0x00f000f000f000f0ull, 4);
+    x = bit_permute_step(x, 0x0000ff000000ff00ull, 8);
+    x = bit_permute_step(x, 0x00000000ffff0000ull, 16);
+    out |= (x & half_mask) | (((x >> 32) & half_mask) << half);
   }
 
   return out;
 }
 
-// Apply a full set of subsitution/permutation rounds for encrypt to the
-// incoming byte vector
-static std::vector<uint8_t> scramble_subst_perm_enc(
-    const std::vector<uint8_t> &in, const std::vector<uint8_t> &key,
-    uint32_t bit_width, uint32_t num_rounds) {
-  assert(in.size() == ((bit_width + 7) / 8));
-  assert(key.size() == ((bit_width + 7) / 8));
-
-  std::vector<uint8_t> state(in);
+// Apply a full set of subsitution/permutation rounds for encrypt
+static uint64_t scramble_subst_perm_enc(uint64_t in, uint64_t key,
+                                        uint32_t bit_width,
+                                        uint32_t num_rounds) {
+  const ByteSboxes &sboxes = get_byte_sboxes();
+  uint64_t state = in;
 
   for (uint32_t i = 0; i < num_rounds; ++i) {
-    state = xor_vectors(state, key);
+    state ^= key;
 
-    state = scramble_sbox_layer(state, bit_width, PRESENT_SBOX4);
+    state = scramble_sbox_layer(state, bit_width, sboxes.enc, PRESENT_SBOX4);
     state = scramble_flip_layer(state, bit_width);
     state = scramble_perm_layer(state, bit_width, false);
   }
 
-  state = xor_vectors(state, key);
-
-  return state;
+  return state ^ key;
 }
 
-// Apply a full set of substitution/permutation rounds for decrypt to the
-// incoming byte vector
-static std::vector<uint8_t> scramble_subst_perm_dec(
-    const std::vector<uint8_t> &in, const std::vector<uint8_t> &key,
-    uint32_t bit_width, uint32_t num_rounds) {
-  assert(in.size() == ((bit_width + 7) / 8));
-  assert(key.size() == ((bit_width + 7) / 8));
-
-  std::vector<uint8_t> state(in);
+// Apply a full set of substitution/permutation rounds for decrypt
+static uint64_t scramble_subst_perm_dec(uint64_t in, uint64_t key,
+                                        uint32_t bit_width,
+                                        uint32_t num_rounds) {
+  const ByteSboxes &sboxes = get_byte_sboxes();
+  uint64_t state = in;
 
   for (uint32_t i = 0; i < num_rounds; ++i) {
-    state = xor_vectors(state, key);
+    state ^= key;
 
     state = scramble_perm_layer(state, bit_width, true);
     state = scramble_flip_layer(state, bit_width);
-    state = scramble_sbox_layer(state, bit_width, PRESENT_SBOX4_INV);
+    state =
+        scramble_sbox_layer(state, bit_width, sboxes.dec, PRESENT_SBOX4_INV);
   }
 
-  state = xor_vectors(state, key);
-
-  return state;
+  return state ^ key;
 }
 
-// Generate a keystream for XORing with data using PRINCE.
-// If repeat_keystream is set to true, the output from one PRINCE instance is
-// repeated when the keystream is greater than a single PRINCE width (64bit).
-// Otherwise, multiple PRINCEs are instantiated to form the keystream.
-static std::vector<uint8_t> scramble_gen_keystream(
-    const std::vector<uint8_t> &addr, uint32_t addr_width,
-    const std::vector<uint8_t> &nonce, const std::vector<uint8_t> &key,
-    uint32_t keystream_width, uint32_t num_half_rounds, bool repeat_keystream) {
-  assert(key.size() == (kPrinceWidthByte * 2));
+// XOR the keystream for addr into buf, which is keystream_width bits long.
+// The keystream is generated using PRINCE. If repeat_keystream is set to
+// true, the output from one PRINCE instance is repeated when the keystream is
+// greater than a single PRINCE width (64bit). Otherwise, multiple PRINCEs are
+// instantiated to form the keystream.
+static void scramble_xor_keystream(uint8_t *buf, uint64_t addr,
+                                   uint32_t addr_width, const uint8_t *nonce,
+                                   const uint8_t key[kPrinceWidthByte * 2],
+                                   uint32_t keystream_width,
+                                   bool repeat_keystream) {
+  assert(addr_width < kPrinceWidth);
 
   // Determine how many PRINCE replications are required
-  uint32_t num_princes, num_repetitions;
-  if (repeat_keystream) {
-    num_princes = 1;
-    num_repetitions = (keystream_width + kPrinceWidth - 1) / kPrinceWidth;
-  } else {
-    num_princes = (keystream_width + kPrinceWidth - 1) / kPrinceWidth;
-    num_repetitions = 1;
-  }
+  uint32_t num_blocks = (keystream_width + kPrinceWidth - 1) / kPrinceWidth;
+  uint32_t num_princes = repeat_keystream ? 1 : num_blocks;
 
-  std::vector<uint8_t> keystream;
-
-  for (uint32_t i = 0; i < num_princes; ++i) {
-    // Initial vector is data for PRINCE to encrypt. Formed from nonce and data
-    // address
-    std::vector<uint8_t> iv(8, 0);
-
-    for (uint32_t j = 0; j < kPrinceWidth; ++j) {
-      if (j < addr_width) {
-        // Bottom addr_width bits of IV are address
-        or_vector_bit(iv, j, read_vector_bit(addr, j));
-      } else {
-        // Other bits are taken from nonce. Each PRINCE instantiation will use
-        // different nonce bits.
-        int nonce_bit = (j - addr_width) + i * (kPrinceWidth - addr_width);
-        or_vector_bit(iv, j, read_vector_bit(nonce, nonce_bit));
-      }
+  // The key is little-endian, so the top 64 bits are K0 and the bottom 64
+  // bits are K1.
+  uint64_t k0 = read_u64_le(key + kPrinceWidthByte);
+  uint64_t k1 = read_u64_le(key);
+
+  uint32_t keystream_bytes = (keystream_width + 7) / 8;
+  uint64_t keystream_block = 0;
+
+  for (uint32_t i = 0; i < num_blocks; ++i) {
+    if (i < num_princes) {
+      // Initial vector is data for PRINCE to encrypt. The bottom addr_width
+      // bits are the address. Other bits are taken from nonce. Each PRINCE
+      // instantiation will use different nonce bits.
+      uint32_t nonce_bits = kPrinceWidth - addr_width;
+      uint64_t iv = (addr & width_mask(addr_width)) |
+                    (read_buf_bits(nonce, i * nonce_bits, nonce_bits)
+                     << addr_width);
+
+      keystream_block =
+          prince_encrypt_fast(iv, k0, k1, kNumPrinceHalfRounds);
     }
 
-    // PRINCE C reference model works on big-endian byte order
-    iv = byte_reverse_vector(iv);
-    auto key_be = byte_reverse_vector(key);
-
-    // Apply PRINCE to IV to produce keystream
-    std::vector<uint8_t> keystream_block(kPrinceWidthByte);
-    prince_enc_dec(&iv[0], &key_be[0], &keystream_block[0], 0, num_half_rounds,
-                   0);
-
-    // Flip keystream into little endian order and add to keystream vector
-    keystream_block = byte_reverse_vector(keystream_block);
-    // Repeat the output of a single PRINCE instance if needed
-    for (uint32_t k = 0; k < num_repetitions; ++k) {
-      keystream.insert(keystream.end(), keystream_block.begin(),
-                       keystream_block.end());
+    // XOR the block into buf, dropping any bytes past the end of the
+    // keystream and any unused top bits in the final byte.
+    for (uint32_t j = 0; j < kPrinceWidthByte; ++j) {
+      uint32_t byte_idx = i * kPrinceWidthByte + j;
+      if (byte_idx >= keystream_bytes)
+        break;
+
+      uint8_t ks_byte = keystream_block >> (8 * j);
+      if (byte_idx == keystream_bytes - 1 && (keystream_width % 8)) {
+        ks_byte &= (1 << (keystream_width % 8)) - 1;
+      }
+      buf[byte_idx] ^= ks_byte;
     }
   }
+}
 
-  // Total keystream bits generated are some multiple of kPrinceWidth. This can
-  // result in unused keystream bits. Remove the unused bytes from the keystream
-  // vector and zero out top unused bits in the final byte if required.
-  uint32_t keystream_bytes = (keystream_width + 7) / 8;
-  uint32_t keystream_bytes_to_erase = keystream.size() - keystream_bytes;
-  if (keystream_bytes_to_erase) {
-    keystream.erase(keystream.end() - keystream_bytes_to_erase,
-                    keystream.end());
-  }
+uint32_t scramble_addr_int(uint32_t addr, uint32_t addr_width,
+                           const uint8_t *nonce, uint32_t nonce_width) {
+  assert(addr_width <= 32 && addr_width <= nonce_width);
 
-  if (keystream_width % 8) {
-    keystream[keystream.size() - 1] &= (1 << (keystream_width % 8)) - 1;
-  }
+  // Address is scrambled by using substitution/permutation layer with the top
+  // addr_width bits of the nonce used as a key.
+  uint64_t key = read_buf_bits(nonce, nonce_width - addr_width, addr_width);
 
-  return keystream;
+  return scramble_subst_perm_enc(addr & width_mask(addr_width), key,
+                                 addr_width, kNumAddrSubstPermRounds);
 }
 
-// Split incoming data into subst_perm_width chunks and individually apply the
-// substitution/permutation layer to each
-static std::vector<uint8_t> scramble_subst_perm_full_width(
-    const std::vector<uint8_t> &in, uint32_t bit_width,
-    uint32_t subst_perm_width, bool enc) {
-  assert(in.size() == ((bit_width + 7) / 8));
+void scramble_subst_perm_data_buf(const uint8_t *data_in, uint8_t *data_out,
+                                  uint32_t data_width,
+                                  uint32_t subst_perm_width, bool enc) {
+  assert(0 < subst_perm_width && subst_perm_width <= 64);
 
-  // Determine how many bytes each subst_perm_width chunk is and how many
-  // chunks are needed to cover the full bit_width.
-  uint32_t subst_perm_bytes = (subst_perm_width + 7) / 8;
-  uint32_t subst_perm_blocks =
-      (bit_width + subst_perm_width - 1) / subst_perm_width;
+  // Split incoming data into subst_perm_width chunks and individually apply
+  // the substitution/permutation layer to each. Where data_width does not
+  // evenly divide into subst_perm_width the final block is smaller.
+  for (uint32_t lo = 0; lo < data_width; lo += subst_perm_width) {
+    uint32_t block_width = std::min(subst_perm_width, data_width - lo);
+    uint64_t block = read_buf_bits(data_in, lo, block_width);
 
-  std::vector<uint8_t> out(in.size(), 0);
-  std::vector<uint8_t> zero_key(subst_perm_bytes, 0);
+    block = enc ? scramble_subst_perm_enc(block, 0, block_width,
+                                          kNumDataSubstPermRounds)
+                : scramble_subst_perm_dec(block, 0, block_width,
+                                          kNumDataSubstPermRounds);
 
-  auto sp_scrambler = enc ? scramble_subst_perm_enc : scramble_subst_perm_dec;
+    write_buf_bits(data_out, lo, block_width, block);
+  }
 
-  for (uint32_t i = 0; i < subst_perm_blocks; ++i) {
-    // Where bit_width does not evenly divide into subst_perm_width the
-    // final block is smaller.
-    uint32_t bits_so_far = subst_perm_width * i;
-    uint32_t block_width = std::min(subst_perm_width, bit_width - bits_so_far);
+  // Clear any unused bits at the top of the last byte
+  if (data_width % 8) {
+    data_out[data_width / 8] &= (1 << (data_width % 8)) - 1;
+  }
+}
 
-    std::vector<uint8_t> subst_perm_data(subst_perm_bytes, 0);
+void scramble_data_keystream_buf(uint8_t *keystream, uint32_t addr,
+                                 uint32_t addr_width, const uint8_t *nonce,
+                                 const uint8_t key[kPrinceWidthByte * 2],
+                                 uint32_t data_width, bool repeat_keystream) {
+  memset(keystream, 0, (data_width + 7) / 8);
+  scramble_xor_keystream(keystream, addr, addr_width, nonce, key, data_width,
+                         repeat_keystream);
+}
 
-    // Extract bits from in for this chunk
-    for (uint32_t j = 0; j < block_width; ++j) {
-      or_vector_bit(subst_perm_data, j,
-                    read_vector_bit(in, j + i * subst_perm_width));
-    }
+void scramble_encrypt_data_buf(const uint8_t *data_in, uint8_t *data_out,
+                               uint32_t data_width, uint32_t subst_perm_width,
+                               uint32_t addr, uint32_t addr_width,
+                               const uint8_t *nonce,
+                               const uint8_t key[kPrinceWidthByte * 2],
+                               bool repeat_keystream) {
+  // Data is encrypted by XORing with keystream then applying
+  // substitution/permutation layer
+  if (data_out != data_in) {
+    memcpy(data_out, data_in, (data_width + 7) / 8);
+  }
+  scramble_xor_keystream(data_out, addr, addr_width, nonce, key, data_width,
+                         repeat_keystream);
+  scramble_subst_perm_data_buf(data_out, data_out, data_width,
+                               subst_perm_width, true);
+}
 
-    // Apply the substitution/permutation layer to the chunk
-    auto subst_perm_out = sp_scrambler(subst_perm_data, zero_key, block_width,
-                                       kNumDataSubstPermRounds);
+void scramble_decrypt_data_buf(const uint8_t *data_in, uint8_t *data_out,
+                               uint32_t data_width, uint32_t subst_perm_width,
+                               uint32_t addr, uint32_t addr_width,
+                               const uint8_t *nonce,
+                               const uint8_t key[kPrinceWidthByte * 2],
+                               bool repeat_keystream) {
+  // Data is decrypted by reversing substitution/permutation layer then XORing
+  // with keystream
+  scramble_subst_perm_data_buf(data_in, data_out, data_width, subst_perm_width,
+                               false);
+  scramble_xor_keystream(data_out, addr, addr_width, nonce, key, data_width,
+                         repeat_keystream);
+}
 
-    // Write the result to the `out` vector
-    for (uint32_t j = 0; j < block_width; ++j) {
-      or_vector_bit(out, j + i * subst_perm_width,
-                    read_vector_bit(subst_perm_out, j));
-    }
-  }
+// The functions below wrap the fixed-width API for callers that use byte
+// vectors.
 
-  return out;
+// Convert a little-endian byte vector holding an address of addr_width bits
+// to an integer
+static uint32_t addr_bytes_to_int(const std::vector<uint8_t> &addr,
+                                  uint32_t addr_width) {
+  assert(addr.size() == ((addr_width + 7) / 8));
+  assert(addr_width <= 32);
+
+  return read_buf_bits(&addr[0], 0, addr_width);
 }
 
 std::vector<uint8_t> scramble_addr(const std::vector<uint8_t> &addr_in,
                                    uint32_t addr_width,
                                    const std::vector<uint8_t> &nonce,
                                    uint32_t nonce_width) {
-  assert(addr_in.size() == ((addr_width + 7) / 8));
+  assert(nonce.size() * 8 >= nonce_width);
 
-  std::vector<uint8_t> addr_enc_nonce(addr_in.size(), 0);
+  uint32_t addr_out = scramble_addr_int(addr_bytes_to_int(addr_in, addr_width),
+                                        addr_width, &nonce[0], nonce_width);
 
-  // Address is scrambled by using substitution/permutation layer with the nonce
-  // used as a key.
-  // Extract relevant nonce bits for key
-  for (uint32_t i = 0; i < addr_width; ++i) {
-    or_vector_bit(addr_enc_nonce, i,
-                  read_vector_bit(nonce, nonce_width - addr_width + i));
+  std::vector<uint8_t> ret(addr_in.size());
+  for (size_t i = 0; i < ret.size(); ++i) {
+    ret[i] = addr_out >> (8 * i);
   }
-
-  // Apply substitution/permutation layer
-  return scramble_subst_perm_enc(addr_in, addr_enc_nonce, addr_width,
-                                 kNumAddrSubstPermRounds);
+  return ret;
 }
 
 std::vector<uint8_t> scramble_encrypt_data(
@@ -324,19 +454,13 @@ std::vector<uint8_t> scramble_encrypt_data(
     uint32_t addr_width, const std::vector<uint8_t> &nonce,
     const std::vector<uint8_t> &key, bool repeat_keystream) {
   assert(data_in.size() == ((data_width + 7) / 8));
-  assert(addr.size() == ((addr_width + 7) / 8));
-
-  // Data is encrypted by XORing with keystream then applying
-  // substitution/permutation layer
-
-  auto keystream =
-      scramble_gen_keystream(addr, addr_width, nonce, key, data_width,
-                             kNumPrinceHalfRounds, repeat_keystream);
-
-  auto data_enc = xor_vectors(data_in, keystream);
+  assert(key.size() == (kPrinceWidthByte * 2));
 
-  return scramble_subst_perm_full_width(data_enc, data_width, subst_perm_width,
-                                        true);
+  std::vector<uint8_t> ret(data_in.size());
+  scramble_encrypt_data_buf(&data_in[0], &ret[0], data_width, subst_perm_width,
+                            addr_bytes_to_int(addr, addr_width), addr_width,
+                            &nonce[0], &key[0], repeat_keystream);
+  return ret;
 }
 
 std::vector<uint8_t> scramble_decrypt_data(
@@ -345,18 +469,37 @@ std::vector<uint8_t> scramble_decrypt_data(
     uint32_t addr_width, const std::vector<uint8_t> &nonce,
     const std::vector<uint8_t> &key, bool repeat_keystream) {
   assert(data_in.size() == ((data_width + 7) / 8));
-  assert(addr.size() == ((addr_width + 7) / 8));
+  assert(key.size() == (kPrinceWidthByte * 2));
 
-  // Data is decrypted by reversing substitution/permutation layer then XORing
-  // with keystream
-  auto data_sp_out = scramble_subst_perm_full_width(data_in, data_width,
-                                                    subst_perm_width, false);
+  std::vector<uint8_t> ret(data_in.size());
+  scramble_decrypt_data_buf(&data_in[0], &ret[0], data_width, subst_perm_width,
+                            addr_bytes_to_int(addr, addr_width), addr_width,
+                            &nonce[0], &key[0], repeat_keystream);
+  return ret;
+}
+
+std::vector<uint8_t> scramble_data_keystream(const std::vector<uint8_t> &addr,
+                                             uint32_t addr_width,
+                                             const std::vector<uint8_t> &nonce,
+                                             const std::vector<uint8_t> &key,
+                                             uint32_t data_width,
+                                             bool repeat_keystream) {
+  assert(key.size() == (kPrinceWidthByte * 2));
 
-  auto keystream =
-      scramble_gen_keystream(addr, addr_width, nonce, key, data_width,
-                             kNumPrinceHalfRounds, repeat_keystream);
+  std::vector<uint8_t> ret((data_width + 7) / 8);
+  scramble_data_keystream_buf(&ret[0], addr_bytes_to_int(addr, addr_width),
+                              addr_width, &nonce[0], &key[0], data_width,
+                              repeat_keystream);
+  return ret;
+}
 
-  auto data_dec = xor_vectors(data_sp_out, keystream);
+std::vector<uint8_t> scramble_subst_perm_data(
+    const std::vector<uint8_t> &data_in, uint32_t data_width,
+    uint32_t subst_perm_width, bool enc) {
+  assert(data_in.size() == ((data_width + 7) / 8));
 
-  return data_dec;
+  std::vector<uint8_t> ret(data_in.size());
+  scramble_subst_perm_data_buf(&data_in[0], &ret[0], data_width,
+                               subst_perm_width, enc);
+  return ret;
 }
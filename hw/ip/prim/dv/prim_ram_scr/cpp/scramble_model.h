@@ -13,6 +13,12 @@ const uint32_t kPrinceWidthByte = kPrinceWidth / 8;
 
 // C++ model of memory scrambling. All byte vectors are in little endian byte
 // order (least significant byte at index 0).
+//
+// There are two versions of the API. The functions that take and return
+// std::vector<uint8_t> are convenient for one-off use. The "fixed-width"
+// functions further down work on integers and caller-provided buffers, never
+// allocate and are much faster. The vector functions are thin wrappers around
+// them.
 
 /** Scramble an address to give the physical address used to access the
  * scrambled memory. Return vector of scrambled address bytes
@@ -68,4 +74,101 @@ std::vector<uint8_t> scramble_encrypt_data(
     uint32_t addr_width, const std::vector<uint8_t> &nonce,
     const std::vector<uint8_t> &key, bool repeat_keystream);
 
+/** Generate the keystream that is XORed with data at a given address
+ *
+ * scramble_encrypt_data() is equivalent to XORing the data with this
+ * keystream and then calling scramble_subst_perm_data() with enc = true.
+ * Splitting the two steps lets a caller that accesses the same address many
+ * times under one key and nonce compute the keystream once.
+ *
+ * @param addr             Byte vector of data address
+ * @param addr_width       Width of the address in bits
+ * @param nonce            Byte vector of scrambling nonce
+ * @param key              Byte vector of scrambling key
+ * @param data_width       Width of data (and so of the keystream) in bits
+ * @param repeat_keystream As for scramble_encrypt_data()
+ * @return Byte vector with the keystream
+ */
+std::vector<uint8_t> scramble_data_keystream(const std::vector<uint8_t> &addr,
+                                             uint32_t addr_width,
+                                             const std::vector<uint8_t> &nonce,
+                                             const std::vector<uint8_t> &key,
+                                             uint32_t data_width,
+                                             bool repeat_keystream);
+
+/** Apply the data substitution/permutation network
+ *
+ * This is the part of scramble_encrypt_data() (enc = true) or
+ * scramble_decrypt_data() (enc = false) that doesn't depend on the address,
+ * nonce or key.
+ *
+ * @param data_in          Byte vector of data
+ * @param data_width       Width of data in bits
+ * @param subst_perm_width Width over which the substitution/permutation network
+ *                         is applied (DiffWidth parameter on prim_ram_1p_scr)
+ * @param enc              True to encrypt, false to decrypt
+ * @return Byte vector with the result
+ */
+std::vector<uint8_t> scramble_subst_perm_data(
+    const std::vector<uint8_t> &data_in, uint32_t data_width,
+    uint32_t subst_perm_width, bool enc);
+
+// Fixed-width API. Buffers are little endian, like the byte vectors above.
+// Addresses are at most 32 bits wide and the substitution/permutation network
+// is applied to chunks of at most 64 bits. A buffer holding an n-bit value
+// must be (n + 7) / 8 bytes long. Unused bits at the top of the last byte of
+// an output buffer are cleared.
+
+/** Scramble an address, as scramble_addr()
+ *
+ * @param addr         Address (only the bottom addr_width bits are used)
+ * @param addr_width   Width of the address in bits (at most 32)
+ * @param nonce        Buffer with the scrambling nonce
+ * @param nonce_width  Width of scramble nonce in bits
+ * @return Scrambled address
+ */
+uint32_t scramble_addr_int(uint32_t addr, uint32_t addr_width,
+                           const uint8_t *nonce, uint32_t nonce_width);
+
+/** Apply the data substitution/permutation network, as
+ * scramble_subst_perm_data()
+ *
+ * data_in and data_out may point at the same buffer.
+ */
+void scramble_subst_perm_data_buf(const uint8_t *data_in, uint8_t *data_out,
+                                  uint32_t data_width,
+                                  uint32_t subst_perm_width, bool enc);
+
+/** Generate the keystream for an address, as scramble_data_keystream()
+ *
+ * keystream must be (data_width + 7) / 8 bytes long. key is
+ * kPrinceWidthByte * 2 bytes long.
+ */
+void scramble_data_keystream_buf(uint8_t *keystream, uint32_t addr,
+                                 uint32_t addr_width, const uint8_t *nonce,
+                                 const uint8_t key[kPrinceWidthByte * 2],
+                                 uint32_t data_width, bool repeat_keystream);
+
+/** Encrypt scrambled data, as scramble_encrypt_data()
+ *
+ * data_in and data_out may point at the same buffer.
+ */
+void scramble_encrypt_data_buf(const uint8_t *data_in, uint8_t *data_out,
+                               uint32_t data_width, uint32_t subst_perm_width,
+                               uint32_t addr, uint32_t addr_width,
+                               const uint8_t *nonce,
+                               const uint8_t key[kPrinceWidthByte * 2],
+                               bool repeat_keystream);
+
+/** Decrypt scrambled data, as scramble_decrypt_data()
+ *
+ * data_in and data_out may point at the same buffer.
+ */
+void scramble_decrypt_data_buf(const uint8_t *data_in, uint8_t *data_out,
+                               uint32_t data_width, uint32_t subst_perm_width,
+                               uint32_t addr, uint32_t addr_width,
+                               const uint8_t *nonce,
+                               const uint8_t key[kPrinceWidthByte * 2],
+                               bool repeat_keystream);
+
 #endif  // OPENTITAN_HW_IP_PRIM_DV_PRIM_RAM_SCR_CPP_SCRAMBLE_MODEL_H_
@@ -0,0 +1,177 @@
+// Copyright lowRISC contributors.
+// Licensed under the Apache License, Version 2.0, see LICENSE for details.
+// SPDX-License-Identifier: Apache-2.0
+
+#include "scramble_model.h"
+
+#include <cstdint>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace {
+
+struct ScrambleConfig {
+  uint32_t addr_width;
+  uint32_t data_width;
+  uint32_t subst_perm_width;
+  uint32_t nonce_width;
+  bool repeat_keystream;
+};
+
+// Main RAM: 32-bit words, each with 7 ECC bits
+const ScrambleConfig kMainRam = {15, 39, 39, 64, true};
+
+// A wide memory like OTBN's DMEM: 256-bit words with ECC, using a separate
+// PRINCE instance for each 64 bits of keystream
+const ScrambleConfig kWideMem = {7, 312, 39, 320, false};
+
+struct GoldenWord {
+  uint32_t addr;
+  uint32_t scr_addr;
+  std::vector<uint8_t> enc_data;
+};
+
+// Generated with the original bit-serial model (before the fixed-width
+// kernels), using the key, nonce and data from Pattern() below.
+const GoldenWord kMainRamGolden[] = {
+    {0x0, 0x556e, {0xf8, 0x19, 0xed, 0xc7, 0x10}},
+    {0x1, 0x55ef, {0x47, 0x08, 0x46, 0x89, 0x65}},
+    {0x2a5c, 0x5e74, {0x23, 0x10, 0xe3, 0xab, 0x10}},
+    {0x7fff, 0x56b1, {0x0b, 0x00, 0xe8, 0xaa, 0x22}},
+};
+
+const GoldenWord kWideMemGolden[] = {
+    {0x0, 0x49, {0x99, 0xb2, 0x9f, 0x8e, 0xa6, 0x44, 0x1b, 0xd5, 0x5f, 0x58,
+                 0xbe, 0x3a, 0x73, 0x2c, 0x6e, 0x0a, 0x42, 0x9f, 0xbb, 0xc9,
+                 0x74, 0x30, 0x8a, 0xef, 0x25, 0x4c, 0x1a, 0x99, 0xa0, 0xfb,
+                 0xa9, 0xb9, 0xa0, 0xc5, 0x9d, 0x96, 0x43, 0x3b, 0xbf}},
+    {0x1, 0x4a, {0xed, 0xf5, 0x9e, 0x63, 0xf9, 0xf9, 0xee, 0xa3, 0xba, 0xe8,
+                 0x77, 0xd8, 0x01, 0x80, 0xe2, 0x3d, 0x59, 0x70, 0x99, 0x45,
+                 0xc4, 0x91, 0xec, 0x8d, 0x68, 0x71, 0x39, 0xff, 0xed, 0x40,
+                 0xf8, 0x10, 0x9f, 0x86, 0x67, 0xb4, 0x0d, 0xf3, 0xc2}},
+    {0x55, 0x5b, {0xe0, 0x66, 0x5a, 0x22, 0xca, 0x43, 0x2d, 0x20, 0xcf, 0x46,
+                  0x3e, 0xe9, 0x50, 0x74, 0xdb, 0x71, 0x9d, 0x4c, 0x7c, 0x78,
+                  0xaa, 0x88, 0x2d, 0x25, 0x0b, 0x68, 0x5f, 0x3f, 0x5f, 0x5d,
+                  0x10, 0x84, 0x47, 0x46, 0xfc, 0x10, 0xd3, 0x18, 0xe6}},
+    {0x7f, 0x2, {0x76, 0x2a, 0xb3, 0x3c, 0x8a, 0x0f, 0x19, 0x31, 0x89, 0x9e,
+                 0xd2, 0x10, 0x2f, 0x3c, 0x94, 0xdc, 0x2f, 0x30, 0xd4, 0xd9,
+                 0x47, 0x9f, 0x61, 0x9b, 0xba, 0xdd, 0x81, 0x0a, 0x83, 0x67,
+                 0xc0, 0x62, 0xf9, 0x92, 0x1d, 0x20, 0xdf, 0x98, 0xde}},
+};
+
+// Return a width-bit value with byte i set to seed + i * mul
+std::vector<uint8_t> Pattern(uint32_t seed, uint32_t mul, uint32_t width) {
+  std::vector<uint8_t> ret((width + 7) / 8);
+  for (size_t i = 0; i < ret.size(); ++i) {
+    ret[i] = (seed + i * mul) & 0xff;
+  }
+  if (width % 8) {
+    ret.back() &= (1 << (width % 8)) - 1;
+  }
+  return ret;
+}
+
+std::vector<uint8_t> Key() { return Pattern(0x5a, 0x3b, kPrinceWidth * 2); }
+
+std::vector<uint8_t> Nonce(const ScrambleConfig &cfg) {
+  return Pattern(0x13, 0x71, cfg.nonce_width);
+}
+
+std::vector<uint8_t> Data(const ScrambleConfig &cfg, uint32_t addr) {
+  return Pattern(addr * 0x1f + 0x2d, 0x47, cfg.data_width);
+}
+
+std::vector<uint8_t> AddrBytes(const ScrambleConfig &cfg, uint32_t addr) {
+  std::vector<uint8_t> ret((cfg.addr_width + 7) / 8);
+  for (size_t i = 0; i < ret.size(); ++i) {
+    ret[i] = addr >> (8 * i);
+  }
+  return ret;
+}
+
+uint32_t AddrInt(const std::vector<uint8_t> &addr) {
+  uint32_t ret = 0;
+  for (size_t i = 0; i < addr.size(); ++i) {
+    ret |= (uint32_t)addr[i] << (8 * i);
+  }
+  return ret;
+}
+
+// Scramble and unscramble a word with the byte vector API and the fixed-width
+// API. Check that they agree with each other and with the expected scrambled
+// address and data.
+void CheckWord(const ScrambleConfig &cfg, uint32_t addr,
+               const std::vector<uint8_t> &data, uint32_t exp_scr_addr,
+               const std::vector<uint8_t> &exp_enc_data) {
+  std::vector<uint8_t> key = Key();
+  std::vector<uint8_t> nonce = Nonce(cfg);
+  std::vector<uint8_t> addr_bytes = AddrBytes(cfg, addr);
+
+  EXPECT_EQ(AddrInt(scramble_addr(addr_bytes, cfg.addr_width, nonce,
+                                  cfg.nonce_width)),
+            exp_scr_addr);
+  EXPECT_EQ(scramble_addr_int(addr, cfg.addr_width, &nonce[0], cfg.nonce_width),
+            exp_scr_addr);
+
+  std::vector<uint8_t> enc_data = scramble_encrypt_data(
+      data, cfg.data_width, cfg.subst_perm_width, addr_bytes, cfg.addr_width,
+      nonce, key, cfg.repeat_keystream);
+  EXPECT_EQ(enc_data, exp_enc_data);
+  EXPECT_EQ(scramble_decrypt_data(enc_data, cfg.data_width,
+                                  cfg.subst_perm_width, addr_bytes,
+                                  cfg.addr_width, nonce, key,
+                                  cfg.repeat_keystream),
+            data);
+
+  // The fixed-width API, working in place
+  std::vector<uint8_t> buf = data;
+  scramble_encrypt_data_buf(&buf[0], &buf[0], cfg.data_width,
+                            cfg.subst_perm_width, addr, cfg.addr_width,
+                            &nonce[0], &key[0], cfg.repeat_keystream);
+  EXPECT_EQ(buf, exp_enc_data);
+  scramble_decrypt_data_buf(&buf[0], &buf[0], cfg.data_width,
+                            cfg.subst_perm_width, addr, cfg.addr_width,
+                            &nonce[0], &key[0], cfg.repeat_keystream);
+  EXPECT_EQ(buf, data);
+}
+
+TEST(ScrambleModelTest, MainRamMatchesGolden) {
+  for (const GoldenWord &word : kMainRamGolden) {
+    SCOPED_TRACE(word.addr);
+    CheckWord(kMainRam, word.addr, Data(kMainRam, word.addr), word.scr_addr,
+              word.enc_data);
+  }
+}
+
+TEST(ScrambleModelTest, WideMemMatchesGolden) {
+  for (const GoldenWord &word : kWideMemGolden) {
+    SCOPED_TRACE(word.addr);
+    CheckWord(kWideMem, word.addr, Data(kWideMem, word.addr), word.scr_addr,
+              word.enc_data);
+  }
+}
+
+// Check the APIs against each other for every address of the wide memory and
+// a sample of main RAM addresses
+TEST(ScrambleModelTest, FixedWidthMatchesVectorApi) {
+  for (const ScrambleConfig &cfg : {kMainRam, kWideMem}) {
+    std::vector<uint8_t> key = Key();
+    std::vector<uint8_t> nonce = Nonce(cfg);
+    uint32_t num_words = 1u << cfg.addr_width;
+
+    for (uint32_t addr = 0; addr < num_words; addr += 1 + addr / 8) {
+      SCOPED_TRACE(addr);
+      std::vector<uint8_t> addr_bytes = AddrBytes(cfg, addr);
+      std::vector<uint8_t> data = Data(cfg, addr);
+      std::vector<uint8_t> enc_data = scramble_encrypt_data(
+          data, cfg.data_width, cfg.subst_perm_width, addr_bytes,
+          cfg.addr_width, nonce, key, cfg.repeat_keystream);
+      uint32_t scr_addr = AddrInt(
+          scramble_addr(addr_bytes, cfg.addr_width, nonce, cfg.nonce_width));
+      CheckWord(cfg, addr, data, scr_addr, enc_data);
+    }
+  }
+}
+
+}  // namespace
@@ -11,23 +11,33 @@
 #include <stdint.h>
 
 // Calculates even parity for a 64-bit word
-static uint8_t calc_parity(uint64_t word, bool invert) {
-  bool parity = false;
+static inline uint8_t calc_parity(uint64_t word, bool invert) {
+#if defined(__GNUC__) || defined(__clang__)
+  return (uint8_t)__builtin_parityll(word) ^ invert;
+#else
+  // Fold the word in half until the parity is in the bottom bit
+  word ^= word >> 32;
+  word ^= word >> 16;
+  word ^= word >> 8;
+  word ^= word >> 4;
+  word ^= word >> 2;
+  word ^= word >> 1;
+  return (uint8_t)(word & 1) ^ invert;
+#endif
+}
 
-  while (word) {
-    if (word & 1) {
-      parity = !parity;
+// Finds the data bit whose column of the parity check matrix matches
+// syndrome. Returns -1 if there is no such bit.
+static int find_data_bit(const uint8_t *columns, int k, uint8_t syndrome) {
+  for (int i = 0; i < k; ++i) {
+    if (columns[i] == syndrome) {
+      return i;
     }
-
-    word >>= 1;
   }
-
-  return parity ^ invert;
+  return -1;
 }
 
-uint8_t enc_secded_22_16(const uint8_t bytes[2]) {
-  uint16_t word = ((uint16_t)bytes[0] << 0) | ((uint16_t)bytes[1] << 8);
-
+static inline uint8_t enc_secded_22_16_word(uint16_t word) {
   return (calc_parity(word & 0x496e, false) << 0) |
          (calc_parity(word & 0xf20b, false) << 1) |
          (calc_parity(word & 0x8ed8, false) << 2) |
@@ -36,10 +46,66 @@ uint8_t enc_secded_22_16(const uint8_t bytes[2]) {
          (calc_parity(word & 0x11f3, false) << 5);
 }
 
-uint8_t enc_secded_28_22(const uint8_t bytes[3]) {
-  uint32_t word = ((uint32_t)bytes[0] << 0) | ((uint32_t)bytes[1] << 8) |
-                  ((uint32_t)bytes[2] << 16);
+uint8_t enc_secded_22_16(const uint8_t bytes[2]) {
+  uint16_t word = ((uint16_t)bytes[0] << 0) | ((uint16_t)bytes[1] << 8);
+
+  return enc_secded_22_16_word(word);
+}
+
+void enc_secded_22_16_buf(const uint16_t *words, uint8_t *check_bits,
+                          size_t count) {
+  for (size_t i = 0; i < count; ++i) {
+    check_bits[i] = enc_secded_22_16_word(words[i]);
+  }
+}
+
+size_t syndrome_secded_22_16_buf(const uint16_t *words,
+                                 const uint8_t *check_bits, uint8_t *syndromes,
+                                 size_t count) {
+  size_t num_errors = 0;
+  for (size_t i = 0; i < count; ++i) {
+    uint8_t syndrome = enc_secded_22_16_word(words[i]) ^ check_bits[i];
+    if (syndromes) {
+      syndromes[i] = syndrome;
+    }
+    num_errors += (syndrome != 0);
+  }
+  return num_errors;
+}
+
+size_t dec_secded_22_16_buf(uint16_t *words, uint8_t *check_bits,
+                            uint8_t *errors, size_t count) {
+  static const uint8_t kDataSyndromes[16] = {
+      0x32, 0x23, 0x19, 0x7, 0x2c, 0x31, 0x25, 0x34, 0x29, 0xe, 0x1c, 0x15,
+      0x2a, 0x1a, 0xb, 0x16};
+  size_t num_errors = 0;
+  for (size_t i = 0; i < count; ++i) {
+    uint8_t syndrome = enc_secded_22_16_word(words[i]) ^ check_bits[i];
+    uint8_t err = 0;
+    if (syndrome) {
+      ++num_errors;
+      if (calc_parity(syndrome, false)) {
+        err = 1;
+        if ((syndrome & (syndrome - 1)) == 0) {
+          check_bits[i] ^= syndrome;
+        } else {
+          int bit = find_data_bit(kDataSyndromes, 16, syndrome);
+          if (bit >= 0) {
+            words[i] ^= (uint16_t)1 << bit;
+          }
+        }
+      } else {
+        err = 2;
+      }
+    }
+    if (errors) {
+      errors[i] = err;
+    }
+  }
+  return num_errors;
+}
 
+static inline uint8_t enc_secded_28_22_word(uint32_t word) {
   return (calc_parity(word & 0x3003ff, false) << 0) |
          (calc_parity(word & 0x10fc0f, false) << 1) |
          (calc_parity(word & 0x271c71, false) << 2) |
@@ -48,10 +114,67 @@ uint8_t enc_secded_28_22(const uint8_t bytes[3]) {
          (calc_parity(word & 0x3ed348, false) << 5);
 }
 
-uint8_t enc_secded_39_32(const uint8_t bytes[4]) {
+uint8_t enc_secded_28_22(const uint8_t bytes[3]) {
   uint32_t word = ((uint32_t)bytes[0] << 0) | ((uint32_t)bytes[1] << 8) |
-                  ((uint32_t)bytes[2] << 16) | ((uint32_t)bytes[3] << 24);
+                  ((uint32_t)bytes[2] << 16);
+
+  return enc_secded_28_22_word(word);
+}
+
+void enc_secded_28_22_buf(const uint32_t *words, uint8_t *check_bits,
+                          size_t count) {
+  for (size_t i = 0; i < count; ++i) {
+    check_bits[i] = enc_secded_28_22_word(words[i]);
+  }
+}
+
+size_t syndrome_secded_28_22_buf(const uint32_t *words,
+                                 const uint8_t *check_bits, uint8_t *syndromes,
+                                 size_t count) {
+  size_t num_errors = 0;
+  for (size_t i = 0; i < count; ++i) {
+    uint8_t syndrome = enc_secded_28_22_word(words[i]) ^ check_bits[i];
+    if (syndromes) {
+      syndromes[i] = syndrome;
+    }
+    num_errors += (syndrome != 0);
+  }
+  return num_errors;
+}
 
+size_t dec_secded_28_22_buf(uint32_t *words, uint8_t *check_bits,
+                            uint8_t *errors, size_t count) {
+  static const uint8_t kDataSyndromes[22] = {
+      0x7, 0xb, 0x13, 0x23, 0xd, 0x15, 0x25, 0x19, 0x29, 0x31, 0xe, 0x16, 0x26,
+      0x1a, 0x2a, 0x32, 0x1c, 0x2c, 0x34, 0x38, 0x3b, 0x3d};
+  size_t num_errors = 0;
+  for (size_t i = 0; i < count; ++i) {
+    uint8_t syndrome = enc_secded_28_22_word(words[i]) ^ check_bits[i];
+    uint8_t err = 0;
+    if (syndrome) {
+      ++num_errors;
+      if (calc_parity(syndrome, false)) {
+        err = 1;
+        if ((syndrome & (syndrome - 1)) == 0) {
+          check_bits[i] ^= syndrome;
+        } else {
+          int bit = find_data_bit(kDataSyndromes, 22, syndrome);
+          if (bit >= 0) {
+            words[i] ^= (uint32_t)1 << bit;
+          }
+        }
+      } else {
+        err = 2;
+      }
+    }
+    if (errors) {
+      errors[i] = err;
+    }
+  }
+  return num_errors;
+}
+
+static inline uint8_t enc_secded_39_32_word(uint32_t word) {
   return (calc_parity(word & 0x2606bd25, false) << 0) |
          (calc_parity(word & 0xdeba8050, false) << 1) |
          (calc_parity(word & 0x413d89aa, false) << 2) |
@@ -61,12 +184,68 @@ uint8_t enc_secded_39_32(const uint8_t bytes[4]) {
          (calc_parity(word & 0x98505586, false) << 6);
 }
 
-uint8_t enc_secded_64_57(const uint8_t bytes[8]) {
-  uint64_t word = ((uint64_t)bytes[0] << 0) | ((uint64_t)bytes[1] << 8) |
-                  ((uint64_t)bytes[2] << 16) | ((uint64_t)bytes[3] << 24) |
-                  ((uint64_t)bytes[4] << 32) | ((uint64_t)bytes[5] << 40) |
-                  ((uint64_t)bytes[6] << 48) | ((uint64_t)bytes[7] << 56);
+uint8_t enc_secded_39_32(const uint8_t bytes[4]) {
+  uint32_t word = ((uint32_t)bytes[0] << 0) | ((uint32_t)bytes[1] << 8) |
+                  ((uint32_t)bytes[2] << 16) | ((uint32_t)bytes[3] << 24);
+
+  return enc_secded_39_32_word(word);
+}
 
+void enc_secded_39_32_buf(const uint32_t *words, uint8_t *check_bits,
+                          size_t count) {
+  for (size_t i = 0; i < count; ++i) {
+    check_bits[i] = enc_secded_39_32_word(words[i]);
+  }
+}
+
+size_t syndrome_secded_39_32_buf(const uint32_t *words,
+                                 const uint8_t *check_bits, uint8_t *syndromes,
+                                 size_t count) {
+  size_t num_errors = 0;
+  for (size_t i = 0; i < count; ++i) {
+    uint8_t syndrome = enc_secded_39_32_word(words[i]) ^ check_bits[i];
+    if (syndromes) {
+      syndromes[i] = syndrome;
+    }
+    num_errors += (syndrome != 0);
+  }
+  return num_errors;
+}
+
+size_t dec_secded_39_32_buf(uint32_t *words, uint8_t *check_bits,
+                            uint8_t *errors, size_t count) {
+  static const uint8_t kDataSyndromes[32] = {
+      0x19, 0x54, 0x61, 0x34, 0x1a, 0x15, 0x2a, 0x4c, 0x45, 0x38, 0x49, 0xd,
+      0x51, 0x31, 0x68, 0x7, 0x1c, 0xb, 0x25, 0x26, 0x46, 0xe, 0x70, 0x32, 0x2c,
+      0x13, 0x23, 0x62, 0x4a, 0x29, 0x16, 0x52};
+  size_t num_errors = 0;
+  for (size_t i = 0; i < count; ++i) {
+    uint8_t syndrome = enc_secded_39_32_word(words[i]) ^ check_bits[i];
+    uint8_t err = 0;
+    if (syndrome) {
+      ++num_errors;
+      if (calc_parity(syndrome, false)) {
+        err = 1;
+        if ((syndrome & (syndrome - 1)) == 0) {
+          check_bits[i] ^= syndrome;
+        } else {
+          int bit = find_data_bit(kDataSyndromes, 32, syndrome);
+          if (bit >= 0) {
+            words[i] ^= (uint32_t)1 << bit;
+          }
+        }
+      } else {
+        err = 2;
+      }
+    }
+    if (errors) {
+      errors[i] = err;
+    }
+  }
+  return num_errors;
+}
+
+static inline uint8_t enc_secded_64_57_word(uint64_t word) {
   return (calc_parity(word & 0x103fff800007fff, false) << 0) |
          (calc_parity(word & 0x17c1ff801ff801f, false) << 1) |
          (calc_parity(word & 0x1bde1f87e0781e1, false) << 2) |
@@ -76,12 +255,72 @@ uint8_t enc_secded_64_57(const uint8_t bytes[8]) {
          (calc_parity(word & 0x1fbdda769a46910, false) << 6);
 }
 
-uint8_t enc_secded_72_64(const uint8_t bytes[8]) {
+uint8_t enc_secded_64_57(const uint8_t bytes[8]) {
   uint64_t word = ((uint64_t)bytes[0] << 0) | ((uint64_t)bytes[1] << 8) |
                   ((uint64_t)bytes[2] << 16) | ((uint64_t)bytes[3] << 24) |
                   ((uint64_t)bytes[4] << 32) | ((uint64_t)bytes[5] << 40) |
                   ((uint64_t)bytes[6] << 48) | ((uint64_t)bytes[7] << 56);
 
+  return enc_secded_64_57_word(word);
+}
+
+void enc_secded_64_57_buf(const uint64_t *words, uint8_t *check_bits,
+                          size_t count) {
+  for (size_t i = 0; i < count; ++i) {
+    check_bits[i] = enc_secded_64_57_word(words[i]);
+  }
+}
+
+size_t syndrome_secded_64_57_buf(const uint64_t *words,
+                                 const uint8_t *check_bits, uint8_t *syndromes,
+                                 size_t count) {
+  size_t num_errors = 0;
+  for (size_t i = 0; i < count; ++i) {
+    uint8_t syndrome = enc_secded_64_57_word(words[i]) ^ check_bits[i];
+    if (syndromes) {
+      syndromes[i] = syndrome;
+    }
+    num_errors += (syndrome != 0);
+  }
+  return num_errors;
+}
+
+size_t dec_secded_64_57_buf(uint64_t *words, uint8_t *check_bits,
+                            uint8_t *errors, size_t count) {
+  static const uint8_t kDataSyndromes[57] = {
+      0x7, 0xb, 0x13, 0x23, 0x43, 0xd, 0x15, 0x25, 0x45, 0x19, 0x29, 0x49, 0x31,
+      0x51, 0x61, 0xe, 0x16, 0x26, 0x46, 0x1a, 0x2a, 0x4a, 0x32, 0x52, 0x62,
+      0x1c, 0x2c, 0x4c, 0x34, 0x54, 0x64, 0x38, 0x58, 0x68, 0x70, 0x1f, 0x2f,
+      0x4f, 0x37, 0x57, 0x67, 0x3b, 0x5b, 0x6b, 0x73, 0x3d, 0x5d, 0x6d, 0x75,
+      0x79, 0x3e, 0x5e, 0x6e, 0x76, 0x7a, 0x7c, 0x7f};
+  size_t num_errors = 0;
+  for (size_t i = 0; i < count; ++i) {
+    uint8_t syndrome = enc_secded_64_57_word(words[i]) ^ check_bits[i];
+    uint8_t err = 0;
+    if (syndrome) {
+      ++num_errors;
+      if (calc_parity(syndrome, false)) {
+        err = 1;
+        if ((syndrome & (syndrome - 1)) == 0) {
+          check_bits[i] ^= syndrome;
+        } else {
+          int bit = find_data_bit(kDataSyndromes, 57, syndrome);
+          if (bit >= 0) {
+            words[i] ^= (uint64_t)1 << bit;
+          }
+        }
+      } else {
+        err = 2;
+      }
+    }
+    if (errors) {
+      errors[i] = err;
+    }
+  }
+  return num_errors;
+}
+
+static inline uint8_t enc_secded_72_64_word(uint64_t word) {
   return (calc_parity(word & 0xb9000000001fffff, false) << 0) |
          (calc_parity(word & 0x5e00000fffe0003f, false) << 1) |
          (calc_parity(word & 0x67003ff003e007c1, false) << 2) |
@@ -92,9 +331,73 @@ uint8_t enc_secded_72_64(const uint8_t bytes[8]) {
          (calc_parity(word & 0x7aed348d221a4420, false) << 7);
 }
 
-uint8_t enc_secded_inv_22_16(const uint8_t bytes[2]) {
-  uint16_t word = ((uint16_t)bytes[0] << 0) | ((uint16_t)bytes[1] << 8);
+uint8_t enc_secded_72_64(const uint8_t bytes[8]) {
+  uint64_t word = ((uint64_t)bytes[0] << 0) | ((uint64_t)bytes[1] << 8) |
+                  ((uint64_t)bytes[2] << 16) | ((uint64_t)bytes[3] << 24) |
+                  ((uint64_t)bytes[4] << 32) | ((uint64_t)bytes[5] << 40) |
+                  ((uint64_t)bytes[6] << 48) | ((uint64_t)bytes[7] << 56);
+
+  return enc_secded_72_64_word(word);
+}
+
+void enc_secded_72_64_buf(const uint64_t *words, uint8_t *check_bits,
+                          size_t count) {
+  for (size_t i = 0; i < count; ++i) {
+    check_bits[i] = enc_secded_72_64_word(words[i]);
+  }
+}
 
+size_t syndrome_secded_72_64_buf(const uint64_t *words,
+                                 const uint8_t *check_bits, uint8_t *syndromes,
+                                 size_t count) {
+  size_t num_errors = 0;
+  for (size_t i = 0; i < count; ++i) {
+    uint8_t syndrome = enc_secded_72_64_word(words[i]) ^ check_bits[i];
+    if (syndromes) {
+      syndromes[i] = syndrome;
+    }
+    num_errors += (syndrome != 0);
+  }
+  return num_errors;
+}
+
+size_t dec_secded_72_64_buf(uint64_t *words, uint8_t *check_bits,
+                            uint8_t *errors, size_t count) {
+  static const uint8_t kDataSyndromes[64] = {
+      0x7, 0xb, 0x13, 0x23, 0x43, 0x83, 0xd, 0x15, 0x25, 0x45, 0x85, 0x19, 0x29,
+      0x49, 0x89, 0x31, 0x51, 0x91, 0x61, 0xa1, 0xc1, 0xe, 0x16, 0x26, 0x46,
+      0x86, 0x1a, 0x2a, 0x4a, 0x8a, 0x32, 0x52, 0x92, 0x62, 0xa2, 0xc2, 0x1c,
+      0x2c, 0x4c, 0x8c, 0x34, 0x54, 0x94, 0x64, 0xa4, 0xc4, 0x38, 0x58, 0x98,
+      0x68, 0xa8, 0xc8, 0x70, 0xb0, 0xd0, 0xe0, 0x6d, 0xd6, 0x3e, 0xcb, 0xb3,
+      0xb5, 0xce, 0x79};
+  size_t num_errors = 0;
+  for (size_t i = 0; i < count; ++i) {
+    uint8_t syndrome = enc_secded_72_64_word(words[i]) ^ check_bits[i];
+    uint8_t err = 0;
+    if (syndrome) {
+      ++num_errors;
+      if (calc_parity(syndrome, false)) {
+        err = 1;
+        if ((syndrome & (syndrome - 1)) == 0) {
+          check_bits[i] ^= syndrome;
+        } else {
+          int bit = find_data_bit(kDataSyndromes, 64, syndrome);
+          if (bit >= 0) {
+            words[i] ^= (uint64_t)1 << bit;
+          }
+        }
+      } else {
+        err = 2;
+      }
+    }
+    if (errors) {
+      errors[i] = err;
+    }
+  }
+  return num_errors;
+}
+
+static inline uint8_t enc_secded_inv_22_16_word(uint16_t word) {
   return (calc_parity(word & 0x496e, false) << 0) |
          (calc_parity(word & 0xf20b, true) << 1) |
          (calc_parity(word & 0x8ed8, false) << 2) |
@@ -103,10 +406,66 @@ uint8_t enc_secded_inv_22_16(const uint8_t bytes[2]) {
          (calc_parity(word & 0x11f3, true) << 5);
 }
 
-uint8_t enc_secded_inv_28_22(const uint8_t bytes[3]) {
-  uint32_t word = ((uint32_t)bytes[0] << 0) | ((uint32_t)bytes[1] << 8) |
-                  ((uint32_t)bytes[2] << 16);
+uint8_t enc_secded_inv_22_16(const uint8_t bytes[2]) {
+  uint16_t word = ((uint16_t)bytes[0] << 0) | ((uint16_t)bytes[1] << 8);
+
+  return enc_secded_inv_22_16_word(word);
+}
+
+void enc_secded_inv_22_16_buf(const uint16_t *words, uint8_t *check_bits,
+                              size_t count) {
+  for (size_t i = 0; i < count; ++i) {
+    check_bits[i] = enc_secded_inv_22_16_word(words[i]);
+  }
+}
 
+size_t syndrome_secded_inv_22_16_buf(const uint16_t *words,
+                                     const uint8_t *check_bits,
+                                     uint8_t *syndromes, size_t count) {
+  size_t num_errors = 0;
+  for (size_t i = 0; i < count; ++i) {
+    uint8_t syndrome = enc_secded_inv_22_16_word(words[i]) ^ check_bits[i];
+    if (syndromes) {
+      syndromes[i] = syndrome;
+    }
+    num_errors += (syndrome != 0);
+  }
+  return num_errors;
+}
+
+size_t dec_secded_inv_22_16_buf(uint16_t *words, uint8_t *check_bits,
+                                uint8_t *errors, size_t count) {
+  static const uint8_t kDataSyndromes[16] = {
+      0x32, 0x23, 0x19, 0x7, 0x2c, 0x31, 0x25, 0x34, 0x29, 0xe, 0x1c, 0x15,
+      0x2a, 0x1a, 0xb, 0x16};
+  size_t num_errors = 0;
+  for (size_t i = 0; i < count; ++i) {
+    uint8_t syndrome = enc_secded_inv_22_16_word(words[i]) ^ check_bits[i];
+    uint8_t err = 0;
+    if (syndrome) {
+      ++num_errors;
+      if (calc_parity(syndrome, false)) {
+        err = 1;
+        if ((syndrome & (syndrome - 1)) == 0) {
+          check_bits[i] ^= syndrome;
+        } else {
+          int bit = find_data_bit(kDataSyndromes, 16, syndrome);
+          if (bit >= 0) {
+            words[i] ^= (uint16_t)1 << bit;
+          }
+        }
+      } else {
+        err = 2;
+      }
+    }
+    if (errors) {
+      errors[i] = err;
+    }
+  }
+  return num_errors;
+}
+
+static inline uint8_t enc_secded_inv_28_22_word(uint32_t word) {
   return (calc_parity(word & 0x3003ff, false) << 0) |
          (calc_parity(word & 0x10fc0f, true) << 1) |
          (calc_parity(word & 0x271c71, false) << 2) |
@@ -115,10 +474,67 @@ uint8_t enc_secded_inv_28_22(const uint8_t bytes[3]) {
          (calc_parity(word & 0x3ed348, true) << 5);
 }
 
-uint8_t enc_secded_inv_39_32(const uint8_t bytes[4]) {
+uint8_t enc_secded_inv_28_22(const uint8_t bytes[3]) {
   uint32_t word = ((uint32_t)bytes[0] << 0) | ((uint32_t)bytes[1] << 8) |
-                  ((uint32_t)bytes[2] << 16) | ((uint32_t)bytes[3] << 24);
+                  ((uint32_t)bytes[2] << 16);
+
+  return enc_secded_inv_28_22_word(word);
+}
+
+void enc_secded_inv_28_22_buf(const uint32_t *words, uint8_t *check_bits,
+                              size_t count) {
+  for (size_t i = 0; i < count; ++i) {
+    check_bits[i] = enc_secded_inv_28_22_word(words[i]);
+  }
+}
+
+size_t syndrome_secded_inv_28_22_buf(const uint32_t *words,
+                                     const uint8_t *check_bits,
+                                     uint8_t *syndromes, size_t count) {
+  size_t num_errors = 0;
+  for (size_t i = 0; i < count; ++i) {
+    uint8_t syndrome = enc_secded_inv_28_22_word(words[i]) ^ check_bits[i];
+    if (syndromes) {
+      syndromes[i] = syndrome;
+    }
+    num_errors += (syndrome != 0);
+  }
+  return num_errors;
+}
+
+size_t dec_secded_inv_28_22_buf(uint32_t *words, uint8_t *check_bits,
+                                uint8_t *errors, size_t count) {
+  static const uint8_t kDataSyndromes[22] = {
+      0x7, 0xb, 0x13, 0x23, 0xd, 0x15, 0x25, 0x19, 0x29, 0x31, 0xe, 0x16, 0x26,
+      0x1a, 0x2a, 0x32, 0x1c, 0x2c, 0x34, 0x38, 0x3b, 0x3d};
+  size_t num_errors = 0;
+  for (size_t i = 0; i < count; ++i) {
+    uint8_t syndrome = enc_secded_inv_28_22_word(words[i]) ^ check_bits[i];
+    uint8_t err = 0;
+    if (syndrome) {
+      ++num_errors;
+      if (calc_parity(syndrome, false)) {
+        err = 1;
+        if ((syndrome & (syndrome - 1)) == 0) {
+          check_bits[i] ^= syndrome;
+        } else {
+          int bit = find_data_bit(kDataSyndromes, 22, syndrome);
+          if (bit >= 0) {
+            words[i] ^= (uint32_t)1 << bit;
+          }
+        }
+      } else {
+        err = 2;
+      }
+    }
+    if (errors) {
+      errors[i] = err;
+    }
+  }
+  return num_errors;
+}
 
+static inline uint8_t enc_secded_inv_39_32_word(uint32_t word) {
   return (calc_parity(word & 0x2606bd25, false) << 0) |
          (calc_parity(word & 0xdeba8050, true) << 1) |
          (calc_parity(word & 0x413d89aa, false) << 2) |
@@ -128,12 +544,68 @@ uint8_t enc_secded_inv_39_32(const uint8_t bytes[4]) {
          (calc_parity(word & 0x98505586, false) << 6);
 }
 
-uint8_t enc_secded_inv_64_57(const uint8_t bytes[8]) {
-  uint64_t word = ((uint64_t)bytes[0] << 0) | ((uint64_t)bytes[1] << 8) |
-                  ((uint64_t)bytes[2] << 16) | ((uint64_t)bytes[3] << 24) |
-                  ((uint64_t)bytes[4] << 32) | ((uint64_t)bytes[5] << 40) |
-                  ((uint64_t)bytes[6] << 48) | ((uint64_t)bytes[7] << 56);
+uint8_t enc_secded_inv_39_32(const uint8_t bytes[4]) {
+  uint32_t word = ((uint32_t)bytes[0] << 0) | ((uint32_t)bytes[1] << 8) |
+                  ((uint32_t)bytes[2] << 16) | ((uint32_t)bytes[3] << 24);
+
+  return enc_secded_inv_39_32_word(word);
+}
+
+void enc_secded_inv_39_32_buf(const uint32_t *words, uint8_t *check_bits,
+                              size_t count) {
+  for (size_t i = 0; i < count; ++i) {
+    check_bits[i] = enc_secded_inv_39_32_word(words[i]);
+  }
+}
+
+size_t syndrome_secded_inv_39_32_buf(const uint32_t *words,
+                                     const uint8_t *check_bits,
+                                     uint8_t *syndromes, size_t count) {
+  size_t num_errors = 0;
+  for (size_t i = 0; i < count; ++i) {
+    uint8_t syndrome = enc_secded_inv_39_32_word(words[i]) ^ check_bits[i];
+    if (syndromes) {
+      syndromes[i] = syndrome;
+    }
+    num_errors += (syndrome != 0);
+  }
+  return num_errors;
+}
+
+size_t dec_secded_inv_39_32_buf(uint32_t *words, uint8_t *check_bits,
+                                uint8_t *errors, size_t count) {
+  static const uint8_t kDataSyndromes[32] = {
+      0x19, 0x54, 0x61, 0x34, 0x1a, 0x15, 0x2a, 0x4c, 0x45, 0x38, 0x49, 0xd,
+      0x51, 0x31, 0x68, 0x7, 0x1c, 0xb, 0x25, 0x26, 0x46, 0xe, 0x70, 0x32, 0x2c,
+      0x13, 0x23, 0x62, 0x4a, 0x29, 0x16, 0x52};
+  size_t num_errors = 0;
+  for (size_t i = 0; i < count; ++i) {
+    uint8_t syndrome = enc_secded_inv_39_32_word(words[i]) ^ check_bits[i];
+    uint8_t err = 0;
+    if (syndrome) {
+      ++num_errors;
+      if (calc_parity(syndrome, false)) {
+        err = 1;
+        if ((syndrome & (syndrome - 1)) == 0) {
+          check_bits[i] ^= syndrome;
+        } else {
+          int bit = find_data_bit(kDataSyndromes, 32, syndrome);
+          if (bit >= 0) {
+            words[i] ^= (uint32_t)1 << bit;
+          }
+        }
+      } else {
+        err = 2;
+      }
+    }
+    if (errors) {
+      errors[i] = err;
+    }
+  }
+  return num_errors;
+}
 
+static inline uint8_t enc_secded_inv_64_57_word(uint64_t word) {
   return (calc_parity(word & 0x103fff800007fff, false) << 0) |
          (calc_parity(word & 0x17c1ff801ff801f, true) << 1) |
          (calc_parity(word & 0x1bde1f87e0781e1, false) << 2) |
@@ -143,12 +615,72 @@ uint8_t enc_secded_inv_64_57(const uint8_t bytes[8]) {
          (calc_parity(word & 0x1fbdda769a46910, false) << 6);
 }
 
-uint8_t enc_secded_inv_72_64(const uint8_t bytes[8]) {
+uint8_t enc_secded_inv_64_57(const uint8_t bytes[8]) {
   uint64_t word = ((uint64_t)bytes[0] << 0) | ((uint64_t)bytes[1] << 8) |
                   ((uint64_t)bytes[2] << 16) | ((uint64_t)bytes[3] << 24) |
                   ((uint64_t)bytes[4] << 32) | ((uint64_t)bytes[5] << 40) |
                   ((uint64_t)bytes[6] << 48) | ((uint64_t)bytes[7] << 56);
 
+  return enc_secded_inv_64_57_word(word);
+}
+
+void enc_secded_inv_64_57_buf(const uint64_t *words, uint8_t *check_bits,
+                              size_t count) {
+  for (size_t i = 0; i < count; ++i) {
+    check_bits[i] = enc_secded_inv_64_57_word(words[i]);
+  }
+}
+
+size_t syndrome_secded_inv_64_57_buf(const uint64_t *words,
+                                     const uint8_t *check_bits,
+                                     uint8_t *syndromes, size_t count) {
+  size_t num_errors = 0;
+  for (size_t i = 0; i < count; ++i) {
+    uint8_t syndrome = enc_secded_inv_64_57_word(words[i]) ^ check_bits[i];
+    if (syndromes) {
+      syndromes[i] = syndrome;
+    }
+    num_errors += (syndrome != 0);
+  }
+  return num_errors;
+}
+
+size_t dec_secded_inv_64_57_buf(uint64_t *words, uint8_t *check_bits,
+                                uint8_t *errors, size_t count) {
+  static const uint8_t kDataSyndromes[57] = {
+      0x7, 0xb, 0x13, 0x23, 0x43, 0xd, 0x15, 0x25, 0x45, 0x19, 0x29, 0x49, 0x31,
+      0x51, 0x61, 0xe, 0x16, 0x26, 0x46, 0x1a, 0x2a, 0x4a, 0x32, 0x52, 0x62,
+      0x1c, 0x2c, 0x4c, 0x34, 0x54, 0x64, 0x38, 0x58, 0x68, 0x70, 0x1f, 0x2f,
+      0x4f, 0x37, 0x57, 0x67, 0x3b, 0x5b, 0x6b, 0x73, 0x3d, 0x5d, 0x6d, 0x75,
+      0x79, 0x3e, 0x5e, 0x6e, 0x76, 0x7a, 0x7c, 0x7f};
+  size_t num_errors = 0;
+  for (size_t i = 0; i < count; ++i) {
+    uint8_t syndrome = enc_secded_inv_64_57_word(words[i]) ^ check_bits[i];
+    uint8_t err = 0;
+    if (syndrome) {
+      ++num_errors;
+      if (calc_parity(syndrome, false)) {
+        err = 1;
+        if ((syndrome & (syndrome - 1)) == 0) {
+          check_bits[i] ^= syndrome;
+        } else {
+          int bit = find_data_bit(kDataSyndromes, 57, syndrome);
+          if (bit >= 0) {
+            words[i] ^= (uint64_t)1 << bit;
+          }
+        }
+      } else {
+        err = 2;
+      }
+    }
+    if (errors) {
+      errors[i] = err;
+    }
+  }
+  return num_errors;
+}
+
+static inline uint8_t enc_secded_inv_72_64_word(uint64_t word) {
   return (calc_parity(word & 0xb9000000001fffff, false) << 0) |
          (calc_parity(word & 0x5e00000fffe0003f, true) << 1) |
          (calc_parity(word & 0x67003ff003e007c1, false) << 2) |
@@ -158,3 +690,69 @@ uint8_t enc_secded_inv_72_64(const uint8_t bytes[8]) {
          (calc_parity(word & 0xcbdaaa4a91152210, false) << 6) |
          (calc_parity(word & 0x7aed348d221a4420, true) << 7);
 }
+
+uint8_t enc_secded_inv_72_64(const uint8_t bytes[8]) {
+  uint64_t word = ((uint64_t)bytes[0] << 0) | ((uint64_t)bytes[1] << 8) |
+                  ((uint64_t)bytes[2] << 16) | ((uint64_t)bytes[3] << 24) |
+                  ((uint64_t)bytes[4] << 32) | ((uint64_t)bytes[5] << 40) |
+                  ((uint64_t)bytes[6] << 48) | ((uint64_t)bytes[7] << 56);
+
+  return enc_secded_inv_72_64_word(word);
+}
+
+void enc_secded_inv_72_64_buf(const uint64_t *words, uint8_t *check_bits,
+                              size_t count) {
+  for (size_t i = 0; i < count; ++i) {
+    check_bits[i] = enc_secded_inv_72_64_word(words[i]);
+  }
+}
+
+size_t syndrome_secded_inv_72_64_buf(const uint64_t *words,
+                                     const uint8_t *check_bits,
+                                     uint8_t *syndromes, size_t count) {
+  size_t num_errors = 0;
+  for (size_t i = 0; i < count; ++i) {
+    uint8_t syndrome = enc_secded_inv_72_64_word(words[i]) ^ check_bits[i];
+    if (syndromes) {
+      syndromes[i] = syndrome;
+    }
+    num_errors += (syndrome != 0);
+  }
+  return num_errors;
+}
+
+size_t dec_secded_inv_72_64_buf(uint64_t *words, uint8_t *check_bits,
+                                uint8_t *errors, size_t count) {
+  static const uint8_t kDataSyndromes[64] = {
+      0x7, 0xb, 0x13, 0x23, 0x43, 0x83, 0xd, 0x15, 0x25, 0x45, 0x85, 0x19, 0x29,
+      0x49, 0x89, 0x31, 0x51, 0x91, 0x61, 0xa1, 0xc1, 0xe, 0x16, 0x26, 0x46,
+      0x86, 0x1a, 0x2a, 0x4a, 0x8a, 0x32, 0x52, 0x92, 0x62, 0xa2, 0xc2, 0x1c,
+      0x2c, 0x4c, 0x8c, 0x34, 0x54, 0x94, 0x64, 0xa4, 0xc4, 0x38, 0x58, 0x98,
+      0x68, 0xa8, 0xc8, 0x70, 0xb0, 0xd0, 0xe0, 0x6d, 0xd6, 0x3e, 0xcb, 0xb3,
+      0xb5, 0xce, 0x79};
+  size_t num_errors = 0;
+  for (size_t i = 0; i < count; ++i) {
+    uint8_t syndrome = enc_secded_inv_72_64_word(words[i]) ^ check_bits[i];
+    uint8_t err = 0;
+    if (syndrome) {
+      ++num_errors;
+      if (calc_parity(syndrome, false)) {
+        err = 1;
+        if ((syndrome & (syndrome - 1)) == 0) {
+          check_bits[i] ^= syndrome;
+        } else {
+          int bit = find_data_bit(kDataSyndromes, 64, syndrome);
+          if (bit >= 0) {
+            words[i] ^= (uint64_t)1 << bit;
+          }
+        }
+      } else {
+        err = 2;
+      }
+    }
+    if (errors) {
+      errors[i] = err;
+    }
+  }
+  return num_errors;
+}
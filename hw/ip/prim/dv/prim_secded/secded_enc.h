@@ -8,6 +8,7 @@
 #ifndef OPENTITAN_HW_IP_PRIM_DV_PRIM_SECDED_SECDED_ENC_H_
 #define OPENTITAN_HW_IP_PRIM_DV_PRIM_SECDED_SECDED_ENC_H_
 
+#include <stddef.h>
 #include <stdint.h>
 
 #ifdef __cplusplus
@@ -17,17 +18,104 @@ extern "C" {
 // Integrity encode functions for varying bit widths matching the functionality
 // of the RTL modules of the same name. Each takes an array of bytes in
 // little-endian order and returns the calculated integrity bits.
+//
+// Each encode function also has buffer-based variants which process count
+// data words (stored in the smallest integer type that holds them) in one
+// call:
+//
+//  - enc_secded_<n>_<k>_buf writes the integrity bits for each word to
+//    check_bits.
+//
+//  - syndrome_secded_<n>_<k>_buf writes the syndrome for each word and its
+//    integrity bits to syndromes (which may be NULL) and returns the number of
+//    nonzero syndromes.
+//
+//  - dec_secded_<n>_<k>_buf corrects single bit errors in words and
+//    check_bits in place. If errors is not NULL, it writes an error code for
+//    each word, matching err_o of the RTL decoder: bit 0 is set for a single
+//    (correctable) error and bit 1 for a double error. Returns the number of
+//    words with an error.
 
 uint8_t enc_secded_22_16(const uint8_t bytes[2]);
+void enc_secded_22_16_buf(const uint16_t *words, uint8_t *check_bits,
+                          size_t count);
+size_t syndrome_secded_22_16_buf(const uint16_t *words,
+                                 const uint8_t *check_bits, uint8_t *syndromes,
+                                 size_t count);
+size_t dec_secded_22_16_buf(uint16_t *words, uint8_t *check_bits,
+                            uint8_t *errors, size_t count);
 uint8_t enc_secded_28_22(const uint8_t bytes[3]);
+void enc_secded_28_22_buf(const uint32_t *words, uint8_t *check_bits,
+                          size_t count);
+size_t syndrome_secded_28_22_buf(const uint32_t *words,
+                                 const uint8_t *check_bits, uint8_t *syndromes,
+                                 size_t count);
+size_t dec_secded_28_22_buf(uint32_t *words, uint8_t *check_bits,
+                            uint8_t *errors, size_t count);
 uint8_t enc_secded_39_32(const uint8_t bytes[4]);
+void enc_secded_39_32_buf(const uint32_t *words, uint8_t *check_bits,
+                          size_t count);
+size_t syndrome_secded_39_32_buf(const uint32_t *words,
+                                 const uint8_t *check_bits, uint8_t *syndromes,
+                                 size_t count);
+size_t dec_secded_39_32_buf(uint32_t *words, uint8_t *check_bits,
+                            uint8_t *errors, size_t count);
 uint8_t enc_secded_64_57(const uint8_t bytes[8]);
+void enc_secded_64_57_buf(const uint64_t *words, uint8_t *check_bits,
+                          size_t count);
+size_t syndrome_secded_64_57_buf(const uint64_t *words,
+                                 const uint8_t *check_bits, uint8_t *syndromes,
+                                 size_t count);
+size_t dec_secded_64_57_buf(uint64_t *words, uint8_t *check_bits,
+                            uint8_t *errors, size_t count);
 uint8_t enc_secded_72_64(const uint8_t bytes[8]);
+void enc_secded_72_64_buf(const uint64_t *words, uint8_t *check_bits,
+                          size_t count);
+size_t syndrome_secded_72_64_buf(const uint64_t *words,
+                                 const uint8_t *check_bits, uint8_t *syndromes,
+                                 size_t count);
+size_t dec_secded_72_64_buf(uint64_t *words, uint8_t *check_bits,
+                            uint8_t *errors, size_t count);
 uint8_t enc_secded_inv_22_16(const uint8_t bytes[2]);
+void enc_secded_inv_22_16_buf(const uint16_t *words, uint8_t *check_bits,
+                              size_t count);
+size_t syndrome_secded_inv_22_16_buf(const uint16_t *words,
+                                     const uint8_t *check_bits,
+                                     uint8_t *syndromes, size_t count);
+size_t dec_secded_inv_22_16_buf(uint16_t *words, uint8_t *check_bits,
+                                uint8_t *errors, size_t count);
 uint8_t enc_secded_inv_28_22(const uint8_t bytes[3]);
+void enc_secded_inv_28_22_buf(const uint32_t *words, uint8_t *check_bits,
+                              size_t count);
+size_t syndrome_secded_inv_28_22_buf(const uint32_t *words,
+                                     const uint8_t *check_bits,
+                                     uint8_t *syndromes, size_t count);
+size_t dec_secded_inv_28_22_buf(uint32_t *words, uint8_t *check_bits,
+                                uint8_t *errors, size_t count);
 uint8_t enc_secded_inv_39_32(const uint8_t bytes[4]);
+void enc_secded_inv_39_32_buf(const uint32_t *words, uint8_t *check_bits,
+                              size_t count);
+size_t syndrome_secded_inv_39_32_buf(const uint32_t *words,
+                                     const uint8_t *check_bits,
+                                     uint8_t *syndromes, size_t count);
+size_t dec_secded_inv_39_32_buf(uint32_t *words, uint8_t *check_bits,
+                                uint8_t *errors, size_t count);
 uint8_t enc_secded_inv_64_57(const uint8_t bytes[8]);
+void enc_secded_inv_64_57_buf(const uint64_t *words, uint8_t *check_bits,
+                              size_t count);
+size_t syndrome_secded_inv_64_57_buf(const uint64_t *words,
+                                     const uint8_t *check_bits,
+                                     uint8_t *syndromes, size_t count);
+size_t dec_secded_inv_64_57_buf(uint64_t *words, uint8_t *check_bits,
+                                uint8_t *errors, size_t count);
 uint8_t enc_secded_inv_72_64(const uint8_t bytes[8]);
+void enc_secded_inv_72_64_buf(const uint64_t *words, uint8_t *check_bits,
+                              size_t count);
+size_t syndrome_secded_inv_72_64_buf(const uint64_t *words,
+                                     const uint8_t *check_bits,
+                                     uint8_t *syndromes, size_t count);
+size_t dec_secded_inv_72_64_buf(uint64_t *words, uint8_t *check_bits,
+                                uint8_t *errors, size_t count);
 
 #ifdef __cplusplus
 }  // extern "C"
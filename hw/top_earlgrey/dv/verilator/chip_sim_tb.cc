@@ -5,10 +5,17 @@
 #include <iostream>
 #include <string>
 
+#include "uartdpi.h"
 #include "verilated_toplevel.h"
 #include "verilator_memutil.h"
 #include "verilator_sim_ctrl.h"
 
+// Pass UART output to the simulation controller, so that it can start tracing
+// when a UART prints some text (--trace-trigger=NAME:TEXT)
+static void ReportUartOutput(void *arg, const char *name, char c) {
+  static_cast<VerilatorSimCtrl *>(arg)->ReportOutput(name, c);
+}
+
 int main(int argc, char **argv) {
   chip_sim_tb top;
   VerilatorMemUtil memutil;
@@ -40,6 +47,7 @@ int main(int argc, char **argv) {
   memutil.RegisterMemoryArea("flash", 0x20000000u, &flash);
   memutil.RegisterMemoryArea("otp", 0x40000000u /* (bogus LMA) */, &otp);
   simctrl.RegisterExtension(&memutil);
+  uartdpi_set_output_hook(ReportUartOutput, &simctrl);
 
   // The initial reset delay must be long enough such that pwr/rst/clkmgr will
   // release clocks to the entire design.  This allows for synchronous resets
@@ -155,8 +155,12 @@ module chip_sim_tb (
   );
 
   `define RV_CORE_IBEX      u_dut.top_earlgrey.u_rv_core_ibex
+  `define IBEX_CORE         `RV_CORE_IBEX.u_core.u_ibex_core
   `define SIM_SRAM_IF       u_sim_sram.u_sim_sram_if
 
+  import "DPI-C" function void simctrl_report_event(input string name);
+  import "DPI-C" function void simctrl_report_test_result(input bit passed);
+
   // Detect SW test termination.
   sim_sram u_sim_sram (
     .clk_i    (`RV_CORE_IBEX.clk_i),
@@ -193,11 +197,31 @@ module chip_sim_tb (
       $display("Verilator sim termination requested");
       $display("Your simulation wrote to 0x%h", u_sw_test_status_if.sw_test_status_addr);
       dv_test_status_pkg::dv_test_status(u_sw_test_status_if.sw_test_passed);
+      // Keep the trace ring buffer (--trace-ring) if the test failed
+      simctrl_report_test_result(u_sw_test_status_if.sw_test_passed);
       $finish;
     end
   end
 
+  // Report a "pc" event to the simulation controller when the core starts executing the
+  // instruction at the address given with +trace_trigger_pc=ADDR (in hex). Use with
+  // --trace-trigger=pc to start tracing there.
+  logic [31:0] trace_trigger_pc;
+  bit          trace_trigger_pc_en;
+
+  initial begin
+    trace_trigger_pc_en = $value$plusargs("trace_trigger_pc=%h", trace_trigger_pc);
+  end
+
+  always @(posedge `RV_CORE_IBEX.clk_i) begin
+    if (trace_trigger_pc_en && `IBEX_CORE.instr_new_id &&
+        `IBEX_CORE.pc_id == trace_trigger_pc) begin
+      simctrl_report_event("pc");
+    end
+  end
+
   `undef RV_CORE_IBEX
+  `undef IBEX_CORE
   `undef SIM_SRAM_IF
 
 
@@ -34,18 +34,30 @@ C_SRC_TOP = """
 #include <stdint.h>
 
 // Calculates even parity for a 64-bit word
-static uint8_t calc_parity(uint64_t word, bool invert) {
-  bool parity = false;
+static inline uint8_t calc_parity(uint64_t word, bool invert) {
+#if defined(__GNUC__) || defined(__clang__)
+  return (uint8_t)__builtin_parityll(word) ^ invert;
+#else
+  // Fold the word in half until the parity is in the bottom bit
+  word ^= word >> 32;
+  word ^= word >> 16;
+  word ^= word >> 8;
+  word ^= word >> 4;
+  word ^= word >> 2;
+  word ^= word >> 1;
+  return (uint8_t)(word & 1) ^ invert;
+#endif
+}
 
-  while (word) {
-    if (word & 1) {
-      parity = !parity;
+// Finds the data bit whose column of the parity check matrix matches
+// syndrome. Returns -1 if there is no such bit.
+static int find_data_bit(const uint8_t *columns, int k, uint8_t syndrome) {
+  for (int i = 0; i < k; ++i) {
+    if (columns[i] == syndrome) {
+      return i;
     }
-
-    word >>= 1;
   }
-
-  return parity ^ invert;
+  return -1;
 }
 """
 
@@ -53,6 +65,7 @@ C_H_TOP = """
 #ifndef OPENTITAN_HW_IP_PRIM_DV_PRIM_SECDED_SECDED_ENC_H_
 #define OPENTITAN_HW_IP_PRIM_DV_PRIM_SECDED_SECDED_ENC_H_
 
+#include <stddef.h>
 #include <stdint.h>
 
 #ifdef __cplusplus
@@ -62,6 +75,23 @@ extern "C" {
 // Integrity encode functions for varying bit widths matching the functionality
 // of the RTL modules of the same name. Each takes an array of bytes in
 // little-endian order and returns the calculated integrity bits.
+//
+// Each encode function also has buffer-based variants which process count
+// data words (stored in the smallest integer type that holds them) in one
+// call:
+//
+//  - enc_secded_<n>_<k>_buf writes the integrity bits for each word to
+//    check_bits.
+//
+//  - syndrome_secded_<n>_<k>_buf writes the syndrome for each word and its
+//    integrity bits to syndromes (which may be NULL) and returns the number of
+//    nonzero syndromes.
+//
+//  - dec_secded_<n>_<k>_buf corrects single bit errors in words and
+//    check_bits in place. If errors is not NULL, it writes an error code for
+//    each word, matching err_o of the RTL decoder: bit 0 is set for a single
+//    (correctable) error and bit 1 for a double error. Returns the number of
+//    words with an error.
 
 """
 
@@ -655,6 +685,37 @@ def bytes_to_c_type(num_bytes):
     return None
 
 
+def c_wrap(first: str, items: List[str], joiner: str, last: str,
+           indent: int) -> str:
+    """Join items into C source, wrapping at 80 columns.
+
+    The result starts with first (indented by indent spaces) and ends with
+    last. Continuation lines are aligned with the first item, matching the
+    output of clang-format, so the generated code is tidy even if clang-format
+    isn't available.
+    """
+    align = indent + len(first)
+    lines = []
+    line = ' ' * indent + first
+    for idx, item in enumerate(items):
+        tail = last if idx == len(items) - 1 else joiner.rstrip()
+        at_start = (line.strip() == '' or line == ' ' * indent + first)
+        if not at_start and len(line) + len(joiner) + len(item + tail) > 80:
+            lines.append(line + joiner.rstrip())
+            line = ' ' * align + item
+        else:
+            line += ('' if at_start else joiner) + item
+    lines.append(line + last)
+    return '\n'.join(lines) + '\n'
+
+
+def calc_c_syndromes(k, m, codes):
+    """Return the syndrome for a single bit error in each data bit"""
+    masks = calc_bitmasks(k, m, codes, False)
+    return [sum(1 << j for j, mask in enumerate(masks) if (mask >> i) & 1)
+            for i in range(k)]
+
+
 def write_c_files(n, k, m, codes, suffix, c_src_filename, c_h_filename,
                   codetype):
     in_bytes = math.ceil(k / 8)
@@ -674,36 +735,120 @@ def write_c_files(n, k, m, codes, suffix, c_src_filename, c_h_filename,
     assert codetype in ["hsiao", "inv_hsiao"]
     invert = (codetype == "inv_hsiao")
 
-    with open(c_src_filename, "a") as f:
-        # Write out function prototype in src
-        f.write(f"\n{out_type} enc_secded{suffix}_{n}_{k}"
-                f"(const uint8_t bytes[{in_bytes}]) {{\n")
+    fn_name = f"enc_secded{suffix}_{n}_{k}"
+    word_fn_name = f"{fn_name}_word"
+    syn_fn_name = f"syndrome_secded{suffix}_{n}_{k}_buf"
+    dec_fn_name = f"dec_secded{suffix}_{n}_{k}_buf"
 
-        # Form a single word from the incoming byte data
-        f.write(f"{in_type} word = ")
-        f.write(" | ".join(
-                [f"(({in_type})bytes[{i}] << {i*8})" for i in range(in_bytes)]))
-        f.write(";\n\n")
+    enc_params = [f"const {in_type} *words", f"{out_type} *check_bits",
+                  "size_t count"]
+    syn_params = [f"const {in_type} *words", f"const {out_type} *check_bits",
+                  f"{out_type} *syndromes", "size_t count"]
+    dec_params = [f"{in_type} *words", f"{out_type} *check_bits",
+                  "uint8_t *errors", "size_t count"]
+
+    with open(c_src_filename, "a") as f:
+        # Write out a helper that encodes a single word. This is shared
+        # between the byte-based and buffer-based functions below.
+        f.write(f"\nstatic inline {out_type} {word_fn_name}"
+                f"({in_type} word) {{\n")
 
         # AND the word with the codes, calculating parity of each and combine
-        # into a single word of integrity bits
-        f.write("return ")
+        # into a single word of integrity bits. Add ECC bit inversion if
+        # needed (see print_enc function).
         parity_bit_masks = enumerate(calc_bitmasks(k, m, codes, False))
-        # Add ECC bit inversion if needed (see print_enc function).
-        f.write(" | ".join(
-                [f"(calc_parity(word & 0x{mask:x}, "
-                 f"{'true' if invert and (par_bit % 2) else 'false'}) << {par_bit})"
-                 for par_bit, mask in parity_bit_masks]))
+        f.write(c_wrap("return ",
+                       [f"(calc_parity(word & 0x{mask:x}, "
+                        f"{'true' if invert and (par_bit % 2) else 'false'})"
+                        f" << {par_bit})"
+                        for par_bit, mask in parity_bit_masks],
+                       " | ", ";", 2))
+        f.write("}\n")
 
-        f.write(";\n}\n")
+        # Write out function prototype in src
+        f.write(f"\n{out_type} {fn_name}"
+                f"(const uint8_t bytes[{in_bytes}]) {{\n")
+
+        # Form a single word from the incoming byte data
+        f.write(c_wrap(f"{in_type} word = ",
+                       [f"(({in_type})bytes[{i}] << {i*8})"
+                        for i in range(in_bytes)],
+                       " | ", ";", 2))
+        f.write(f"\n  return {word_fn_name}(word);\n}}\n")
+
+        # Buffer-based encode
+        f.write("\n")
+        f.write(c_wrap(f"void {fn_name}_buf(", enc_params, ", ", ") {", 0))
+        f.write(f"  for (size_t i = 0; i < count; ++i) {{\n"
+                f"    check_bits[i] = {word_fn_name}(words[i]);\n"
+                f"  }}\n"
+                f"}}\n")
+
+        # Buffer-based syndrome calculation
+        f.write("\n")
+        f.write(c_wrap(f"size_t {syn_fn_name}(", syn_params, ", ", ") {", 0))
+        f.write(f"  size_t num_errors = 0;\n"
+                f"  for (size_t i = 0; i < count; ++i) {{\n"
+                f"    {out_type} syndrome = "
+                f"{word_fn_name}(words[i]) ^ check_bits[i];\n"
+                f"    if (syndromes) {{\n"
+                f"      syndromes[i] = syndrome;\n"
+                f"    }}\n"
+                f"    num_errors += (syndrome != 0);\n"
+                f"  }}\n"
+                f"  return num_errors;\n"
+                f"}}\n")
+
+        # Buffer-based decode (with correction). The table gives the syndrome
+        # for an error in each data bit. A syndrome with odd parity is a
+        # single error, which is either in a check bit (if exactly one bit is
+        # set) or in the data bit with a matching syndrome.
+        f.write("\n")
+        f.write(c_wrap(f"size_t {dec_fn_name}(", dec_params, ", ", ") {", 0))
+        f.write(f"  static const {out_type} kDataSyndromes[{k}] = {{\n")
+        f.write(c_wrap("", [f"0x{syn:x}" for syn in
+                            calc_c_syndromes(k, m, codes)],
+                       ", ", "};", 6))
+        f.write(f"  size_t num_errors = 0;\n"
+                f"  for (size_t i = 0; i < count; ++i) {{\n"
+                f"    {out_type} syndrome = "
+                f"{word_fn_name}(words[i]) ^ check_bits[i];\n"
+                f"    uint8_t err = 0;\n"
+                f"    if (syndrome) {{\n"
+                f"      ++num_errors;\n"
+                f"      if (calc_parity(syndrome, false)) {{\n"
+                f"        err = 1;\n"
+                f"        if ((syndrome & (syndrome - 1)) == 0) {{\n"
+                f"          check_bits[i] ^= syndrome;\n"
+                f"        }} else {{\n"
+                f"          int bit = find_data_bit(kDataSyndromes, {k}, "
+                f"syndrome);\n"
+                f"          if (bit >= 0) {{\n"
+                f"            words[i] ^= ({in_type})1 << bit;\n"
+                f"          }}\n"
+                f"        }}\n"
+                f"      }} else {{\n"
+                f"        err = 2;\n"
+                f"      }}\n"
+                f"    }}\n"
+                f"    if (errors) {{\n"
+                f"      errors[i] = err;\n"
+                f"    }}\n"
+                f"  }}\n"
+                f"  return num_errors;\n"
+                f"}}\n")
 
     with open(c_h_filename, "a") as f:
-        # Write out function declaration in header
-        f.write(f"{out_type} enc_secded{suffix}_{n}_{k}"
+        # Write out function declarations in header
+        f.write(f"{out_type} {fn_name}"
                 f"(const uint8_t bytes[{in_bytes}]);\n")
+        f.write(c_wrap(f"void {fn_name}_buf(", enc_params, ", ", ");", 0))
+        f.write(c_wrap(f"size_t {syn_fn_name}(", syn_params, ", ", ");", 0))
+        f.write(c_wrap(f"size_t {dec_fn_name}(", dec_params, ", ", ");", 0))
 
 
 def format_c_files(c_src_filename, c_h_filename):
+    result = None
     try:
         # Call clang-format to in-place format generated C code. If there are
         # any issues log a warning.
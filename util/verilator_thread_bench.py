@@ -0,0 +1,150 @@
+#!/usr/bin/env python3
+# Copyright lowRISC contributors.
+# Licensed under the Apache License, Version 2.0, see LICENSE for details.
+# SPDX-License-Identifier: Apache-2.0
+"""Compare the speed of chip_sim Verilator models built with different
+numbers of threads.
+
+Verilator fixes the number of threads when it generates the model, so this
+builds one model per thread count (each in its own build directory), runs
+each of them for a fixed number of cycles on the same workload and reports
+the simulated cycles per second.
+
+Typical usage (booting the test ROM):
+    TEST_ROM=build-bin/sw/device/lib/testing/test_rom
+    util/verilator_thread_bench.py \\
+        --rom $TEST_ROM/test_rom_sim_verilator.scr.39.vmem \\
+        --otp build-bin/sw/device/otp_img/otp_img_sim_verilator.vmem \\
+        --cycles 500000 --pin
+"""
+import argparse
+import os
+import re
+import subprocess
+import sys
+from typing import Dict, List, Optional
+
+REPO_TOP = os.path.normpath(os.path.join(os.path.dirname(__file__), '..'))
+
+FUSESOC_CORE = 'lowrisc:dv:chip_verilator_sim'
+SIM_BINARY = 'sim-verilator/Vchip_sim_tb'
+
+_SPEED_RE = re.compile(r'^Simulation speed:\s+([0-9.e+]+) cycles/s', re.M)
+
+
+def build_model(build_root: str, threads: int) -> str:
+    '''Build a model with the given number of threads and return its path'''
+    cmd = [
+        'fusesoc', '--cores-root=' + REPO_TOP, 'run', '--flag=fileset_top',
+        '--target=sim', '--setup', '--build',
+        '--build-root=' + build_root, FUSESOC_CORE,
+        '--verilator_options=--threads {}'.format(threads)
+    ]
+    print('Building model with {} thread(s) in {}'.format(threads, build_root),
+          flush=True)
+    subprocess.run(cmd, check=True, cwd=REPO_TOP)
+    return os.path.join(build_root, SIM_BINARY)
+
+
+def run_model(binary: str, meminits: List[str], cycles: int,
+              pin_cpus: Optional[str]) -> float:
+    '''Run a model and return its speed in cycles/s'''
+    cmd = [binary, '--term-after-cycles={}'.format(cycles)]
+    cmd += ['--meminit=' + arg for arg in meminits]
+    if pin_cpus is not None:
+        cmd.append('--pin-threads=' + pin_cpus)
+
+    proc = subprocess.run(cmd,
+                          stdout=subprocess.PIPE,
+                          stderr=subprocess.STDOUT,
+                          universal_newlines=True)
+    match = _SPEED_RE.search(proc.stdout)
+    if proc.returncode != 0 or match is None:
+        sys.stdout.write(proc.stdout)
+        raise RuntimeError('Simulation {} failed (exit code {}).'.format(
+            binary, proc.returncode))
+
+    # Show the per-thread CPU time to help spot unbalanced partitions.
+    stats_pos = proc.stdout.find('Thread CPU time:')
+    if stats_pos >= 0:
+        sys.stdout.write(proc.stdout[stats_pos:])
+    return float(match.group(1))
+
+
+def main() -> int:
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument('--rom', required=True, help='ROM image to boot')
+    parser.add_argument('--otp', help='OTP image')
+    parser.add_argument('--flash', help='Flash image')
+    parser.add_argument('--cycles',
+                        type=int,
+                        default=200000,
+                        help='Cycles to simulate in each run (default: '
+                        '%(default)s)')
+    parser.add_argument('--threads',
+                        default='1,2,4,8',
+                        help='Comma-separated thread counts to compare '
+                        '(default: %(default)s)')
+    parser.add_argument('--runs',
+                        type=int,
+                        default=3,
+                        help='Runs per thread count; the best speed is '
+                        'reported (default: %(default)s)')
+    parser.add_argument('--pin',
+                        action='store_true',
+                        help='Pin the threads of a model with N threads to '
+                        'CPUs 0 to N-1')
+    parser.add_argument('--build-root',
+                        default=os.path.join(REPO_TOP, 'build',
+                                             'verilator_thread_bench'),
+                        help='Where to build the models (one subdirectory '
+                        'per thread count)')
+    parser.add_argument('--no-build',
+                        action='store_true',
+                        help="Reuse models from an earlier run instead of "
+                        "building them")
+    args = parser.parse_args()
+
+    try:
+        thread_counts = [int(t) for t in args.threads.split(',')]
+    except ValueError:
+        parser.error('--threads must be a comma-separated list of integers.')
+    if any(t < 1 for t in thread_counts):
+        parser.error('Thread counts must be positive.')
+
+    meminits = ['rom,' + os.path.abspath(args.rom)]
+    if args.otp:
+        meminits.append('otp,' + os.path.abspath(args.otp))
+    if args.flash:
+        meminits.append('flash,' + os.path.abspath(args.flash))
+
+    speeds = {}  # type: Dict[int, float]
+    for threads in thread_counts:
+        build_root = os.path.join(args.build_root,
+                                  'threads-{}'.format(threads))
+        if args.no_build:
+            binary = os.path.join(build_root, SIM_BINARY)
+        else:
+            binary = build_model(build_root, threads)
+
+        pin_cpus = '0-{}'.format(threads - 1) if args.pin else None
+        best = 0.0
+        for run in range(args.runs):
+            print('Running model with {} thread(s), run {} of {}'.format(
+                threads, run + 1, args.runs),
+                  flush=True)
+            best = max(best, run_model(binary, meminits, args.cycles,
+                                       pin_cpus))
+        speeds[threads] = best
+
+    base = speeds[thread_counts[0]]
+    print()
+    print('Threads  Speed (cycles/s)  Speedup')
+    for threads in thread_counts:
+        print('{:7}  {:16.0f}  {:6.2f}x'.format(threads, speeds[threads],
+                                                speeds[threads] / base))
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())